@@ -0,0 +1,67 @@
+package com.divisionind.hq.api;
+
+import com.divisionind.hq.sim.QuadEmulator;
+
+import java.lang.management.ManagementFactory;
+import java.lang.management.ThreadMXBean;
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * Connects to 1..hundreds of emulated quads on one {@link LinkLoop} and reports the controller's cpu use and how
+ * evenly each quad's control packets arrive. Not a jmh benchmark as it measures wall clock behaviour.
+ *
+ * ./gradlew linkLoad --args='1 10 100 250'
+ * (every quad takes 2 file descriptors, raise ulimit -n for more than ~500)
+ */
+public class LinkLoopLoad {
+
+    private static final long RUN_MS = 5000;
+    private static final long WARMUP_MS = 1000;
+
+    public static void main(String[] args) throws Exception {
+        int[] counts = args.length > 0 ? new int[args.length] : new int[] { 1, 10, 50, 100, 250 };
+        for (int i = 0; i < args.length; i++)
+            counts[i] = Integer.parseInt(args[i]);
+
+        System.out.println("quads  pkt/s     cpu%   jitter p50/p99/max (us)");
+        for (int count : counts)
+            run(count);
+    }
+
+    private static void run(int count) throws Exception {
+        ThreadMXBean threads = ManagementFactory.getThreadMXBean();
+        List<HackQuad> quads = new ArrayList<>();
+
+        try (QuadEmulator emulator = new QuadEmulator(count); LinkLoop loop = new LinkLoop("hq-link-load")) {
+            for (int i = 0; i < count; i++)
+                quads.add(HackQuad.open("127.0.0.1", emulator.getPort(i), loop));
+
+            Thread.sleep(WARMUP_MS);
+            emulator.takeStats();
+            long cpu = controllerCpu(threads);
+            long start = System.nanoTime();
+
+            Thread.sleep(RUN_MS);
+
+            double cpuPercent = (controllerCpu(threads) - cpu) * 100.0 / (System.nanoTime() - start);
+            QuadEmulator.Stats stats = emulator.takeStats();
+            System.out.printf("%-6d %-9.0f %-6.2f %d/%d/%d%n", count, stats.packetsPerSecond, cpuPercent, stats.p50, stats.p99, stats.max);
+
+            for (HackQuad quad : quads)
+                quad.close();
+        }
+    }
+
+    /* ns of cpu used by the link loop and event handler threads */
+    private static long controllerCpu(ThreadMXBean threads) {
+        long ret = 0;
+
+        for (Thread thread : Thread.getAllStackTraces().keySet()) {
+            if (thread.getName().startsWith("hq-"))
+                ret += Math.max(threads.getThreadCpuTime(thread.getId()), 0);
+        }
+
+        return ret;
+    }
+}
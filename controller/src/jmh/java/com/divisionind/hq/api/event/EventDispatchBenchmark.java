@@ -0,0 +1,77 @@
+package com.divisionind.hq.api.event;
+
+import com.divisionind.hq.api.event.events.StatusUpdateEvent;
+import org.openjdk.jmh.annotations.*;
+
+import java.lang.reflect.Method;
+import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.concurrent.TimeUnit;
+
+/**
+ * Status update dispatch to a few handlers: bound invokers + pooled events vs Method.invoke() + a new event per
+ * update as it was before. Run with {@code ./gradlew jmh}.
+ */
+@BenchmarkMode(Mode.Throughput)
+@OutputTimeUnit(TimeUnit.MICROSECONDS)
+@State(Scope.Thread)
+@Warmup(iterations = 3, time = 1)
+@Measurement(iterations = 5, time = 1)
+@Fork(1)
+public class EventDispatchBenchmark {
+
+    private static final int LISTENERS = 4;
+
+    public static class StatusListener implements Listener {
+
+        float sum;
+
+        @EventHandler
+        private void onStatusUpdate(StatusUpdateEvent event) {
+            sum += event.getBattery() + event.getPitch();
+        }
+    }
+
+    private EventManagerImpl manager;
+    private EventPool<StatusUpdateEvent> pool;
+    private Map<Class<? extends Event>, List<Object[]>> reflective;
+    private float battery;
+
+    @Setup
+    public void setup() throws NoSuchMethodException {
+        manager = new EventManagerImpl(null);
+        pool = new EventPool<>(StatusUpdateEvent::new, 16);
+        reflective = new HashMap<>();
+
+        Method method = StatusListener.class.getDeclaredMethod("onStatusUpdate", StatusUpdateEvent.class);
+        method.setAccessible(true);
+
+        List<Object[]> entries = new ArrayList<>();
+        for (int i = 0; i < LISTENERS; i++) {
+            StatusListener listener = new StatusListener();
+            manager.registerListeners(listener);
+            entries.add(new Object[] { listener, method });
+        }
+        reflective.put(StatusUpdateEvent.class, entries);
+    }
+
+    @TearDown
+    public void tearDown() {
+        manager.shutdown();
+    }
+
+    @Benchmark
+    public void bound() {
+        manager.callEvent(pool.acquire().set(battery++, (byte) -60, 1.0f, 2.0f, 3.0f, 4.0f, 0));
+    }
+
+    @Benchmark
+    public void reflective() throws Exception {
+        Event event = new StatusUpdateEvent(battery++, (byte) -60, 1.0f, 2.0f, 3.0f, 4.0f, 0);
+
+        for (Object[] entry : reflective.get(event.getClass()))
+            ((Method) entry[1]).invoke(entry[0], event);
+    }
+}
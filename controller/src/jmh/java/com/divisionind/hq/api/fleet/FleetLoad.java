@@ -0,0 +1,90 @@
+package com.divisionind.hq.api.fleet;
+
+import com.divisionind.hq.sim.QuadEmulator;
+
+import java.lang.management.ManagementFactory;
+import java.lang.management.ThreadMXBean;
+import java.util.concurrent.TimeUnit;
+
+/**
+ * Flies a {@link Fleet} of hundreds of emulated quads: how spread out the control packets are (most in one ms vs
+ * the ideal quads/CONTROL_UPDATE_RATE), how long a broadcast setpoint takes to reach every quad, cpu use and
+ * whether the fleet stays healthy.
+ *
+ * ./gradlew fleetLoad --args='10 100 250'
+ * (every quad takes 2 file descriptors, raise ulimit -n for more than ~500)
+ */
+public class FleetLoad {
+
+    private static final long RUN_MS = 5000;
+    private static final long WARMUP_MS = 1000;
+    private static final long BROADCAST_TIMEOUT_MS = 1000;
+
+    public static void main(String[] args) throws Exception {
+        int[] counts = args.length > 0 ? new int[args.length] : new int[] { 10, 100, 250 };
+        for (int i = 0; i < args.length; i++)
+            counts[i] = Integer.parseInt(args[i]);
+
+        System.out.println("quads  pkt/s     max/ms  ideal/ms  broadcast(ms)  cpu%   jitter p99 (us)  health");
+        for (int count : counts)
+            run(count);
+    }
+
+    private static void run(int count) throws Exception {
+        ThreadMXBean threads = ManagementFactory.getThreadMXBean();
+
+        try (QuadEmulator emulator = new QuadEmulator(count); Fleet fleet = new Fleet()) {
+            for (int i = 0; i < count; i++)
+                fleet.add("127.0.0.1", emulator.getPort(i));
+
+            Thread.sleep(WARMUP_MS);
+            emulator.takeStats();
+            long cpu = controllerCpu(threads);
+            long start = System.nanoTime();
+
+            // time until every quad got the new setpoint, should be within one control period
+            fleet.setControl(0.25f, 1.0f, -1.0f, 0.0f, false);
+            double broadcastMs = awaitControl(emulator, 0.25f);
+
+            Thread.sleep(RUN_MS);
+
+            double cpuPercent = (controllerCpu(threads) - cpu) * 100.0 / (System.nanoTime() - start);
+            QuadEmulator.Stats stats = emulator.takeStats();
+            System.out.printf("%-6d %-9.0f %-7d %-9.1f %-14.2f %-6.2f %-16d %s%n", count, stats.packetsPerSecond,
+                    stats.maxPerMs, count / 20.0, broadcastMs, cpuPercent, stats.p99, fleet.getHealth());
+
+            fleet.stop();
+        }
+    }
+
+    /**
+     * @return ms until every emulated quad got throttle, -1 if one didn't within BROADCAST_TIMEOUT_MS
+     */
+    private static double awaitControl(QuadEmulator emulator, float throttle) throws InterruptedException {
+        long start = System.nanoTime();
+        long deadline = start + TimeUnit.MILLISECONDS.toNanos(BROADCAST_TIMEOUT_MS);
+
+        for (int i = 0; i < emulator.size(); i++) {
+            while (emulator.getControl(i)[0] != throttle) {
+                if (System.nanoTime() - deadline > 0)
+                    return -1;
+
+                Thread.sleep(0, 100_000);
+            }
+        }
+
+        return (System.nanoTime() - start) / 1e6;
+    }
+
+    /* ns of cpu used by the fleet's link loop and the event handler threads */
+    private static long controllerCpu(ThreadMXBean threads) {
+        long ret = 0;
+
+        for (Thread thread : Thread.getAllStackTraces().keySet()) {
+            if (thread.getName().startsWith("hq-"))
+                ret += Math.max(threads.getThreadCpuTime(thread.getId()), 0);
+        }
+
+        return ret;
+    }
+}
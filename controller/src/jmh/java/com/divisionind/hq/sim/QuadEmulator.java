@@ -0,0 +1,234 @@
+package com.divisionind.hq.sim;
+
+import java.io.Closeable;
+import java.io.IOException;
+import java.net.InetSocketAddress;
+import java.net.SocketAddress;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.channels.ClosedSelectorException;
+import java.nio.channels.DatagramChannel;
+import java.nio.channels.SelectionKey;
+import java.nio.channels.Selector;
+import java.util.Arrays;
+import java.util.concurrent.TimeUnit;
+
+/**
+ * Many simulated quads on localhost, one udp port each. They answer like the firmware's link does (status
+ * updates every STATUS_UPDATE_RATE once a controller has talked to them) and record how evenly the control
+ * packets of each one arrive.
+ */
+public class QuadEmulator implements Closeable {
+
+    /* firmware's STATUS_UPDATE_RATE */
+    public static final long STATUS_RATE = TimeUnit.MILLISECONDS.toNanos(100);
+
+    /* HackQuad.CONTROL_UPDATE_RATE */
+    public static final long CONTROL_PERIOD = TimeUnit.MILLISECONDS.toNanos(20);
+
+    private static final int HISTOGRAM_US = 20_000;
+
+    private final Selector selector;
+    private final Quad[] quads;
+    private final ByteBuffer buffer;
+    private final Thread thread;
+    private volatile boolean running;
+
+    /* |control interval - CONTROL_PERIOD| in us, of all quads */
+    private final long[] jitter;
+    private long controlPackets;
+    private long periodStart;
+
+    /* control packets of all quads that arrived within the same ms */
+    private long burstMs;
+    private int burst, maxBurst;
+
+    public QuadEmulator(int count) throws IOException {
+        selector = Selector.open();
+        quads = new Quad[count];
+        buffer = ByteBuffer.allocateDirect(512).order(ByteOrder.LITTLE_ENDIAN);
+        jitter = new long[HISTOGRAM_US + 1];
+
+        for (int i = 0; i < count; i++) {
+            Quad quad = new Quad();
+            quad.channel = DatagramChannel.open();
+            quad.channel.bind(new InetSocketAddress("127.0.0.1", 0));
+            quad.channel.configureBlocking(false);
+            quad.channel.register(selector, SelectionKey.OP_READ, quad);
+            quads[i] = quad;
+        }
+
+        periodStart = System.nanoTime();
+        running = true;
+        thread = new Thread(this::run);
+        thread.setDaemon(true);
+        thread.setName("quad-emulator");
+        thread.start();
+    }
+
+    public int size() {
+        return quads.length;
+    }
+
+    public int getPort(int quad) {
+        return quads[quad].channel.socket().getLocalPort();
+    }
+
+    /**
+     * @return last setpoint quad got, throttle/pitch/roll/yaw
+     */
+    public float[] getControl(int quad) {
+        synchronized (quads[quad]) {
+            return quads[quad].control.clone();
+        }
+    }
+
+    private void run() {
+        long nextStatus = System.nanoTime() + STATUS_RATE;
+
+        try {
+            while (running) {
+                long wait = nextStatus - System.nanoTime();
+
+                if (wait > 0)
+                    selector.select(this::read, TimeUnit.NANOSECONDS.toMillis(wait + 999_999));
+
+                long now = System.nanoTime();
+                if (now - nextStatus >= 0) {
+                    for (Quad quad : quads)
+                        sendStatus(quad);
+
+                    nextStatus += STATUS_RATE;
+                    if (now - nextStatus > 0)
+                        nextStatus = now + STATUS_RATE;
+                }
+            }
+        } catch (IOException | ClosedSelectorException e) {
+            if (running)
+                e.printStackTrace();
+        }
+    }
+
+    private void read(SelectionKey key) {
+        Quad quad = (Quad) key.attachment();
+        SocketAddress from;
+
+        try {
+            for (;;) {
+                buffer.clear();
+                if ((from = quad.channel.receive(buffer)) == null)
+                    break;
+
+                long now = System.nanoTime();
+                buffer.flip();
+                quad.controller = from;
+
+                // | id u8 | nonce u24 | payload |
+                if (buffer.remaining() < 4 || (buffer.get() & 0xFF) != 69 /* UPDATE_CONTROL */)
+                    continue;
+
+                buffer.position(4);
+                synchronized (quad) {
+                    for (int i = 0; i < 4 && buffer.remaining() >= 4; i++)
+                        quad.control[i] = buffer.getFloat();
+                }
+
+                synchronized (jitter) {
+                    if (quad.lastControl != 0) {
+                        long dev = Math.abs(now - quad.lastControl - CONTROL_PERIOD) / 1000;
+                        jitter[(int) Math.min(dev, HISTOGRAM_US)]++;
+                    }
+                    controlPackets++;
+
+                    if (now / 1_000_000 != burstMs) {
+                        burstMs = now / 1_000_000;
+                        burst = 0;
+                    }
+                    maxBurst = Math.max(maxBurst, ++burst);
+                }
+                quad.lastControl = now;
+            }
+        } catch (IOException e) {
+            // controller went away
+        }
+    }
+
+    private void sendStatus(Quad quad) {
+        if (quad.controller == null)
+            return;
+
+        buffer.clear();
+        buffer.put((byte) 20 /* STATUS_UPDATE */);
+        buffer.putFloat(3.9f);
+        buffer.put((byte) -50);
+        buffer.putFloat(0.001f);
+        buffer.putFloat(0.0f).putFloat(0.0f).putFloat(0.0f);
+        buffer.flip();
+
+        try {
+            quad.channel.send(buffer, quad.controller);
+        } catch (IOException e) {
+            // controller went away
+        }
+    }
+
+    /**
+     * Control packet arrival stats since the last call.
+     */
+    public Stats takeStats() {
+        Stats ret = new Stats();
+        long now = System.nanoTime();
+
+        synchronized (jitter) {
+            long total = 0, seen = 0;
+
+            for (long n : jitter)
+                total += n;
+
+            ret.packetsPerSecond = controlPackets * 1e9 / (now - periodStart);
+            ret.maxPerMs = maxBurst;
+            for (int us = 0; us <= HISTOGRAM_US; us++) {
+                if (jitter[us] == 0)
+                    continue;
+
+                seen += jitter[us];
+                if (ret.p50 < 0 && seen * 2 >= total)
+                    ret.p50 = us;
+                if (ret.p99 < 0 && seen * 100 >= total * 99)
+                    ret.p99 = us;
+                ret.max = us;
+            }
+
+            Arrays.fill(jitter, 0);
+            controlPackets = 0;
+            maxBurst = 0;
+            periodStart = now;
+        }
+
+        return ret;
+    }
+
+    @Override
+    public void close() throws IOException {
+        running = false;
+        selector.close();
+
+        for (Quad quad : quads)
+            quad.channel.close();
+    }
+
+    public static class Stats {
+        public double packetsPerSecond;
+        /* most control packets that arrived within one ms */
+        public int maxPerMs;
+        /* us, HISTOGRAM_US means that or more */
+        public int p50 = -1, p99 = -1, max = -1;
+    }
+
+    private static class Quad {
+        private DatagramChannel channel;
+        private SocketAddress controller;
+        private long lastControl;
+        private final float[] control = new float[4];
+    }
+}
@@ -22,10 +22,36 @@ public interface HackQuad extends Closeable {
     /* how long the connection can be unstable before it is terminated */
     long CONNECTION_TIMEOUT = 2000;
 
+    /**
+     * @param addr host of the quad, optionally with a ":port" for quads that aren't on UDP_PORT (e.g. a
+     *             firmware/host virtual_quad, which serves http on the tcp port of the same number)
+     */
     static HackQuad open(String addr) throws SocketException, UnknownHostException {
+        int colon = addr.lastIndexOf(':');
+
+        // a single colon, more are an ipv6 address
+        if (colon > 0 && addr.indexOf(':') == colon) {
+            int port;
+            try {
+                port = Integer.parseInt(addr.substring(colon + 1));
+            } catch (NumberFormatException e) {
+                throw new UnknownHostException("invalid port in " + addr);
+            }
+
+            return new HackQuadImpl(addr.substring(0, colon), port, null);
+        }
+
         return new HackQuadImpl(addr);
     }
 
+    /**
+     * @param port udp port of the quad, for quads that aren't on UDP_PORT (e.g. simulated ones)
+     * @param loop link loop to run this quad's link on, null for the shared one
+     */
+    static HackQuad open(String addr, int port, LinkLoop loop) throws SocketException, UnknownHostException {
+        return new HackQuadImpl(addr, port, loop);
+    }
+
     void setControl(float throttle, float pitch, float roll, float yawRate, boolean flagClearPanic);
 
     void send(UDPPacket packet);
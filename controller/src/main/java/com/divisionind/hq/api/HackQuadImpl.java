@@ -2,11 +2,14 @@ package com.divisionind.hq.api;
 
 import com.divisionind.hq.api.event.EventManager;
 import com.divisionind.hq.api.event.EventManagerImpl;
+import com.divisionind.hq.api.event.EventPool;
 import com.divisionind.hq.api.event.events.ConnectionTimeoutEvent;
+import com.divisionind.hq.api.event.events.CpuUpdateEvent;
 import com.divisionind.hq.api.event.events.StatusUpdateEvent;
-import com.divisionind.hq.api.packet.HQBufferReader;
-import com.divisionind.hq.api.packet.HQBufferWriter;
+import com.divisionind.hq.api.packet.PacketCodec;
 import com.divisionind.hq.api.packet.UDPPacket;
+import com.divisionind.hq.api.packet.inbound.HQICpuUpdate;
+import com.divisionind.hq.api.packet.inbound.HQIRegistryBatchAck;
 import com.divisionind.hq.api.packet.inbound.HQIStatusUpdate;
 import com.divisionind.hq.api.packet.outbound.HQOControl;
 import com.divisionind.hq.api.registry.Registry;
@@ -14,62 +17,79 @@ import com.divisionind.hq.api.registry.RegistryImpl;
 
 import java.io.IOException;
 import java.net.*;
-import java.util.concurrent.ScheduledExecutorService;
-import java.util.concurrent.ScheduledFuture;
-import java.util.concurrent.ScheduledThreadPoolExecutor;
-import java.util.concurrent.TimeUnit;
-import java.util.concurrent.atomic.AtomicInteger;
+import java.nio.BufferOverflowException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.channels.DatagramChannel;
 import java.util.concurrent.atomic.AtomicReference;
 
+/**
+ * One quad's link state, sending/receiving is done by the {@link LinkLoop} it was opened on.
+ */
 public class HackQuadImpl implements HackQuad {
 
-    private DatagramSocket udpSocket;
-    private SocketAddress udpAddress;
+    private static final PacketCodec<HQIStatusUpdate> STATUS_CODEC = PacketCodec.of(HQIStatusUpdate.class);
+    private static final PacketCodec<HQIRegistryBatchAck> BATCH_ACK_CODEC = PacketCodec.of(HQIRegistryBatchAck.class);
+    private static final PacketCodec<HQICpuUpdate> CPU_CODEC = PacketCodec.of(HQICpuUpdate.class);
+
+    private final LinkLoop loop;
+    private final DatagramChannel udpChannel;
+    private final ByteBuffer sendBuffer;
     private int udpNonce;
-    private String hostIp;
-    private String httpRoot;
-    private Registry registry;
-    private EventManager eventManager;
+    private final String hostIp;
+    private final String httpRoot;
+    private final RegistryImpl registry;
+    private final EventManager eventManager;
+    private final EventPool<StatusUpdateEvent> statusEvents;
+    private final HQIStatusUpdate status;
 
-    private AtomicReference<HQOControl> controlData;
+    private final AtomicReference<HQOControl> controlData;
 
-    private long lastStatusUpdate;
-    private AtomicInteger rssi;
-    private AtomicReference<Float> battery;
+    /* ns, when the loop sends the next control packet and the slot of the period it's in. only touched by the loop */
+    long nextSend;
+    int sendSlot;
 
-    private Thread udpSendTask;
-    private ScheduledExecutorService scheduler;
-    private ScheduledFuture<?> connectionTimeoutFuture;
-    private Thread udpRecvTask;
+    private final long openedAt;
+    private volatile long lastStatusUpdate;
+    private volatile int rssi;
+    private volatile float battery;
 
     protected HackQuadImpl(String addr) throws SocketException, UnknownHostException {
-        udpSocket = new DatagramSocket();
-        udpAddress = new InetSocketAddress(addr, HackQuad.UDP_PORT);
-        udpNonce = 0;
+        this(addr, UDP_PORT, null);
+    }
+
+    protected HackQuadImpl(String addr, int port, LinkLoop loop) throws SocketException, UnknownHostException {
         InetAddress ipaddr = InetAddress.getByName(addr);
+        try {
+            this.loop = loop != null ? loop : LinkLoop.shared();
+
+            // connected, so read/write don't allocate a sender address for every datagram
+            udpChannel = DatagramChannel.open();
+            udpChannel.connect(new InetSocketAddress(ipaddr, port));
+            udpChannel.configureBlocking(false);
+        } catch (IOException e) {
+            throw (SocketException) new SocketException("failed to open udp channel").initCause(e);
+        }
+
+        // reused for every datagram, send() is synchronized
+        sendBuffer = ByteBuffer.allocateDirect(LinkLoop.UDP_BUFFER_SIZE).order(ByteOrder.LITTLE_ENDIAN);
+        udpNonce = 0;
         hostIp = ipaddr.getHostAddress();
-        httpRoot = "http://" + hostIp;
+        // the firmware serves http on 80, quads on other ports (virtual ones) on the tcp port of the same number
+        httpRoot = port == UDP_PORT ? "http://" + hostIp : "http://" + hostIp + ":" + port;
         registry = new RegistryImpl(this);
-        eventManager = new EventManagerImpl(this);
+        eventManager = new EventManagerImpl(this, this.loop.getEventExecutor());
+        statusEvents = new EventPool<>(StatusUpdateEvent::new, 16);
+        status = new HQIStatusUpdate(); // only read out into the event
 
         controlData = new AtomicReference<>(new HQOControl(0.0f, 0.0f, 0.0f, 0.0f, false));
 
+        openedAt = System.currentTimeMillis();
         lastStatusUpdate = 0;
-        rssi = new AtomicInteger(0);
-        battery = new AtomicReference<>(0.0f);
-
-        udpSendTask = new Thread(this::udpSendHandler);
-        udpSendTask.setDaemon(true);
-        udpSendTask.setName("udp_send_task");
-        udpSendTask.start();
+        rssi = 0;
+        battery = 0.0f;
 
-        udpRecvTask = new Thread(this::udpRecvHandler);
-        udpRecvTask.setDaemon(true);
-        udpRecvTask.setName("udp_recv_task");
-        udpRecvTask.start();
-
-        scheduler = new ScheduledThreadPoolExecutor(1);
-        scheduler.scheduleAtFixedRate(this::connectionWatchdog, CONNECTION_TIMEOUT, CONNECTION_TIMEOUT, TimeUnit.MILLISECONDS);
+        this.loop.add(this);
     }
 
     @Override
@@ -78,36 +98,41 @@ public class HackQuadImpl implements HackQuad {
     }
 
     @Override
-    public void send(UDPPacket packet) {
-        HQBufferWriter out = new HQBufferWriter();
+    public synchronized void send(UDPPacket packet) {
+        ByteBuffer out = sendBuffer;
+        out.clear();
 
         // write id
-        out.write(packet.id());
+        out.put((byte) packet.id());
 
         // write nonce
-        out.write24Int(udpNonce);
+        out.put((byte) udpNonce);
+        out.putShort((short) (udpNonce >> 8));
         incrementNonce();
 
         // write contents
         try {
-            UDPPacket.serialize(out, packet);
-        } catch (IllegalAccessException e) {
+            PacketCodec.of(packet).encode(packet, out);
+        } catch (BufferOverflowException e) {
             e.printStackTrace();
             return;
         }
 
-        byte[] buffer = out.toByteArray();
-        DatagramPacket udp = new DatagramPacket(buffer, buffer.length, udpAddress);
+        // non-blocking, a full socket buffer drops the packet like the network would
+        out.flip();
         try {
-            udpSocket.send(udp);
+            udpChannel.write(out);
+        } catch (PortUnreachableException e) {
+            // nothing listening (yet), the watchdog handles it
         } catch (IOException e) {
-            e.printStackTrace();
+            if (udpChannel.isOpen())
+                e.printStackTrace();
         }
     }
 
     @Override
     public int getRSSI() {
-        return rssi.get();
+        return rssi;
     }
 
     private static boolean between(int number, int min, int max) {
@@ -138,7 +163,7 @@ public class HackQuadImpl implements HackQuad {
 
     @Override
     public float getBattery() {
-        return battery.get();
+        return battery;
     }
 
     @Override
@@ -180,68 +205,85 @@ public class HackQuadImpl implements HackQuad {
         udpNonce &= 0xFFFFFF; // ensure never gets above 24-bit val
     }
 
-    private void udpSendHandler() {
-        while (!udpSocket.isClosed()) {
-            try {
-                Thread.sleep(HackQuad.CONTROL_UPDATE_RATE);
-            } catch (InterruptedException e) { }
+    DatagramChannel channel() {
+        return udpChannel;
+    }
 
-            send(controlData.get());
+    /**
+     * Called by the loop once the next control packet is due.
+     *
+     * @return false once closed, drops it from the loop's schedule
+     */
+    boolean tick(long now) {
+        if (!udpChannel.isOpen())
+            return false;
+
+        if ((System.currentTimeMillis() - Math.max(lastStatusUpdate, openedAt)) > CONNECTION_TIMEOUT) {
+            close();
+            getEventManger().callEventAsync(new ConnectionTimeoutEvent());
+            return false;
         }
+
+        send(controlData.get().stamp(now / 1_000_000L));
+
+        // fell behind (e.g. suspended), skip what was missed rather than sending a burst, staying in the same slot
+        nextSend += LinkLoop.CONTROL_PERIOD;
+        if (now - nextSend > 0)
+            nextSend += ((now - nextSend) / LinkLoop.CONTROL_PERIOD + 1) * LinkLoop.CONTROL_PERIOD;
+
+        return true;
     }
 
-    private void connectionWatchdog() {
-        if ((System.currentTimeMillis() - lastStatusUpdate) > CONNECTION_TIMEOUT) {
-            try {
-                close();
-            } catch (Exception e) {
-                e.printStackTrace();
-            }
-            getEventManger().callEvent(new ConnectionTimeoutEvent());
+    /**
+     * Called by the loop for every datagram received, in is positioned at the packet id.
+     */
+    void onDatagram(ByteBuffer in) {
+        if (!in.hasRemaining())
+            return;
+
+        int id = in.get() & 0xFF;
+
+        switch (id) {
+            default:
+                break;
+            case 20 /* STATUS_UPDATE */:
+                if (!STATUS_CODEC.decode(in, status))
+                    break;
+
+                status.fcLoopTime *= 1000.0f;
+
+                battery = status.battery;
+                rssi = (byte) status.rssi;
+                lastStatusUpdate = System.currentTimeMillis();
+
+                getEventManger().callEventAsync(statusEvents.acquire().set(status.battery, (byte) status.rssi, status.fcLoopTime, status.angleX, status.angleY, status.angleZ, lastStatusUpdate));
+                break;
+            case 21 /* REGISTRY_BATCH_ACK */:
+                HQIRegistryBatchAck ack = new HQIRegistryBatchAck();
+                if (BATCH_ACK_CODEC.decode(in, ack))
+                    registry.getBatchChannel().handleAck(ack);
+                break;
+            case 22 /* CPU_UPDATE */:
+                HQICpuUpdate cpu = new HQICpuUpdate();
+                if (CPU_CODEC.decode(in, cpu))
+                    getEventManger().callEventAsync(new CpuUpdateEvent(cpu.window, cpu.cores, cpu.load0, cpu.load1, cpu.count, cpu.tasks));
+                break;
         }
     }
 
-    private void udpRecvHandler() {
-        byte[] buffer = new byte[256];
-        DatagramPacket in = new DatagramPacket(buffer, buffer.length);
-
-        while (!udpSocket.isClosed()) {
-            try {
-                udpSocket.receive(in);
-
-                HQBufferReader reader = new HQBufferReader(buffer);
-                int id = reader.read();
-
-                switch (id) {
-                    default:
-                        break;
-                    case 20 /* STATUS_UPDATE */:
-                        HQIStatusUpdate status = new HQIStatusUpdate();
-                        try {
-                            UDPPacket.deserialize(reader, status);
-                            status.fcLoopTime *= 1000.0f;
-
-                            battery.set(status.battery);
-                            rssi.set((byte) status.rssi);
-                            lastStatusUpdate = System.currentTimeMillis();
-
-                            getEventManger().callEventAsync(new StatusUpdateEvent(status.battery, (byte) status.rssi, status.fcLoopTime, status.angleX, status.angleY, status.angleZ, lastStatusUpdate));
-                        } catch (IllegalAccessException e) { }
-//                        battery.set(reader.readFloat());
-//                        rssi.set((byte) reader.read()); // signed int
-//                        lastStatusUpdate = System.currentTimeMillis();
-                        break;
-                }
-            } catch (IOException e) {
-                e.printStackTrace();
-            }
-        }
+    void onReadError(IOException e) {
+        // PortUnreachable: nothing listening (yet), the watchdog handles it
+        if (!(e instanceof PortUnreachableException) && udpChannel.isOpen())
+            e.printStackTrace();
     }
 
     @Override
     public void close() {
-        udpSocket.close();
+        try {
+            udpChannel.close();
+        } catch (IOException e) {
+            e.printStackTrace();
+        }
         eventManager.shutdown();
-        scheduler.shutdown();
     }
 }
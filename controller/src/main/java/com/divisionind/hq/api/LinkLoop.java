@@ -0,0 +1,186 @@
+package com.divisionind.hq.api;
+
+import com.divisionind.hq.api.event.EventManager;
+
+import java.io.Closeable;
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.channels.ClosedChannelException;
+import java.nio.channels.ClosedSelectorException;
+import java.nio.channels.SelectionKey;
+import java.nio.channels.Selector;
+import java.util.PriorityQueue;
+import java.util.Queue;
+import java.util.concurrent.ConcurrentLinkedQueue;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.atomic.AtomicInteger;
+
+/**
+ * Runs the control links of any number of {@link HackQuad}s on one thread: a selector over their (non-blocking)
+ * channels for status/acks and a queue ordered by when each quad's next control packet is due. Event handlers of
+ * all of them share one small pool of threads.
+ *
+ * The control period is split into SEND_SLOTS slots and every quad sends in the least used slot when it's added,
+ * so a fleet's packets are spread over the period instead of going out (and hitting the network) in bursts.
+ */
+public final class LinkLoop implements Closeable {
+
+    /* largest datagram either side sends, registry batches (REGBATCH_ACK_SIZE) are the biggest */
+    static final int UDP_BUFFER_SIZE = 512;
+
+    /* 1ms each, about what select() can time */
+    static final int SEND_SLOTS = (int) HackQuad.CONTROL_UPDATE_RATE;
+    static final long CONTROL_PERIOD = TimeUnit.MILLISECONDS.toNanos(HackQuad.CONTROL_UPDATE_RATE);
+    private static final long SLOT_LENGTH = CONTROL_PERIOD / SEND_SLOTS;
+
+    private static LinkLoop shared;
+
+    private final Selector selector;
+    private final Thread thread;
+    private final Queue<HackQuadImpl> added;
+    private final PriorityQueue<HackQuadImpl> schedule;
+    private final ByteBuffer recvBuffer;
+    private final ExecutorService eventExecutor;
+    private final int[] slotUse;
+    private final long epoch;
+    private volatile boolean running;
+
+    public LinkLoop(String name) throws IOException {
+        AtomicInteger latestThreadId = new AtomicInteger(0);
+
+        this.selector = Selector.open();
+        this.added = new ConcurrentLinkedQueue<>();
+        this.schedule = new PriorityQueue<>((a, b) -> Long.signum(a.nextSend - b.nextSend));
+        this.slotUse = new int[SEND_SLOTS];
+        this.epoch = System.nanoTime();
+        this.recvBuffer = ByteBuffer.allocateDirect(UDP_BUFFER_SIZE).order(ByteOrder.LITTLE_ENDIAN);
+        this.eventExecutor = Executors.newFixedThreadPool(EventManager.HANDLER_THREADS, r -> {
+            Thread ret = new Thread(r);
+            ret.setDaemon(true);
+            ret.setName(String.format("hq-eventhandler-%d", latestThreadId.getAndIncrement()));
+
+            return ret;
+        });
+
+        this.running = true;
+        this.thread = new Thread(this::run);
+        this.thread.setDaemon(true);
+        this.thread.setName(name);
+        this.thread.start();
+    }
+
+    /**
+     * @return the loop {@link HackQuad#open(String)} puts quads on, started on first use
+     */
+    public static synchronized LinkLoop shared() throws IOException {
+        if (shared == null || !shared.running)
+            shared = new LinkLoop("hq-link");
+
+        return shared;
+    }
+
+    ExecutorService getEventExecutor() {
+        return eventExecutor;
+    }
+
+    /**
+     * Starts sending/receiving for quad, its first control packet goes out right away.
+     */
+    void add(HackQuadImpl quad) {
+        added.add(quad);
+        selector.wakeup();
+    }
+
+    private void run() {
+        try {
+            while (running) {
+                long now = System.nanoTime();
+                HackQuadImpl quad;
+
+                // registered here rather than by the caller, register() can block on a select() in progress
+                while ((quad = added.poll()) != null) {
+                    try {
+                        quad.channel().register(selector, SelectionKey.OP_READ, quad);
+                        assignSlot(quad, now);
+                        schedule.add(quad);
+                    } catch (ClosedChannelException e) {
+                        // closed before it got here
+                    }
+                }
+
+                // due control packets, closed quads just drop out of the schedule
+                while ((quad = schedule.peek()) != null && quad.nextSend - now <= 0) {
+                    schedule.poll();
+
+                    if (quad.tick(now))
+                        schedule.add(quad);
+                    else
+                        slotUse[quad.sendSlot]--;
+                }
+
+                // rounded up, waking early would just spin until the next packet is due
+                quad = schedule.peek();
+                if (quad == null) {
+                    selector.select(this::read);
+                } else {
+                    long wait = quad.nextSend - System.nanoTime();
+
+                    if (wait > 0)
+                        selector.select(this::read, TimeUnit.NANOSECONDS.toMillis(wait + 999_999));
+                    else
+                        selector.selectNow(this::read);
+                }
+            }
+        } catch (IOException | ClosedSelectorException e) {
+            if (running)
+                e.printStackTrace();
+        } finally {
+            running = false;
+        }
+    }
+
+    /* first send is the next start of the least used slot */
+    private void assignSlot(HackQuadImpl quad, long now) {
+        int slot = 0;
+
+        for (int i = 1; i < SEND_SLOTS; i++) {
+            if (slotUse[i] < slotUse[slot])
+                slot = i;
+        }
+
+        slotUse[slot]++;
+        quad.sendSlot = slot;
+
+        long start = epoch + slot * SLOT_LENGTH;
+        quad.nextSend = start + Math.floorDiv(now - start + CONTROL_PERIOD - 1, CONTROL_PERIOD) * CONTROL_PERIOD;
+    }
+
+    private void read(SelectionKey key) {
+        HackQuadImpl quad = (HackQuadImpl) key.attachment();
+        ByteBuffer in = recvBuffer;
+
+        // drain everything that queued up since the last select
+        try {
+            for (;;) {
+                in.clear();
+                if (quad.channel().read(in) <= 0)
+                    break;
+
+                in.flip();
+                quad.onDatagram(in);
+            }
+        } catch (IOException e) {
+            quad.onReadError(e);
+        }
+    }
+
+    @Override
+    public void close() throws IOException {
+        running = false;
+        selector.close();
+        eventExecutor.shutdown();
+    }
+}
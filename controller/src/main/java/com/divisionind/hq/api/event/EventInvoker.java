@@ -0,0 +1,9 @@
+package com.divisionind.hq.api.event;
+
+/**
+ * Calls one {@link EventHandler} method, bound once when its listener is registered.
+ */
+@FunctionalInterface
+public interface EventInvoker {
+    void invoke(Listener listener, Event event) throws Throwable;
+}
@@ -4,12 +4,16 @@ import com.divisionind.hq.api.HackQuad;
 import com.divisionind.hq.api.event.ex.EventDispatchException;
 import com.divisionind.hq.api.event.ex.ListenerRegisterException;
 
+import java.lang.invoke.CallSite;
+import java.lang.invoke.LambdaMetafactory;
+import java.lang.invoke.MethodHandle;
+import java.lang.invoke.MethodHandles;
+import java.lang.invoke.MethodType;
 import java.lang.reflect.Method;
 import java.lang.reflect.Modifier;
-import java.util.ArrayList;
-import java.util.HashMap;
-import java.util.List;
+import java.util.Arrays;
 import java.util.Map;
+import java.util.concurrent.ConcurrentHashMap;
 import java.util.concurrent.ExecutorService;
 import java.util.concurrent.Executors;
 import java.util.concurrent.ThreadFactory;
@@ -17,16 +21,32 @@ import java.util.concurrent.atomic.AtomicInteger;
 
 public class EventManagerImpl implements EventManager, ThreadFactory {
 
+    private static final MethodType INVOKER_TYPE = MethodType.methodType(void.class, Listener.class, Event.class);
+
     private final HackQuad hackQuad;
-    private final Map<Class<? extends Event>, List<ListenerEntry>> handlers;
+    /* copy-on-write, dispatch reads the array without locking */
+    private final Map<Class<? extends Event>, ListenerEntry[]> handlers;
     private final AtomicInteger latestThreadId;
     private final ExecutorService executorService;
+    private final boolean sharedExecutor;
 
     public EventManagerImpl(HackQuad hackQuad) {
         this.hackQuad = hackQuad;
-        this.handlers = new HashMap<>();
+        this.handlers = new ConcurrentHashMap<>();
         this.latestThreadId = new AtomicInteger(0);
         this.executorService = Executors.newFixedThreadPool(HANDLER_THREADS, this);
+        this.sharedExecutor = false;
+    }
+
+    /**
+     * @param executorService runs async events, shared with other managers so it's left running on shutdown()
+     */
+    public EventManagerImpl(HackQuad hackQuad, ExecutorService executorService) {
+        this.hackQuad = hackQuad;
+        this.handlers = new ConcurrentHashMap<>();
+        this.latestThreadId = new AtomicInteger(0);
+        this.executorService = executorService;
+        this.sharedExecutor = true;
     }
 
     @Override
@@ -34,6 +54,41 @@ public class EventManagerImpl implements EventManager, ThreadFactory {
         return hackQuad;
     }
 
+    /**
+     * Binds a handler method to a lambda (as if it was written as one) so calling it is a plain interface call
+     * instead of Method.invoke(). Falls back to a method handle where a lambda can't be spun (static handlers,
+     * listeners we don't have full access to).
+     */
+    private static EventInvoker bind(Class<?> type, Method method) {
+        MethodHandles.Lookup lookup;
+        MethodHandle target;
+
+        try {
+            lookup = MethodHandles.privateLookupIn(type, MethodHandles.lookup());
+            target = lookup.unreflect(method);
+        } catch (IllegalAccessException e) {
+            throw new ListenerRegisterException("Event handler " + method.getName() + " is not accessible.", e);
+        }
+
+        if (!Modifier.isStatic(method.getModifiers())) {
+            try {
+                CallSite site = LambdaMetafactory.metafactory(lookup, "invoke", MethodType.methodType(EventInvoker.class),
+                        INVOKER_TYPE, target, MethodType.methodType(void.class, type, method.getParameterTypes()[0]));
+
+                return (EventInvoker) site.getTarget().invokeExact();
+            } catch (Throwable e) {
+                // fall through
+            }
+        } else {
+            target = MethodHandles.dropArguments(target, 0, type);
+        }
+
+        // block body, as a statement the call site is typed (Listener, Event)void like the handle
+        MethodHandle handle = target.asType(INVOKER_TYPE);
+        return (listener, event) -> { handle.invokeExact(listener, event); };
+    }
+
+    @SuppressWarnings("unchecked")
     private void registerListener(Listener listener) {
         Method[] methods = listener.getClass().getDeclaredMethods();
 
@@ -45,19 +100,14 @@ public class EventManagerImpl implements EventManager, ThreadFactory {
                 if (params.length != 1 || !Event.class.isAssignableFrom(params[0]))
                     throw new ListenerRegisterException("Invalid event handler parameters.");
 
-                // if private, allow access
-                if (Modifier.isPrivate(method.getModifiers()))
-                    method.setAccessible(true);
-
-                // create list if doesnt exist already
-                List<ListenerEntry> listenerEntries = handlers.get(params[0]);
-                if (listenerEntries == null) {
-                    listenerEntries = new ArrayList<>();
-                    handlers.put((Class<? extends Event>) params[0], listenerEntries);
-                }
+                ListenerEntry[] entry = { new ListenerEntry(listener, bind(listener.getClass(), method)) };
 
-                // add handler
-                listenerEntries.add(new ListenerEntry(listener, method));
+                // add handler, replaces the array so dispatches in progress keep the one they started with
+                handlers.merge((Class<? extends Event>) params[0], entry, (old, add) -> {
+                    ListenerEntry[] ret = Arrays.copyOf(old, old.length + 1);
+                    ret[old.length] = add[0];
+                    return ret;
+                });
             }
         }
     }
@@ -70,23 +120,26 @@ public class EventManagerImpl implements EventManager, ThreadFactory {
 
     @Override
     public void callEvent(Event event) {
-        List<ListenerEntry> entries = handlers.get(event.getClass());
+        ListenerEntry[] entries = handlers.get(event.getClass());
+        Throwable lastError = null;
 
         if (entries != null) {
-            Exception lastError = null;
-
             event.hackQuad = getParent();
             for (ListenerEntry entry : entries) {
                 try {
                     entry.function.invoke(entry.listener, event);
-                } catch (Exception e) {
+                } catch (Throwable e) {
                     lastError = e;
                 }
             }
-
-            if (lastError != null)
-                throw new EventDispatchException("Failed to call one or many event handler(s).", lastError);
         }
+
+        // handlers are done with it
+        if (event instanceof PooledEvent)
+            ((PooledEvent) event).release();
+
+        if (lastError != null)
+            throw new EventDispatchException("Failed to call one or many event handler(s).", lastError);
     }
 
     @Override
@@ -105,15 +158,16 @@ public class EventManagerImpl implements EventManager, ThreadFactory {
 
     @Override
     public void shutdown() {
-        executorService.shutdown();
+        if (!sharedExecutor)
+            executorService.shutdown();
     }
 
     private static class ListenerEntry {
 
         private final Listener listener;
-        private final Method function;
+        private final EventInvoker function;
 
-        public ListenerEntry(Listener listener, Method function) {
+        public ListenerEntry(Listener listener, EventInvoker function) {
             this.listener = listener;
             this.function = function;
         }
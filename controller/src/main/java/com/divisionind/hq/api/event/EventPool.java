@@ -0,0 +1,38 @@
+package com.divisionind.hq.api.event;
+
+import java.util.concurrent.ArrayBlockingQueue;
+import java.util.function.Supplier;
+
+/**
+ * Free list of {@link PooledEvent}s. Backed by an array, so taking and returning events doesn't allocate either.
+ * Events are only created when the pool runs dry (e.g. while async handlers lag behind) and dropped when it's full.
+ */
+public class EventPool<T extends PooledEvent> {
+
+    private final ArrayBlockingQueue<T> free;
+    private final Supplier<T> factory;
+
+    public EventPool(Supplier<T> factory, int capacity) {
+        this.free = new ArrayBlockingQueue<>(capacity);
+        this.factory = factory;
+    }
+
+    /**
+     * @return an event to fill in and pass to {@link EventManager#callEvent(Event)} or
+     * {@link EventManager#callEventAsync(Event)}, it comes back here after dispatch
+     */
+    public T acquire() {
+        T event = free.poll();
+
+        if (event == null)
+            event = factory.get();
+
+        event.pool = this;
+        return event;
+    }
+
+    @SuppressWarnings("unchecked")
+    void recycle(PooledEvent event) {
+        free.offer((T) event);
+    }
+}
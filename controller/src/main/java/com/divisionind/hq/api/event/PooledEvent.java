@@ -0,0 +1,20 @@
+package com.divisionind.hq.api.event;
+
+/**
+ * An event that is handed back to its {@link EventPool} once every handler has run, for events fired at
+ * telemetry rates. Handlers must copy out what they need instead of keeping the event around (e.g. for
+ * Platform.runLater()).
+ */
+public abstract class PooledEvent extends Event {
+
+    EventPool<?> pool;
+
+    void release() {
+        EventPool<?> pool = this.pool;
+
+        if (pool != null) {
+            this.pool = null;
+            pool.recycle(this);
+        }
+    }
+}
@@ -0,0 +1,76 @@
+package com.divisionind.hq.api.event.events;
+
+import com.divisionind.hq.api.event.Event;
+
+import java.nio.charset.StandardCharsets;
+
+/**
+ * The quad's cpu use over the last {@link #getWindow()} ms, see /sys/cpu for every task with full names.
+ */
+public class CpuUpdateEvent extends Event {
+
+    private static final int TASK_SIZE = 10;
+    private static final int NAME_LEN = 8;
+
+    private final int window;
+    private final float[] coreLoads;
+    private final String[] names;
+    private final int[] cores;
+    private final float[] loads;
+
+    public CpuUpdateEvent(int window, int cores, int load0, int load1, int count, byte[] tasks) {
+        this.window = window * 100;
+        this.coreLoads = new float[Math.min(cores, 2)];
+        for (int i = 0; i < coreLoads.length; i++)
+            coreLoads[i] = (i == 0 ? load0 : load1) / 2.0f;
+
+        count = Math.min(count, tasks.length / TASK_SIZE);
+        this.names = new String[count];
+        this.cores = new int[count];
+        this.loads = new float[count];
+        for (int i = 0, off = 0; i < count; i++, off += TASK_SIZE) {
+            int len = 0;
+            while (len < NAME_LEN && tasks[off + len] != 0)
+                len++;
+
+            names[i] = new String(tasks, off, len, StandardCharsets.US_ASCII);
+            this.cores[i] = tasks[off + NAME_LEN];
+            loads[i] = (tasks[off + NAME_LEN + 1] & 0xFF) / 2.0f;
+        }
+    }
+
+    /**
+     * @return ms the loads were measured over
+     */
+    public int getWindow() {
+        return window;
+    }
+
+    /**
+     * @return % busy per core, empty if the quad doesn't know
+     */
+    public float[] getCoreLoads() {
+        return coreLoads;
+    }
+
+    /**
+     * @return the busiest tasks' names, cut to 8 chars
+     */
+    public String[] getNames() {
+        return names;
+    }
+
+    /**
+     * @return core each task is pinned to, -1 if it isn't
+     */
+    public int[] getCores() {
+        return cores;
+    }
+
+    /**
+     * @return % of one core each task used
+     */
+    public float[] getLoads() {
+        return loads;
+    }
+}
@@ -1,18 +1,28 @@
 package com.divisionind.hq.api.event.events;
 
-import com.divisionind.hq.api.event.Event;
+import com.divisionind.hq.api.event.PooledEvent;
 
-public class StatusUpdateEvent extends Event {
+/**
+ * Pooled, only valid while the handler runs.
+ */
+public class StatusUpdateEvent extends PooledEvent {
 
-    private final float battery;
-    private final byte rssi;
-    private final float fcLoopTime;
-    private final float pitch;
-    private final float roll;
-    private final float yaw;
-    private final long recvTime;
+    private float battery;
+    private byte rssi;
+    private float fcLoopTime;
+    private float pitch;
+    private float roll;
+    private float yaw;
+    private long recvTime;
+
+    public StatusUpdateEvent() {
+    }
 
     public StatusUpdateEvent(float battery, byte rssi, float fcLoopTime, float pitch, float roll, float yaw, long recvTime) {
+        set(battery, rssi, fcLoopTime, pitch, roll, yaw, recvTime);
+    }
+
+    public StatusUpdateEvent set(float battery, byte rssi, float fcLoopTime, float pitch, float roll, float yaw, long recvTime) {
         this.battery = battery;
         this.rssi = rssi;
         this.fcLoopTime = fcLoopTime;
@@ -20,6 +30,7 @@ public class StatusUpdateEvent extends Event {
         this.roll = roll;
         this.yaw = yaw;
         this.recvTime = recvTime;
+        return this;
     }
 
     public float getBattery() {
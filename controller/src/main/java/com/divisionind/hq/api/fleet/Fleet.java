@@ -0,0 +1,161 @@
+package com.divisionind.hq.api.fleet;
+
+import com.divisionind.hq.api.HackQuad;
+import com.divisionind.hq.api.LinkLoop;
+import com.divisionind.hq.api.event.EventHandler;
+import com.divisionind.hq.api.event.Listener;
+import com.divisionind.hq.api.event.events.ConnectionTimeoutEvent;
+import com.divisionind.hq.api.event.events.StatusUpdateEvent;
+
+import java.io.Closeable;
+import java.io.IOException;
+import java.net.SocketException;
+import java.net.UnknownHostException;
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.List;
+import java.util.concurrent.CopyOnWriteArrayList;
+
+/**
+ * Many quads controlled together (e.g. a light show). All of them run on one {@link LinkLoop} of the fleet's own,
+ * which spreads their control packets over the control period.
+ */
+public class Fleet implements Closeable {
+
+    private final LinkLoop loop;
+    private final List<Member> members;
+
+    public Fleet() throws IOException {
+        this.loop = new LinkLoop("hq-fleet");
+        this.members = new CopyOnWriteArrayList<>();
+    }
+
+    public HackQuad add(String addr) throws SocketException, UnknownHostException {
+        return add(addr, HackQuad.UDP_PORT);
+    }
+
+    public HackQuad add(String addr, int port) throws SocketException, UnknownHostException {
+        HackQuad quad = HackQuad.open(addr, port, loop);
+        Member member = new Member(quad);
+
+        quad.getEventManger().registerListeners(member);
+        members.add(member);
+        return quad;
+    }
+
+    public int size() {
+        return members.size();
+    }
+
+    public HackQuad get(int index) {
+        return members.get(index).quad;
+    }
+
+    public List<HackQuad> getQuads() {
+        List<HackQuad> ret = new ArrayList<>(members.size());
+
+        for (Member member : members)
+            ret.add(member.quad);
+
+        return Collections.unmodifiableList(ret);
+    }
+
+    /**
+     * Same setpoint for every quad, goes out with each one's next control packet.
+     */
+    public void setControl(float throttle, float pitch, float roll, float yawRate, boolean flagClearPanic) {
+        for (Member member : members)
+            member.quad.setControl(throttle, pitch, roll, yawRate, flagClearPanic);
+    }
+
+    /**
+     * Cuts the throttle of every quad.
+     */
+    public void stop() {
+        setControl(0.0f, 0.0f, 0.0f, 0.0f, false);
+    }
+
+    /**
+     * @return latest status of every quad, in the order they were added
+     */
+    public List<QuadTelemetry> getTelemetry() {
+        List<QuadTelemetry> ret = new ArrayList<>(members.size());
+
+        for (int i = 0; i < members.size(); i++)
+            ret.add(members.get(i).snapshot(i));
+
+        return ret;
+    }
+
+    public FleetHealth getHealth() {
+        FleetHealth ret = new FleetHealth();
+        float batterySum = 0.0f;
+        int reporting = 0;
+
+        ret.size = members.size();
+        for (Member member : members) {
+            if (member.lost) {
+                ret.lost++;
+                continue;
+            }
+
+            if (member.quad.isConnectionStable())
+                ret.stable++;
+
+            if (member.lastUpdate == 0)
+                continue;
+
+            float battery = member.quad.getBattery();
+            int rssi = member.quad.getRSSI();
+
+            batterySum += battery;
+            ret.minBattery = reporting == 0 ? battery : Math.min(ret.minBattery, battery);
+            ret.weakestRSSI = reporting == 0 ? rssi : Math.min(ret.weakestRSSI, rssi);
+            reporting++;
+        }
+
+        ret.avgBattery = reporting > 0 ? batterySum / reporting : 0.0f;
+        return ret;
+    }
+
+    @Override
+    public void close() throws IOException {
+        for (Member member : members)
+            member.quad.close();
+
+        members.clear();
+        loop.close();
+    }
+
+    /* status of one quad, copied out of its (pooled) events */
+    private static class Member implements Listener {
+
+        private final HackQuad quad;
+        private volatile boolean lost;
+        private volatile long lastUpdate;
+        private volatile float pitch, roll, yaw, fcLoopTime;
+
+        private Member(HackQuad quad) {
+            this.quad = quad;
+        }
+
+        @EventHandler
+        private void onStatusUpdate(StatusUpdateEvent event) {
+            pitch = event.getPitch();
+            roll = event.getRoll();
+            yaw = event.getYaw();
+            fcLoopTime = event.getFcLoopTime();
+            lastUpdate = event.getRecvTime();
+        }
+
+        @EventHandler
+        private void onConnectionTimeout(ConnectionTimeoutEvent event) {
+            lost = true;
+        }
+
+        private QuadTelemetry snapshot(int index) {
+            return new QuadTelemetry(index, quad.getHost(), !lost, quad.getBattery(), quad.getRSSI(), fcLoopTime, pitch,
+                    roll, yaw, lastUpdate);
+        }
+    }
+}
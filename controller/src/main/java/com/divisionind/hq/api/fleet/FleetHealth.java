@@ -0,0 +1,54 @@
+package com.divisionind.hq.api.fleet;
+
+/**
+ * Health of a whole {@link Fleet} at one point in time. Battery/rssi are over the quads that reported status.
+ */
+public class FleetHealth {
+
+    int size;
+    int stable;
+    int lost;
+    float minBattery;
+    float avgBattery;
+    int weakestRSSI;
+
+    public int getSize() {
+        return size;
+    }
+
+    /**
+     * @return quads with a status update within CONNECTION_STABLE_TIMEOUT
+     */
+    public int getStable() {
+        return stable;
+    }
+
+    /**
+     * @return quads whose connection timed out, they don't reconnect by themselves
+     */
+    public int getLost() {
+        return lost;
+    }
+
+    public float getMinBattery() {
+        return minBattery;
+    }
+
+    public float getAvgBattery() {
+        return avgBattery;
+    }
+
+    public int getWeakestRSSI() {
+        return weakestRSSI;
+    }
+
+    public boolean isHealthy() {
+        return stable == size;
+    }
+
+    @Override
+    public String toString() {
+        return String.format("%d/%d stable, %d lost, battery min %.2fV avg %.2fV, weakest rssi %ddB", stable, size, lost,
+                minBattery, avgBattery, weakestRSSI);
+    }
+}
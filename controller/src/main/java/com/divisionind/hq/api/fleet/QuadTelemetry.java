@@ -0,0 +1,75 @@
+package com.divisionind.hq.api.fleet;
+
+/**
+ * Latest status of one quad of a {@link Fleet}.
+ */
+public class QuadTelemetry {
+
+    private final int index;
+    private final String host;
+    private final boolean connected;
+    private final float battery;
+    private final int rssi;
+    private final float fcLoopTime;
+    private final float pitch;
+    private final float roll;
+    private final float yaw;
+    private final long recvTime;
+
+    QuadTelemetry(int index, String host, boolean connected, float battery, int rssi, float fcLoopTime, float pitch,
+                  float roll, float yaw, long recvTime) {
+        this.index = index;
+        this.host = host;
+        this.connected = connected;
+        this.battery = battery;
+        this.rssi = rssi;
+        this.fcLoopTime = fcLoopTime;
+        this.pitch = pitch;
+        this.roll = roll;
+        this.yaw = yaw;
+        this.recvTime = recvTime;
+    }
+
+    public int getIndex() {
+        return index;
+    }
+
+    public String getHost() {
+        return host;
+    }
+
+    public boolean isConnected() {
+        return connected;
+    }
+
+    public float getBattery() {
+        return battery;
+    }
+
+    public int getRSSI() {
+        return rssi;
+    }
+
+    public float getFcLoopTime() {
+        return fcLoopTime;
+    }
+
+    public float getPitch() {
+        return pitch;
+    }
+
+    public float getRoll() {
+        return roll;
+    }
+
+    public float getYaw() {
+        return yaw;
+    }
+
+    /**
+     * @return ms (currentTimeMillis) the status was received, 0 if there hasn't been any yet
+     */
+    public long getRecvTime() {
+        return recvTime;
+    }
+}
@@ -8,10 +8,18 @@ public class HQBufferReader extends ByteArrayInputStream {
         super(buf);
     }
 
+    public int readShort() {
+        return read() | read() << 8;
+    }
+
     public int readInt() {
         return read() | read() << 8 | read() << 16 | read() << 24;
     }
 
+    public long readLong() {
+        return (readInt() & 0xFFFFFFFFL) | ((long) readInt() << 32);
+    }
+
     public float readFloat() {
         return Float.intBitsToFloat(readInt());
     }
@@ -20,10 +28,16 @@ public class HQBufferReader extends ByteArrayInputStream {
         int curr;
         StringBuilder str = new StringBuilder();
 
-        while ((curr = read()) != 0) { // read till null-term
+        while ((curr = read()) > 0) { // read till null-term (or end of buffer)
             str.append((char) curr);
         }
 
         return str.toString();
     }
+
+    public byte[] readRemaining() {
+        byte[] ret = new byte[available()];
+        read(ret, 0, ret.length);
+        return ret;
+    }
 }
@@ -4,6 +4,11 @@ import java.io.ByteArrayOutputStream;
 
 public class HQBufferWriter extends ByteArrayOutputStream {
 
+    public void writeShort(int i) {
+        write(i);
+        write(i >> 8);
+    }
+
     public void writeInt(int i) {
         write(i);
         write(i >> 8);
@@ -17,6 +22,11 @@ public class HQBufferWriter extends ByteArrayOutputStream {
         write(i >> 16);
     }
 
+    public void writeLong(long l) {
+        writeInt((int) l);
+        writeInt((int) (l >> 32));
+    }
+
     public void writeFloat(float f) {
         writeInt(Float.floatToIntBits(f));
     }
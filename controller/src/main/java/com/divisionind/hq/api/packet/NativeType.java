@@ -1,18 +1,34 @@
 package com.divisionind.hq.api.packet;
 
+import java.lang.invoke.MethodHandle;
+import java.nio.ByteBuffer;
+
+/**
+ * Wire types of {@link PacketEntry} fields. Each type binds a field's getter/setter method handles (see
+ * {@link PacketCodec}) to a {@link Writer}/{@link Reader} once, the handles are invoked with their exact primitive
+ * types, so numeric entries are never boxed and there's no reflective access per packet.
+ */
 public enum NativeType {
 
-    FLOAT(float.class, (out, data) -> out.writeFloat((float) data), HQBufferReader::readFloat),
-    INT8(int.class,    (out, data) -> out.write((int) data),        HQBufferReader::read),
-    INT32(int.class,   (out, data) -> out.writeInt((int) data),     HQBufferReader::readInt),
-    CSTR(String.class, (out, data) -> out.writeStr((String) data),  HQBufferReader::readStr);
+    FLOAT(float.class,  4, g -> (out, p) -> out.putFloat((float) g.invokeExact(p)),
+                           s -> (in, p) -> { s.invokeExact(p, in.getFloat()); }),
+    INT8(int.class,     1, g -> (out, p) -> out.put((byte) (int) g.invokeExact(p)),
+                           s -> (in, p) -> { s.invokeExact(p, in.get() & 0xFF); }),
+    INT32(int.class,    4, g -> (out, p) -> out.putInt((int) g.invokeExact(p)),
+                           s -> (in, p) -> { s.invokeExact(p, in.getInt()); }),
+    CSTR(String.class,  1, g -> (out, p) -> writeStr(out, (String) g.invokeExact(p)),
+                           s -> (in, p) -> { s.invokeExact(p, readStr(in)); }),
+    BYTES(byte[].class, 0, g -> (out, p) -> out.put((byte[]) g.invokeExact(p)),
+                           s -> (in, p) -> { s.invokeExact(p, readRemaining(in)); });
 
     private final Class<?> type;
-    private final Writer writer;
-    private final Reader reader;
+    private final int size;
+    private final WriterFactory writer;
+    private final ReaderFactory reader;
 
-    NativeType(Class<?> type, Writer writer, Reader reader) {
+    NativeType(Class<?> type, int size, WriterFactory writer, ReaderFactory reader) {
         this.type = type;
+        this.size = size;
         this.writer = writer;
         this.reader = reader;
     }
@@ -21,19 +37,64 @@ public enum NativeType {
         return type;
     }
 
-    public void write(HQBufferWriter out, Object data) {
-        writer.store(out, data);
+    /**
+     * @return bytes this type takes up at least on the wire
+     */
+    public int getSize() {
+        return size;
+    }
+
+    /**
+     * @param getter the field's getter, of type (Object)type
+     */
+    public Writer writer(MethodHandle getter) {
+        return writer.bind(getter);
+    }
+
+    /**
+     * @param setter the field's setter, of type (Object, type)void
+     */
+    public Reader reader(MethodHandle setter) {
+        return reader.bind(setter);
+    }
+
+    private static void writeStr(ByteBuffer out, String str) {
+        for (int i = 0; i < str.length(); i++)
+            out.put((byte) str.charAt(i));
+
+        out.put((byte) 0); // null-term
+    }
+
+    private static String readStr(ByteBuffer in) {
+        StringBuilder str = new StringBuilder();
+        byte curr;
+
+        while (in.hasRemaining() && (curr = in.get()) != 0) { // read till null-term (or end of buffer)
+            str.append((char) (curr & 0xFF));
+        }
+
+        return str.toString();
+    }
+
+    private static byte[] readRemaining(ByteBuffer in) {
+        byte[] ret = new byte[in.remaining()];
+        in.get(ret);
+        return ret;
+    }
+
+    public interface Writer {
+        void store(ByteBuffer out, Object packet) throws Throwable;
     }
 
-    public Object read(HQBufferReader in) {
-        return reader.read(in);
+    public interface Reader {
+        void load(ByteBuffer in, Object packet) throws Throwable;
     }
 
-    private interface Writer {
-        void store(HQBufferWriter out, Object data);
+    private interface WriterFactory {
+        Writer bind(MethodHandle getter);
     }
 
-    private interface Reader {
-        Object read(HQBufferReader in);
+    private interface ReaderFactory {
+        Reader bind(MethodHandle setter);
     }
 }
@@ -0,0 +1,126 @@
+package com.divisionind.hq.api.packet;
+
+import java.lang.invoke.MethodHandle;
+import java.lang.invoke.MethodHandles;
+import java.lang.invoke.MethodType;
+import java.lang.reflect.Field;
+import java.lang.reflect.Modifier;
+import java.nio.BufferOverflowException;
+import java.nio.ByteBuffer;
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * Encodes/decodes the {@link PacketEntry} fields of a packet class. The fields are looked up once per class (see
+ * {@link #of(Class)}) and bound to method handle accessors of their exact type (see {@link NativeType}), so values go
+ * straight between the fields and a (reusable) little-endian {@link ByteBuffer} without reflection, boxing or
+ * allocating for fixed size packets.
+ */
+public final class PacketCodec<T extends UDPPacket> {
+
+    private static final ClassValue<PacketCodec<?>> CODECS = new ClassValue<PacketCodec<?>>() {
+        @Override
+        protected PacketCodec<?> computeValue(Class<?> type) {
+            return new PacketCodec<>(type);
+        }
+    };
+
+    private final NativeType.Writer[] writers;
+    private final NativeType.Reader[] readers;
+    private final int minSize;
+
+    private PacketCodec(Class<?> type) {
+        List<NativeType.Writer> writers = new ArrayList<>();
+        List<NativeType.Reader> readers = new ArrayList<>();
+        MethodHandles.Lookup lookup;
+        MethodHandle getter, setter;
+        int minSize = 0;
+
+        try {
+            lookup = MethodHandles.privateLookupIn(type, MethodHandles.lookup());
+        } catch (IllegalAccessException e) {
+            throw new IllegalArgumentException(type.getName() + " is not accessible", e);
+        }
+
+        // same order the fields were always serialized in
+        for (Field f : type.getFields()) {
+            PacketEntry meta = f.getAnnotation(PacketEntry.class);
+
+            if (meta == null || Modifier.isStatic(f.getModifiers()))
+                continue;
+
+            if (f.getType() != meta.value().getType())
+                throw new IllegalArgumentException(type.getName() + "." + f.getName() + " is not a " + meta.value().getType().getSimpleName());
+
+            // typed (Object)field / (Object, field)void, so the accessors can call them with invokeExact
+            try {
+                getter = lookup.unreflectGetter(f).asType(MethodType.methodType(f.getType(), Object.class));
+                setter = lookup.unreflectSetter(f).asType(MethodType.methodType(void.class, Object.class, f.getType()));
+            } catch (IllegalAccessException e) {
+                throw new IllegalArgumentException(type.getName() + "." + f.getName() + " is not accessible", e);
+            }
+
+            writers.add(meta.value().writer(getter));
+            readers.add(meta.value().reader(setter));
+            minSize += meta.value().getSize();
+        }
+
+        this.writers = writers.toArray(new NativeType.Writer[0]);
+        this.readers = readers.toArray(new NativeType.Reader[0]);
+        this.minSize = minSize;
+    }
+
+    @SuppressWarnings("unchecked")
+    public static <T extends UDPPacket> PacketCodec<T> of(Class<T> type) {
+        return (PacketCodec<T>) CODECS.get(type);
+    }
+
+    @SuppressWarnings("unchecked")
+    public static <T extends UDPPacket> PacketCodec<T> of(T packet) {
+        return (PacketCodec<T>) CODECS.get(packet.getClass());
+    }
+
+    /**
+     * @return bytes the packet's contents take up at least
+     */
+    public int getMinSize() {
+        return minSize;
+    }
+
+    /**
+     * Writes the packet's contents at the position of out.
+     *
+     * @throws BufferOverflowException if out doesn't have enough room left
+     */
+    public void encode(T packet, ByteBuffer out) {
+        try {
+            for (NativeType.Writer writer : writers)
+                writer.store(out, packet);
+        } catch (RuntimeException | Error e) {
+            throw e;
+        } catch (Throwable e) {
+            throw new IllegalStateException(e); // field accessors don't throw checked exceptions
+        }
+    }
+
+    /**
+     * Reads the packet's contents from the position of in.
+     *
+     * @return false if in was too short, the packet is left partially filled in that case
+     */
+    public boolean decode(ByteBuffer in, T packet) {
+        if (in.remaining() < minSize)
+            return false;
+
+        try {
+            for (NativeType.Reader reader : readers)
+                reader.load(in, packet);
+        } catch (RuntimeException | Error e) {
+            throw e;
+        } catch (Throwable e) {
+            throw new IllegalStateException(e);
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,34 @@
+package com.divisionind.hq.api.packet.inbound;
+
+import com.divisionind.hq.api.packet.NativeType;
+import com.divisionind.hq.api.packet.PacketEntry;
+import com.divisionind.hq.api.packet.UDPPacket;
+
+public class HQICpuUpdate implements UDPPacket {
+
+    /* 100ms */
+    @PacketEntry(NativeType.INT8)
+    public int window;
+
+    @PacketEntry(NativeType.INT8)
+    public int cores;
+
+    /* 0.5% of one core */
+    @PacketEntry(NativeType.INT8)
+    public int load0;
+
+    @PacketEntry(NativeType.INT8)
+    public int load1;
+
+    @PacketEntry(NativeType.INT8)
+    public int count;
+
+    /* count * (name char[8] | core s8 | load u8), parsed into a CpuUpdateEvent */
+    @PacketEntry(NativeType.BYTES)
+    public byte[] tasks;
+
+    @Override
+    public int id() {
+        return 22;
+    }
+}
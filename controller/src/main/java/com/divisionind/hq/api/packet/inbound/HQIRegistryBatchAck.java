@@ -0,0 +1,29 @@
+package com.divisionind.hq.api.packet.inbound;
+
+import com.divisionind.hq.api.packet.NativeType;
+import com.divisionind.hq.api.packet.PacketEntry;
+import com.divisionind.hq.api.packet.UDPPacket;
+
+public class HQIRegistryBatchAck implements UDPPacket {
+
+    @PacketEntry(NativeType.INT8)
+    public int seq;
+
+    @PacketEntry(NativeType.INT8)
+    public int flags;
+
+    @PacketEntry(NativeType.INT8)
+    public int ok;
+
+    @PacketEntry(NativeType.INT8)
+    public int err;
+
+    /* ok+err results, parsed by RegistryBatchChannel as their layout depends on the request */
+    @PacketEntry(NativeType.BYTES)
+    public byte[] results;
+
+    @Override
+    public int id() {
+        return 21;
+    }
+}
@@ -18,6 +18,13 @@ public class HQOControl implements UDPPacket {
     @PacketEntry(NativeType.FLOAT)
     public float yawRate;
 
+    /**
+     * ms send time on the controller's clock, lets the quad time its setpoint interpolation by when the packets
+     * were sent rather than when they arrived. 0 means not stamped.
+     */
+    @PacketEntry(NativeType.INT32)
+    public int timestamp;
+
     public HQOControl(float throttle, float pitch, float roll, float yawRate, boolean flagClearPanic) {
         if (throttle < 0)
             throw new RuntimeException("negative throttle values are not acceptable");
@@ -31,6 +38,19 @@ public class HQOControl implements UDPPacket {
             this.throttle *= -1.0f; // set sign-bit
     }
 
+    /**
+     * Stamps the packet right before it goes out.
+     *
+     * @param millis monotonic ms, only differences between packets matter so it may wrap
+     * @return this
+     */
+    public HQOControl stamp(long millis) {
+        timestamp = (int) millis;
+        if (timestamp == 0)
+            timestamp = 1;
+        return this;
+    }
+
     @Override
     public int id() {
         return 69;
@@ -0,0 +1,33 @@
+package com.divisionind.hq.api.packet.outbound;
+
+import com.divisionind.hq.api.packet.NativeType;
+import com.divisionind.hq.api.packet.PacketEntry;
+import com.divisionind.hq.api.packet.UDPPacket;
+
+public class HQORegistryBatch implements UDPPacket {
+
+    /* only the low byte is sent */
+    @PacketEntry(NativeType.INT8)
+    public int seq;
+
+    @PacketEntry(NativeType.INT8)
+    public int flags;
+
+    @PacketEntry(NativeType.INT8)
+    public int count;
+
+    @PacketEntry(NativeType.BYTES)
+    public byte[] ops;
+
+    public HQORegistryBatch(int seq, int flags, int count, byte[] ops) {
+        this.seq = seq;
+        this.flags = flags;
+        this.count = count;
+        this.ops = ops;
+    }
+
+    @Override
+    public int id() {
+        return 70;
+    }
+}
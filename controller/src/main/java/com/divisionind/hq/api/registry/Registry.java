@@ -2,12 +2,44 @@ package com.divisionind.hq.api.registry;
 
 import com.divisionind.hq.api.HackQuadChild;
 
+import java.util.Collection;
 import java.util.List;
+import java.util.Map;
 
 public interface Registry extends HackQuadChild {
     List<RemoteRegister> queryRegistry();
 
     RemoteRegister queryRegistryEntry(String key);
 
+    /**
+     * Changes apply right away and are saved once the quad is disarmed (or on {@link #commit()}).
+     */
     void updateRegistryEntry(String key, Object value) throws RuntimeException;
+
+    /**
+     * Queries many registry entries at once over the binary udp channel.
+     *
+     * @param keys to query
+     * @return key -> value for every requested key
+     * @throws RuntimeException if any key could not be read
+     */
+    Map<String, Object> queryRegistryEntries(Collection<String> keys) throws RuntimeException;
+
+    /**
+     * Sets many registry entries at once over the binary udp channel, e.g. a whole PID tuning
+     * profile. Changes apply right away and are saved once the quad is disarmed (or on {@link #commit()}).
+     *
+     * @param values key -> value, value types are converted to the entry's type by the quad
+     * @throws IllegalArgumentException if a value is null
+     * @throws RuntimeException if any key could not be set
+     */
+    void updateRegistryEntries(Map<String, Object> values) throws RuntimeException;
+
+    /**
+     * Saves all staged registry changes to the quad's flash now. Flash writes stall the quad's
+     * cpu, so avoid this while flying.
+     *
+     * @throws RuntimeException if the commit failed
+     */
+    void commit() throws RuntimeException;
 }
@@ -0,0 +1,241 @@
+package com.divisionind.hq.api.registry;
+
+import com.divisionind.hq.api.HackQuad;
+import com.divisionind.hq.api.HackQuadChild;
+import com.divisionind.hq.api.packet.HQBufferReader;
+import com.divisionind.hq.api.packet.HQBufferWriter;
+import com.divisionind.hq.api.packet.inbound.HQIRegistryBatchAck;
+import com.divisionind.hq.api.packet.outbound.HQORegistryBatch;
+
+import java.util.*;
+import java.util.concurrent.*;
+import java.util.concurrent.atomic.AtomicInteger;
+
+/**
+ * Binary registry channel over the udp control socket. Gets/sets many registry entries per datagram
+ * (keyed by {@link String#hashCode()}, which matches the firmware's key_hash) with one ack per datagram.
+ * See firmware regbatch.h for the wire format.
+ */
+public class RegistryBatchChannel implements HackQuadChild {
+
+    /* firmware recv buffer (512) - udp header (4) - batch header (3), with some slack */
+    public static final int MAX_OPS_SIZE = 500;
+
+    /* how long to wait for an ack before re-sending a batch */
+    public static final long ACK_TIMEOUT = 250;
+
+    /* how many times a batch is sent before giving up */
+    public static final int MAX_ATTEMPTS = 3;
+
+    private static final int OP_GET = 0;
+    private static final int OP_SET = 1;
+
+    private static final int FLAG_PERSIST = 1;
+
+    private static final int ACK_TRUNCATED = 1;
+    private static final int ACK_MALFORMED = 1 << 1;
+    private static final int ACK_PERSIST_FAIL = 1 << 2;
+
+    private static final int STATUS_OK = 0;
+
+    private final HackQuad hackQuad;
+    private final AtomicInteger latestSeq;
+    private final Map<Integer, CompletableFuture<HQIRegistryBatchAck>> pending;
+
+    public RegistryBatchChannel(HackQuad hackQuad) {
+        this.hackQuad = hackQuad;
+        this.latestSeq = new AtomicInteger(0);
+        this.pending = new ConcurrentHashMap<>();
+    }
+
+    @Override
+    public HackQuad getParent() {
+        return hackQuad;
+    }
+
+    public Map<String, Object> get(Collection<String> keys) throws RuntimeException {
+        Map<String, Object> ret = new HashMap<>();
+        Deque<Op> ops = new ArrayDeque<>();
+
+        for (String key : keys)
+            ops.add(new Op(key, null));
+
+        process(ops, 0, ret);
+        return ret;
+    }
+
+    public void set(Map<String, Object> values, boolean persist) throws RuntimeException {
+        Deque<Op> ops = new ArrayDeque<>();
+
+        for (Map.Entry<String, Object> ent : values.entrySet()) {
+            // a null value would go out as a get, whose result has nowhere to go here
+            if (ent.getValue() == null)
+                throw new IllegalArgumentException("no value to set for registry key: " + ent.getKey());
+
+            ops.add(new Op(ent.getKey(), ent.getValue()));
+        }
+
+        process(ops, persist ? FLAG_PERSIST : 0, null);
+    }
+
+    /**
+     * Called by the udp receive task when a batch ack arrives.
+     */
+    public void handleAck(HQIRegistryBatchAck ack) {
+        CompletableFuture<HQIRegistryBatchAck> future = pending.remove(ack.seq);
+
+        if (future != null)
+            future.complete(ack);
+    }
+
+    private void process(Deque<Op> ops, int flags, Map<String, Object> results) {
+        List<String> failed = new ArrayList<>();
+
+        while (!ops.isEmpty()) {
+            Map<Integer, Op> batch = new LinkedHashMap<>();
+            HQBufferWriter out = new HQBufferWriter();
+
+            // fill datagram, duplicate keys have to wait for the next one as results are keyed by hash
+            while (!ops.isEmpty() && batch.size() < 255) {
+                Op op = ops.peek();
+                if (batch.containsKey(op.hash) || out.size() + op.encoded.length > MAX_OPS_SIZE)
+                    break;
+
+                out.writeBytes(op.encoded);
+                batch.put(op.hash, ops.poll());
+            }
+
+            if (batch.isEmpty())
+                throw new RuntimeException("registry value too large for a batch: " + ops.peek().key);
+
+            HQIRegistryBatchAck ack = exchange(new HQORegistryBatch(0, flags, batch.size(), out.toByteArray()));
+
+            if ((ack.flags & ACK_MALFORMED) != 0)
+                throw new RuntimeException("registry batch rejected as malformed");
+
+            if ((ack.flags & ACK_PERSIST_FAIL) != 0)
+                throw new RuntimeException("failed to persist registry batch");
+
+            HQBufferReader in = new HQBufferReader(ack.results);
+            for (int i = 0; i < ack.ok + ack.err; i++) {
+                Op op = batch.remove(in.readInt());
+                int status = in.read();
+
+                if (op == null)
+                    throw new RuntimeException("registry batch ack does not match request");
+
+                if (status != STATUS_OK) {
+                    failed.add(op.key);
+                } else
+                if (!op.isSet()) {
+                    results.put(op.key, readValue(in, RegisterType.getById(in.read())));
+                }
+            }
+
+            // ops the quad had no room to ack go out again with the next batch
+            if (!batch.isEmpty()) {
+                if ((ack.flags & ACK_TRUNCATED) == 0)
+                    throw new RuntimeException("registry batch ack is missing results");
+
+                List<Op> retry = new ArrayList<>(batch.values());
+                Collections.reverse(retry);
+                retry.forEach(ops::addFirst);
+            }
+        }
+
+        if (!failed.isEmpty())
+            throw new RuntimeException("failed to access registry value(s): " + String.join(", ", failed));
+    }
+
+    private HQIRegistryBatchAck exchange(HQORegistryBatch packet) {
+        for (int attempt = 0; attempt < MAX_ATTEMPTS; attempt++) {
+            CompletableFuture<HQIRegistryBatchAck> future = new CompletableFuture<>();
+
+            // new seq per attempt so a late ack from a previous attempt isn't mistaken for this one
+            packet.seq = latestSeq.getAndIncrement() & 0xFF;
+            pending.put(packet.seq, future);
+            hackQuad.send(packet);
+
+            try {
+                return future.get(ACK_TIMEOUT, TimeUnit.MILLISECONDS);
+            } catch (TimeoutException e) {
+                // lost in transit, try again
+            } catch (InterruptedException | ExecutionException e) {
+                throw new RuntimeException("interrupted waiting for registry batch ack", e);
+            } finally {
+                pending.remove(packet.seq);
+            }
+        }
+
+        throw new RuntimeException("timed out waiting for registry batch ack");
+    }
+
+    private static Object readValue(HQBufferReader in, RegisterType type) {
+        switch (type) {
+            default:
+            case REG_8B:
+                return in.read();
+            case REG_16B:
+                return in.readShort();
+            case REG_32B:
+                return in.readInt();
+            case REG_64B:
+                return (int) in.readLong(); // matches the http api, too much effort for 64-bit data types
+            case REG_FLT:
+                return in.readFloat();
+            case REG_STR:
+                return in.readStr();
+        }
+    }
+
+    private static void writeValue(HQBufferWriter out, Object value) {
+        if (value instanceof Float || value instanceof Double) {
+            out.write(RegisterType.REG_FLT.getId());
+            out.writeFloat(((Number) value).floatValue());
+        } else
+        if (value instanceof Long) {
+            out.write(RegisterType.REG_64B.getId());
+            out.writeLong((Long) value);
+        } else
+        if (value instanceof Number) {
+            out.write(RegisterType.REG_32B.getId());
+            out.writeInt(((Number) value).intValue());
+        } else
+        if (value instanceof Boolean) {
+            out.write(RegisterType.REG_8B.getId());
+            out.write((Boolean) value ? 1 : 0);
+        } else
+        if (value instanceof String) {
+            out.write(RegisterType.REG_STR.getId());
+            out.writeStr((String) value);
+        } else
+            throw new IllegalArgumentException("unsupported registry value type: " + value.getClass().getName());
+    }
+
+    private static class Op {
+
+        private final String key;
+        private final int hash;
+        private final Object value;
+        private final byte[] encoded;
+
+        private Op(String key, Object value) {
+            HQBufferWriter out = new HQBufferWriter();
+
+            this.key = key;
+            this.hash = key.hashCode();
+            this.value = value;
+
+            out.write(isSet() ? OP_SET : OP_GET);
+            out.writeInt(hash);
+            if (isSet())
+                writeValue(out, value);
+
+            this.encoded = out.toByteArray();
+        }
+
+        private boolean isSet() {
+            return value != null;
+        }
+    }
+}
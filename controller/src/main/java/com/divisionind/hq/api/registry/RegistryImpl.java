@@ -7,15 +7,23 @@ import org.json.JSONObject;
 
 import java.io.IOException;
 import java.util.ArrayList;
+import java.util.Collection;
 import java.util.Iterator;
 import java.util.List;
+import java.util.Map;
 
 public class RegistryImpl implements Registry {
 
     private final HackQuad hackQuad;
+    private final RegistryBatchChannel batchChannel;
 
     public RegistryImpl(HackQuad hackQuad) {
         this.hackQuad = hackQuad;
+        this.batchChannel = new RegistryBatchChannel(hackQuad);
+    }
+
+    public RegistryBatchChannel getBatchChannel() {
+        return batchChannel;
     }
 
     private Object getValueFrom(JSONObject json, RegisterType type) {
@@ -59,7 +67,8 @@ public class RegistryImpl implements Registry {
                     JSONObject curr = (JSONObject) jsonIt.next();
                     RegisterType type = RegisterType.getById(curr.getInt("type"));
 
-                    ret.add(new RemoteRegisterImpl(this, curr.getString("key"), type, getValueFrom(curr, type)));
+                    ret.add(new RemoteRegisterImpl(this, curr.getString("key"), type, getValueFrom(curr, type),
+                            curr.optBoolean("dirty")));
                 }
             }
         } catch (IOException e) {
@@ -82,7 +91,7 @@ public class RegistryImpl implements Registry {
                 JSONObject jsonResp = new JSONObject(resp.getResponse());
                 RegisterType type = RegisterType.getById(jsonResp.getInt("type"));
 
-                ret = new RemoteRegisterImpl(this, key, type, getValueFrom(jsonResp, type));
+                ret = new RemoteRegisterImpl(this, key, type, getValueFrom(jsonResp, type), jsonResp.optBoolean("dirty"));
             }
         } catch (IOException e) {
             e.printStackTrace();
@@ -105,4 +114,26 @@ public class RegistryImpl implements Registry {
             throw new RuntimeException("IOException attempting to set registry value");
         }
     }
+
+    @Override
+    public Map<String, Object> queryRegistryEntries(Collection<String> keys) throws RuntimeException {
+        return batchChannel.get(keys);
+    }
+
+    @Override
+    public void updateRegistryEntries(Map<String, Object> values) throws RuntimeException {
+        batchChannel.set(values, false);
+    }
+
+    @Override
+    public void commit() throws RuntimeException {
+        try {
+            HTTP resp = HTTP.request(httpRoot() + "/reg/commit", "POST", null);
+            if (resp.getCode() != 200)
+                throw new RuntimeException("failed to commit registry");
+        } catch (IOException e) {
+            e.printStackTrace();
+            throw new RuntimeException("IOException attempting to commit registry");
+        }
+    }
 }
@@ -15,5 +15,10 @@ public interface RemoteRegister {
 
     Object getValue();
 
+    /**
+     * @return true if the value was changed on the quad but not yet committed to its flash
+     */
+    boolean isDirty();
+
     void updateValue(Object nValue);
 }
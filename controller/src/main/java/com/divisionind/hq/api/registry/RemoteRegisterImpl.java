@@ -7,12 +7,18 @@ public class RemoteRegisterImpl implements RemoteRegister {
     private String key;
     private RegisterType type;
     private Object value;
+    private boolean dirty;
 
     public RemoteRegisterImpl(Registry manager, String key, RegisterType type, Object value) {
+        this(manager, key, type, value, false);
+    }
+
+    public RemoteRegisterImpl(Registry manager, String key, RegisterType type, Object value, boolean dirty) {
         this.manager = manager;
         this.key = key;
         this.type = type;
         this.value = value;
+        this.dirty = dirty;
 
         // handle custom renderers
         try {
@@ -63,9 +69,15 @@ public class RemoteRegisterImpl implements RemoteRegister {
         return value;
     }
 
+    @Override
+    public boolean isDirty() {
+        return dirty;
+    }
+
     @Override
     public void updateValue(Object nValue) {
         value = nValue;
         manager.updateRegistryEntry(key, value);
+        dirty = true;
     }
 }
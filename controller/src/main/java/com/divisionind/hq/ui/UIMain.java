@@ -249,14 +249,21 @@ public class UIMain extends Application implements Initializable, Listener {
 
     @EventHandler
     private void onStatusUpdate(StatusUpdateEvent event) {
+        // the event is reused once we return, copy out what the ui thread needs
+        int strength = event.getParent().getConnectionStrength();
+        byte rssi = event.getRSSI();
+        float battery = event.getBattery();
+        float fcLoopTime = event.getFcLoopTime();
+        float pitch = event.getPitch(), roll = event.getRoll(), yaw = event.getYaw();
+
         Platform.runLater(() -> {
-            rssiLabel.setText(String.format("(%d/5) %ddB", event.getParent().getConnectionStrength() + 1, event.getRSSI()));
-            batteryLabel.setText(String.format("%.3fV (%d%%)", event.getBattery(), Math.round(estimateBatteryPercent(event.getBattery()))));
+            rssiLabel.setText(String.format("(%d/5) %ddB", strength + 1, rssi));
+            batteryLabel.setText(String.format("%.3fV (%d%%)", battery, Math.round(estimateBatteryPercent(battery))));
 
-            fcRefreshLabel.setText(String.format("%.0f", 1000.0f / event.getFcLoopTime()));
-            angleXLabel.setText(String.format("%.2f", event.getPitch()));
-            angleYLabel.setText(String.format("%.2f", event.getRoll()));
-            angleZLabel.setText(String.format("%.2f", event.getYaw()));
+            fcRefreshLabel.setText(String.format("%.0f", 1000.0f / fcLoopTime));
+            angleXLabel.setText(String.format("%.2f", pitch));
+            angleYLabel.setText(String.format("%.2f", roll));
+            angleZLabel.setText(String.format("%.2f", yaw));
             // could just print time of last update at bottom corner of ui instead of connected (use color to show that)
         });
     }
@@ -0,0 +1,129 @@
+package com.divisionind.hq.api;
+
+import org.junit.jupiter.api.AfterEach;
+import org.junit.jupiter.api.BeforeEach;
+import org.junit.jupiter.api.Test;
+
+import java.io.IOException;
+import java.net.DatagramPacket;
+import java.net.DatagramSocket;
+import java.net.InetAddress;
+import java.net.SocketTimeoutException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+
+import static org.junit.jupiter.api.Assertions.*;
+
+/**
+ * A {@link LinkLoop} against plain sockets standing in for quads on localhost.
+ */
+class LinkLoopTest {
+
+    private LinkLoop loop;
+    private DatagramSocket[] quads;
+
+    @BeforeEach
+    void setUp() throws IOException {
+        loop = new LinkLoop("hq-link-test");
+        quads = new DatagramSocket[3];
+
+        for (int i = 0; i < quads.length; i++) {
+            quads[i] = new DatagramSocket(0, InetAddress.getLoopbackAddress());
+            quads[i].setSoTimeout((int) HackQuad.CONTROL_UPDATE_RATE * 10);
+        }
+    }
+
+    @AfterEach
+    void tearDown() throws IOException {
+        loop.close();
+
+        for (DatagramSocket quad : quads)
+            quad.close();
+    }
+
+    private static DatagramPacket receive(DatagramSocket quad) throws IOException {
+        DatagramPacket packet = new DatagramPacket(new byte[LinkLoop.UDP_BUFFER_SIZE], LinkLoop.UDP_BUFFER_SIZE);
+        quad.receive(packet);
+        return packet;
+    }
+
+    private HackQuad open(int quad) throws IOException {
+        return HackQuad.open("127.0.0.1", quads[quad].getLocalPort(), loop);
+    }
+
+    @Test
+    void controlPeriod() throws IOException {
+        try (HackQuad quad = open(0)) {
+            long first = 0, last = 0;
+            int packets = 20;
+
+            for (int i = 0; i < packets; i++) {
+                DatagramPacket packet = receive(quads[0]);
+                ByteBuffer in = ByteBuffer.wrap(packet.getData(), 0, packet.getLength()).order(ByteOrder.LITTLE_ENDIAN);
+
+                assertEquals(69, in.get() & 0xFF);
+                assertEquals(i, (in.get() & 0xFF) | (in.getShort() & 0xFFFF) << 8);
+
+                last = System.nanoTime();
+                if (i == 0)
+                    first = last;
+            }
+
+            // scheduling noise aside, one packet per CONTROL_UPDATE_RATE
+            double period = (last - first) / 1e6 / (packets - 1);
+            assertTrue(period > HackQuad.CONTROL_UPDATE_RATE * 0.75 && period < HackQuad.CONTROL_UPDATE_RATE * 1.5,
+                    "control period " + period + " ms");
+        }
+    }
+
+    @Test
+    void statusAndClose() throws IOException {
+        HackQuad[] opened = new HackQuad[quads.length];
+
+        for (int i = 0; i < quads.length; i++)
+            opened[i] = open(i);
+
+        // every quad on the loop gets its control packets and status goes back to the right one
+        for (int i = 0; i < quads.length; i++) {
+            DatagramPacket control = receive(quads[i]);
+            ByteBuffer status = ByteBuffer.allocate(22).order(ByteOrder.LITTLE_ENDIAN);
+            status.put((byte) 20).putFloat(3.5f + i).put((byte) -60).putFloat(0.001f).putFloat(0).putFloat(0).putFloat(0);
+
+            quads[i].send(new DatagramPacket(status.array(), status.position(), control.getSocketAddress()));
+        }
+
+        long deadline = System.currentTimeMillis() + HackQuad.CONNECTION_STABLE_TIMEOUT;
+        for (int i = 0; i < quads.length; i++) {
+            while (opened[i].getBattery() == 0.0f && System.currentTimeMillis() < deadline)
+                Thread.yield();
+
+            assertEquals(3.5f + i, opened[i].getBattery());
+            assertEquals(-60, opened[i].getRSSI());
+            assertTrue(opened[i].isConnectionStable());
+        }
+
+        // closed quads drop out of the schedule, the others keep sending
+        opened[0].close();
+        drain(quads[0]);
+        assertThrows(SocketTimeoutException.class, () -> receive(quads[0]));
+        receive(quads[1]);
+
+        for (int i = 1; i < quads.length; i++)
+            opened[i].close();
+    }
+
+    /* what was sent before the quad was closed */
+    private static void drain(DatagramSocket quad) throws IOException {
+        int timeout = quad.getSoTimeout();
+
+        quad.setSoTimeout((int) HackQuad.CONTROL_UPDATE_RATE * 2);
+        try {
+            for (;;)
+                receive(quad);
+        } catch (SocketTimeoutException e) {
+            // empty
+        } finally {
+            quad.setSoTimeout(timeout);
+        }
+    }
+}
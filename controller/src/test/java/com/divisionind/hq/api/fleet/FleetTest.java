@@ -0,0 +1,78 @@
+package com.divisionind.hq.api.fleet;
+
+import com.divisionind.hq.api.HackQuad;
+import org.junit.jupiter.api.Test;
+
+import java.io.IOException;
+import java.net.DatagramPacket;
+import java.net.DatagramSocket;
+import java.net.InetAddress;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.util.List;
+
+import static org.junit.jupiter.api.Assertions.*;
+
+class FleetTest {
+
+    /* status update from quad, sent back to wherever its last control packet came from */
+    private static void reportStatus(DatagramSocket quad, float battery, byte rssi) throws IOException {
+        DatagramPacket control = new DatagramPacket(new byte[512], 512);
+        quad.receive(control);
+
+        ByteBuffer status = ByteBuffer.allocate(22).order(ByteOrder.LITTLE_ENDIAN);
+        status.put((byte) 20).putFloat(battery).put(rssi).putFloat(0.001f).putFloat(1).putFloat(2).putFloat(3);
+        quad.send(new DatagramPacket(status.array(), status.position(), control.getSocketAddress()));
+    }
+
+    @Test
+    void health() throws IOException {
+        DatagramSocket a = new DatagramSocket(0, InetAddress.getLoopbackAddress());
+        DatagramSocket b = new DatagramSocket(0, InetAddress.getLoopbackAddress());
+
+        try (Fleet fleet = new Fleet()) {
+            a.setSoTimeout(1000);
+            b.setSoTimeout(1000);
+            fleet.add("127.0.0.1", a.getLocalPort());
+            fleet.add("127.0.0.1", b.getLocalPort());
+
+            // only the first one reports
+            reportStatus(a, 3.7f, (byte) -55);
+
+            long deadline = System.currentTimeMillis() + HackQuad.CONNECTION_STABLE_TIMEOUT;
+            while (fleet.getTelemetry().get(0).getRecvTime() == 0 && System.currentTimeMillis() < deadline)
+                Thread.yield();
+
+            List<QuadTelemetry> telemetry = fleet.getTelemetry();
+            assertEquals(2, telemetry.size());
+            assertNotEquals(0, telemetry.get(0).getRecvTime());
+            assertEquals(3.7f, telemetry.get(0).getBattery());
+            assertEquals(2.0f, telemetry.get(0).getRoll());
+            assertEquals(0, telemetry.get(1).getRecvTime());
+
+            FleetHealth health = fleet.getHealth();
+            assertEquals(2, health.getSize());
+            assertEquals(1, health.getStable());
+            assertEquals(0, health.getLost());
+            assertEquals(3.7f, health.getMinBattery());
+            assertEquals(3.7f, health.getAvgBattery());
+            assertEquals(-55, health.getWeakestRSSI());
+            assertFalse(health.isHealthy());
+
+            // setpoints go to every quad
+            fleet.setControl(0.5f, 0.0f, 0.0f, 0.0f, false);
+            for (DatagramSocket quad : new DatagramSocket[] { a, b }) {
+                DatagramPacket control = new DatagramPacket(new byte[512], 512);
+                float throttle;
+
+                do {
+                    quad.receive(control);
+                    throttle = ByteBuffer.wrap(control.getData(), 4, 4).order(ByteOrder.LITTLE_ENDIAN).getFloat();
+                } while (throttle != 0.5f);
+            }
+        } finally {
+            a.close();
+            b.close();
+        }
+    }
+}
@@ -0,0 +1,86 @@
+package com.divisionind.hq.api.packet;
+
+import com.divisionind.hq.api.event.events.CpuUpdateEvent;
+import com.divisionind.hq.api.packet.inbound.HQICpuUpdate;
+import com.divisionind.hq.api.packet.inbound.HQIRegistryBatchAck;
+import com.divisionind.hq.api.packet.inbound.HQIStatusUpdate;
+import com.divisionind.hq.api.packet.outbound.HQOControl;
+import org.junit.jupiter.api.Test;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+
+import static org.junit.jupiter.api.Assertions.*;
+
+class PacketCodecTest {
+
+    private static ByteBuffer buffer() {
+        return ByteBuffer.allocateDirect(512).order(ByteOrder.LITTLE_ENDIAN);
+    }
+
+    @Test
+    void controlLayout() {
+        HQOControl control = new HQOControl(0.5f, 1.0f, -2.0f, 3.0f, true).stamp(0x12345678);
+        ByteBuffer out = buffer();
+
+        PacketCodec.of(control).encode(control, out);
+        out.flip();
+
+        // matches what the firmware reads out of packet 69
+        assertEquals(20, out.remaining());
+        assertEquals(-0.5f, out.getFloat());
+        assertEquals(1.0f, out.getFloat());
+        assertEquals(-2.0f, out.getFloat());
+        assertEquals(3.0f, out.getFloat());
+        assertEquals(0x12345678, out.getInt());
+    }
+
+    @Test
+    void statusRoundTrip() {
+        ByteBuffer buf = buffer();
+        buf.putFloat(3.7f).put((byte) -60).putFloat(0.001f).putFloat(1).putFloat(2).putFloat(3).flip();
+
+        HQIStatusUpdate status = new HQIStatusUpdate();
+        assertTrue(PacketCodec.of(HQIStatusUpdate.class).decode(buf, status));
+        assertEquals(3.7f, status.battery);
+        assertEquals(-60, (byte) status.rssi);
+        assertEquals(0.001f, status.fcLoopTime);
+        assertEquals(3.0f, status.angleZ);
+        assertFalse(buf.hasRemaining());
+
+        buf.position(0).limit(8);
+        assertFalse(PacketCodec.of(HQIStatusUpdate.class).decode(buf, status));
+    }
+
+    @Test
+    void trailingBytes() {
+        ByteBuffer buf = buffer();
+        buf.put((byte) 7).put((byte) 0).put((byte) 1).put((byte) 0).putInt(0xCAFE).put((byte) 0).flip();
+
+        HQIRegistryBatchAck ack = new HQIRegistryBatchAck();
+        assertTrue(PacketCodec.of(HQIRegistryBatchAck.class).decode(buf, ack));
+        assertEquals(7, ack.seq);
+        assertEquals(1, ack.ok);
+        assertEquals(5, ack.results.length);
+    }
+
+    @Test
+    void cpuUpdate() {
+        ByteBuffer buf = buffer();
+        // as ctrllink_send_cpu() sends it: 1s window, two cores at 50%/12.5%, two tasks
+        buf.put((byte) 10).put((byte) 2).put((byte) 100).put((byte) 25).put((byte) 2);
+        buf.put("flight\0\0".getBytes()).put((byte) 1).put((byte) 180);
+        buf.put("wifi_tas".getBytes()).put((byte) -1).put((byte) 7);
+        buf.flip();
+
+        HQICpuUpdate cpu = new HQICpuUpdate();
+        assertTrue(PacketCodec.of(HQICpuUpdate.class).decode(buf, cpu));
+
+        CpuUpdateEvent event = new CpuUpdateEvent(cpu.window, cpu.cores, cpu.load0, cpu.load1, cpu.count, cpu.tasks);
+        assertEquals(1000, event.getWindow());
+        assertArrayEquals(new float[] { 50.0f, 12.5f }, event.getCoreLoads());
+        assertArrayEquals(new String[] { "flight", "wifi_tas" }, event.getNames());
+        assertArrayEquals(new int[] { 1, -1 }, event.getCores());
+        assertArrayEquals(new float[] { 90.0f, 3.5f }, event.getLoads());
+    }
+}
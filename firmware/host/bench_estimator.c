@@ -0,0 +1,243 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runs every attitude estimator over the same imu data and reports its cost
+ * per update and its attitude (tilt) error.
+ *
+ *   bench_estimator            - simulated flight, see synthesize()
+ *   bench_estimator imu.csv    - recorded data, one sample per line:
+ *                                dt,ax,ay,az,gx,gy,gz[,rest[,roll,pitch]]
+ *                                (s, m/s^2, dps, 0/1, deg), error needs roll/pitch
+ *
+ * Without a file it exits non-zero if an estimator's rms error is off, so it
+ * doubles as a test.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_TSC
+#endif
+
+#include "hackquad/estimator.h"
+
+#define RATE      1000.f  /* Hz */
+#define DURATION  60.f    /* s */
+#define SETTLE    5.f     /* s, error isn't counted before this */
+#define G_ACCL    9.80665f
+
+struct sample {
+    struct estimator_input in;
+    bool truth;
+    float roll, pitch; /* deg */
+};
+
+/* deg, simulated data only. the complementary filter trusts the accel a lot and
+ * integrates euler angles without cross coupling, it's kept as a reference */
+static const float max_rms[ESTIMATOR_COUNT] = {
+    [ESTIMATOR_MADGWICK]      = 3.f,
+    [ESTIMATOR_COMPLEMENTARY] = 10.f,
+    [ESTIMATOR_MAHONY]        = 3.f,
+    [ESTIMATOR_ESKF]          = 3.f
+};
+
+static struct sample *samples;
+static size_t sample_count;
+
+/* deterministic gaussian noise */
+static float noise(float sigma) {
+    float u1 = (rand() + 1.f) / (RAND_MAX + 2.f), u2 = (rand() + 1.f) / (RAND_MAX + 2.f);
+
+    return sigma * sqrtf(-2.f * logf(u1)) * cosf(2.f * (float) M_PI * u2);
+}
+
+/*
+ * 2s still on the ground, then rocking in roll and pitch with motor vibration
+ * on the accel, a residual gyro bias and alternating 0.3s lateral pushes.
+ */
+static void synthesize() {
+    float t, dt = 1.f / RATE, roll, pitch, droll, dpitch, lat, w = 2.f * (float) M_PI;
+    struct sample *s;
+    size_t i;
+
+    sample_count = (size_t) (DURATION * RATE);
+    samples = calloc(sample_count, sizeof(*samples));
+    srand(3);
+
+    for (i = 0; i < sample_count; i++) {
+        s = &samples[i];
+        t = i * dt;
+
+        if (t < 2.f) {
+            roll = pitch = droll = dpitch = lat = 0.f;
+        } else {
+            roll = 10.f * DEG_TO_RAD * sinf(w * 0.5f * t);
+            droll = 10.f * DEG_TO_RAD * w * 0.5f * cosf(w * 0.5f * t);
+            pitch = 8.f * DEG_TO_RAD * sinf(w * 0.3f * t + 1.f);
+            dpitch = 8.f * DEG_TO_RAD * w * 0.3f * cosf(w * 0.3f * t + 1.f);
+            lat = fmodf(t, 1.f) < 0.3f ? (fmodf(t, 2.f) < 1.f ? 4.f : -4.f) : 0.f;
+        }
+
+        // body rates of a roll then pitch rotation (yaw fixed)
+        s->in.dt = dt;
+        s->in.gyr.x = droll * RAD_TO_DEG + 0.3f + noise(1.f);
+        s->in.gyr.y = dpitch * cosf(roll) * RAD_TO_DEG - 0.2f + noise(1.f);
+        s->in.gyr.z = -dpitch * sinf(roll) * RAD_TO_DEG + noise(1.f);
+
+        s->in.acc.x = -G_ACCL * sinf(pitch) + noise(t < 2.f ? 0.05f : 1.5f);
+        s->in.acc.y = G_ACCL * sinf(roll) * cosf(pitch) + lat + noise(t < 2.f ? 0.05f : 1.5f);
+        s->in.acc.z = G_ACCL * cosf(roll) * cosf(pitch) + noise(t < 2.f ? 0.05f : 1.5f);
+        s->in.rest = t < 2.f;
+
+        s->truth = true;
+        s->roll = roll * RAD_TO_DEG;
+        s->pitch = pitch * RAD_TO_DEG;
+    }
+}
+
+static int load(const char *path) {
+    FILE *f = fopen(path, "r");
+    struct sample s;
+    char line[256];
+    int rest, n;
+    size_t cap = 0;
+
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        n = sscanf(line, "%f,%f,%f,%f,%f,%f,%f,%d,%f,%f", &s.in.dt, &s.in.acc.x, &s.in.acc.y, &s.in.acc.z,
+                   &s.in.gyr.x, &s.in.gyr.y, &s.in.gyr.z, &rest, &s.roll, &s.pitch);
+        if (n < 7)
+            continue; // header/comments
+
+        s.in.rest = n >= 8 && rest;
+        s.truth = n >= 10;
+
+        if (sample_count == cap) {
+            cap = cap ? cap * 2 : 4096;
+            samples = realloc(samples, cap * sizeof(*samples));
+        }
+        samples[sample_count++] = s;
+    }
+
+    fclose(f);
+    return sample_count ? 0 : -1;
+}
+
+/* deg between the gravity vectors of two roll/pitch pairs */
+static float tilt_error(float roll0, float pitch0, float roll1, float pitch1) {
+    float r0 = roll0 * DEG_TO_RAD, p0 = pitch0 * DEG_TO_RAD, r1 = roll1 * DEG_TO_RAD, p1 = pitch1 * DEG_TO_RAD;
+    float dot = sinf(p0) * sinf(p1) + sinf(r0) * cosf(p0) * sinf(r1) * cosf(p1) +
+                cosf(r0) * cosf(p0) * cosf(r1) * cosf(p1);
+
+    return acosf(fminf(fmaxf(dot, -1.f), 1.f)) * RAD_TO_DEG;
+}
+
+static double now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+    struct estimator est;
+    vec3f_t rpy;
+    double start, ns, sum;
+    float err, max, t;
+    size_t i, n;
+    int type, failed = 0;
+#ifdef HAS_TSC
+    unsigned long long cycles;
+#endif
+
+    if (argc > 1) {
+        if (load(argv[1])) {
+            fprintf(stderr, "no samples in %s\n", argv[1]);
+            return 1;
+        }
+    } else {
+        synthesize();
+    }
+
+    printf("%zu samples\n", sample_count);
+    printf("%-14s %10s %10s %12s %12s\n", "estimator", "ns/update", "cyc/update", "rms error", "max error");
+
+    for (type = 0; type < ESTIMATOR_COUNT; type++) {
+        // cost, updates only
+        estimator_select(&est, type, &samples[0].in.acc);
+        est.adaptive = true;
+        start = now_ns();
+#ifdef HAS_TSC
+        cycles = __rdtsc();
+#endif
+        for (i = 0; i < sample_count; i++)
+            estimator_update(&est, &samples[i].in);
+#ifdef HAS_TSC
+        cycles = __rdtsc() - cycles;
+#endif
+        ns = (now_ns() - start) / sample_count;
+
+        // accuracy
+        estimator_select(&est, type, &samples[0].in.acc);
+        est.adaptive = true;
+        sum = max = 0.f;
+        t = 0.f;
+        n = 0;
+        for (i = 0; i < sample_count; i++) {
+            estimator_update(&est, &samples[i].in);
+            t += samples[i].in.dt;
+
+            if (!samples[i].truth || t < SETTLE)
+                continue;
+
+            estimator_angle(&est, &rpy);
+            err = tilt_error(rpy.x, rpy.y, samples[i].roll, samples[i].pitch);
+            sum += err * err;
+            max = fmaxf(max, err);
+            n++;
+        }
+
+        printf("%-14s %10.1f ", estimators[type]->name, ns);
+#ifdef HAS_TSC
+        printf("%10.0f ", (double) cycles / sample_count);
+#else
+        printf("%10s ", "-");
+#endif
+        if (n) {
+            printf("%8.2f deg %8.2f deg\n", sqrt(sum / n), max);
+            if (argc <= 1 && sqrt(sum / n) > max_rms[type]) {
+                fprintf(stderr, "%s: rms error over %.1f deg\n", estimators[type]->name, max_rms[type]);
+                failed = 1;
+            }
+        } else {
+            printf("%12s %12s\n", "-", "-");
+        }
+    }
+
+    free(samples);
+    return failed;
+}
@@ -0,0 +1,173 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Time-to-ready of the registry, reg_init() on the host's file backed nvs
+ * (nvs_file.c) against the per-key layout it replaced. Every case starts from
+ * a freshly written partition file:
+ *
+ *   first   empty partition, every default gets written
+ *   boot    partition as left by a previous boot
+ *   migrate partition in the per-key layout (the first boot after updating)
+ *
+ *   bench_registry [iterations]
+ *
+ * The host's nvs rewrites the whole file on every commit where the esp32 writes
+ * a flash page, only the counts of nvs calls carry over to the quad, the us
+ * show their relative cost. On the quad the "registry" stage of the boot
+ * timeline has the real figure.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hackquad/registry.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+
+#define BENCH_FILE   "bench_registry_nvs.bin"
+#define NVS_NAMESPACE "hq_registry"
+
+static s64 now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (s64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int cmp_s64(const void *a, const void *b) {
+    s64 x = *(const s64 *) a, y = *(const s64 *) b;
+
+    return (x > y) - (x < y);
+}
+
+static esp_err_t legacy_write(nvs_handle_t handle, struct reg_entry *entry) {
+    switch (entry->type) {
+        default:
+            return ESP_FAIL;
+        case REG_8B:
+            return nvs_set_u8(handle, entry->key_hash_str, *(u8 *) entry->location);
+        case REG_16B:
+            return nvs_set_u16(handle, entry->key_hash_str, *(u16 *) entry->location);
+        case REG_32B:
+        case REG_FLT:
+            return nvs_set_u32(handle, entry->key_hash_str, *(u32 *) entry->location);
+        case REG_64B:
+            return nvs_set_u64(handle, entry->key_hash_str, *(u64 *) entry->location);
+        case REG_STR:
+            return nvs_set_str(handle, entry->key_hash_str, entry->location);
+    }
+}
+
+static esp_err_t legacy_read(nvs_handle_t handle, struct reg_entry *entry) {
+    size_t size;
+
+    switch (entry->type) {
+        default:
+            return ESP_FAIL;
+        case REG_8B:
+            return nvs_get_u8(handle, entry->key_hash_str, entry->location);
+        case REG_16B:
+            return nvs_get_u16(handle, entry->key_hash_str, entry->location);
+        case REG_32B:
+        case REG_FLT:
+            return nvs_get_u32(handle, entry->key_hash_str, entry->location);
+        case REG_64B:
+            return nvs_get_u64(handle, entry->key_hash_str, entry->location);
+        case REG_STR:
+            size = entry->size;
+            return nvs_get_str(handle, entry->key_hash_str, entry->location, &size);
+    }
+}
+
+/* the old reg_init(), an open + read per entry and an open + write + commit per missing one */
+static void legacy_init() {
+    nvs_handle_t handle;
+    esp_err_t ret;
+    size_t i;
+
+    nvs_flash_init();
+    for (i = 0; i < registry_len; i++) {
+        if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle))
+            continue;
+        ret = legacy_read(handle, &registry[i]);
+        nvs_close(handle);
+
+        if (ret && !nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle)) {
+            if (!legacy_write(handle, &registry[i]))
+                nvs_commit(handle);
+            nvs_close(handle);
+        }
+    }
+}
+
+/* partition in the state a case starts from */
+enum layout { EMPTY, LEGACY, BLOB };
+
+static void prepare(enum layout layout) {
+    remove(BENCH_FILE);
+    nvs_flash_init();
+
+    if (layout == LEGACY)
+        legacy_init();
+    else if (layout == BLOB)
+        reg_init();
+}
+
+static void bench(const char *name, enum layout layout, void (*init)(), int iterations) {
+    s64 *took, start;
+    int i;
+
+    took = malloc(sizeof(*took) * iterations);
+
+    for (i = 0; i < iterations; i++) {
+        prepare(layout);
+
+        start = now_ns();
+        init();
+        took[i] = now_ns() - start;
+    }
+
+    qsort(took, iterations, sizeof(*took), cmp_s64);
+    printf("%-16s n=%-5d min %8.1f us | p50 %8.1f us | max %8.1f us\n", name, iterations, took[0] * 1e-3,
+           took[iterations / 2] * 1e-3, took[iterations - 1] * 1e-3);
+
+    free(took);
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+
+    if (iterations <= 0)
+        iterations = 1;
+
+    nvs_file_set_path(BENCH_FILE);
+    printf("%zu registry entries\n", registry_len);
+
+    bench("per-key first", EMPTY, legacy_init, iterations);
+    bench("per-key boot", LEGACY, legacy_init, iterations);
+    bench("blob first", EMPTY, reg_init, iterations);
+    bench("blob boot", BLOB, reg_init, iterations);
+    bench("blob migrate", LEGACY, reg_init, iterations);
+
+    remove(BENCH_FILE);
+    return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Round trip latency of the control link framing per transport, measured with
+ * HQLINK_PING_ID frames the quad side echoes back.
+ *
+ *   bench_transport [iterations]
+ *
+ * Only loopback (framing + thread handoff) and udp over the host's loopback
+ * interface can run here, esp-now needs two esp32s. On the quad, the same
+ * pings can be sent over each CTRL_TRANSPORT to compare them on real radios.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hackquad/transport.h"
+#include "hackquad/loopback.h"
+#include "hackquad/udpserver.h"
+
+#define PING_SIZE 20 /* about the size of a control frame */
+
+static void null_handler(int id, u8 *data, size_t len) {
+    (void) id;
+    (void) data;
+    (void) len;
+}
+
+static void *link_thread(void *arg) {
+    struct hq_link *link = arg;
+
+    // runs until the process exits
+    for (;;)
+        hq_link_yield(link);
+
+    return NULL;
+}
+
+static s64 now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (s64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int cmp_s64(const void *a, const void *b) {
+    s64 x = *(const s64 *) a, y = *(const s64 *) b;
+
+    return (x > y) - (x < y);
+}
+
+static void bench(const char *name, struct hq_transport *peer, int iterations) {
+    u8 buf[HQLINK_BUFFER_SIZE];
+    s64 *rtt, start;
+    u32 nonce;
+    int i, lost = 0;
+
+    rtt = malloc(sizeof(*rtt) * iterations);
+
+    for (i = 0; i < iterations; i++) {
+        nonce = i & 0xFFFFFF;
+        memset(buf, 0, PING_SIZE);
+        buf[0] = HQLINK_PING_ID;
+        buf[1] = nonce;
+        buf[2] = nonce >> 8;
+        buf[3] = nonce >> 16;
+
+        start = now_ns();
+        peer->ops->send(peer, buf, PING_SIZE);
+        if (peer->ops->recv(peer, buf, sizeof(buf)) != PING_SIZE - 3 || buf[0] != HQLINK_PONG_ID)
+            lost++;
+        rtt[i] = now_ns() - start;
+    }
+
+    qsort(rtt, iterations, sizeof(*rtt), cmp_s64);
+    printf("%-9s n=%-7d min %7.1f us | p50 %7.1f us | p99 %7.1f us | max %8.1f us | lost %d\n", name, iterations,
+           rtt[0] * 1e-3, rtt[iterations / 2] * 1e-3, rtt[iterations * 99 / 100] * 1e-3, rtt[iterations - 1] * 1e-3,
+           lost);
+
+    free(rtt);
+}
+
+struct udp_peer {
+    struct hq_transport transport;
+    int sock;
+    struct sockaddr_in quad;
+};
+
+static ssize_t udp_peer_recv(struct hq_transport *transport, u8 *buf, size_t len) {
+    return recv(((struct udp_peer *) transport)->sock, buf, len, 0);
+}
+
+static ssize_t udp_peer_send(struct hq_transport *transport, const u8 *data, size_t len) {
+    struct udp_peer *peer = (struct udp_peer *) transport;
+
+    return sendto(peer->sock, data, len, 0, (struct sockaddr *) &peer->quad, sizeof(peer->quad));
+}
+
+static const struct hq_transport_ops udp_peer_ops = {
+        .name = "udp peer",
+        .mtu  = HQLINK_BUFFER_SIZE,
+        .recv = udp_peer_recv,
+        .send = udp_peer_send
+};
+
+int main(int argc, char **argv) {
+    static struct loopback_pair pair;
+    static struct hq_link link, udp_link;
+    static struct udp_context udp_ctx;
+    struct udp_peer udp_peer;
+    int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+    socklen_t addrlen;
+    pthread_t thread;
+
+    if (iterations <= 0)
+        iterations = 1;
+
+    loopback_create(&pair);
+    link.transport = &pair.a.transport;
+    link.recv_handler = null_handler;
+    pthread_create(&thread, NULL, link_thread, &link);
+    pthread_detach(thread);
+
+    if (udp_create(&udp_ctx, IPADDR_LOOPBACK, 0))
+        return 1;
+
+    udp_link.transport = &udp_ctx.transport;
+    udp_link.recv_handler = null_handler;
+    pthread_create(&thread, NULL, link_thread, &udp_link);
+    pthread_detach(thread);
+
+    udp_peer.transport.ops = &udp_peer_ops;
+    udp_peer.sock = socket(AF_INET, SOCK_DGRAM, 0);
+    addrlen = sizeof(udp_peer.quad);
+    getsockname(udp_ctx.sock, (struct sockaddr *) &udp_peer.quad, &addrlen);
+
+    bench("loopback", &pair.b.transport, iterations);
+    bench("udp", &udp_peer.transport, iterations);
+    return 0;
+}
@@ -0,0 +1,402 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Minimal blocking stand-in for esp_http_server on posix sockets, enough to run
+ * httpserver.c unchanged on the host. Like the esp32's it serves one request at
+ * a time from a single thread, matches uris exactly (query ignored) and closes
+ * the connection after every response.
+ */
+
+#define _GNU_SOURCE /* pthread_setname_np */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+
+#include "esp_http_server.h"
+#include "esp_log.h"
+
+#define TAG "httpd"
+
+uint16_t httpd_default_port = 80;
+
+struct httpd_server {
+    httpd_config_t config;
+    httpd_uri_t *handlers;
+    size_t handlers_len;
+    int fd;
+    volatile int running;
+    pthread_t thread;
+};
+
+/* per request state, behind httpd_req_t.aux */
+struct httpd_req_aux {
+    int fd;
+    const char *body;      /* part of the body read along with the headers */
+    size_t body_len;
+    size_t remaining;      /* body bytes not yet returned by httpd_req_recv() */
+    const char *type;
+    const char *status;
+    int chunked;           /* 1 once chunked headers went out, 2 after the last chunk */
+    int sent;
+};
+
+static const char *const methods[] = {"DELETE", "GET", "HEAD", "POST", "PUT"};
+
+static int send_all(int fd, const char *buf, size_t len) {
+    ssize_t n;
+
+    while (len) {
+        n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n <= 0)
+            return -1;
+
+        buf += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+static esp_err_t send_head(httpd_req_t *r, const char *status, ssize_t len) {
+    struct httpd_req_aux *aux = r->aux;
+    char head[256];
+    int n;
+
+    if (len < 0) {
+        n = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\n"
+                                         "Connection: close\r\n\r\n", status, aux->type);
+    } else {
+        n = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zd\r\n"
+                                         "Connection: close\r\n\r\n", status, aux->type, len);
+    }
+
+    aux->sent = 1;
+    return send_all(aux->fd, head, n) ? ESP_ERR_HTTPD_RESP_SEND : ESP_OK;
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len) {
+    struct httpd_req_aux *aux = r->aux;
+    ssize_t n;
+
+    if (buf_len > aux->remaining)
+        buf_len = aux->remaining;
+    if (!buf_len)
+        return 0;
+
+    if (aux->body_len) {
+        n = buf_len < aux->body_len ? buf_len : aux->body_len;
+        memcpy(buf, aux->body, n);
+        aux->body += n;
+        aux->body_len -= n;
+    } else {
+        n = recv(aux->fd, buf, buf_len, 0);
+        if (n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+
+    aux->remaining -= n;
+    return n;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type) {
+    ((struct httpd_req_aux *) r->aux)->type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status) {
+    ((struct httpd_req_aux *) r->aux)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    struct httpd_req_aux *aux = r->aux;
+
+    if (buf_len == HTTPD_RESP_USE_STRLEN)
+        buf_len = strlen(buf);
+
+    if (send_head(r, aux->status, buf_len) || send_all(aux->fd, buf, buf_len))
+        return ESP_ERR_HTTPD_RESP_SEND;
+
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    struct httpd_req_aux *aux = r->aux;
+    char size[16];
+    int n;
+
+    if (buf_len == HTTPD_RESP_USE_STRLEN)
+        buf_len = buf ? strlen(buf) : 0;
+
+    if (!aux->chunked) {
+        if (send_head(r, aux->status, -1))
+            return ESP_ERR_HTTPD_RESP_SEND;
+        aux->chunked = 1;
+    }
+
+    n = snprintf(size, sizeof(size), "%zx\r\n", buf_len);
+    if (send_all(aux->fd, size, n) || send_all(aux->fd, buf, buf_len) || send_all(aux->fd, "\r\n", 2))
+        return ESP_ERR_HTTPD_RESP_SEND;
+
+    // empty chunk ends the response
+    if (!buf_len)
+        aux->chunked = 2;
+
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg) {
+    struct httpd_req_aux *aux = req->aux;
+    const char *status;
+    size_t len = strlen(msg);
+
+    switch (error) {
+        case HTTPD_400_BAD_REQUEST:
+            status = "400 Bad Request";
+            break;
+        case HTTPD_404_NOT_FOUND:
+            status = "404 Not Found";
+            break;
+        case HTTPD_405_METHOD_NOT_ALLOWED:
+            status = "405 Method Not Allowed";
+            break;
+        case HTTPD_408_REQ_TIMEOUT:
+            status = "408 Request Timeout";
+            break;
+        default:
+            status = "500 Internal Server Error";
+            break;
+    }
+
+    aux->type = "text/html";
+    if (send_head(req, status, len) || send_all(aux->fd, msg, len))
+        return ESP_ERR_HTTPD_RESP_SEND;
+
+    return ESP_OK;
+}
+
+static const httpd_uri_t *find_handler(struct httpd_server *server, const char *uri, int method, int *uri_found) {
+    *uri_found = 0;
+
+    for (size_t i = 0; i < server->handlers_len; i++) {
+        if (strcmp(server->handlers[i].uri, uri))
+            continue;
+
+        *uri_found = 1;
+        if ((int) server->handlers[i].method == method)
+            return &server->handlers[i];
+    }
+
+    return NULL;
+}
+
+static void serve(struct httpd_server *server, int fd) {
+    char head[HTTPD_MAX_REQ_HDR_LEN + 1];
+    char *end = NULL, *line, *save, *field;
+    struct httpd_req_aux aux;
+    const httpd_uri_t *handler;
+    httpd_req_t req;
+    size_t len = 0, i;
+    ssize_t n;
+    int uri_found;
+
+    memset(&req, 0, sizeof(req));
+    memset(&aux, 0, sizeof(aux));
+    aux.fd = fd;
+    aux.type = "text/html";
+    aux.status = "200 OK";
+    req.aux = &aux;
+    req.handle = server;
+
+    // headers, body bytes read along with them are handed out first by httpd_req_recv()
+    while (!end && len < sizeof(head) - 1) {
+        n = recv(fd, head + len, sizeof(head) - 1 - len, 0);
+        if (n <= 0)
+            return;
+
+        len += n;
+        head[len] = '\0';
+        end = strstr(head, "\r\n\r\n");
+    }
+
+    if (!end) {
+        httpd_resp_send_err(&req, HTTPD_400_BAD_REQUEST, "Header fields are too long");
+        return;
+    }
+
+    *end = '\0';
+    aux.body = end + 4;
+    aux.body_len = head + len - aux.body;
+
+    line = strtok_r(head, "\r\n", &save);
+    field = line ? strchr(line, ' ') : NULL;
+    if (!field) {
+        httpd_resp_send_err(&req, HTTPD_400_BAD_REQUEST, "Bad request syntax");
+        return;
+    }
+
+    *field++ = '\0';
+    req.method = -1;
+    for (i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        if (!strcmp(line, methods[i]))
+            req.method = i;
+    }
+
+    // uri up to the query/version
+    len = strcspn(field, " ?");
+    if (len > HTTPD_MAX_URI_LEN) {
+        httpd_resp_send_err(&req, HTTPD_400_BAD_REQUEST, "URI is too long");
+        return;
+    }
+    memcpy((char *) req.uri, field, len);
+    ((char *) req.uri)[len] = '\0';
+
+    while ((line = strtok_r(NULL, "\r\n", &save))) {
+        if (!strncasecmp(line, "Content-Length:", 15))
+            req.content_len = strtoul(line + 15, NULL, 10);
+    }
+
+    aux.remaining = req.content_len;
+    if (aux.body_len > req.content_len)
+        aux.body_len = req.content_len;
+
+    handler = find_handler(server, req.uri, req.method, &uri_found);
+    if (!handler) {
+        if (uri_found)
+            httpd_resp_send_err(&req, HTTPD_405_METHOD_NOT_ALLOWED, "Request method for this URI is not handled by server");
+        else
+            httpd_resp_send_err(&req, HTTPD_404_NOT_FOUND, "Nothing matches the given URI");
+        return;
+    }
+
+    req.user_ctx = handler->user_ctx;
+    if (handler->handler(&req) != ESP_OK) {
+        ESP_LOGW(TAG, "handler of %s failed", req.uri);
+        return;
+    }
+
+    if (aux.chunked == 1)
+        httpd_resp_send_chunk(&req, NULL, 0);
+    else if (!aux.sent)
+        httpd_resp_send(&req, "", 0);
+}
+
+static void *server_thread(void *arg) {
+    struct httpd_server *server = arg;
+    struct timeval timeout;
+    int fd;
+
+    pthread_setname_np(pthread_self(), "httpd");
+
+    while (server->running) {
+        fd = accept(server->fd, NULL, NULL);
+        if (fd < 0)
+            continue;
+
+        timeout.tv_sec = server->config.recv_wait_timeout;
+        timeout.tv_usec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        timeout.tv_sec = server->config.send_wait_timeout;
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        serve(server, fd);
+        shutdown(fd, SHUT_WR);
+        close(fd);
+    }
+
+    return NULL;
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+    struct httpd_server *server;
+    struct sockaddr_in addr;
+    int one = 1;
+
+    server = calloc(1, sizeof(*server));
+    if (!server)
+        return ESP_ERR_NO_MEM;
+
+    server->config = *config;
+    server->handlers = calloc(config->max_uri_handlers, sizeof(httpd_uri_t));
+    server->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (!server->handlers || server->fd < 0)
+        goto fail;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(config->server_port);
+
+    setsockopt(server->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(server->fd, (struct sockaddr *) &addr, sizeof(addr)) || listen(server->fd, 8)) {
+        ESP_LOGE(TAG, "failed to listen on port %u, errno = %i", config->server_port, errno);
+        goto fail;
+    }
+
+    server->running = 1;
+    if (pthread_create(&server->thread, NULL, server_thread, server))
+        goto fail;
+
+    ESP_LOGI(TAG, "listening on port %u", config->server_port);
+    *handle = server;
+    return ESP_OK;
+
+fail:
+    if (server->fd >= 0)
+        close(server->fd);
+    free(server->handlers);
+    free(server);
+    return ESP_ERR_HTTPD_TASK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+    struct httpd_server *server = handle;
+
+    server->running = 0;
+    shutdown(server->fd, SHUT_RDWR);
+    pthread_join(server->thread, NULL);
+    close(server->fd);
+    free(server->handlers);
+    free(server);
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler) {
+    struct httpd_server *server = handle;
+    int uri_found;
+
+    if (find_handler(server, uri_handler->uri, uri_handler->method, &uri_found))
+        return ESP_ERR_HTTPD_HANDLER_EXISTS;
+
+    if (server->handlers_len == server->config.max_uri_handlers) {
+        ESP_LOGE(TAG, "no slots left for registering handler of %s", uri_handler->uri);
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+
+    server->handlers[server->handlers_len++] = *uri_handler;
+    return ESP_OK;
+}
@@ -0,0 +1,30 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* CHECK() for the host tests, counts failures in failed instead of stopping at the first */
+
+#ifndef HACKQUAD_HOST_CHECK_H
+#define HACKQUAD_HOST_CHECK_H
+
+#include <stdio.h>
+
+#define CHECK(x) do { if (!(x)) { fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #x); failed++; } } while (0)
+
+static int failed;
+
+#endif /* HACKQUAD_HOST_CHECK_H */
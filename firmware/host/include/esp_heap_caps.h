@@ -0,0 +1,46 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* host build stand-in for the esp-idf header, the host's heap grows on demand so there's nothing to report */
+
+#ifndef HACKQUAD_HOST_ESP_HEAP_CAPS_H
+#define HACKQUAD_HOST_ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_EXEC     (1 << 0)
+#define MALLOC_CAP_DMA      (1 << 3)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+static inline size_t heap_caps_get_free_size(uint32_t caps) {
+    (void) caps;
+    return 0;
+}
+
+static inline size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    (void) caps;
+    return 0;
+}
+
+static inline size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    (void) caps;
+    return 0;
+}
+
+#endif /* HACKQUAD_HOST_ESP_HEAP_CAPS_H */
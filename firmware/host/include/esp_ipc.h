@@ -0,0 +1,36 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* host build stand-in for the esp-idf header, there's one "core" to run on */
+
+#ifndef HACKQUAD_HOST_ESP_IPC_H
+#define HACKQUAD_HOST_ESP_IPC_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef void (*esp_ipc_func_t)(void *arg);
+
+static inline esp_err_t esp_ipc_call_blocking(uint32_t cpu_id, esp_ipc_func_t func, void *arg) {
+    (void) cpu_id;
+    func(arg);
+    return ESP_OK;
+}
+
+#endif /* HACKQUAD_HOST_ESP_IPC_H */
@@ -0,0 +1,43 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* host build stand-in, only what the shared headers reference */
+
+#ifndef HACKQUAD_HOST_FREERTOS_H
+#define HACKQUAD_HOST_FREERTOS_H
+
+#define portNUM_PROCESSORS 1
+#define portTICK_PERIOD_MS 1
+#define portMAX_DELAY      0xFFFFFFFFu
+#define pdTRUE             1
+#define pdFALSE            0
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+
+static inline int xPortGetCoreID() {
+    return 0;
+}
+
+/* no isrs on the host, everything runs in a thread */
+static inline int xPortInIsrContext() {
+    return 0;
+}
+
+#endif /* HACKQUAD_HOST_FREERTOS_H */
@@ -0,0 +1,51 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* host build stand-in, mutexes are pthread mutexes on the host */
+
+#ifndef HACKQUAD_HOST_FREERTOS_SEMPHR_H
+#define HACKQUAD_HOST_FREERTOS_SEMPHR_H
+
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct {
+    pthread_mutex_t mutex;
+} StaticSemaphore_t;
+
+typedef StaticSemaphore_t *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer) {
+    pthread_mutex_init(&buffer->mutex, NULL);
+    return buffer;
+}
+
+/* always waits, portMAX_DELAY is the only timeout used */
+static inline int xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    (void) ticks;
+    pthread_mutex_lock(&sem->mutex);
+    return pdTRUE;
+}
+
+static inline int xSemaphoreGive(SemaphoreHandle_t sem) {
+    pthread_mutex_unlock(&sem->mutex);
+    return pdTRUE;
+}
+
+#endif /* HACKQUAD_HOST_FREERTOS_SEMPHR_H */
@@ -0,0 +1,84 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* host build stand-in, only what the shared headers reference, tasks are pthreads on the host */
+
+#ifndef HACKQUAD_HOST_FREERTOS_TASK_H
+#define HACKQUAD_HOST_FREERTOS_TASK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef void *TaskHandle_t;
+typedef uint8_t StackType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef struct {
+    void *unused;
+} StaticTask_t;
+
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+typedef struct {
+    TaskHandle_t xHandle;
+    const char *pcTaskName;
+    uint32_t ulRunTimeCounter;  /* us */
+} TaskStatus_t;
+
+/* the process' threads with their cpu time, see task_stats.c */
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *status, UBaseType_t max, uint32_t *total);
+
+/* the calling thread's handle and its number (configUSE_TRACE_FACILITY), see task_stats.c */
+TaskHandle_t xTaskGetCurrentTaskHandle();
+UBaseType_t uxTaskGetTaskNumber(TaskHandle_t task);
+void vTaskSetTaskNumber(TaskHandle_t task, UBaseType_t number);
+
+static inline BaseType_t xTaskGetAffinity(TaskHandle_t task) {
+    (void) task;
+    return tskNO_AFFINITY;
+}
+
+/* nothing to look up by name or core, the virtual quad's threads aren't tasks */
+static inline TaskHandle_t xTaskGetHandle(const char *name) {
+    (void) name;
+    return NULL;
+}
+
+static inline TaskHandle_t xTaskGetIdleTaskHandleForCPU(unsigned int cpu) {
+    (void) cpu;
+    return NULL;
+}
+
+static inline char *pcTaskGetName(TaskHandle_t task) {
+    (void) task;
+    return "?";
+}
+
+static inline void vTaskDelay(uint32_t ticks) {
+    struct timespec ts = {.tv_sec = ticks / 1000, .tv_nsec = (ticks % 1000) * 1000000L};
+
+    nanosleep(&ts, NULL);
+}
+
+static inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    (void) task;
+    return 0;
+}
+
+#endif /* HACKQUAD_HOST_FREERTOS_TASK_H */
@@ -0,0 +1,38 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* host build stand-in, lwip's socket api is the posix one */
+
+#ifndef HACKQUAD_HOST_LWIP_SOCKETS_H
+#define HACKQUAD_HOST_LWIP_SOCKETS_H
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef IPADDR_ANY
+#define IPADDR_ANY        ((u32) 0x00000000UL)
+#endif
+
+#ifndef IPADDR_LOOPBACK
+#define IPADDR_LOOPBACK   ((u32) 0x7f000001UL)
+#endif
+
+#endif /* HACKQUAD_HOST_LWIP_SOCKETS_H */
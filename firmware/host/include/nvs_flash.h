@@ -0,0 +1,46 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* host build stand-in for the esp-idf header, the "partition" is a file, see host/nvs_file.c */
+
+#ifndef HACKQUAD_HOST_NVS_FLASH_H
+#define HACKQUAD_HOST_NVS_FLASH_H
+
+#include "esp_err.h"
+
+#define NVS_FILE_DEFAULT "hackquad_nvs.bin"
+
+/**
+ * Sets the file backing nvs, must be called before nvs_flash_init(). Defaults
+ * to NVS_FILE_DEFAULT in the working directory.
+ */
+void nvs_file_set_path(const char *path);
+
+/**
+ * Loads the file, a missing one is an empty partition.
+ *
+ * @return ESP_FAIL if the file exists but is corrupt
+ */
+esp_err_t nvs_flash_init();
+
+/**
+ * Drops every key and truncates the file.
+ */
+esp_err_t nvs_flash_erase();
+
+#endif /* HACKQUAD_HOST_NVS_FLASH_H */
@@ -0,0 +1,416 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Load and impairment sweep of the udp control path, against the virtual quad
+ * (vquad.h) in this process over the host's loopback interface. Every point
+ * sends control packets at a rate (0 = as fast as the socket takes them)
+ * through a set of impairments:
+ *
+ *   loss    fraction lost, in bursts of mean length burst (gilbert-elliott)
+ *   dup     fraction sent twice
+ *   reorder fraction held back and sent after the next packet
+ *   trunc   fraction cut at a random length
+ *
+ * and reports what the quad made of them:
+ *
+ *   proc/s   control packets handled per second
+ *   dropped  frames the link dropped (short header, too long, old/repeated nonce)
+ *   reject   frames with a payload too short for their id
+ *   stale    times the shaper leveled the quad out for lack of packets
+ *   age      ms, longest gap between packets the shaper saw
+ *   lost     gaps in the controller timestamps the shaper saw, the ms timestamps
+ *            make it count jitter as loss past a few hundred packets/s
+ *   cpu      % of one core used by the quad (link, sim and status threads)
+ *
+ *   load_link [seconds per point]
+ *   load_link --check    short sweep that fails on regressions, run by ctest
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "vquad.h"
+#include "hackquad/ctrllink.h"
+#include "hackquad/hackquad_msg.h"
+#include "hackquad/transport.h"
+#include "esp_timer.h"
+#include "check.h"
+
+#define CONTROL_SIZE 24    /* header + 4 floats + timestamp */
+#define FLOOD_BATCH  64    /* packets sent per clock read when flooding */
+
+struct impair {
+    float loss, burst;
+    float dup, reorder, trunc;
+};
+
+struct point {
+    u32 rate;  /* packets/s, 0 = flood */
+    struct impair imp;
+};
+
+struct result {
+    u32 generated;  /* control packets made */
+    u32 datagrams;  /* actually sent, after loss/dup */
+    u32 impaired;   /* dup'd + reordered + truncated */
+    struct ctrllink_stats link;
+    struct setpoint_stats sp;
+    float seconds;
+    float cpu;      /* % of one core */
+};
+
+/* impairment state of a run */
+struct gen {
+    bool bad;
+    bool holding;
+    u8 held[CONTROL_SIZE];
+    size_t held_len;
+};
+
+static int sock;
+static u32 nonce;
+static u64 rng;
+
+static float frand() {
+    // xorshift64*, reseeded by every run so points don't depend on the ones before
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return ((rng * 0x2545F4914F6CDD1DULL) >> 40) / 16777216.f;
+}
+
+static u64 cpu_us(int who) {
+    struct timespec ts;
+
+    clock_gettime(who, &ts);
+    return (u64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void put_header(u8 *buf, u8 id, u32 n) {
+    buf[0] = id;
+    buf[1] = n;
+    buf[2] = n >> 8;
+    buf[3] = n >> 16;
+}
+
+static u32 next_nonce() {
+    // 0 would re-prime the order in the middle of a run
+    if (++nonce > 0xFFFFFF)
+        nonce = 1;
+
+    return nonce;
+}
+
+static void make_control(u8 *buf, u32 n) {
+    float values[4] = {0.5f, sinf(n * 0.05f) * 20.f, 5.f, 0.f};
+    u32 ms = esp_timer_get_time() / 1000;
+
+    put_header(buf, CTRLLINK_CONTROL_ID, next_nonce());
+    memcpy(buf + 4, values, sizeof(values));
+    memcpy(buf + 20, &ms, sizeof(ms));
+}
+
+static void send_datagram(struct result *res, const u8 *buf, size_t len) {
+    // a full socket buffer is what flooding is about, not an error
+    if (send(sock, buf, len, 0) > 0)
+        res->datagrams++;
+}
+
+/* one generated packet through the impairments */
+static void impair_send(const struct impair *imp, struct result *res, struct gen *gen) {
+    u8 buf[CONTROL_SIZE];
+    size_t len = CONTROL_SIZE;
+
+    make_control(buf, res->generated++);
+
+    // gilbert-elliott, bad state loses everything, mean burst length sets how long it lasts
+    if (imp->loss > 0.f) {
+        if (gen->bad)
+            gen->bad = frand() >= 1.f / imp->burst;
+        else
+            gen->bad = frand() < imp->loss / (imp->burst * (1.f - imp->loss));
+
+        if (gen->bad)
+            return;
+    }
+
+    if (frand() < imp->trunc) {
+        len = 1 + (size_t) (frand() * (CONTROL_SIZE - 1));
+        res->impaired++;
+    }
+
+    if (!gen->holding && frand() < imp->reorder) {
+        memcpy(gen->held, buf, len);
+        gen->held_len = len;
+        gen->holding = true;
+        res->impaired++;
+        return;
+    }
+
+    send_datagram(res, buf, len);
+    if (frand() < imp->dup) {
+        send_datagram(res, buf, len);
+        res->impaired++;
+    }
+
+    if (gen->holding) {
+        send_datagram(res, gen->held, gen->held_len);
+        gen->holding = false;
+    }
+}
+
+/* waits for every datagram sent so far to have gone through the link */
+static void link_sync() {
+    u8 buf[HQLINK_BUFFER_SIZE];
+    s64 until = esp_timer_get_time() + 500000;
+    struct timespec poll = {0, 1000000};
+
+    put_header(buf, HQLINK_PING_ID, next_nonce());
+    send(sock, buf, 4, 0);
+
+    while (esp_timer_get_time() < until) {
+        if (recv(sock, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+            if (buf[0] == HQLINK_PONG_ID)
+                return;
+        } else {
+            nanosleep(&poll, NULL);
+        }
+    }
+}
+
+static void run(const struct point *p, float seconds, struct result *res) {
+    struct ctrllink_stats before;
+    struct setpoint_stats sp_before;
+    struct gen gen;
+    u64 start, now, end, proc_cpu, gen_cpu;
+    u32 due, i;
+    struct timespec tick = {0, 1000000};
+
+    memset(res, 0, sizeof(*res));
+    memset(&gen, 0, sizeof(gen));
+    rng = 0x9e3779b97f4a7c15ULL;
+    link_sync();
+    ctrllink_get_stats(&before);
+    setpoint_stats_reset(&ctrl_setpoint);
+    sp_before = ctrl_setpoint.stats;
+
+    proc_cpu = cpu_us(CLOCK_PROCESS_CPUTIME_ID);
+    gen_cpu = cpu_us(CLOCK_THREAD_CPUTIME_ID);
+
+    start = esp_timer_get_time();
+    end = start + (u64) (seconds * 1e6f);
+    while ((now = esp_timer_get_time()) < end) {
+        if (!p->rate) {
+            for (i = 0; i < FLOOD_BATCH; i++)
+                impair_send(&p->imp, res, &gen);
+            continue;
+        }
+
+        // everything due by now, then sleep a tick. High rates go out in 1ms bursts
+        due = (u32) ((now - start) * p->rate / 1000000);
+        while (res->generated < due)
+            impair_send(&p->imp, res, &gen);
+
+        nanosleep(&tick, NULL);
+    }
+
+    res->seconds = (esp_timer_get_time() - start) / 1e6f;
+
+    // staleness as of the end of sending, the sync below is a gap of its own
+    res->sp = ctrl_setpoint.stats;
+    res->sp.packets -= sp_before.packets;
+    res->sp.lost -= sp_before.lost;
+    res->sp.late -= sp_before.late;
+    res->sp.stale -= sp_before.stale;
+    res->sp.failsafe -= sp_before.failsafe;
+
+    // the process minus this (sending) thread
+    proc_cpu = cpu_us(CLOCK_PROCESS_CPUTIME_ID) - proc_cpu;
+    gen_cpu = cpu_us(CLOCK_THREAD_CPUTIME_ID) - gen_cpu;
+    res->cpu = proc_cpu > gen_cpu ? (proc_cpu - gen_cpu) / (res->seconds * 1e4f) : 0.f;
+
+    link_sync();
+    ctrllink_get_stats(&res->link);
+    res->link.control -= before.control;
+    res->link.dropped -= before.dropped;
+    res->link.rejected -= before.rejected;
+    res->link.regbatch -= before.regbatch;
+    res->link.unknown -= before.unknown;
+}
+
+static void print_header() {
+    printf("%6s %5s %5s %5s %5s %5s | %8s %8s %9s %7s %7s %5s %6s %5s %6s\n", "rate", "loss", "burst", "dup", "reord",
+           "trunc", "sent", "proc/s", "delivered", "dropped", "reject", "stale", "age", "lost", "cpu");
+}
+
+static void print_result(const struct point *p, const struct result *r) {
+    char rate[16];
+
+    if (p->rate)
+        snprintf(rate, sizeof(rate), "%u", (unsigned) p->rate);
+    else
+        snprintf(rate, sizeof(rate), "flood");
+
+    printf("%6s %4.0f%% %5.1f %4.0f%% %4.0f%% %4.0f%% | %8u %8.0f %8.1f%% %7u %7u %5u %4.0fms %5u %5.1f%%\n", rate,
+           p->imp.loss * 100.f, p->imp.burst, p->imp.dup * 100.f, p->imp.reorder * 100.f, p->imp.trunc * 100.f,
+           (unsigned) r->datagrams, r->link.control / r->seconds,
+           r->datagrams ? 100.f * r->link.control / r->datagrams : 0.f, (unsigned) r->link.dropped,
+           (unsigned) r->link.rejected, (unsigned) r->sp.stale, r->sp.age_max / 1000.f, (unsigned) r->sp.lost, r->cpu);
+    fflush(stdout);
+}
+
+/* sweep of rate x loss x reorder, then duplication/truncation on their own */
+static void sweep(float seconds) {
+    static const u32 rates[] = {50, 500, 5000, 0};
+    static const struct impair losses[] = {{.loss = 0, .burst = 1}, {.loss = 0.05f, .burst = 1},
+                                          {.loss = 0.2f, .burst = 5}};
+    static const float reorders[] = {0, 0.1f};
+    static const struct point extra[] = {
+            {50,  {0, 1, 0.1f, 0, 0}},
+            {500, {0, 1, 0.1f, 0, 0}},
+            {50,  {0, 1, 0, 0, 0.1f}},
+            {500, {0, 1, 0, 0, 0.1f}},
+            {500, {0.05f, 3, 0.05f, 0.05f, 0.05f}},
+    };
+    struct point p;
+    struct result r;
+    size_t i, j, k;
+
+    print_header();
+    for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        for (j = 0; j < sizeof(losses) / sizeof(losses[0]); j++) {
+            for (k = 0; k < sizeof(reorders) / sizeof(reorders[0]); k++) {
+                p.rate = rates[i];
+                p.imp = losses[j];
+                p.imp.reorder = reorders[k];
+                run(&p, seconds, &r);
+                print_result(&p, &r);
+            }
+        }
+    }
+
+    for (i = 0; i < sizeof(extra) / sizeof(extra[0]); i++) {
+        run(&extra[i], seconds, &r);
+        print_result(&extra[i], &r);
+    }
+}
+
+/*
+ * Below a few thousand packets/s nothing is lost on the loopback interface, so
+ * every datagram has to be accounted for: handled, dropped by the framing or
+ * rejected by the handler. Anything else is a regression.
+ */
+static void check() {
+    const struct point clean = {50, {0, 1, 0, 0, 0}};
+    const struct point dup = {500, {0, 1, 0.2f, 0, 0}};
+    const struct point reorder = {500, {0, 1, 0, 0.2f, 0}};
+    const struct point trunc = {500, {0, 1, 0, 0, 0.2f}};
+    const struct point bursts = {50, {0.5f, 10, 0, 0, 0}};
+    const struct point flood = {0, {0, 1, 0, 0, 0}};
+    struct result r;
+
+    print_header();
+
+    run(&clean, 0.5f, &r);
+    print_result(&clean, &r);
+    CHECK(r.link.control == r.datagrams);
+    CHECK(r.link.dropped == 0 && r.link.rejected == 0);
+    CHECK(r.sp.stale == 0 && r.sp.lost == 0);
+
+    // every copy after the first is old news
+    run(&dup, 0.5f, &r);
+    print_result(&dup, &r);
+    CHECK(r.link.control == r.generated);
+    CHECK(r.link.dropped == r.datagrams - r.generated);
+
+    // held back packets arrive after a newer one and are dropped
+    run(&reorder, 0.5f, &r);
+    print_result(&reorder, &r);
+    CHECK(r.link.dropped > 0);
+    CHECK(r.link.control + r.link.dropped == r.datagrams);
+
+    // cut into the header: dropped, into the payload: rejected, past the floats: handled without timestamp
+    run(&trunc, 0.5f, &r);
+    print_result(&trunc, &r);
+    CHECK(r.link.dropped > 0 && r.link.rejected > 0);
+    CHECK(r.link.control + r.link.dropped + r.link.rejected == r.datagrams);
+
+    // 200ms bursts are longer than CTRL_STALE
+    run(&bursts, 1.f, &r);
+    print_result(&bursts, &r);
+    CHECK(r.sp.lost > 0);
+    CHECK(r.sp.stale > 0);
+    CHECK(r.link.control == r.datagrams);
+
+    // only has to survive, what gets through depends on the machine
+    run(&flood, 0.2f, &r);
+    print_result(&flood, &r);
+    CHECK(r.link.control > 0);
+    CHECK(r.link.control + r.link.dropped <= r.datagrams);
+}
+
+int main(int argc, char **argv) {
+    struct vquad_conf conf = {0, 0, "load_link.bin"};
+    struct sockaddr_in addr;
+    int rcvbuf = 1 << 20;
+    u8 prime[4];
+    bool checking = argc > 1 && !strcmp(argv[1], "--check");
+    float seconds = argc > 1 && !checking ? strtof(argv[1], NULL) : 2.f;
+
+    if (seconds <= 0.f)
+        seconds = 2.f;
+
+    remove(conf.nvs_path);
+    if (vquad_start(&conf)) {
+        fprintf(stderr, "failed to start virtual quad\n");
+        return 1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(vquad_udp_port());
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    connect(sock, (struct sockaddr *) &addr, sizeof(addr));
+
+    // nonce 0 primes the quad's order
+    put_header(prime, HQLINK_PING_ID, 0);
+    send(sock, prime, 4, 0);
+
+    if (checking)
+        check();
+    else
+        sweep(seconds);
+
+    remove(conf.nvs_path);
+    if (failed)
+        fprintf(stderr, "%d check(s) failed\n", failed);
+
+    return failed != 0;
+}
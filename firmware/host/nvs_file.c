@@ -0,0 +1,440 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File backed stand-in for nvs, so registry.c runs unchanged on the host. The
+ * whole partition is kept in memory, nvs_set_*() and nvs_erase_key() only change
+ * that copy. The file is rewritten (to a temp file + rename) on nvs_commit() and
+ * nvs_flash_erase(), anything set since the last commit is lost on exit. Unlike
+ * the esp32, where sets already reach flash and nvs_commit() is all but a no-op.
+ *
+ * | magic u32 | record[] | crc u32 |
+ * record = | namespace_len u8 | namespace | key_len u8 | key | len u32 | value[len] |
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+#define TAG "nvs_file"
+
+#define NVS_FILE_MAGIC   0x564e5148 /* "HQNV" */
+#define NVS_KEY_NAME_MAX 16         /* incl. terminator, as on the esp32 */
+#define NVS_MAX_NS       16
+#define NVS_READONLY_BIT 0x100
+
+struct nvs_item {
+    char ns[NVS_KEY_NAME_MAX];
+    char key[NVS_KEY_NAME_MAX];
+    uint8_t *value;
+    size_t len;
+};
+
+static pthread_mutex_t nvs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static const char *nvs_path = NVS_FILE_DEFAULT;
+static int nvs_ready;
+
+static struct nvs_item *items;
+static size_t items_len, items_cap;
+
+static char namespaces[NVS_MAX_NS][NVS_KEY_NAME_MAX];
+
+void nvs_file_set_path(const char *path) {
+    nvs_path = path;
+}
+
+static void nvs_clear() {
+    for (size_t i = 0; i < items_len; i++)
+        free(items[i].value);
+
+    items_len = 0;
+}
+
+static struct nvs_item *nvs_find(const char *ns, const char *key) {
+    for (size_t i = 0; i < items_len; i++) {
+        if (!strcmp(items[i].ns, ns) && !strcmp(items[i].key, key))
+            return &items[i];
+    }
+
+    return NULL;
+}
+
+static esp_err_t nvs_put(const char *ns, const char *key, const void *value, size_t len) {
+    struct nvs_item *item = nvs_find(ns, key);
+    uint8_t *copy;
+
+    if (strlen(key) >= NVS_KEY_NAME_MAX)
+        return ESP_ERR_NVS_INVALID_LENGTH;
+
+    copy = malloc(len ? len : 1);
+    if (!copy)
+        return ESP_ERR_NO_MEM;
+    memcpy(copy, value, len);
+
+    if (!item) {
+        if (items_len == items_cap) {
+            size_t cap = items_cap ? items_cap * 2 : 32;
+            struct nvs_item *grown = realloc(items, cap * sizeof(*items));
+
+            if (!grown) {
+                free(copy);
+                return ESP_ERR_NO_MEM;
+            }
+
+            items = grown;
+            items_cap = cap;
+        }
+
+        item = &items[items_len++];
+        strcpy(item->ns, ns);
+        strcpy(item->key, key);
+        item->value = NULL;
+    }
+
+    free(item->value);
+    item->value = copy;
+    item->len = len;
+    return ESP_OK;
+}
+
+/* reads a length prefixed name, returns bytes consumed or 0 if it doesn't fit */
+static size_t nvs_read_name(const uint8_t *data, size_t len, char *out) {
+    if (len < 1 || data[0] >= NVS_KEY_NAME_MAX || len - 1 < data[0])
+        return 0;
+
+    memcpy(out, data + 1, data[0]);
+    out[data[0]] = '\0';
+    return 1 + data[0];
+}
+
+static esp_err_t nvs_load(const uint8_t *data, size_t len) {
+    char ns[NVS_KEY_NAME_MAX], key[NVS_KEY_NAME_MAX];
+    const uint8_t *end;
+    uint32_t magic, crc, vlen;
+    size_t used;
+
+    if (len < 8)
+        return ESP_FAIL;
+
+    memcpy(&magic, data, sizeof(magic));
+    memcpy(&crc, data + len - 4, sizeof(crc));
+    if (magic != NVS_FILE_MAGIC || esp_rom_crc32_le(0, data, len - 4) != crc)
+        return ESP_FAIL;
+
+    end = data + len - 4;
+    data += 4;
+    while (data < end) {
+        if (!(used = nvs_read_name(data, end - data, ns)))
+            return ESP_FAIL;
+        data += used;
+
+        if (!(used = nvs_read_name(data, end - data, key)))
+            return ESP_FAIL;
+        data += used;
+
+        if (end - data < 4)
+            return ESP_FAIL;
+        memcpy(&vlen, data, sizeof(vlen));
+        data += 4;
+
+        if ((size_t) (end - data) < vlen)
+            return ESP_FAIL;
+
+        if (nvs_put(ns, key, data, vlen))
+            return ESP_ERR_NO_MEM;
+        data += vlen;
+    }
+
+    return ESP_OK;
+}
+
+/* writes the whole partition, caller holds nvs_mutex */
+static esp_err_t nvs_store() {
+    char tmp[4096];
+    uint32_t magic = NVS_FILE_MAGIC, crc, vlen;
+    uint8_t *buf, *wr, nlen;
+    size_t size = 8;
+    FILE *f;
+    int ok;
+
+    for (size_t i = 0; i < items_len; i++)
+        size += 2 + strlen(items[i].ns) + strlen(items[i].key) + 4 + items[i].len;
+
+    buf = malloc(size);
+    if (!buf)
+        return ESP_ERR_NO_MEM;
+
+    wr = buf;
+    memcpy(wr, &magic, 4);
+    wr += 4;
+    for (size_t i = 0; i < items_len; i++) {
+        nlen = strlen(items[i].ns);
+        *wr++ = nlen;
+        memcpy(wr, items[i].ns, nlen);
+        wr += nlen;
+
+        nlen = strlen(items[i].key);
+        *wr++ = nlen;
+        memcpy(wr, items[i].key, nlen);
+        wr += nlen;
+
+        vlen = items[i].len;
+        memcpy(wr, &vlen, 4);
+        memcpy(wr + 4, items[i].value, vlen);
+        wr += 4 + vlen;
+    }
+
+    crc = esp_rom_crc32_le(0, buf, wr - buf);
+    memcpy(wr, &crc, 4);
+
+    // never leave a half written partition behind
+    snprintf(tmp, sizeof(tmp), "%s.tmp", nvs_path);
+    f = fopen(tmp, "wb");
+    if (!f) {
+        ESP_LOGE(TAG, "failed to open %s", tmp);
+        free(buf);
+        return ESP_FAIL;
+    }
+
+    ok = fwrite(buf, 1, size, f) == size;
+    ok &= fclose(f) == 0;
+    free(buf);
+
+    if (!ok || rename(tmp, nvs_path)) {
+        ESP_LOGE(TAG, "failed to write %s", nvs_path);
+        remove(tmp);
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init() {
+    uint8_t *data = NULL;
+    esp_err_t ret = ESP_OK;
+    long size;
+    FILE *f;
+
+    pthread_mutex_lock(&nvs_mutex);
+    nvs_clear();
+
+    f = fopen(nvs_path, "rb");
+    if (f) {
+        if (fseek(f, 0, SEEK_END) || (size = ftell(f)) < 0 || fseek(f, 0, SEEK_SET)) {
+            ret = ESP_FAIL;
+        } else if (size > 0) {
+            data = malloc(size);
+            if (!data || fread(data, 1, size, f) != (size_t) size)
+                ret = ESP_FAIL;
+            else
+                ret = nvs_load(data, size);
+        }
+
+        fclose(f);
+        free(data);
+    }
+
+    if (ret) {
+        ESP_LOGE(TAG, "%s is corrupt", nvs_path);
+        nvs_clear();
+    }
+
+    nvs_ready = ret == ESP_OK;
+    pthread_mutex_unlock(&nvs_mutex);
+    return ret;
+}
+
+esp_err_t nvs_flash_erase() {
+    esp_err_t ret;
+
+    pthread_mutex_lock(&nvs_mutex);
+    nvs_clear();
+    ret = nvs_store();
+    pthread_mutex_unlock(&nvs_mutex);
+    return ret;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    esp_err_t ret = ESP_ERR_NVS_NOT_INITIALIZED;
+    size_t i;
+
+    if (strlen(name) >= NVS_KEY_NAME_MAX)
+        return ESP_ERR_NVS_INVALID_LENGTH;
+
+    pthread_mutex_lock(&nvs_mutex);
+    if (nvs_ready) {
+        ret = ESP_FAIL;
+        for (i = 0; i < NVS_MAX_NS; i++) {
+            if (!namespaces[i][0])
+                strcpy(namespaces[i], name);
+
+            if (!strcmp(namespaces[i], name)) {
+                *out_handle = (i + 1) | (open_mode == NVS_READONLY ? NVS_READONLY_BIT : 0);
+                ret = ESP_OK;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&nvs_mutex);
+
+    return ret;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    (void) handle;
+}
+
+static const char *nvs_ns(nvs_handle_t handle) {
+    size_t i = (handle & ~NVS_READONLY_BIT) - 1;
+
+    return i < NVS_MAX_NS && namespaces[i][0] ? namespaces[i] : NULL;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    esp_err_t ret;
+
+    if (!nvs_ns(handle))
+        return ESP_ERR_NVS_INVALID_HANDLE;
+
+    pthread_mutex_lock(&nvs_mutex);
+    ret = nvs_store();
+    pthread_mutex_unlock(&nvs_mutex);
+    return ret;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    const char *ns = nvs_ns(handle);
+    struct nvs_item *item;
+    esp_err_t ret = ESP_ERR_NVS_NOT_FOUND;
+
+    if (!ns)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    if (handle & NVS_READONLY_BIT)
+        return ESP_ERR_NVS_READ_ONLY;
+
+    pthread_mutex_lock(&nvs_mutex);
+    item = nvs_find(ns, key);
+    if (item) {
+        free(item->value);
+        *item = items[--items_len];
+        ret = ESP_OK;
+    }
+    pthread_mutex_unlock(&nvs_mutex);
+
+    return ret;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    const char *ns = nvs_ns(handle);
+    esp_err_t ret;
+
+    if (!ns)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    if (handle & NVS_READONLY_BIT)
+        return ESP_ERR_NVS_READ_ONLY;
+
+    pthread_mutex_lock(&nvs_mutex);
+    ret = nvs_put(ns, key, value, length);
+    pthread_mutex_unlock(&nvs_mutex);
+    return ret;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    const char *ns = nvs_ns(handle);
+    struct nvs_item *item;
+    esp_err_t ret = ESP_ERR_NVS_NOT_FOUND;
+
+    if (!ns)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+
+    pthread_mutex_lock(&nvs_mutex);
+    item = nvs_find(ns, key);
+    if (item) {
+        ret = ESP_OK;
+
+        // NULL out_value queries the size, like the esp32's
+        if (out_value && *length < item->len)
+            ret = ESP_ERR_NVS_INVALID_LENGTH;
+        else if (out_value)
+            memcpy(out_value, item->value, item->len);
+
+        *length = item->len;
+    }
+    pthread_mutex_unlock(&nvs_mutex);
+
+    return ret;
+}
+
+/* fixed size values are blobs that have to match in size */
+static esp_err_t nvs_get_fixed(nvs_handle_t handle, const char *key, void *out_value, size_t size) {
+    size_t len = size;
+    esp_err_t ret = nvs_get_blob(handle, key, NULL, &len);
+
+    if (ret)
+        return ret;
+    if (len != size)
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+
+    return nvs_get_blob(handle, key, out_value, &len);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value) {
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u16(nvs_handle_t handle, const char *key, uint16_t value) {
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u64(nvs_handle_t handle, const char *key, uint64_t value) {
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value) {
+    return nvs_set_blob(handle, key, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value) {
+    return nvs_get_fixed(handle, key, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_u16(nvs_handle_t handle, const char *key, uint16_t *out_value) {
+    return nvs_get_fixed(handle, key, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value) {
+    return nvs_get_fixed(handle, key, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_u64(nvs_handle_t handle, const char *key, uint64_t *out_value) {
+    return nvs_get_fixed(handle, key, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length) {
+    return nvs_get_blob(handle, key, out_value, length);
+}
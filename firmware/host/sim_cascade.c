@@ -0,0 +1,198 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Single axis simulation of the cascaded angle/rate loop, compares the old
+ * single-rate loop (estimator + angle + rate every sample, motors last) with the
+ * multi-rate one (rate + mixer right after the gyro read, estimator + angle
+ * every FC_OUTER_DIV samples after the motors are out).
+ *
+ * Plant is a rigid body with first order motor lag, the gyro goes through the
+ * mpu DLPF (modelled as a first order lag of its datasheet delay) and the
+ * motors are updated after the flight loop's compute time. Every config flies
+ * the same angle steps and torque kicks with the same pid gains.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "hackquad/estimator.h"
+#include "hackquad/pid.h"
+
+#define PHYS_RATE  8000.f  /* Hz */
+#define MPU_RATE   1000.f  /* Hz */
+#define DURATION   20.f    /* s */
+#define G_ACCL     9.80665f
+
+#define MOTOR_TAU  0.015f  /* s */
+#define PLANT_GAIN 40.f    /* deg/s^2 per unit of pid output */
+
+/* us, estimated esp32 flight loop costs, see /mpu/timing for real ones */
+#define PID_TIME   10.f
+#define EST_TIME   40.f
+
+struct config {
+    const char *name;
+    int outer_div;
+    bool multirate;     /* rate loop before the estimator */
+    float dlpf_delay;   /* s */
+    float read_time;    /* us, mean i2c read */
+};
+
+#define READ_NORMAL 450.f                          /* us, full read every sample */
+#define READ_LOWLAG   ((3 * 270.f + 450.f) / 4)     /* us, gyro-only reads, full every 4th */
+
+static const struct config configs[] = {
+    {"single-rate, 44Hz dlpf", 1, false, 0.0049f, READ_NORMAL},
+    {"multi-rate /1, 44Hz dlpf", 1, true, 0.0049f, READ_NORMAL},
+    {"multi-rate /2, 44Hz dlpf", 2, true, 0.0049f, READ_NORMAL},
+    {"multi-rate /4, 44Hz dlpf", 4, true, 0.0049f, READ_NORMAL},
+    {"single-rate, 256Hz dlpf", 1, false, 0.00098f, READ_LOWLAG},
+    {"multi-rate /1, 256Hz dlpf", 1, true, 0.00098f, READ_LOWLAG},
+    {"multi-rate /4, 256Hz dlpf", 4, true, 0.00098f, READ_LOWLAG},
+};
+
+static struct pid_kon angle_kons = {.kp = 8.f, .ki = 0.5f, .kd = 0.f, .epsilon = 0.f};
+static struct pid_kon rate_kons = {.kp = 2.f, .ki = 1.f, .kd = 0.01f, .epsilon = 0.f};
+
+static float noise(float sigma) {
+    float u1 = (rand() + 1.f) / (RAND_MAX + 2.f), u2 = (rand() + 1.f) / (RAND_MAX + 2.f);
+
+    return sigma * sqrtf(-2.f * logf(u1)) * cosf(2.f * (float) M_PI * u2);
+}
+
+/* +/-10deg steps every second, torque kicks half way between them */
+static float setpoint(float t) {
+    return fmodf(t, 2.f) < 1.f ? 10.f : -10.f;
+}
+
+static float disturbance(float t) {
+    return fmodf(t, 1.f) >= 0.5f && fmodf(t, 1.f) < 0.52f ? 3000.f : 0.f;
+}
+
+static void run(const struct config *c, float *rms, float *kick, float *cpu) {
+    struct pid_ctx pid_angle = {.kons = &angle_kons}, pid_rate = {.kons = &rate_kons};
+    struct estimator est;
+    struct estimator_input in;
+    vec3f_t rpy, acc;
+    float t, dt = 1.f / PHYS_RATE, angle = 0, rate = 0, motor = 0, gyro = 0, cmd = 0, pending = 0;
+    float rate_set = 0, err, sum = 0, busy = 0, next_sample = 0, apply_at = -1, gsum = 0, sdt = 0;
+    int outer = 0, n = 0, steps;
+    bool kicked;
+
+    srand(4);
+    acc.x = 0;
+    acc.y = 0;
+    acc.z = G_ACCL;
+    estimator_select(&est, ESTIMATOR_MADGWICK, &acc);
+    est.adaptive = true;
+    rpy.x = rpy.y = rpy.z = 0;
+    *kick = 0;
+
+    for (steps = 0; steps < DURATION * PHYS_RATE; steps++) {
+        t = steps * dt;
+
+        // physics
+        motor += (cmd - motor) * dt / MOTOR_TAU;
+        rate += (-PLANT_GAIN * motor + disturbance(t)) * dt;
+        angle += rate * dt;
+        gyro += (rate - gyro) * dt / c->dlpf_delay;
+
+        // motors take the output once the loop is done computing it
+        if (apply_at >= 0 && t >= apply_at) {
+            cmd = pending;
+            apply_at = -1;
+        }
+
+        if (t < next_sample)
+            continue;
+        next_sample += 1.f / MPU_RATE;
+
+        in.dt = 1.f / MPU_RATE;
+        in.gyr.x = gyro + noise(0.1f);
+        in.gyr.y = in.gyr.z = 0;
+        in.acc.x = 0;
+        in.acc.y = G_ACCL * sinf(angle * DEG_TO_RAD) + noise(0.3f);
+        in.acc.z = G_ACCL * cosf(angle * DEG_TO_RAD) + noise(0.3f);
+        in.rest = false;
+
+        gsum += in.gyr.x * in.dt;
+        sdt += in.dt;
+        kicked = ++outer >= c->outer_div;
+
+        if (c->multirate) {
+            // rate loop right away on the newest gyro, motors out after read + pid
+            pending = pid_update(&pid_rate, -rate_set, in.gyr.x, in.dt);
+            apply_at = t + (c->read_time + PID_TIME) * 1e-6f;
+            busy += c->read_time + PID_TIME;
+
+            if (kicked) {
+                in.gyr.x = gsum / sdt;
+                in.dt = sdt;
+                estimator_update(&est, &in);
+                estimator_angle(&est, &rpy);
+                rate_set = pid_update(&pid_angle, setpoint(t), rpy.x, sdt);
+                busy += EST_TIME + PID_TIME;
+            }
+        } else {
+            estimator_update(&est, &in);
+            estimator_angle(&est, &rpy);
+            rate_set = pid_update(&pid_angle, setpoint(t), rpy.x, in.dt);
+            pending = pid_update(&pid_rate, -rate_set, in.gyr.x, in.dt);
+            apply_at = t + (c->read_time + EST_TIME + 2 * PID_TIME) * 1e-6f;
+            busy += c->read_time + EST_TIME + 2 * PID_TIME;
+        }
+
+        if (kicked) {
+            outer = 0;
+            gsum = sdt = 0;
+        }
+
+        if (t >= 2.f) {
+            err = angle - setpoint(t);
+            sum += err * err;
+            n++;
+
+            if (fmodf(t, 1.f) >= 0.5f && fabsf(angle - setpoint(t)) > *kick)
+                *kick = fabsf(angle - setpoint(t));
+        }
+
+        if (!isfinite(angle))
+            break;
+    }
+
+    *rms = n ? sqrtf(sum / n) : INFINITY;
+    *cpu = busy / (DURATION * MPU_RATE);
+}
+
+int main() {
+    float rms, kick, cpu;
+    size_t i;
+
+    printf("%-26s %12s %14s %12s\n", "loop", "rms error", "kick error", "cpu/sample");
+    printf("%-26s %12s %14s %12s\n", "", "(steps)", "(max)", "(est.)");
+    for (i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        run(&configs[i], &rms, &kick, &cpu);
+        printf("%-26s %8.2f deg %10.2f deg %9.0f us\n", configs[i].name, rms, kick, cpu);
+    }
+
+    return 0;
+}
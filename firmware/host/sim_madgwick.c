@@ -0,0 +1,168 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Simulated comparison of the fixed and adaptive gain madgwick filters.
+ *
+ *   recovery - quad level and still, estimate starts 60deg off (after a crash),
+ *              time until the estimate is within 2deg
+ *   hover    - rocking +/-10deg at 0.5Hz with gyro noise/bias residual, motor
+ *              vibration on the accel and lateral acceleration bursts,
+ *              rms/max error after settling (rest is never set in flight)
+ *
+ * Exits non-zero if the adaptive filter doesn't beat the fixed one where it
+ * should, so it doubles as a test.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hackquad/flightmath.h"
+
+#define RATE      1000.f /* Hz */
+#define G_ACCL    9.80665f
+#define GYRO_ERR  5.f    /* mpu.c MADGWICK_GYRO_ERR */
+#define REST_ERR  60.f   /* mpu.c MADGWICK_REST_ERR */
+
+enum filter { FIXED, ADAPTIVE, ADAPTIVE_REST };
+
+static const char *filter_names[] = {"fixed", "adaptive", "adaptive+rest"};
+
+/* deterministic gaussian noise */
+static float noise(float sigma) {
+    float u1 = (rand() + 1.f) / (RAND_MAX + 2.f), u2 = (rand() + 1.f) / (RAND_MAX + 2.f);
+
+    return sigma * sqrtf(-2.f * logf(u1)) * cosf(2.f * (float) M_PI * u2);
+}
+
+static void init(madgwick_ahrs_t *ahrs, enum filter filter, float roll) {
+    if (filter == FIXED)
+        madgwick_init(ahrs, GYRO_ERR);
+    else
+        madgwick_init_adaptive(ahrs, GYRO_ERR, REST_ERR);
+
+    ahrs->q.w = cosf(roll / 2.f);
+    ahrs->q.x = sinf(roll / 2.f);
+    ahrs->rest = filter == ADAPTIVE_REST;
+}
+
+static void update(madgwick_ahrs_t *ahrs, enum filter filter, float dt, const float *acc, const float *gyr) {
+    if (filter == FIXED)
+        madgwick_update(ahrs, dt, acc[0], acc[1], acc[2], gyr[0], gyr[1], gyr[2]);
+    else
+        madgwick_update_adaptive(ahrs, dt, G_ACCL, acc[0], acc[1], acc[2], gyr[0], gyr[1], gyr[2]);
+}
+
+/* deg between the estimated gravity and the one of a pure roll */
+static float error(madgwick_ahrs_t *ahrs, float roll) {
+    vec3f_t g;
+    float dot;
+
+    // q is only roughly normalized (single Q_rsqrt iteration)
+    quaternion_get_gravity(&ahrs->q, &g);
+    dot = (g.y * sinf(roll) + g.z * cosf(roll)) / sqrtf(g.x * g.x + g.y * g.y + g.z * g.z);
+    return acosf(fminf(fmaxf(dot, -1.f), 1.f)) * RAD_TO_DEG;
+}
+
+static float recovery(enum filter filter) {
+    madgwick_ahrs_t ahrs;
+    float acc[3], gyr[3], dt = 1.f / RATE;
+    int i;
+
+    srand(1);
+    init(&ahrs, filter, 60.f * DEG_TO_RAD);
+
+    for (i = 0; i < 30 * RATE; i++) {
+        acc[0] = noise(0.05f);
+        acc[1] = noise(0.05f);
+        acc[2] = G_ACCL + noise(0.05f);
+        gyr[0] = noise(0.002f);
+        gyr[1] = noise(0.002f);
+        gyr[2] = noise(0.002f);
+
+        update(&ahrs, filter, dt, acc, gyr);
+        if (error(&ahrs, 0) < 2.f)
+            return i * dt;
+    }
+
+    return INFINITY;
+}
+
+static void hover(enum filter filter, float *rms, float *max) {
+    madgwick_ahrs_t ahrs;
+    float acc[3], gyr[3], lat, roll, rate, err, sum = 0, dt = 1.f / RATE, t;
+    int i, n = 0;
+
+    srand(2);
+    init(&ahrs, filter, 0);
+    ahrs.rest = 0;
+    *max = 0;
+
+    for (i = 0; i < 60 * RATE; i++) {
+        t = i * dt;
+        roll = 10.f * DEG_TO_RAD * sinf(2.f * (float) M_PI * 0.5f * t);
+        rate = 10.f * DEG_TO_RAD * 2.f * (float) M_PI * 0.5f * cosf(2.f * (float) M_PI * 0.5f * t);
+
+        // 0.3s lateral push every second, alternating sides so the quad doesn't drift off
+        lat = fmodf(t, 1.f) < 0.3f ? (fmodf(t, 2.f) < 1.f ? 4.f : -4.f) : 0.f;
+
+        acc[0] = noise(1.5f);
+        acc[1] = G_ACCL * sinf(roll) + lat + noise(1.5f);
+        acc[2] = G_ACCL * cosf(roll) + noise(1.5f);
+        gyr[0] = rate + 0.3f * DEG_TO_RAD + noise(0.02f);
+        gyr[1] = noise(0.02f);
+        gyr[2] = noise(0.02f);
+
+        update(&ahrs, filter, dt, acc, gyr);
+
+        if (t >= 5.f) {
+            err = error(&ahrs, roll);
+            sum += err * err;
+            n++;
+            if (err > *max)
+                *max = err;
+        }
+    }
+
+    *rms = sqrtf(sum / n);
+}
+
+int main() {
+    float conv[3], rms[3], max[3];
+    int f, failed = 0;
+
+    printf("%-14s %14s %14s %14s\n", "filter", "recovery (s)", "hover rms", "hover max");
+    for (f = FIXED; f <= ADAPTIVE_REST; f++) {
+        conv[f] = recovery(f);
+        hover(f, &rms[f], &max[f]);
+        printf("%-14s %14.3f %12.2f deg %10.2f deg\n", filter_names[f], conv[f], rms[f], max[f]);
+    }
+
+    if (!(conv[ADAPTIVE] < conv[FIXED] && conv[ADAPTIVE_REST] < conv[FIXED])) {
+        fprintf(stderr, "adaptive filter doesn't re-converge faster\n");
+        failed = 1;
+    }
+
+    if (!(rms[ADAPTIVE] <= rms[FIXED])) {
+        fprintf(stderr, "adaptive filter has a larger steady state error\n");
+        failed = 1;
+    }
+
+    return failed;
+}
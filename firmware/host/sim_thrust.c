@@ -0,0 +1,254 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Single axis rate loop over a pair of motors with a non-linear thrust curve,
+ * flown at several hover thrusts with and without the thrust linearization
+ * (MOTOR_LINEARIZE). Every run steps the rate setpoint with the same pid gains,
+ * without linearization the loop gain (and with it rise time and overshoot)
+ * follows the slope of the thrust curve at the hover point.
+ *
+ * The motor's thrust is a*d^2 + (1-a)*d of duty d, the registry curve is that
+ * sampled at 1/8 duty steps like it would be measured on a thrust stand.
+ *
+ * Exits non-zero if the table isn't a monotone inverse of the curve or the
+ * linearized loop isn't flatter across throttle, so it doubles as a test.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "hackquad/thrust.h"
+#include "hackquad/pid.h"
+
+#define PHYS_RATE  8000.f  /* Hz */
+#define LOOP_RATE  1000.f  /* Hz */
+#define DURATION   0.6f    /* s */
+#define STEP_AT    0.1f    /* s */
+#define STEP_RATE  25.f    /* deg/s */
+
+#define MOTOR_TAU  0.015f  /* s */
+#define PLANT_GAIN 40.f    /* deg/s^2 per unit of thrust difference (in duty units) */
+#define CURVE_A    0.85f   /* share of d^2 in the motor's thrust */
+
+static struct pid_kon rate_kons = {.kp = 2.f, .ki = 1.f, .kd = 0.01f, .epsilon = 0.f};
+
+static const float hover[] = {0.2f, 0.35f, 0.5f, 0.65f};
+#define HOVER_LEVELS (sizeof(hover) / sizeof(hover[0]))
+
+/* thrust of the simulated motor, both 0..THRUST_MAX */
+static float motor_thrust(float duty) {
+    float d = duty / THRUST_MAX;
+
+    return THRUST_MAX * (CURVE_A * d * d + (1.f - CURVE_A) * d);
+}
+
+static float motor_slope(float duty) {
+    return 2.f * CURVE_A * duty / THRUST_MAX + (1.f - CURVE_A);
+}
+
+/* duty the simulated motor needs for thrust, by bisection */
+static float motor_duty(float thrust) {
+    float lo = 0, hi = THRUST_MAX, mid;
+    int i;
+
+    for (i = 0; i < 40; i++) {
+        mid = (lo + hi) / 2;
+        if (motor_thrust(mid) < thrust)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return (lo + hi) / 2;
+}
+
+static void measured_curve(struct thrust_curve *curve, int linearize) {
+    int i;
+
+    memset(curve, 0, sizeof(*curve));
+    curve->linearize = linearize;
+    for (i = 0; i < THRUST_CURVE_POINTS; i++)
+        curve->thrust[i] = motor_thrust(THRUST_MAX * (i + 1) / THRUST_CURVE_POINTS) * 0.01f; /* grams, say */
+}
+
+static int check_table() {
+    struct thrust_curve curve;
+    struct thrust_lut lut;
+    float t, err, max_err = 0;
+    u32 duty, prev = 0;
+    int failed = 0;
+
+    measured_curve(&curve, 0);
+    thrust_lut_build(&lut, &curve);
+    for (t = 0; t <= THRUST_MAX; t += 0.25f) {
+        if (fabsf((float) thrust_duty(&lut, t) - t) > 0.5f) {
+            fprintf(stderr, "table isn't straight with linearization off (%.2f -> %u)\n", t, thrust_duty(&lut, t));
+            return 1;
+        }
+    }
+
+    curve.linearize = 1;
+    if (!thrust_lut_refresh(&lut, &curve) || thrust_lut_refresh(&lut, &curve)) {
+        fprintf(stderr, "table isn't rebuilt exactly when the curve changes\n");
+        failed = 1;
+    }
+
+    for (t = 0; t <= THRUST_MAX; t += 0.25f) {
+        duty = thrust_duty(&lut, t);
+        if (duty < prev) {
+            fprintf(stderr, "table isn't monotone at %.2f\n", t);
+            return 1;
+        }
+        prev = duty;
+
+        // curve is sampled piecewise linear, a few counts off in between the points is expected
+        err = fabsf(motor_thrust((float) duty) - t);
+        if (err > max_err)
+            max_err = err;
+    }
+
+    if (thrust_duty(&lut, 0) != 0 || thrust_duty(&lut, THRUST_MAX) != (u32) THRUST_MAX ||
+        thrust_duty(&lut, -10.f) != 0 || thrust_duty(&lut, 2 * THRUST_MAX) != (u32) THRUST_MAX) {
+        fprintf(stderr, "table doesn't keep the ends\n");
+        failed = 1;
+    }
+
+    printf("inverse error: %.1f of %.0f thrust\n", max_err, THRUST_MAX);
+    if (max_err > 0.01f * THRUST_MAX) {
+        fprintf(stderr, "table is more than 1%% off the curve\n");
+        failed = 1;
+    }
+
+    // a non-monotone or empty curve still gives a usable table
+    curve.thrust[4] = curve.thrust[2];
+    thrust_lut_build(&lut, &curve);
+    for (prev = 0, t = 0; t <= THRUST_MAX; t += 1.f) {
+        if (thrust_duty(&lut, t) < prev) {
+            fprintf(stderr, "table of a non-monotone curve isn't monotone\n");
+            failed = 1;
+            break;
+        }
+        prev = thrust_duty(&lut, t);
+    }
+
+    memset(curve.thrust, 0, sizeof(curve.thrust));
+    thrust_lut_build(&lut, &curve);
+    if (thrust_duty(&lut, 512.f) != 512) {
+        fprintf(stderr, "table of an empty curve isn't straight\n");
+        failed = 1;
+    }
+
+    return failed;
+}
+
+/* rate step at hover thrust (fraction of THRUST_MAX), 10-90% rise time in ms and overshoot in % */
+static void step(const struct thrust_lut *lut, float level, float *rise, float *overshoot) {
+    struct pid_ctx pid = {.kons = &rate_kons};
+    float t, dt = 1.f / PHYS_RATE, rate = 0, set, out = 0, throttle, peak = 0;
+    float ta = 0, tb = 0, t10 = -1, t90 = -1, next = 0;
+    int steps;
+
+    // stick throttle that hovers at level, in thrust without linearization it's duty
+    throttle = lut->built.linearize ? level * THRUST_MAX : motor_duty(level * THRUST_MAX);
+    ta = tb = motor_thrust((float) thrust_duty(lut, throttle));
+
+    for (steps = 0; steps < DURATION * PHYS_RATE; steps++) {
+        t = steps * dt;
+        set = t >= STEP_AT ? STEP_RATE : 0;
+
+        if (t >= next) {
+            next += 1.f / LOOP_RATE;
+            out = pid_update(&pid, set, rate, 1.f / LOOP_RATE);
+        }
+
+        ta += (motor_thrust((float) thrust_duty(lut, throttle - out)) - ta) * dt / MOTOR_TAU;
+        tb += (motor_thrust((float) thrust_duty(lut, throttle + out)) - tb) * dt / MOTOR_TAU;
+        rate += PLANT_GAIN * (ta - tb) / 2 * dt;
+
+        if (t < STEP_AT)
+            continue;
+        if (rate > peak)
+            peak = rate;
+        if (t10 < 0 && rate >= 0.1f * STEP_RATE)
+            t10 = t;
+        if (t90 < 0 && rate >= 0.9f * STEP_RATE)
+            t90 = t;
+    }
+
+    *rise = t10 >= 0 && t90 >= 0 ? (t90 - t10) * 1e3f : INFINITY;
+    *overshoot = (peak / STEP_RATE - 1.f) * 100.f;
+}
+
+static double lookup_ns(const struct thrust_lut *lut) {
+    struct timespec a, b;
+    volatile u32 sink = 0;
+    int i, n = 10000000;
+
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    for (i = 0; i < n; i++)
+        sink += thrust_duty(lut, (float) (i & 1023));
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    (void) sink;
+
+    return ((b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec)) / n;
+}
+
+int main() {
+    struct thrust_curve curve;
+    struct thrust_lut luts[2];
+    float rise[2][HOVER_LEVELS], over[2][HOVER_LEVELS], lo[2], hi[2];
+    size_t i;
+    int l, failed;
+
+    failed = check_table();
+
+    for (l = 0; l < 2; l++) {
+        measured_curve(&curve, l);
+        thrust_lut_build(&luts[l], &curve);
+    }
+
+    printf("%-8s %-8s %14s %12s %12s\n", "hover", "slope", "", "rise", "overshoot");
+    for (i = 0; i < HOVER_LEVELS; i++) {
+        for (l = 0; l < 2; l++) {
+            step(&luts[l], hover[i], &rise[l][i], &over[l][i]);
+            printf("%-8.2f %-8.2f %14s %9.1f ms %10.1f %%\n", hover[i], motor_slope(motor_duty(hover[i] * THRUST_MAX)),
+                   l ? "linearized" : "duty", rise[l][i], over[l][i]);
+        }
+    }
+
+    for (l = 0; l < 2; l++) {
+        lo[l] = hi[l] = rise[l][0];
+        for (i = 1; i < HOVER_LEVELS; i++) {
+            lo[l] = fminf(lo[l], rise[l][i]);
+            hi[l] = fmaxf(hi[l], rise[l][i]);
+        }
+        printf("%-10s rise time spread %.2fx\n", l ? "linearized" : "duty", hi[l] / lo[l]);
+    }
+
+    printf("lookup: %.1f ns\n", lookup_ns(&luts[1]));
+
+    if (!(hi[1] / lo[1] < 1.15f && hi[1] / lo[1] < hi[0] / lo[0])) {
+        fprintf(stderr, "linearized loop gain isn't flat across throttle\n");
+        failed = 1;
+    }
+
+    return failed;
+}
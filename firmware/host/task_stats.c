@@ -0,0 +1,117 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * uxTaskGetSystemState() stand-in, the virtual quad's threads are the tasks.
+ * Run time is the thread's user + system time from /proc, in us like the
+ * firmware's esp_timer run time clock (at the kernel's tick resolution).
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#define TASK_STATS_MAX  64
+#define TASK_NAME_LEN   16
+
+/* pcTaskName has to stay valid after the call, like the tcb's name */
+static char names[TASK_STATS_MAX][TASK_NAME_LEN];
+
+static int read_thread(const char *tid, char *name, uint32_t *runtime) {
+    unsigned long utime, stime;
+    char path[64], buf[512], *p;
+    FILE *f;
+    size_t len;
+
+    snprintf(path, sizeof(path), "/proc/self/task/%s/comm", tid);
+    if (!(f = fopen(path, "r")))
+        return -1;
+    len = fread(name, 1, TASK_NAME_LEN - 1, f);
+    fclose(f);
+    name[len] = '\0';
+    name[strcspn(name, "\n")] = '\0';
+
+    snprintf(path, sizeof(path), "/proc/self/task/%s/stat", tid);
+    if (!(f = fopen(path, "r")))
+        return -1;
+    len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+
+    // comm may contain spaces, fields after it are fixed: state is field 3, utime/stime 14/15
+    if (!(p = strrchr(buf, ')')) || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                                           &utime, &stime) != 2)
+        return -1;
+
+    *runtime = (uint32_t) ((utime + stime) * (1000000ull / (unsigned long long) sysconf(_SC_CLK_TCK)));
+    return 0;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *status, UBaseType_t max, uint32_t *total) {
+    struct dirent *ent;
+    UBaseType_t n = 0;
+    DIR *dir;
+
+    if (!(dir = opendir("/proc/self/task")))
+        return 0;
+
+    while ((ent = readdir(dir))) {
+        if (ent->d_name[0] == '.')
+            continue;
+
+        // too small a status array gives nothing, as in FreeRTOS
+        if (n >= max || n >= TASK_STATS_MAX) {
+            n = 0;
+            break;
+        }
+
+        if (read_thread(ent->d_name, names[n], &status[n].ulRunTimeCounter))
+            continue;
+
+        status[n].xHandle = (TaskHandle_t) (uintptr_t) strtoul(ent->d_name, NULL, 10);
+        status[n].pcTaskName = names[n];
+        n++;
+    }
+
+    closedir(dir);
+    *total = (uint32_t) esp_timer_get_time();
+    return n;
+}
+
+/* handles are thread ids as above, only the calling thread's number is kept */
+static __thread UBaseType_t task_number;
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return (TaskHandle_t) (uintptr_t) syscall(SYS_gettid);
+}
+
+UBaseType_t uxTaskGetTaskNumber(TaskHandle_t task) {
+    return task == xTaskGetCurrentTaskHandle() ? task_number : 0;
+}
+
+void vTaskSetTaskNumber(TaskHandle_t task, UBaseType_t number) {
+    if (task == xTaskGetCurrentTaskHandle())
+        task_number = number;
+}
@@ -0,0 +1,233 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Setpoint shaping between control packets, staleness and failsafe.
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include "hackquad/setpoint.h"
+#include "check.h"
+
+#define NEAR(a, b) (fabsf((a) - (b)) < 1e-3f)
+
+static struct setpoint_conf conf = {
+    .mode = SETPOINT_STEP,
+    .slew_angle = 0.f,
+    .slew_yaw = 0.f,
+    .stale = 100,
+    .timeout = 3000
+};
+
+static void push(struct setpoint_shaper *s, float throttle, float x, u32 sent, u64 recv) {
+    struct setpoint sp = {.throttle = throttle, .x = x, .y = -x, .z = 0.f};
+
+    setpoint_push(s, &sp, sent, recv);
+}
+
+static struct setpoint at(struct setpoint_shaper *s, u64 now) {
+    struct setpoint out;
+
+    setpoint_update(s, now, &out);
+    return out;
+}
+
+static void test_modes() {
+    struct setpoint_shaper s;
+
+    conf.mode = SETPOINT_STEP;
+    setpoint_init(&s, &conf);
+    CHECK(at(&s, 1000).throttle == 0.f); // nothing yet
+    push(&s, 500, 0, 1000, 1000000);
+    push(&s, 500, 10, 1020, 1020000);
+    CHECK(NEAR(at(&s, 1030000).x, 10));
+
+    conf.mode = SETPOINT_INTERPOLATE;
+    setpoint_init(&s, &conf);
+    push(&s, 500, 0, 1000, 1000000);
+    push(&s, 500, 10, 1020, 1020000);
+    CHECK(NEAR(at(&s, 1020000).x, 0));
+    CHECK(NEAR(at(&s, 1030000).x, 5));
+    CHECK(NEAR(at(&s, 1030000).y, -5));
+    CHECK(NEAR(at(&s, 1045000).x, 10));
+
+    conf.mode = SETPOINT_PREDICT;
+    setpoint_init(&s, &conf);
+    push(&s, 500, 0, 1000, 1000000);
+    push(&s, 500, 10, 1020, 1020000);
+    CHECK(NEAR(at(&s, 1020000).x, 10));
+    CHECK(NEAR(at(&s, 1030000).x, 15));
+    CHECK(NEAR(at(&s, 1060000).x, 20)); // no further than one interval
+
+    // timed by the controller's clock, not the (jittery) arrival
+    setpoint_init(&s, &conf);
+    push(&s, 500, 0, 1000, 1000000);
+    push(&s, 500, 10, 1020, 1028000);
+    CHECK(fabsf(at(&s, 1030000).x - 15) < 0.1f);
+    CHECK(s.stats.late == 0);
+    push(&s, 500, 20, 1040, 1055000);
+    CHECK(s.stats.late == 1);
+}
+
+static void test_throttle_cut() {
+    struct setpoint_shaper s;
+
+    conf.mode = SETPOINT_INTERPOLATE;
+    setpoint_init(&s, &conf);
+    push(&s, 500, 0, 1000, 1000000);
+    push(&s, 0, 0, 1020, 1020000);
+    CHECK(at(&s, 1020000).throttle == 0.f);
+}
+
+static void test_slew() {
+    struct setpoint_shaper s;
+    u64 t;
+
+    conf.mode = SETPOINT_STEP;
+    conf.slew_angle = 100.f;
+    setpoint_init(&s, &conf);
+    push(&s, 500, 10, 1000, 1000000);
+    at(&s, 1000000);
+
+    // first packet is taken as is, the next step is limited to 100deg/s
+    push(&s, 500, 0, 1020, 1020000);
+    for (t = 1020000; t <= 1030000; t += 1000)
+        at(&s, t);
+    CHECK(NEAR(s.out.x, 10 - 2 - 1)); // 20ms since the update at 1s, then 10 x 1ms
+    conf.slew_angle = 0.f;
+}
+
+static void test_stale() {
+    struct setpoint_shaper s;
+    struct setpoint out;
+
+    conf.mode = SETPOINT_STEP;
+    setpoint_init(&s, &conf);
+    push(&s, 600, 10, 1000, 1000000);
+
+    out = at(&s, 1050000);
+    CHECK(NEAR(out.x, 10));
+    CHECK(s.stats.stale == 0);
+
+    // leveled out, throttle held
+    out = at(&s, 1150000);
+    CHECK(NEAR(out.x, 0));
+    CHECK(NEAR(out.throttle, 600));
+    CHECK(s.stats.stale == 1);
+
+    // ramped down
+    out = at(&s, 1000000 + 3000000 + SETPOINT_FAILSAFE_RAMP / 2);
+    CHECK(NEAR(out.throttle, 300));
+    CHECK(s.stats.failsafe == 1);
+    out = at(&s, 1000000 + 3000000 + SETPOINT_FAILSAFE_RAMP * 2);
+    CHECK(out.throttle == 0.f);
+    CHECK(s.stats.failsafe == 1);
+    CHECK(s.stats.age_max == 3000000 + SETPOINT_FAILSAFE_RAMP * 2);
+
+    // a packet brings it back
+    push(&s, 600, 10, 8000, 8000000);
+    out = at(&s, 8000000);
+    CHECK(NEAR(out.x, 10));
+    CHECK(NEAR(out.throttle, 600));
+}
+
+static void test_lost() {
+    struct setpoint_shaper s;
+
+    setpoint_init(&s, &conf);
+    push(&s, 500, 0, 1000, 1000000);
+    push(&s, 500, 0, 1020, 1020000);
+    push(&s, 500, 0, 1080, 1080000);
+    CHECK(s.stats.lost == 2);
+    CHECK(s.stats.packets == 3);
+}
+
+/* controller restarts, its clock starts over, then jumps ahead: neither is loss */
+static void test_resync() {
+    struct setpoint_shaper s;
+
+    setpoint_init(&s, &conf);
+    push(&s, 500, 0, 900000, 1000000);
+    push(&s, 500, 0, 900020, 1020000);
+    push(&s, 500, 0, 15, 1040000);
+    push(&s, 500, 0, 35, 1060000);
+    CHECK(s.stats.lost == 0);
+    CHECK(s.stats.resync == 1);
+
+    push(&s, 500, 0, 3000000, 1080000);
+    push(&s, 500, 0, 3000020, 1100000);
+    CHECK(s.stats.lost == 0);
+    CHECK(s.stats.resync == 2);
+    CHECK(fabsf(s.stats.interval - 20000) < 1000);
+
+    // shaping carries on in local time
+    CHECK(NEAR(at(&s, 1120000).throttle, 500));
+    CHECK(s.stats.stale == 0);
+}
+
+/* controller drops from 100 to 25 packets/s, one gap is loss, then the interval follows */
+static void test_rate_change() {
+    struct setpoint_shaper s;
+    u32 ms = 1000, lost;
+    int i;
+
+    setpoint_init(&s, &conf);
+    for (i = 0; i < 100; i++, ms += 10)
+        push(&s, 500, 0, ms, ms * 1000);
+    CHECK(fabsf(s.stats.interval - 10000) < 500);
+
+    for (i = 0; i < 100; i++, ms += 40)
+        push(&s, 500, 0, ms, ms * 1000);
+    CHECK(fabsf(s.stats.interval - 40000) < 2000);
+
+    lost = s.stats.lost;
+    CHECK(lost <= 3);
+
+    // a real gap at the new rate still counts
+    push(&s, 500, 0, ms + 80, (ms + 80) * 1000);
+    CHECK(s.stats.lost == lost + 2);
+}
+
+/* packet stamped by the link after the flight loop took its time */
+static void test_recv_after_now() {
+    struct setpoint_shaper s;
+
+    setpoint_init(&s, &conf);
+    push(&s, 500, 10, 1000, 1000000);
+    push(&s, 500, 10, 1020, 1020100);
+    at(&s, 1020000);
+    CHECK(s.stats.age_max == 0);
+    CHECK(s.stats.stale == 0);
+}
+
+int main() {
+    test_modes();
+    test_throttle_cut();
+    test_slew();
+    test_stale();
+    test_lost();
+    test_resync();
+    test_rate_change();
+    test_recv_after_now();
+
+    if (failed)
+        fprintf(stderr, "%d check(s) failed\n", failed);
+    return failed != 0;
+}
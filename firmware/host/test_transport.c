@@ -0,0 +1,239 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Control link framing over the loopback and udp transports.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "hackquad/transport.h"
+#include "hackquad/loopback.h"
+#include "hackquad/udpserver.h"
+#include "check.h"
+
+/* last frame the quad side handled */
+static int handled;
+static int last_id;
+static size_t last_len;
+static u8 last_data[HQLINK_BUFFER_SIZE];
+
+static void recv_handler(int id, u8 *data, size_t len) {
+    handled++;
+    last_id = id;
+    last_len = len;
+    memcpy(last_data, data, len);
+}
+
+static volatile int stopping;
+
+static void *link_thread(void *arg) {
+    struct hq_link *link = arg;
+
+    // recv fails for good once the loopback is closed, udp runs until the process exits
+    while (!stopping)
+        hq_link_yield(link);
+
+    return NULL;
+}
+
+static size_t frame(u8 *buf, u8 id, u32 nonce, const void *payload, size_t len) {
+    buf[0] = id;
+    buf[1] = nonce;
+    buf[2] = nonce >> 8;
+    buf[3] = nonce >> 16;
+    memcpy(buf + 4, payload, len);
+    return len + 4;
+}
+
+/* every frame sent before a ping has been handled once its pong is back */
+static void link_sync(struct hq_transport *peer, u32 nonce) {
+    u8 buf[HQLINK_BUFFER_SIZE];
+    ssize_t len;
+
+    peer->ops->send(peer, buf, frame(buf, HQLINK_PING_ID, nonce, "sync", 4));
+    len = peer->ops->recv(peer, buf, sizeof(buf));
+
+    CHECK(len == 5);
+    CHECK(buf[0] == HQLINK_PONG_ID);
+    CHECK(!memcmp(buf + 1, "sync", 4));
+}
+
+static void test_framing(struct hq_transport *peer, struct hq_link *link) {
+    u8 buf[HQLINK_BUFFER_SIZE];
+    float control[4] = {0.5f, 1, 2, 3};
+    u32 dropped;
+
+    handled = 0;
+    dropped = link->dropped;
+
+    // nonce 0 primes the order
+    peer->ops->send(peer, buf, frame(buf, 69, 0, control, sizeof(control)));
+    link_sync(peer, 1);
+    CHECK(handled == 1);
+    CHECK(last_id == 69);
+    CHECK(last_len == sizeof(control));
+    CHECK(!memcmp(last_data, control, sizeof(control)));
+
+    // older than the latest nonce, dropped
+    peer->ops->send(peer, buf, frame(buf, 69, 10, control, sizeof(control)));
+    peer->ops->send(peer, buf, frame(buf, 70, 5, control, sizeof(control)));
+    link_sync(peer, 11);
+    CHECK(handled == 2);
+    CHECK(last_id == 69);
+    CHECK(link->dropped == dropped + 1);
+
+    // too short for a header
+    peer->ops->send(peer, buf, 2);
+    link_sync(peer, 12);
+    CHECK(handled == 2);
+    CHECK(link->dropped == dropped + 2);
+
+    // repeated by the network, dropped
+    peer->ops->send(peer, buf, frame(buf, 69, 13, control, sizeof(control)));
+    peer->ops->send(peer, buf, frame(buf, 69, 13, control, sizeof(control)));
+    link_sync(peer, 14);
+    CHECK(handled == 3);
+    CHECK(link->dropped == dropped + 3);
+
+    // controller restarted, 0 re-primes
+    peer->ops->send(peer, buf, frame(buf, 70, 0, "x", 1));
+    peer->ops->send(peer, buf, frame(buf, 42, 1, "yz", 2));
+    link_sync(peer, 2);
+    CHECK(handled == 5);
+    CHECK(last_id == 42);
+    CHECK(last_len == 2);
+}
+
+/* controller restarts and its nonce 0 frame is lost, the next one starts the new session */
+static void test_restart_lost(struct hq_transport *peer, struct hq_link *link) {
+    u8 buf[HQLINK_BUFFER_SIZE];
+    u32 dropped = link->dropped;
+    int before = handled;
+
+    peer->ops->send(peer, buf, frame(buf, 69, 1000, "a", 1));
+    link_sync(peer, 1001);
+    CHECK(handled == before + 1);
+
+    // within the window it's still a late frame of the old session
+    peer->ops->send(peer, buf, frame(buf, 69, 1001 - HQLINK_NONCE_WINDOW, "b", 1));
+    link_sync(peer, 1002);
+    CHECK(handled == before + 1);
+    CHECK(link->dropped == dropped + 1);
+
+    // nonce 0 never arrived
+    peer->ops->send(peer, buf, frame(buf, 42, 1, "c", 1));
+    peer->ops->send(peer, buf, frame(buf, 43, 2, "d", 1));
+    link_sync(peer, 3);
+    CHECK(handled == before + 3);
+    CHECK(last_id == 43);
+    CHECK(link->dropped == dropped + 1);
+}
+
+/* only udp can carry more than the link takes, the loopback refuses it already */
+static void test_oversized(struct hq_transport *peer, struct hq_link *link) {
+    u8 buf[HQLINK_BUFFER_SIZE + 8];
+    u8 payload[HQLINK_BUFFER_SIZE];
+    u32 dropped = link->dropped;
+    int before = handled;
+
+    memset(payload, 0, sizeof(payload));
+
+    // one byte over, would be cut to a full buffer and handled as such
+    peer->ops->send(peer, buf, frame(buf, 70, 3, payload, HQLINK_BUFFER_SIZE - 3));
+    link_sync(peer, 4);
+    CHECK(handled == before);
+    CHECK(link->dropped == dropped + 1);
+
+    // exactly full still fits
+    peer->ops->send(peer, buf, frame(buf, 42, 5, payload, HQLINK_BUFFER_SIZE - 4));
+    link_sync(peer, 6);
+    CHECK(handled == before + 1);
+    CHECK(last_len == HQLINK_BUFFER_SIZE - 4);
+}
+
+/* talks to a udp_context from a plain socket */
+struct udp_peer {
+    struct hq_transport transport;
+    int sock;
+    struct sockaddr_in quad;
+};
+
+static ssize_t udp_peer_recv(struct hq_transport *transport, u8 *buf, size_t len) {
+    return recv(((struct udp_peer *) transport)->sock, buf, len, 0);
+}
+
+static ssize_t udp_peer_send(struct hq_transport *transport, const u8 *data, size_t len) {
+    struct udp_peer *peer = (struct udp_peer *) transport;
+
+    return sendto(peer->sock, data, len, 0, (struct sockaddr *) &peer->quad, sizeof(peer->quad));
+}
+
+static const struct hq_transport_ops udp_peer_ops = {
+        .name = "udp peer",
+        .mtu  = HQLINK_BUFFER_SIZE,
+        .recv = udp_peer_recv,
+        .send = udp_peer_send
+};
+
+int main() {
+    static struct loopback_pair pair;
+    static struct hq_link link, udp_link;
+    static struct udp_context udp_ctx;
+    struct udp_peer udp_peer;
+    socklen_t addrlen;
+    pthread_t thread;
+
+    loopback_create(&pair);
+    link.transport = &pair.a.transport;
+    link.recv_handler = recv_handler;
+    pthread_create(&thread, NULL, link_thread, &link);
+
+    test_framing(&pair.b.transport, &link);
+    test_restart_lost(&pair.b.transport, &link);
+    CHECK(hq_link_mtu(&link) == HQLINK_BUFFER_SIZE);
+
+    stopping = 1;
+    loopback_close(&pair);
+    pthread_join(thread, NULL);
+    loopback_destroy(&pair);
+    stopping = 0;
+
+    // same thing over a real socket
+    CHECK(udp_create(&udp_ctx, IPADDR_LOOPBACK, 0) == 0);
+    udp_link.transport = &udp_ctx.transport;
+    udp_link.recv_handler = recv_handler;
+
+    udp_peer.transport.ops = &udp_peer_ops;
+    udp_peer.sock = socket(AF_INET, SOCK_DGRAM, 0);
+    addrlen = sizeof(udp_peer.quad);
+    getsockname(udp_ctx.sock, (struct sockaddr *) &udp_peer.quad, &addrlen);
+
+    pthread_create(&thread, NULL, link_thread, &udp_link);
+    pthread_detach(thread);
+    test_framing(&udp_peer.transport, &udp_link);
+    test_oversized(&udp_peer.transport, &udp_link);
+
+    if (failed)
+        fprintf(stderr, "%d check(s) failed\n", failed);
+    else
+        printf("transport tests passed\n");
+
+    return failed != 0;
+}
@@ -0,0 +1,161 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Virtual quad over a real udp socket: control packets move its attitude and
+ * come back in status updates, a persisted registry batch survives a reload
+ * from the nvs file.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "vquad.h"
+#include "hackquad/ctrllink.h"
+#include "hackquad/regbatch.h"
+#include "hackquad/registry.h"
+#include "esp_timer.h"
+#include "check.h"
+
+#define NVS_PATH "test_vquad.bin"
+
+static int sock;
+static u32 nonce;
+
+static void send_frame(u8 id, const void *payload, size_t len) {
+    u8 buf[HQLINK_BUFFER_SIZE];
+
+    nonce++;
+    buf[0] = id;
+    buf[1] = nonce;
+    buf[2] = nonce >> 8;
+    buf[3] = nonce >> 16;
+    memcpy(buf + 4, payload, len);
+    send(sock, buf, len + 4, 0);
+}
+
+/* @return length of the next frame with id, 0 on timeout */
+static ssize_t recv_frame(u8 id, u8 *buf, size_t len) {
+    s64 until = esp_timer_get_time() + 1000000;
+    ssize_t n;
+
+    while (esp_timer_get_time() < until) {
+        n = recv(sock, buf, len, 0);
+        if (n > 0 && buf[0] == id)
+            return n;
+    }
+
+    return 0;
+}
+
+static void send_control(float throttle, float x, float y, float z) {
+    u8 payload[20];
+    float values[4] = {throttle, x, y, z};
+    u32 ms = esp_timer_get_time() / 1000;
+
+    memcpy(payload, values, sizeof(values));
+    memcpy(payload + 16, &ms, sizeof(ms));
+    send_frame(CTRLLINK_CONTROL_ID, payload, sizeof(payload));
+}
+
+static void test_control() {
+    struct timespec period = {0, 20 * 1000000L};
+    struct status_update status;
+    u8 buf[HQLINK_BUFFER_SIZE];
+    vec3f_t att;
+
+    // 1s of packets at the controller's rate, the model settles well within that
+    for (int i = 0; i < 50; i++) {
+        send_control(0.5f, 10.f, -5.f, 0.f);
+        nanosleep(&period, NULL);
+    }
+
+    vquad_attitude(&att);
+    CHECK(fabsf(att.x - 10.f) < 1.f);
+    CHECK(fabsf(att.y + 5.f) < 1.f);
+
+    // the ones queued up since the start still have the old attitude
+    while (recv(sock, buf, sizeof(buf), MSG_DONTWAIT) > 0);
+    CHECK(recv_frame(CTRLLINK_STATUS_ID, buf, sizeof(buf)) == sizeof(status));
+    memcpy(&status, buf, sizeof(status));
+    CHECK(status.x > 5.f);
+    CHECK(status.y < -2.5f);
+    CHECK(status.battery < 4.2f && status.battery > 3.f);
+}
+
+static void test_registry() {
+    struct reg_entry *ent = reg_lookup("CTRL_SLEW_ANGLE");
+    u8 batch[16], ack[HQLINK_BUFFER_SIZE];
+    u32 hash = ent->key_hash;
+    float value = 123.f;
+
+    // | seq | flags | count | op | hash | type | value |
+    batch[0] = 7;
+    batch[1] = REGBATCH_FLAG_PERSIST;
+    batch[2] = 1;
+    batch[3] = REGBATCH_OP_SET;
+    memcpy(batch + 4, &hash, sizeof(hash));
+    batch[8] = REG_FLT;
+    memcpy(batch + 9, &value, sizeof(value));
+    send_frame(REGBATCH_PACKET_ID, batch, 13);
+
+    CHECK(recv_frame(REGBATCH_ACK_ID, ack, sizeof(ack)) == 10);
+    CHECK(ack[1] == 7);
+    CHECK(ack[2] == 0);
+    CHECK(ack[3] == 1);
+    CHECK(*((float *) ent->location) == 123.f);
+
+    // lose it in ram, the file has it
+    *((float *) ent->location) = 0.f;
+    CHECK(reg_read("CTRL_SLEW_ANGLE") == 0);
+    CHECK(*((float *) ent->location) == 123.f);
+}
+
+int main() {
+    struct vquad_conf conf = {0, 0, NVS_PATH};
+    struct timeval timeout = {0, 100000};
+    struct sockaddr_in addr;
+
+    remove(NVS_PATH);
+    if (vquad_start(&conf)) {
+        fprintf(stderr, "failed to start virtual quad\n");
+        return 1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(vquad_udp_port());
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    connect(sock, (struct sockaddr *) &addr, sizeof(addr));
+
+    test_control();
+    test_registry();
+
+    remove(NVS_PATH);
+    printf("%s\n", failed ? "FAILED" : "ok");
+    return failed != 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Virtual HackQuad, see vquad.h. The http server listens on the tcp port of the
+ * same number as the control link, connect the controller to localhost:<port>.
+ *
+ *   virtual_quad [port] [nvs file]
+ *
+ * Several quads are several processes:
+ *   for i in 0 1 2 3; do ./virtual_quad $((25565 + i)) vq$i.bin & done
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "vquad.h"
+#include "hackquad/udpserver.h"
+#include "esp_err.h"
+#include "nvs_flash.h"
+
+int main(int argc, char **argv) {
+    struct vquad_conf conf;
+    long port = UDPSERVER_PORT;
+
+    if (argc > 1) {
+        port = strtol(argv[1], NULL, 10);
+        if (port <= 0 || port > 65535) {
+            fprintf(stderr, "usage: %s [port] [nvs file]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    conf.udp_port = port;
+    conf.http_port = port;
+    conf.nvs_path = argc > 2 ? argv[2] : NVS_FILE_DEFAULT;
+
+    if (vquad_start(&conf) != ESP_OK)
+        return 1;
+
+    printf("virtual quad on port %ld, nvs in %s\n", port, conf.nvs_path);
+    fflush(stdout);
+
+    for (;;)
+        pause();
+}
@@ -0,0 +1,274 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE /* pthread_setname_np */
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "vquad.h"
+#include "hackquad/ctrllink.h"
+#include "hackquad/hackquad_msg.h"
+#include "hackquad/httpserver.h"
+#include "hackquad/mpu.h"
+#include "hackquad/registry.h"
+#include "hackquad/setpoint.h"
+#include "hackquad/syscpu.h"
+#include "hackquad/trace.h"
+#include "hackquad/udpserver.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_http_server.h"
+#include "nvs_flash.h"
+
+#define STATUS_UPDATE_RATE 100 /* delay in ms between sending status updates, as the firmware's */
+
+/*
+ * registry[] with storage of its own. The firmware points entries at the globals
+ * of the modules using them, here every entry gets a field of reg_values named
+ * after its key, so registry.def builds as is. The shaping entries are copied
+ * into ctrl_conf by the sim, the rest are only stored.
+ */
+typedef u8 vq_REG_8B;
+typedef u16 vq_REG_16B;
+typedef u32 vq_REG_32B;
+typedef u64 vq_REG_64B;
+typedef float vq_REG_FLT;
+typedef char vq_REG_STR[VQ_REG_STR_SIZE];
+
+#undef REG_ENTRY
+#define REG_ENTRY(key, type, var) vq_##type key;
+static struct {
+#include "hackquad/registry.def"
+} reg_values;
+
+#undef REG_ENTRY
+#define REG_ENTRY(key, type, var) \
+    { #key, type, &reg_values.key, sizeof(reg_values.key), REG_HASH_##key, REG_HASHSTR_##key, REG_CLEAN },
+struct reg_entry registry[] = {
+#include "hackquad/registry.def"
+};
+DEFINE_REGISTRY_LEN();
+
+/* what httpserver.c reads of the flight side, the sim loop stands in for the mpu's */
+u8 mpu_rate_mode = MPU_RATE_NORMAL;
+struct mpu_timing mpu_timing;
+static struct setpoint_conf ctrl_conf;
+struct setpoint_shaper ctrl_setpoint = {.conf = &ctrl_conf};
+
+static struct udp_context udp_ctx;
+static volatile u32 control_seq;
+
+static pthread_mutex_t state_mutex = PTHREAD_MUTEX_INITIALIZER;
+static vec3f_t attitude;
+static float throttle;
+static float avg_loop;  /* s, like hq_avg_fcloop */
+
+void mpu_calibrate() {
+    ESP_LOGW(TAG, "virtual quad has no mpu to calibrate");
+}
+
+void mpu_timing_reset() {
+    pthread_mutex_lock(&state_mutex);
+    mpu_timing.read_max = mpu_timing.est_max = mpu_timing.loop_max = 0;
+    pthread_mutex_unlock(&state_mutex);
+}
+
+static void control_notify() {
+    __atomic_add_fetch(&control_seq, 1, __ATOMIC_RELEASE);
+}
+
+static void *link_task(void *arg) {
+    (void) arg;
+
+    // task names as on the quad, for /sys/cpu
+    pthread_setname_np(pthread_self(), "link");
+
+    for (;;)
+        ctrllink_yield();
+
+    return NULL;
+}
+
+static void *status_update_task(void *arg) {
+    (void) arg;
+
+    struct timespec delay = {0, STATUS_UPDATE_RATE * 1000000L};
+    struct status_update status_update;
+    const struct syscpu_report *cpu;
+    int cpu_count = 0;
+
+    pthread_setname_np(pthread_self(), "status_task");
+    syscpu_init();
+
+    for (;;) {
+        if (++cpu_count >= SYSCPU_SAMPLE_MS / STATUS_UPDATE_RATE) {
+            cpu_count = 0;
+            if ((cpu = syscpu_sample()))
+                ctrllink_send_cpu(cpu);
+        }
+        trace_poll();
+
+        pthread_mutex_lock(&state_mutex);
+        status_update.battery = VQ_BATTERY - VQ_BATTERY_SAG * throttle;
+        status_update.rssi = VQ_RSSI;
+        status_update.fc_loop_time = avg_loop;
+        status_update.x = attitude.x;
+        status_update.y = attitude.y;
+        status_update.z = attitude.z;
+        pthread_mutex_unlock(&state_mutex);
+
+        ctrllink_send_status(&status_update);
+        nanosleep(&delay, NULL);
+    }
+
+    return NULL;
+}
+
+/* shaping entries changed through /reg/set or registry batches apply on the next step */
+static void sim_load_conf() {
+    ctrl_conf.mode = reg_values.CTRL_SHAPING;
+    ctrl_conf.slew_angle = reg_values.CTRL_SLEW_ANGLE;
+    ctrl_conf.slew_yaw = reg_values.CTRL_SLEW_YAW;
+    ctrl_conf.stale = reg_values.CTRL_STALE;
+    ctrl_conf.timeout = reg_values.CTRL_TIMEOUT;
+}
+
+static void *sim_task(void *arg) {
+    (void) arg;
+
+    struct control_data ctrl;
+    struct setpoint sp;
+    struct timespec wake;
+    u64 now, last, next;
+    u32 seen = 0, seq, us;
+    float dt, k;
+
+    pthread_setname_np(pthread_self(), "hackquad_main");
+    next = last = esp_timer_get_time();
+    for (;;) {
+        next += VQ_SIM_PERIOD;
+        wake.tv_sec = next / 1000000;
+        wake.tv_nsec = (next % 1000000) * 1000;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+
+        now = esp_timer_get_time();
+        dt = (now - last) / 1000000.f;
+        last = now;
+
+        trace_begin(TRACE_FC_LOOP, 0);
+        sim_load_conf();
+
+        seq = __atomic_load_n(&control_seq, __ATOMIC_ACQUIRE);
+        if (seq != seen) {
+            seen = seq;
+            ctrllink_get_control(&ctrl);
+
+            sp.throttle = ctrl.throttle;
+            sp.x = ctrl.x;
+            sp.y = ctrl.y;
+            sp.z = ctrl.z;
+            setpoint_push(&ctrl_setpoint, &sp, ctrl.sent, ctrl.recv);
+        }
+
+        setpoint_update(&ctrl_setpoint, now, &sp);
+
+        // angles settle on the setpoint, yaw is rate controlled like the firmware's
+        k = 1.f - expf(-dt / VQ_ANGLE_TAU);
+        pthread_mutex_lock(&state_mutex);
+        attitude.x += (sp.x - attitude.x) * k;
+        attitude.y += (sp.y - attitude.y) * k;
+        attitude.z = remainderf(attitude.z + sp.z * dt, 360.f);
+        throttle = sp.throttle;
+        avg_loop = avg_loop * 0.995f + dt * 0.005f;
+
+        us = esp_timer_get_time() - now;
+        mpu_timing.samples++;
+        if (now > next + VQ_SIM_PERIOD) {
+            // overslept a whole step, don't try to catch up
+            mpu_timing.missed++;
+            next = now;
+        }
+        mpu_timing.loop = mpu_timing.loop * 0.99f + us * 0.01f;
+        if (us > mpu_timing.loop_max)
+            mpu_timing.loop_max = us;
+        pthread_mutex_unlock(&state_mutex);
+        trace_end(TRACE_FC_LOOP, 0);
+    }
+
+    return NULL;
+}
+
+int vquad_start(const struct vquad_conf *conf) {
+    pthread_t thread;
+
+    // firmware defaults of the entries the virtual quad uses, see hackquad_main.c
+    reg_values.CTRL_SHAPING = SETPOINT_INTERPOLATE;
+    reg_values.CTRL_SLEW_ANGLE = 360.f;
+    reg_values.CTRL_SLEW_YAW = 2000.f;
+    reg_values.CTRL_STALE = 100;
+    reg_values.CTRL_TIMEOUT = 3000;
+
+    nvs_file_set_path(conf->nvs_path);
+    reg_init();
+
+    sim_load_conf();
+    setpoint_init(&ctrl_setpoint, &ctrl_conf);
+    mpu_timing.period = VQ_SIM_PERIOD;
+
+    if (udp_create(&udp_ctx, IPADDR_ANY, conf->udp_port))
+        return ESP_FAIL;
+    ctrllink_init(&udp_ctx.transport, control_notify);
+    trace_init();
+
+#if VQ_HTTP
+    if (conf->http_port) {
+        httpd_default_port = conf->http_port;
+        if (http_init())
+            return ESP_FAIL;
+    }
+#else
+    if (conf->http_port)
+        ESP_LOGW(TAG, "built without cJSON, no http server");
+#endif
+
+    if (pthread_create(&thread, NULL, link_task, NULL) ||
+        pthread_create(&thread, NULL, status_update_task, NULL) ||
+        pthread_create(&thread, NULL, sim_task, NULL))
+        return ESP_FAIL;
+
+    return ESP_OK;
+}
+
+u16 vquad_udp_port() {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    if (getsockname(udp_ctx.sock, (struct sockaddr *) &addr, &len))
+        return 0;
+
+    return ntohs(addr.sin_port);
+}
+
+void vquad_attitude(vec3f_t *out) {
+    pthread_mutex_lock(&state_mutex);
+    *out = attitude;
+    pthread_mutex_unlock(&state_mutex);
+}
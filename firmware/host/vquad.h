@@ -0,0 +1,73 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HACKQUAD_HOST_VQUAD_H
+#define HACKQUAD_HOST_VQUAD_H
+
+#include "hackquad/lint_defs.h"
+#include "hackquad/flightmath.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Virtual HackQuad, the firmware's network side (control link, registry batches,
+ * status updates, http server + registry) on posix sockets with a file for nvs.
+ * The flight controller is replaced by a simple attitude model following the
+ * shaped setpoint, so controllers see a quad that reacts to their inputs.
+ *
+ * Link, registry and setpoint state are globals like on the esp32, so it's one
+ * virtual quad per process. Run several processes for several quads.
+ */
+
+#define VQ_SIM_PERIOD    2000   /* us, attitude model step, the mpu's rate in normal mode */
+#define VQ_ANGLE_TAU     0.15f  /* s, time constant of the angle loop the model pretends to have */
+#define VQ_BATTERY       4.15f  /* V, unloaded */
+#define VQ_BATTERY_SAG   0.5f   /* V, at full throttle */
+#define VQ_RSSI          -40
+#define VQ_REG_STR_SIZE  64     /* storage of REG_STR entries */
+
+struct vquad_conf {
+    u16 udp_port;       /* control link, 0 for any free one (see vquad_udp_port()) */
+    u16 http_port;      /* 0 to not start the http server */
+    const char *nvs_path;
+};
+
+/**
+ * Loads the registry and starts the link, status, sim (and http) threads.
+ *
+ * @return ESP_OK or ESP_FAIL if a socket couldn't be bound
+ */
+int vquad_start(const struct vquad_conf *conf);
+
+/**
+ * @return port the control link is bound to
+ */
+u16 vquad_udp_port();
+
+/**
+ * @param out deg, current attitude of the model
+ */
+void vquad_attitude(vec3f_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HACKQUAD_HOST_VQUAD_H */
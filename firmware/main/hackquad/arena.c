@@ -0,0 +1,46 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+
+#include "hackquad/arena.h"
+
+void arena_init(struct arena *a, void *buf, size_t size) {
+    a->base = buf;
+    a->size = size;
+    arena_reset(a);
+}
+
+void *arena_alloc(struct arena *a, size_t size) {
+    // aligned by address, heap buffers are only 4 byte aligned on the esp32
+    uintptr_t next = ((uintptr_t) (a->base + a->used) + ARENA_ALIGN - 1) & ~((uintptr_t) ARENA_ALIGN - 1);
+    size_t start = next - (uintptr_t) a->base;
+
+    if (start > a->size || size > a->size - start) {
+        a->failed++;
+        return NULL;
+    }
+
+    a->used = start + size;
+    return a->base + start;
+}
+
+void arena_reset(struct arena *a) {
+    a->used = 0;
+    a->failed = 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HACKQUAD_ARENA_H
+#define HACKQUAD_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "hackquad/lint_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ARENA_ALIGN 8
+
+/*
+ * Bump allocator over a fixed buffer. Allocations are never freed one by one,
+ * arena_reset() drops all of them at once.
+ */
+struct arena {
+    u8 *base;
+    size_t size;
+    size_t used;    /* high water since the last reset, allocations only ever add to it */
+    u32 failed;     /* allocations that didn't fit since the last reset */
+};
+
+void arena_init(struct arena *a, void *buf, size_t size);
+
+/**
+ * @return ARENA_ALIGN aligned memory, NULL if size doesn't fit anymore
+ */
+void *arena_alloc(struct arena *a, size_t size);
+
+void arena_reset(struct arena *a);
+
+static inline bool arena_owns(const struct arena *a, const void *ptr) {
+    return (const u8 *) ptr >= a->base && (const u8 *) ptr < a->base + a->size;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HACKQUAD_ARENA_H */
@@ -17,20 +17,20 @@
  */
 
 #include "hackquad/blinkcodes.h"
+#include "hackquad/sysmem.h"
 #include "freertos/task.h"
 #include "driver/gpio.h"
 
 static u32 rate = BLCR_FAST;
 
+/* only toggles the pin, it is set up by blc_init() on the caller's stack */
+SYSMEM_TASK(blink_task, 1024);
+
 static void blc_process_task(void *arg) {
     (void) arg;
 
     u32 counter = 0;
 
-    // setup built in LED
-    gpio_reset_pin(BLINK_GPIO);
-    gpio_set_direction(BLINK_GPIO, GPIO_MODE_OUTPUT);
-
     for (;;) {
         gpio_set_level(BLINK_GPIO, counter++ & 1);
         vTaskDelay(rate);
@@ -38,7 +38,11 @@ static void blc_process_task(void *arg) {
 }
 
 void blc_init() {
-    xTaskCreate(blc_process_task, "blink_task", 2304, NULL, 0, NULL);
+    // setup built in LED
+    gpio_reset_pin(BLINK_GPIO);
+    gpio_set_direction(BLINK_GPIO, GPIO_MODE_OUTPUT);
+
+    sysmem_task_start(blink_task, blc_process_task, "blink_task", NULL, 0);
 }
 
 void blc_setrate(u32 ratel) {
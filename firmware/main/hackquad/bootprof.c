@@ -0,0 +1,127 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "hackquad/bootprof.h"
+#include "pthread.h"
+
+#define BOOT_TASK_NAME 14
+
+struct boot_stage {
+    const char *name;
+    s64 start, end; /* us since boot, end = -1 while running, = start for marks */
+    u8 core;
+    char task[BOOT_TASK_NAME];
+};
+
+static struct boot_stage stages[BOOT_STAGE_MAX];
+static int stage_count;
+static int running;
+static int finished;
+static pthread_mutex_t boot_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int _boot_add(const char *name, s64 end) {
+    struct boot_stage *stage;
+    int id = -1;
+
+    pthread_mutex_lock(&boot_mutex);
+    if (stage_count < BOOT_STAGE_MAX) {
+        id = stage_count++;
+        stage = &stages[id];
+
+        stage->name = name;
+        stage->start = esp_timer_get_time();
+        stage->end = end ? end : stage->start;
+        stage->core = xPortGetCoreID();
+        strlcpy(stage->task, pcTaskGetTaskName(NULL), sizeof(stage->task));
+
+        if (end)
+            running++;
+    }
+    pthread_mutex_unlock(&boot_mutex);
+
+    return id;
+}
+
+int boot_begin(const char *name) {
+    return _boot_add(name, -1);
+}
+
+void boot_end(int stage) {
+    int report;
+
+    if (stage < 0 || stage >= BOOT_STAGE_MAX)
+        return;
+
+    pthread_mutex_lock(&boot_mutex);
+    stages[stage].end = esp_timer_get_time();
+    report = --running == 0 && finished;
+    pthread_mutex_unlock(&boot_mutex);
+
+    if (report)
+        boot_report();
+}
+
+void boot_mark(const char *name) {
+    _boot_add(name, 0);
+}
+
+void boot_finish() {
+    int report;
+
+    pthread_mutex_lock(&boot_mutex);
+    finished = 1;
+    report = running == 0;
+    pthread_mutex_unlock(&boot_mutex);
+
+    if (report)
+        boot_report();
+}
+
+void boot_report() {
+    struct boot_stage *stage;
+    s64 last = 0;
+    int i;
+
+    ESP_LOGI(TAG, "boot timeline (%d stages)", stage_count);
+
+    for (i = 0; i < stage_count; i++) {
+        stage = &stages[i];
+
+        if (stage->end < 0) {
+            ESP_LOGI(TAG, "%8.1f ->  running                    core %d %-13s %s", stage->start * 1e-3f,
+                     stage->core, stage->task, stage->name);
+        } else if (stage->end == stage->start) {
+            ESP_LOGI(TAG, "%8.1f ms                             core %d %-13s %s", stage->start * 1e-3f,
+                     stage->core, stage->task, stage->name);
+        } else {
+            ESP_LOGI(TAG, "%8.1f -> %8.1f ms (%7.1f)         core %d %-13s %s", stage->start * 1e-3f,
+                     stage->end * 1e-3f, (stage->end - stage->start) * 1e-3f, stage->core, stage->task, stage->name);
+        }
+
+        if (stage->end > last)
+            last = stage->end;
+    }
+
+    ESP_LOGI(TAG, "boot finished after %.1f ms", last * 1e-3f);
+}
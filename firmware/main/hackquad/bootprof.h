@@ -0,0 +1,70 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HACKQUAD_BOOTPROF_H
+#define HACKQUAD_BOOTPROF_H
+
+#include "hackquad/lint_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* max stages/marks recorded, extra ones are dropped */
+#define BOOT_STAGE_MAX 24
+
+/*
+ * Boot timeline, stages may run on different tasks at the same time. Once
+ * boot_finish() was called and every begun stage has ended, the timeline is
+ * logged (start -> end, duration, core and task of each stage).
+ */
+
+/**
+ * Starts timing a boot stage.
+ *
+ * @param name - must outlive the boot (string literal)
+ * @return handle for boot_end() or -1 if the timeline is full
+ */
+int boot_begin(const char *name);
+
+/**
+ * Ends a stage started with boot_begin().
+ */
+void boot_end(int stage);
+
+/**
+ * Records a single point in time, e.g. a task becoming ready.
+ */
+void boot_mark(const char *name);
+
+/**
+ * Called once no more stages will be started, the timeline is reported as soon
+ * as the last running stage ends.
+ */
+void boot_finish();
+
+/**
+ * Logs the timeline recorded so far.
+ */
+void boot_report();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HACKQUAD_BOOTPROF_H */
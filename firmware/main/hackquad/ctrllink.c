@@ -0,0 +1,168 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "hackquad/ctrllink.h"
+#include "hackquad/regbatch.h"
+#include "hackquad/sysmem.h"
+#include "hackquad/trace.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "pthread.h"
+
+static struct hq_link link;
+static struct control_data control;
+static pthread_mutex_t control_mutex = PTHREAD_MUTEX_INITIALIZER;
+static void (*control_notify)();
+static struct ctrllink_stats stats;
+
+/* every packet the quad sends goes through here, id first */
+static ssize_t ctrllink_send(const u8 *data, size_t len) {
+    ssize_t ret;
+
+    trace_begin(TRACE_LINK_SEND, data[0]);
+    ret = hq_link_send(&link, data, len);
+    trace_end(TRACE_LINK_SEND, data[0]);
+    return ret;
+}
+
+static void ctrllink_recv_handler(int id, u8 *data, size_t len) {
+    static u8 regbatch_ack[REGBATCH_ACK_SIZE];
+    size_t ack_len;
+    float values[4];
+
+    trace_begin(TRACE_LINK_RECV, id);
+    switch (id) {
+        default:
+            ESP_LOGE(TAG, "packet of unknown id recv-ed, id = %i", id);
+            stats.unknown++;
+            break;
+
+        /* UPDATE_CONTROL */
+        case CTRLLINK_CONTROL_ID:
+            if (len < 16) {
+                stats.rejected++;
+                break;
+            }
+
+            // frames aren't aligned for floats
+            memcpy(values, data, sizeof(values));
+
+            // pseudo-mutex created here by the notify as we can be fairly confident that once notified, the flight
+            // controller loop will process this WAY before our next control data update
+            // could modify the data and cause problems
+            pthread_mutex_lock(&control_mutex);
+            control.throttle = values[0];
+            control.x        = values[1];
+            control.y        = values[2];
+            control.z        = values[3];
+
+            // TODO create u8 flags var which stores clear panic mode and en stabilization info
+            //      or keep as is and maintain stabilization for some period after zero throttle
+            //      maybe use accel values and maintain stabilization until down-accel is zero
+
+            // use sign bit to indicate that we wish to reset panic-mode detection
+            control.flag_clear_panicmode = (*((u32 *) &control.throttle) & CTRLLINK_FLAG_PANIC_MODE) != 0;
+            *((u32 *) &control.throttle) &= ~CTRLLINK_FLAG_PANIC_MODE;
+
+            // send timestamp, older controllers don't have one
+            control.sent = 0;
+            if (len >= 20)
+                memcpy(&control.sent, data + 16, sizeof(control.sent));
+            control.recv = esp_timer_get_time();
+            pthread_mutex_unlock(&control_mutex);
+            stats.control++;
+
+            // notify new data
+            if (control_notify)
+                control_notify();
+            break;
+
+        /* REGISTRY_BATCH */
+        case REGBATCH_PACKET_ID:
+            // acks larger than the transport allows are truncated, the controller re-sends what's missing
+            ack_len = hq_link_mtu(&link);
+            if (ack_len > sizeof(regbatch_ack))
+                ack_len = sizeof(regbatch_ack);
+
+            ack_len = regbatch_process(data, len, regbatch_ack, ack_len);
+            stats.regbatch++;
+            if (ack_len)
+                ctrllink_send(regbatch_ack, ack_len);
+            break;
+    }
+    trace_end(TRACE_LINK_RECV, id);
+}
+
+void ctrllink_init(struct hq_transport *transport, void (*notify)()) {
+    link.transport = transport;
+    link.recv_handler = ctrllink_recv_handler;
+    control_notify = notify;
+    sysmem_add(SYSMEM_LINK, sizeof(link) + sizeof(control));
+
+    ESP_LOGI(TAG, "control link using %s transport", transport->ops->name);
+}
+
+int ctrllink_yield() {
+    return hq_link_yield(&link);
+}
+
+void ctrllink_get_control(struct control_data *out) {
+    pthread_mutex_lock(&control_mutex);
+    memcpy(out, &control, sizeof(*out));
+    pthread_mutex_unlock(&control_mutex);
+}
+
+ssize_t ctrllink_send_status(struct status_update *status) {
+    status->id = CTRLLINK_STATUS_ID;
+    return ctrllink_send((u8 *) status, sizeof(*status));
+}
+
+/* 0.5% steps, a task can't take more than one core */
+static u8 cpu_load_u8(float load) {
+    return load <= 0 ? 0 : load >= 100.f ? 200 : (u8) (load * 2.f + 0.5f);
+}
+
+ssize_t ctrllink_send_cpu(const struct syscpu_report *report) {
+    struct cpu_update update;
+    size_t i;
+
+    update.id = CTRLLINK_CPU_ID;
+    update.window = report->window / 100 > 255 ? 255 : report->window / 100;
+    update.cores = report->cores;
+    update.count = report->tasks_len < CTRLLINK_CPU_TASKS ? report->tasks_len : CTRLLINK_CPU_TASKS;
+
+    for (i = 0; i < SYSCPU_CORES; i++)
+        update.core_load[i] = i < report->cores ? cpu_load_u8(report->core_load[i]) : 0;
+
+    for (i = 0; i < update.count; i++) {
+        strncpy(update.tasks[i].name, report->tasks[i].name, sizeof(update.tasks[i].name));
+        update.tasks[i].core = report->tasks[i].core;
+        update.tasks[i].load = cpu_load_u8(report->tasks[i].load);
+    }
+
+    return ctrllink_send((u8 *) &update, offsetof(struct cpu_update, tasks) + update.count * sizeof(update.tasks[0]));
+}
+
+void ctrllink_get_stats(struct ctrllink_stats *out) {
+    // only written by the link task, a torn read is off by one at most
+    *out = stats;
+    out->dropped = link.dropped;
+}
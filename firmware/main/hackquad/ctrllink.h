@@ -0,0 +1,135 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HACKQUAD_CTRLLINK_H
+#define HACKQUAD_CTRLLINK_H
+
+#include <sys/types.h>
+
+#include "hackquad/lint_defs.h"
+#include "hackquad/transport.h"
+#include "hackquad/syscpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Packet handling of the control link, shared by the firmware and the host
+ * build of the quad's network services (host/virtual_quad.c).
+ *
+ * control (CTRLLINK_CONTROL_ID), little-endian:
+ *   | throttle f32 | x f32 | y f32 | z f32 | (sent u32) |
+ *   throttle is 0-1, its sign bit requests clearing panic-mode. sent is the
+ *   controller's ms send time, missing from older controllers.
+ *
+ * status (CTRLLINK_STATUS_ID), every STATUS_UPDATE_RATE:
+ *   | battery f32 | rssi s8 | fc_loop_time f32 | x f32 | y f32 | z f32 |
+ *
+ * cpu (CTRLLINK_CPU_ID), every SYSCPU_SAMPLE_MS, loads in 0.5% of one core:
+ *   | window u8 | cores u8 | core_load u8[2] | count u8 | count * (name char[8] | core s8 | load u8) |
+ *   window is in 100ms, tasks are the busiest count (up to CTRLLINK_CPU_TASKS),
+ *   names are cut to 8 chars and not terminated when they fill them.
+ */
+
+#define CTRLLINK_CONTROL_ID 69
+#define CTRLLINK_STATUS_ID  20
+#define CTRLLINK_CPU_ID     22
+
+#define CTRLLINK_CPU_TASKS  8
+
+#define CTRLLINK_FLAG_PANIC_MODE (1u << 31)
+
+struct control_data {
+    float throttle, x, y, z;  /* throttle 0-1 */
+    int flag_clear_panicmode;
+    u32 sent;  /* ms controller timestamp, 0 from controllers that don't send one */
+    u64 recv;
+};
+
+struct ctrllink_stats {
+    u32 control;   /* control packets handled */
+    u32 regbatch;  /* registry batches handled */
+    u32 rejected;  /* payload too short for its id */
+    u32 unknown;   /* unknown ids */
+    u32 dropped;   /* by the framing, see struct hq_link */
+};
+
+struct __attribute__((packed)) status_update {
+    u8 id;
+    float battery;
+    s8 rssi;
+    float fc_loop_time;
+    float x, y, z;
+};
+
+struct __attribute__((packed)) cpu_update_task {
+    char name[8];
+    s8 core;
+    u8 load;
+};
+
+struct __attribute__((packed)) cpu_update {
+    u8 id;
+    u8 window;
+    u8 cores;
+    u8 core_load[SYSCPU_CORES];
+    u8 count;
+    struct cpu_update_task tasks[CTRLLINK_CPU_TASKS];
+};
+
+/**
+ * @param transport
+ * @param notify - called from the link task after new control data came in, may be NULL
+ */
+void ctrllink_init(struct hq_transport *transport, void (*notify)());
+
+/**
+ * Receives and handles one frame, blocking. See hq_link_yield().
+ */
+int ctrllink_yield();
+
+/**
+ * Copies out the latest control data.
+ */
+void ctrllink_get_control(struct control_data *out);
+
+/**
+ * Sends a status update to the controller (status->id is set here).
+ *
+ * @return amount of data sent, 0 if no controller has connected yet
+ */
+ssize_t ctrllink_send_status(struct status_update *status);
+
+/**
+ * Sends the busiest tasks of report to the controller.
+ *
+ * @return amount of data sent, 0 if no controller has connected yet
+ */
+ssize_t ctrllink_send_cpu(const struct syscpu_report *report);
+
+/**
+ * Counters since boot, read them twice and subtract for a rate.
+ */
+void ctrllink_get_stats(struct ctrllink_stats *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HACKQUAD_CTRLLINK_H */
@@ -0,0 +1,139 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "hackquad/espnow.h"
+#include "hackquad/sysmem.h"
+#include "esp_now.h"
+#include "esp_wifi.h"
+#include "esp_log.h"
+
+struct espnow_frame {
+    u8 src[6];
+    u8 len;
+    u8 data[ESPNOW_FRAME_SIZE];
+};
+
+/* recv callback has no user arg */
+static struct espnow_context *espnow_ctx;
+
+/* only one context may exist, its queue is static */
+static StaticQueue_t queue_buf;
+static u8 queue_storage[ESPNOW_QUEUE_LEN * sizeof(struct espnow_frame)];
+
+static void espnow_recv_cb(const u8 *mac_addr, const u8 *data, int len) {
+    struct espnow_frame frame;
+
+    if (len <= 0 || len > ESPNOW_FRAME_SIZE)
+        return;
+
+    memcpy(frame.src, mac_addr, sizeof(frame.src));
+    frame.len = len;
+    memcpy(frame.data, data, len);
+
+    // runs on the wifi task, never block it
+    if (xQueueSend(espnow_ctx->queue, &frame, 0) != pdTRUE)
+        espnow_ctx->dropped++;
+}
+
+static int espnow_set_peer(struct espnow_context *ctx, const u8 *mac) {
+    esp_now_peer_info_t peer;
+    wifi_mode_t mode;
+
+    if (ctx->has_peer && !memcmp(ctx->peer, mac, sizeof(ctx->peer)))
+        return ESP_OK;
+
+    if (!esp_now_is_peer_exist(mac)) {
+        memset(&peer, 0, sizeof(peer));
+        memcpy(peer.peer_addr, mac, sizeof(peer.peer_addr));
+        peer.channel = 0; // whatever channel wifi is currently on
+        peer.ifidx = !esp_wifi_get_mode(&mode) && mode == WIFI_MODE_STA ? WIFI_IF_STA : WIFI_IF_AP;
+        peer.encrypt = false;
+
+        if (esp_now_add_peer(&peer)) {
+            ESP_LOGE(TAG, "failed to add esp-now peer " MACSTR, MAC2STR(mac));
+            return ESP_FAIL;
+        }
+    }
+
+    memcpy(ctx->peer, mac, sizeof(ctx->peer));
+    ctx->has_peer = true;
+    return ESP_OK;
+}
+
+static ssize_t espnow_recv(struct hq_transport *transport, u8 *buf, size_t len) {
+    struct espnow_context *ctx = (struct espnow_context *) transport;
+    struct espnow_frame frame;
+
+    if (xQueueReceive(ctx->queue, &frame, portMAX_DELAY) != pdTRUE)
+        return -1;
+
+    if (espnow_set_peer(ctx, frame.src))
+        return -1;
+
+    if (frame.len < len)
+        len = frame.len;
+
+    memcpy(buf, frame.data, len);
+    return len;
+}
+
+static ssize_t espnow_send(struct hq_transport *transport, const u8 *data, size_t len) {
+    struct espnow_context *ctx = (struct espnow_context *) transport;
+
+    if (!ctx->has_peer)
+        return 0;
+
+    if (len > ESPNOW_FRAME_SIZE || esp_now_send(ctx->peer, data, len))
+        return -1;
+
+    return len;
+}
+
+static const struct hq_transport_ops espnow_transport_ops = {
+        .name = "espnow",
+        .mtu  = ESPNOW_FRAME_SIZE,
+        .recv = espnow_recv,
+        .send = espnow_send
+};
+
+int espnow_create(struct espnow_context *ctx) {
+    if (espnow_ctx) {
+        ESP_LOGE(TAG, "esp-now transport already created");
+        return ESP_FAIL;
+    }
+
+    ctx->queue = xQueueCreateStatic(ESPNOW_QUEUE_LEN, sizeof(struct espnow_frame), queue_storage, &queue_buf);
+
+    ctx->has_peer = false;
+    ctx->dropped = 0;
+    ctx->transport.ops = &espnow_transport_ops;
+    espnow_ctx = ctx;
+
+    if (esp_now_init() || esp_now_register_recv_cb(espnow_recv_cb)) {
+        ESP_LOGE(TAG, "failed to start esp-now");
+        espnow_ctx = NULL;
+        vQueueDelete(ctx->queue);
+        return ESP_FAIL;
+    }
+
+    sysmem_add(SYSMEM_ESPNOW, sizeof(queue_storage) + sizeof(queue_buf));
+    ESP_LOGI(TAG, "esp-now transport started");
+    return ESP_OK;
+}
@@ -0,0 +1,67 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HACKQUAD_ESPNOW_H
+#define HACKQUAD_ESPNOW_H
+
+#include "hackquad/lint_defs.h"
+#include "hackquad/transport.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESPNOW_QUEUE_LEN  8   /* frames buffered between the wifi task and the link task */
+#define ESPNOW_FRAME_SIZE 250 /* ESP_NOW_MAX_DATA_LEN */
+
+/*
+ * ESP-NOW transport of the control link, see transport.h. Connectionless
+ * vendor action frames straight from the wifi driver, no association, ip or
+ * sockets involved. Needs wifi started (either mode), the controller has to be
+ * on the same channel. Frames are limited to ESPNOW_FRAME_SIZE, so registry
+ * batches have to be kept small when using it.
+ */
+struct espnow_context {
+    struct hq_transport transport;
+
+    /* PRIVATE */
+    QueueHandle_t queue;
+
+    /* sender of the last frame, replies go here */
+    u8 peer[6];
+    bool has_peer;
+
+    /* frames dropped because the queue was full */
+    u32 dropped;
+};
+
+/**
+ * Starts ESP-NOW, only one context may exist.
+ *
+ * @param ctx - ctx->transport is ready to use on success
+ * @return ESP_OK/FAIL
+ */
+int espnow_create(struct espnow_context *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HACKQUAD_ESPNOW_H */
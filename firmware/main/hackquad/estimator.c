@@ -0,0 +1,400 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "hackquad/estimator.h"
+
+#define G_ACCL 9.80665f
+
+/* how far |acc| is off 1g, relative */
+static inline float acc_error(const vec3f_t *acc) {
+    return fabsf(sqrtf(acc->x * acc->x + acc->y * acc->y + acc->z * acc->z) / G_ACCL - 1.f);
+}
+
+/* roll/pitch from gravity alone, yaw 0. identity if there is no reading yet */
+static void quaternion_from_acc(quaternion_t *q, const vec3f_t *acc) {
+    float roll, pitch, cr, sr, cp, sp;
+
+    if (acc->x == 0.f && acc->y == 0.f && acc->z == 0.f) {
+        q->w = 1.f;
+        q->x = q->y = q->z = 0.f;
+        return;
+    }
+
+    roll = atan2f(acc->y, acc->z);
+    pitch = atan2f(-acc->x, sqrtf(acc->y * acc->y + acc->z * acc->z));
+    cr = cosf(roll / 2.f);
+    sr = sinf(roll / 2.f);
+    cp = cosf(pitch / 2.f);
+    sp = sinf(pitch / 2.f);
+
+    q->w = cr * cp;
+    q->x = sr * cp;
+    q->y = cr * sp;
+    q->z = -sr * sp;
+}
+
+static void quaternion_normalize(quaternion_t *q) {
+    float norm = 1.f / sqrtf(q->w * q->w + q->x * q->x + q->y * q->y + q->z * q->z);
+
+    q->w *= norm;
+    q->x *= norm;
+    q->y *= norm;
+    q->z *= norm;
+}
+
+/* q += 0.5 * q x (0, w) * dt, w in rad/s */
+static void quaternion_integrate(quaternion_t *q, float wx, float wy, float wz, float dt) {
+    float hdt = 0.5f * dt, w = q->w, x = q->x, y = q->y, z = q->z;
+
+    q->w += (-x * wx - y * wy - z * wz) * hdt;
+    q->x += ( w * wx + y * wz - z * wy) * hdt;
+    q->y += ( w * wy - x * wz + z * wx) * hdt;
+    q->z += ( w * wz + x * wy - y * wx) * hdt;
+    quaternion_normalize(q);
+}
+
+static void quaternion_angle(quaternion_t *q, vec3f_t *rpy) {
+    vec3f_t gravity;
+
+    quaternion_get_gravity(q, &gravity);
+    quaternion_euler(q, &gravity, rpy);
+}
+
+/* MADGWICK */
+
+static void madgwick_est_init(struct estimator *est, const vec3f_t *acc) {
+    madgwick_init_adaptive(&est->madgwick, MADGWICK_GYRO_ERR, MADGWICK_REST_ERR);
+    quaternion_from_acc(&est->madgwick.q, acc);
+}
+
+static void madgwick_est_update(struct estimator *est, const struct estimator_input *in) {
+    if (est->adaptive) {
+        // high gain at rest/after a crash so it re-converges quickly, accel gated by its distance from 1g
+        est->madgwick.rest = in->rest;
+        madgwick_update_adaptive(&est->madgwick, in->dt, G_ACCL, in->acc.x, in->acc.y, in->acc.z,
+                                 in->gyr.x * DEG_TO_RAD, in->gyr.y * DEG_TO_RAD, in->gyr.z * DEG_TO_RAD);
+    } else {
+        madgwick_update(&est->madgwick, in->dt, in->acc.x, in->acc.y, in->acc.z,
+                        in->gyr.x * DEG_TO_RAD, in->gyr.y * DEG_TO_RAD, in->gyr.z * DEG_TO_RAD);
+    }
+}
+
+static void madgwick_est_angle(struct estimator *est, vec3f_t *rpy) {
+    quaternion_angle(&est->madgwick.q, rpy);
+}
+
+static const struct estimator_ops madgwick_ops = {
+    .name = "madgwick",
+    .init = madgwick_est_init,
+    .update = madgwick_est_update,
+    .angle = madgwick_est_angle
+};
+
+/* COMPLEMENTARY */
+
+static void comp_init(struct estimator *est, const vec3f_t *acc) {
+    memset(&est->comp, 0, sizeof(est->comp));
+
+    if (acc->x != 0.f || acc->y != 0.f || acc->z != 0.f) {
+        est->comp.angle.x = atan2f(acc->y, acc->z) * RAD_TO_DEG;
+        est->comp.angle.y = atanf(-acc->x / sqrtf(acc->y * acc->y + acc->z * acc->z)) * RAD_TO_DEG;
+    }
+}
+
+static void comp_update(struct estimator *est, const struct estimator_input *in) {
+    comp_ahrs_t *f = &est->comp;
+    float comp_acc, comp_gyr;
+
+    comp_acc = COMP_ACC_WEIGHT * expf(-COMP_ACC_GATE * acc_error(&in->acc));
+    comp_gyr = 1.f - comp_acc;
+
+    f->angle.x = (f->angle.x + in->gyr.x * in->dt) * comp_gyr +
+                 atan2f(in->acc.y, in->acc.z) * RAD_TO_DEG * comp_acc;
+    f->angle.y = (f->angle.y + in->gyr.y * in->dt) * comp_gyr +
+                 atanf(-in->acc.x / sqrtf(in->acc.y * in->acc.y + in->acc.z * in->acc.z)) * RAD_TO_DEG * comp_acc;
+}
+
+static void comp_angle(struct estimator *est, vec3f_t *rpy) {
+    *rpy = est->comp.angle;
+}
+
+static const struct estimator_ops comp_ops = {
+    .name = "complementary",
+    .init = comp_init,
+    .update = comp_update,
+    .angle = comp_angle
+};
+
+/* MAHONY */
+
+static void mahony_init(struct estimator *est, const vec3f_t *acc) {
+    memset(&est->mahony, 0, sizeof(est->mahony));
+    quaternion_from_acc(&est->mahony.q, acc);
+}
+
+static void mahony_update(struct estimator *est, const struct estimator_input *in) {
+    mahony_ahrs_t *f = &est->mahony;
+    float gx = in->gyr.x * DEG_TO_RAD, gy = in->gyr.y * DEG_TO_RAD, gz = in->gyr.z * DEG_TO_RAD;
+    float norm, weight, kp, acc_err, ax, ay, az, ex, ey, ez;
+    vec3f_t v;
+
+    acc_err = acc_error(&in->acc);
+    if (acc_err < MADGWICK_ACC_REJECT) {
+        weight = expf(-MADGWICK_ACC_GATE * acc_err);
+        kp = (in->rest ? MAHONY_REST_KP : MAHONY_KP) * weight;
+
+        norm = 1.f / sqrtf(in->acc.x * in->acc.x + in->acc.y * in->acc.y + in->acc.z * in->acc.z);
+        ax = in->acc.x * norm;
+        ay = in->acc.y * norm;
+        az = in->acc.z * norm;
+
+        // error is the rotation between measured and estimated gravity
+        quaternion_get_gravity(&f->q, &v);
+        ex = ay * v.z - az * v.y;
+        ey = az * v.x - ax * v.z;
+        ez = ax * v.y - ay * v.x;
+
+        f->integral.x += MAHONY_KI * weight * ex * in->dt;
+        f->integral.y += MAHONY_KI * weight * ey * in->dt;
+        f->integral.z += MAHONY_KI * weight * ez * in->dt;
+
+        gx += kp * ex;
+        gy += kp * ey;
+        gz += kp * ez;
+    }
+
+    quaternion_integrate(&f->q, gx + f->integral.x, gy + f->integral.y, gz + f->integral.z, in->dt);
+}
+
+static void mahony_angle(struct estimator *est, vec3f_t *rpy) {
+    quaternion_angle(&est->mahony.q, rpy);
+}
+
+static const struct estimator_ops mahony_ops = {
+    .name = "mahony",
+    .init = mahony_init,
+    .update = mahony_update,
+    .angle = mahony_angle
+};
+
+/* ESKF
+ *
+ * Nominal state is the attitude quaternion and the gyro bias, the filter runs
+ * on the 6-dim error (small body frame rotation, bias error) around it:
+ *
+ *   predict: q = q x exp((w - b) dt)
+ *            F = | I - [w]x dt   -I dt |
+ *                | 0              I    |
+ *   update:  h = gravity(q), H = | [h]x  0 |, z = acc / |acc|
+ *
+ * and the error is folded back into q/b after every update. Yaw isn't
+ * observable from the accel, its variance just grows.
+ */
+
+static void eskf_init(struct estimator *est, const vec3f_t *acc) {
+    eskf_ahrs_t *f = &est->eskf;
+    int i;
+
+    memset(f, 0, sizeof(*f));
+    quaternion_from_acc(&f->q, acc);
+
+    for (i = 0; i < 3; i++) {
+        f->P[i][i] = ESKF_INIT_ANGLE * ESKF_INIT_ANGLE;
+        f->P[i + 3][i + 3] = ESKF_INIT_BIAS * ESKF_INIT_BIAS;
+    }
+}
+
+static void eskf_predict(eskf_ahrs_t *f, const float w[3], float dt) {
+    float A[3][3], FP[6][6], s;
+    int i, j, k;
+
+    // A = I - [w]x dt
+    A[0][0] = 1.f;        A[0][1] = w[2] * dt;  A[0][2] = -w[1] * dt;
+    A[1][0] = -w[2] * dt; A[1][1] = 1.f;        A[1][2] = w[0] * dt;
+    A[2][0] = w[1] * dt;  A[2][1] = -w[0] * dt; A[2][2] = 1.f;
+
+    // FP = F * P
+    for (j = 0; j < 6; j++) {
+        for (i = 0; i < 3; i++) {
+            s = -dt * f->P[i + 3][j];
+            for (k = 0; k < 3; k++)
+                s += A[i][k] * f->P[k][j];
+            FP[i][j] = s;
+            FP[i + 3][j] = f->P[i + 3][j];
+        }
+    }
+
+    // P = FP * F^T + Q
+    for (i = 0; i < 6; i++) {
+        for (j = 0; j < 3; j++) {
+            s = -dt * FP[i][j + 3];
+            for (k = 0; k < 3; k++)
+                s += FP[i][k] * A[j][k];
+            f->P[i][j] = s;
+            f->P[i][j + 3] = FP[i][j + 3];
+        }
+    }
+
+    for (i = 0; i < 3; i++) {
+        f->P[i][i] += ESKF_GYRO_NOISE * ESKF_GYRO_NOISE * dt;
+        f->P[i + 3][i + 3] += ESKF_BIAS_NOISE * ESKF_BIAS_NOISE * dt;
+    }
+}
+
+static void eskf_correct(eskf_ahrs_t *f, const vec3f_t *acc, float acc_err) {
+    float H[3][3], PHt[6][3], S[3][3], Si[3][3], K[6][3], r[3], dx[6], sigma, norm, det, s;
+    quaternion_t dq, q = f->q;
+    vec3f_t h;
+    int i, j, k;
+
+    quaternion_get_gravity(&f->q, &h);
+
+    // H = [h]x (attitude part only, bias doesn't show in the accel)
+    H[0][0] = 0.f;   H[0][1] = -h.z; H[0][2] = h.y;
+    H[1][0] = h.z;   H[1][1] = 0.f;  H[1][2] = -h.x;
+    H[2][0] = -h.y;  H[2][1] = h.x;  H[2][2] = 0.f;
+
+    for (i = 0; i < 6; i++) {
+        for (j = 0; j < 3; j++) {
+            s = 0.f;
+            for (k = 0; k < 3; k++)
+                s += f->P[i][k] * H[j][k];
+            PHt[i][j] = s;
+        }
+    }
+
+    // less trust in the accel the further it is from 1g
+    sigma = ESKF_ACC_NOISE + ESKF_ACC_GATE * acc_err;
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
+            s = i == j ? sigma * sigma : 0.f;
+            for (k = 0; k < 3; k++)
+                s += H[i][k] * PHt[k][j];
+            S[i][j] = s;
+        }
+    }
+
+    // 3x3 inverse by cofactors
+    Si[0][0] = S[1][1] * S[2][2] - S[1][2] * S[2][1];
+    Si[0][1] = S[0][2] * S[2][1] - S[0][1] * S[2][2];
+    Si[0][2] = S[0][1] * S[1][2] - S[0][2] * S[1][1];
+    Si[1][0] = S[1][2] * S[2][0] - S[1][0] * S[2][2];
+    Si[1][1] = S[0][0] * S[2][2] - S[0][2] * S[2][0];
+    Si[1][2] = S[0][2] * S[1][0] - S[0][0] * S[1][2];
+    Si[2][0] = S[1][0] * S[2][1] - S[1][1] * S[2][0];
+    Si[2][1] = S[0][1] * S[2][0] - S[0][0] * S[2][1];
+    Si[2][2] = S[0][0] * S[1][1] - S[0][1] * S[1][0];
+
+    det = S[0][0] * Si[0][0] + S[0][1] * Si[1][0] + S[0][2] * Si[2][0];
+    if (fabsf(det) < 1e-20f)
+        return;
+
+    det = 1.f / det;
+    for (i = 0; i < 3; i++)
+        for (j = 0; j < 3; j++)
+            Si[i][j] *= det;
+
+    for (i = 0; i < 6; i++) {
+        for (j = 0; j < 3; j++) {
+            K[i][j] = PHt[i][0] * Si[0][j] + PHt[i][1] * Si[1][j] + PHt[i][2] * Si[2][j];
+        }
+    }
+
+    norm = 1.f / sqrtf(acc->x * acc->x + acc->y * acc->y + acc->z * acc->z);
+    r[0] = acc->x * norm - h.x;
+    r[1] = acc->y * norm - h.y;
+    r[2] = acc->z * norm - h.z;
+
+    for (i = 0; i < 6; i++)
+        dx[i] = K[i][0] * r[0] + K[i][1] * r[1] + K[i][2] * r[2];
+
+    // P = (I - K H) P, H P = (P H^T)^T as P is symmetric
+    for (i = 0; i < 6; i++)
+        for (j = 0; j < 6; j++)
+            f->P[i][j] -= K[i][0] * PHt[j][0] + K[i][1] * PHt[j][1] + K[i][2] * PHt[j][2];
+
+    for (i = 0; i < 6; i++) {
+        for (j = i + 1; j < 6; j++) {
+            s = 0.5f * (f->P[i][j] + f->P[j][i]);
+            f->P[i][j] = f->P[j][i] = s;
+        }
+    }
+
+    // fold the error back into the nominal state, q = q x (1, dtheta/2)
+    dq.w = 1.f;
+    dq.x = 0.5f * dx[0];
+    dq.y = 0.5f * dx[1];
+    dq.z = 0.5f * dx[2];
+
+    f->q.w = q.w * dq.w - q.x * dq.x - q.y * dq.y - q.z * dq.z;
+    f->q.x = q.w * dq.x + q.x * dq.w + q.y * dq.z - q.z * dq.y;
+    f->q.y = q.w * dq.y - q.x * dq.z + q.y * dq.w + q.z * dq.x;
+    f->q.z = q.w * dq.z + q.x * dq.y - q.y * dq.x + q.z * dq.w;
+    quaternion_normalize(&f->q);
+
+    f->bias.x += dx[3];
+    f->bias.y += dx[4];
+    f->bias.z += dx[5];
+}
+
+static void eskf_update(struct estimator *est, const struct estimator_input *in) {
+    eskf_ahrs_t *f = &est->eskf;
+    float w[3], acc_err;
+
+    w[0] = in->gyr.x * DEG_TO_RAD - f->bias.x;
+    w[1] = in->gyr.y * DEG_TO_RAD - f->bias.y;
+    w[2] = in->gyr.z * DEG_TO_RAD - f->bias.z;
+
+    quaternion_integrate(&f->q, w[0], w[1], w[2], in->dt);
+    eskf_predict(f, w, in->dt);
+
+    acc_err = acc_error(&in->acc);
+    if (acc_err < MADGWICK_ACC_REJECT)
+        eskf_correct(f, &in->acc, acc_err);
+}
+
+static void eskf_angle(struct estimator *est, vec3f_t *rpy) {
+    quaternion_angle(&est->eskf.q, rpy);
+}
+
+static const struct estimator_ops eskf_ops = {
+    .name = "eskf",
+    .init = eskf_init,
+    .update = eskf_update,
+    .angle = eskf_angle
+};
+
+const struct estimator_ops *const estimators[ESTIMATOR_COUNT] = {
+    [ESTIMATOR_MADGWICK]      = &madgwick_ops,
+    [ESTIMATOR_COMPLEMENTARY] = &comp_ops,
+    [ESTIMATOR_MAHONY]        = &mahony_ops,
+    [ESTIMATOR_ESKF]          = &eskf_ops
+};
+
+int estimator_select(struct estimator *est, u8 type, const vec3f_t *acc) {
+    if (type >= ESTIMATOR_COUNT)
+        return -1;
+
+    est->ops = estimators[type];
+    est->type = type;
+    est->ops->init(est, acc);
+    return 0;
+}
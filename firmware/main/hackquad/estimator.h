@@ -0,0 +1,142 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HACKQUAD_ESTIMATOR_H
+#define HACKQUAD_ESTIMATOR_H
+
+#include <stdbool.h>
+
+#include "hackquad/lint_defs.h"
+#include "flightmath.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Attitude estimators behind a common interface, the active one is picked by
+ * MPU_ESTIMATOR in the registry and can be switched at run time. Switching
+ * (re)starts the new estimator from the current accel reading.
+ *
+ * Everything in here is plain math on the sample passed in, so it also builds
+ * on the host (see firmware/host/bench_estimator.c).
+ */
+
+enum estimator_type {
+    ESTIMATOR_MADGWICK      = 0, /* gradient descent, adaptive gain with mpu_ahrs_adaptive */
+    ESTIMATOR_COMPLEMENTARY = 1, /* euler angles, accel weight gated by |acc| (the old ANGLE_MODE 1) */
+    ESTIMATOR_MAHONY        = 2, /* PI feedback on the gravity error, integral soaks up residual gyro bias */
+    ESTIMATOR_ESKF          = 3, /* error-state kalman, attitude + gyro bias */
+    ESTIMATOR_COUNT
+};
+
+/* madgwick, see madgwick_init_adaptive() */
+#define MADGWICK_GYRO_ERR 5.f
+#define MADGWICK_REST_ERR 60.f
+
+/* complementary */
+#define COMP_ACC_WEIGHT 0.006f  /* per update at 1g */
+#define COMP_ACC_GATE   4.f     /* weight *= exp(-gate * | |acc|/g - 1 |) */
+
+/* mahony */
+#define MAHONY_KP      1.f      /* 1/s */
+#define MAHONY_KI      0.05f    /* 1/s^2 */
+#define MAHONY_REST_KP 10.f     /* at rest, converges quickly like the adaptive madgwick */
+
+/* eskf, noise densities */
+#define ESKF_GYRO_NOISE  0.005f  /* rad/s */
+#define ESKF_BIAS_NOISE  0.0002f /* rad/s per sqrt(s) */
+#define ESKF_ACC_NOISE   0.05f   /* std dev of the normalized accel direction */
+#define ESKF_ACC_GATE    5.f     /* acc noise += gate * | |acc|/g - 1 | */
+#define ESKF_INIT_ANGLE  0.2f    /* rad, initial std dev of the attitude error */
+#define ESKF_INIT_BIAS   0.02f   /* rad/s, initial std dev of the gyro bias */
+
+typedef struct {
+    vec3f_t angle; /* deg */
+} comp_ahrs_t;
+
+typedef struct {
+    quaternion_t q;
+    vec3f_t integral; /* rad/s */
+} mahony_ahrs_t;
+
+typedef struct {
+    quaternion_t q;
+    vec3f_t bias;  /* rad/s */
+    float P[6][6]; /* covariance of the attitude error (body frame) and gyro bias */
+} eskf_ahrs_t;
+
+struct estimator_input {
+    float dt;     /* s */
+    vec3f_t acc;  /* m/s^2 */
+    vec3f_t gyr;  /* dps */
+    bool rest;    /* sensor is known to sit still */
+};
+
+struct estimator;
+
+struct estimator_ops {
+    const char *name;
+
+    /* resets the state and seeds the attitude from an accel reading (m/s^2) */
+    void (*init)(struct estimator *est, const vec3f_t *acc);
+    void (*update)(struct estimator *est, const struct estimator_input *in);
+
+    /* rpy in deg, same frame as quaternion_euler() */
+    void (*angle)(struct estimator *est, vec3f_t *rpy);
+};
+
+struct estimator {
+    const struct estimator_ops *ops;
+    u8 type;
+    bool adaptive; /* madgwick only */
+
+    union {
+        madgwick_ahrs_t madgwick;
+        comp_ahrs_t comp;
+        mahony_ahrs_t mahony;
+        eskf_ahrs_t eskf;
+    };
+};
+
+/* indexed by enum estimator_type */
+extern const struct estimator_ops *const estimators[ESTIMATOR_COUNT];
+
+/**
+ * Switches to and initializes an estimator.
+ *
+ * @param est
+ * @param type - enum estimator_type
+ * @param acc  - current accel reading (m/s^2) to start from
+ * @return 0 on success, -1 if type is unknown (est is left untouched)
+ */
+int estimator_select(struct estimator *est, u8 type, const vec3f_t *acc);
+
+static inline void estimator_update(struct estimator *est, const struct estimator_input *in) {
+    est->ops->update(est, in);
+}
+
+static inline void estimator_angle(struct estimator *est, vec3f_t *rpy) {
+    est->ops->angle(est, rpy);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HACKQUAD_ESTIMATOR_H */
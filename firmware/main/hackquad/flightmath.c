@@ -16,20 +16,24 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <stdint.h>
+
 #include "flightmath.h"
 #include "math.h"
 
 /* fast inverse sqrt from Quake III Arena source code */
 static inline float Q_rsqrt(float number) {
-    long i;
+    union {
+        float f;
+        int32_t i; // not long, that's 64-bit on the host build
+    } conv;
     float x2, y;
     const float threehalfs = 1.5F;
 
     x2 = number * 0.5F;
-    y = number;
-    i = *(long *) &y;                       // evil floating point bit level hacking
-    i = 0x5f3759df - (i >> 1);              // what the fuck?
-    y = *(float *) &i;
+    conv.f = number;                        // evil floating point bit level hacking
+    conv.i = 0x5f3759df - (conv.i >> 1);    // what the fuck?
+    y = conv.f;
     y = y * (threehalfs - (x2 * y * y));    // 1st iteration
 //	y  = y * ( threehalfs - ( x2 * y * y ) );   // 2nd iteration, this can be removed
 
@@ -42,9 +46,22 @@ void madgwick_init(madgwick_ahrs_t *ahrs, float gerr) {
     ahrs->q.y = 0.f;
     ahrs->q.z = 0.f;
     ahrs->beta = sqrtf(3.f/4.f) * (gerr * DEG_TO_RAD);
+    ahrs->rbeta = ahrs->beta;
+    ahrs->gain = ahrs->beta;
+    ahrs->err = 0.f;
+    ahrs->lost = 0.f;
+    ahrs->rest = 0;
 }
 
-void madgwick_update(madgwick_ahrs_t *q, float dt, float ax, float ay, float az, float gx, float gy, float gz) {
+void madgwick_init_adaptive(madgwick_ahrs_t *ahrs, float gerr, float rerr) {
+    madgwick_init(ahrs, gerr);
+    ahrs->rbeta = sqrtf(3.f/4.f) * (rerr * DEG_TO_RAD);
+    ahrs->gain = ahrs->rbeta; // nothing known at startup, converge quickly
+}
+
+/* one filter step with the given gain, gain = 0 integrates the gyros only */
+static void madgwick_step(madgwick_ahrs_t *q, float dt, float beta, float ax, float ay, float az, float gx, float gy,
+                          float gz) {
     float q0 = q->q.w, q1 = q->q.x, q2 = q->q.y, q3 = q->q.z;
 
     float norm;
@@ -62,43 +79,48 @@ void madgwick_update(madgwick_ahrs_t *q, float dt, float ax, float ay, float az,
     float x2q1 = 2.0f * q1;
     float x2q2 = 2.0f * q2;
 
-    // Normalise the accelerometer measurement
-    norm = Q_rsqrt(ax * ax + ay * ay + az * az);
-    ax *= norm;
-    ay *= norm;
-    az *= norm;
-    // Compute the objective function and Jacobian
-    f_1 = x2q1 * q3 - x2q0 * q2 - ax;
-    f_2 = x2q0 * q1 + x2q2 * q3 - ay;
-    f_3 = 1.0f - x2q1 * q1 - x2q2 * q2 - az;
-    J_11or24 = x2q2; // J_11 negated in matrix multiplication
-    J_12or23 = 2.0f * q3;
-    J_13or22 = x2q0; // J_12 negated in matrix multiplication
-    J_14or21 = x2q1;
-    J_32 = 2.0f * J_14or21; // negated in matrix multiplication
-    J_33 = 2.0f * J_11or24; // negated in matrix multiplication
-    // Compute the gradient (matrix multiplication)
-    SEqHatDot_1 = J_14or21 * f_2 - J_11or24 * f_1;
-    SEqHatDot_2 = J_12or23 * f_1 + J_13or22 * f_2 - J_32 * f_3;
-    SEqHatDot_3 = J_12or23 * f_2 - J_33 * f_3 - J_13or22 * f_1;
-    SEqHatDot_4 = J_14or21 * f_1 + J_11or24 * f_2;
-    // Normalise the gradient
-    norm = Q_rsqrt(SEqHatDot_1 * SEqHatDot_1 + SEqHatDot_2 * SEqHatDot_2 + SEqHatDot_3 * SEqHatDot_3 +
-                   SEqHatDot_4 * SEqHatDot_4);
-    SEqHatDot_1 *= norm;
-    SEqHatDot_2 *= norm;
-    SEqHatDot_3 *= norm;
-    SEqHatDot_4 *= norm;
+    // accel correction, skipped without gain (also avoids normalizing a zero vector)
+    SEqHatDot_1 = SEqHatDot_2 = SEqHatDot_3 = SEqHatDot_4 = 0.f;
+    if (beta > 0.f) {
+        // Normalise the accelerometer measurement
+        norm = Q_rsqrt(ax * ax + ay * ay + az * az);
+        ax *= norm;
+        ay *= norm;
+        az *= norm;
+        // Compute the objective function and Jacobian
+        f_1 = x2q1 * q3 - x2q0 * q2 - ax;
+        f_2 = x2q0 * q1 + x2q2 * q3 - ay;
+        f_3 = 1.0f - x2q1 * q1 - x2q2 * q2 - az;
+        q->err = f_1 * f_1 + f_2 * f_2 + f_3 * f_3;
+        J_11or24 = x2q2; // J_11 negated in matrix multiplication
+        J_12or23 = 2.0f * q3;
+        J_13or22 = x2q0; // J_12 negated in matrix multiplication
+        J_14or21 = x2q1;
+        J_32 = 2.0f * J_14or21; // negated in matrix multiplication
+        J_33 = 2.0f * J_11or24; // negated in matrix multiplication
+        // Compute the gradient (matrix multiplication)
+        SEqHatDot_1 = J_14or21 * f_2 - J_11or24 * f_1;
+        SEqHatDot_2 = J_12or23 * f_1 + J_13or22 * f_2 - J_32 * f_3;
+        SEqHatDot_3 = J_12or23 * f_2 - J_33 * f_3 - J_13or22 * f_1;
+        SEqHatDot_4 = J_14or21 * f_1 + J_11or24 * f_2;
+        // Normalise the gradient
+        norm = Q_rsqrt(SEqHatDot_1 * SEqHatDot_1 + SEqHatDot_2 * SEqHatDot_2 + SEqHatDot_3 * SEqHatDot_3 +
+                       SEqHatDot_4 * SEqHatDot_4);
+        SEqHatDot_1 *= norm;
+        SEqHatDot_2 *= norm;
+        SEqHatDot_3 *= norm;
+        SEqHatDot_4 *= norm;
+    }
     // Compute the quaternion delta measured by gyroscopes
     SEqDot_omega_1 = -halfq1 * gx - halfq2 * gy - halfq3 * gz;
     SEqDot_omega_2 = halfq0 * gx + halfq2 * gz - halfq3 * gy;
     SEqDot_omega_3 = halfq0 * gy - halfq1 * gz + halfq3 * gx;
     SEqDot_omega_4 = halfq0 * gz + halfq1 * gy - halfq2 * gx;
     // Compute then integrate the estimated quaternion delta
-    q0 += (SEqDot_omega_1 - (q->beta * SEqHatDot_1)) * dt;
-    q1 += (SEqDot_omega_2 - (q->beta * SEqHatDot_2)) * dt;
-    q2 += (SEqDot_omega_3 - (q->beta * SEqHatDot_3)) * dt;
-    q3 += (SEqDot_omega_4 - (q->beta * SEqHatDot_4)) * dt;
+    q0 += (SEqDot_omega_1 - (beta * SEqHatDot_1)) * dt;
+    q1 += (SEqDot_omega_2 - (beta * SEqHatDot_2)) * dt;
+    q2 += (SEqDot_omega_3 - (beta * SEqHatDot_3)) * dt;
+    q3 += (SEqDot_omega_4 - (beta * SEqHatDot_4)) * dt;
     // Normalise quaternion
     norm = Q_rsqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
     q0 *= norm;
@@ -112,6 +134,38 @@ void madgwick_update(madgwick_ahrs_t *q, float dt, float ax, float ay, float az,
     q->q.z = q3;
 }
 
+void madgwick_update(madgwick_ahrs_t *q, float dt, float ax, float ay, float az, float gx, float gy, float gz) {
+    madgwick_step(q, dt, q->beta, ax, ay, az, gx, gy, gz);
+}
+
+void madgwick_update_adaptive(madgwick_ahrs_t *q, float dt, float g, float ax, float ay, float az, float gx, float gy,
+                              float gz) {
+    float acc_err, weight, target;
+
+    // how far off 1g the accel is, anything but gravity makes it a worse reference
+    acc_err = fabsf(sqrtf(ax * ax + ay * ay + az * az) / g - 1.f);
+    weight = acc_err < MADGWICK_ACC_REJECT ? expf(-MADGWICK_ACC_GATE * acc_err) : 0.f;
+
+    // err is from the previous update, one sample late doesn't matter here. counts
+    // down instead of resetting so accel noise flickering around TRUST can't hold it off
+    if (acc_err < MADGWICK_ACC_TRUST && q->err > MADGWICK_LOST_ERR)
+        q->lost += dt;
+    else
+        q->lost = fmaxf(q->lost - dt, 0.f);
+
+    target = q->beta;
+    if (q->rest || q->lost >= MADGWICK_LOST_TIME)
+        target = q->rbeta;
+
+    // jump up, decay down
+    if (target > q->gain)
+        q->gain = target;
+    else
+        q->gain += (target - q->gain) * fminf(dt / MADGWICK_GAIN_TAU, 1.f);
+
+    madgwick_step(q, dt, q->gain * weight, ax, ay, az, gx, gy, gz);
+}
+
 /*
  * Quaternions:
  *  - https://www.cprogramming.com/tutorial/3d/quaternions.html
@@ -37,10 +37,26 @@ typedef struct {
 
 typedef struct {
     quaternion_t q;
-    float beta, rbeta;
-    int rest:1;
+    float beta, rbeta;  /* gain in flight / at rest or while recovering */
+    float gain;         /* current gain of the adaptive mode, between beta and rbeta */
+    float err;          /* squared distance of estimated and measured gravity of the last update */
+    float lost;         /* s the estimate has (mostly) disagreed with a trusted accel */
+    int rest:1;         /* set by the caller while the sensor sits still */
 } madgwick_ahrs_t;
 
+/*
+ * Adaptive mode: gain snaps to rbeta at rest or when the estimate stays far off
+ * a trusted accel reading (e.g. after a crash), then decays back to beta. Accel
+ * corrections are weighted down by how far |acc| is from 1g and skipped past
+ * MADGWICK_ACC_REJECT, so linear acceleration doesn't pull the estimate.
+ */
+#define MADGWICK_ACC_GATE    4.f    /* weight = exp(-gate * | |acc|/g - 1 |) */
+#define MADGWICK_ACC_REJECT  0.35f  /* | |acc|/g - 1 | past which accel is ignored */
+#define MADGWICK_ACC_TRUST   0.05f  /* | |acc|/g - 1 | under which a large error means we're lost, not accelerating */
+#define MADGWICK_LOST_ERR    0.12f  /* squared gravity error (~20deg) that counts as lost */
+#define MADGWICK_LOST_TIME   0.3f   /* s it has to stay lost, sustained turns can look like gravity for a moment */
+#define MADGWICK_GAIN_TAU    0.5f   /* s, decay of the gain back to beta */
+
 typedef struct {
     union {
         float v[3];
@@ -75,6 +91,21 @@ void madgwick_init(madgwick_ahrs_t *ahrs, float gerr);
  */
 void madgwick_update(madgwick_ahrs_t *q, float dt, float ax, float ay, float az, float gx, float gy, float gz);
 
+/**
+ * @param ahrs
+ * @param gerr estimated deg/s gyroscope error in flight
+ * @param rerr deg/s error assumed at rest/while recovering, sets how fast it re-converges
+ */
+void madgwick_init_adaptive(madgwick_ahrs_t *ahrs, float gerr, float rerr);
+
+/**
+ * madgwick_update() with adaptive gain and accel gating, see above.
+ *
+ * @param g  gravitational acceleration in the unit of ax/ay/az
+ */
+void madgwick_update_adaptive(madgwick_ahrs_t *q, float dt, float g, float ax, float ay, float az, float gx, float gy,
+                              float gz);
+
 void quaternion_get_gravity(quaternion_t *q, vec3f_t *g);
 void quaternion_euler(quaternion_t *q, vec3f_t *g, vec3f_t *rpy);
 
@@ -0,0 +1,247 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "hackquad/gyrobias.h"
+#include "hackquad/mpu.h"
+#include "hackquad/registry.h"
+#include "hackquad/hackquad_msg.h"
+#include "esp_timer.h"
+
+#define G_ACCL 9.80665f
+
+struct gyrobias_bin {
+    vec3f_t bias;
+    float temp;
+    u16 windows; /* rest windows averaged in, 0 = empty */
+};
+
+struct gyrobias_window {
+    vec3f_t sum, sum_sq, acc;
+    float temp;
+    float acc_min, acc_max; /* |acc|^2 */
+    u16 samples;
+};
+
+/* REGISTRY */
+float mpu_gyrtco_x = 0.0f;
+float mpu_gyrtco_y = 0.0f;
+float mpu_gyrtco_z = 0.0f;
+float mpu_gyrref_t = 25.0f;
+
+vec3f_t gyrobias_current;
+vec3f_t gyrobias_rest_acc;
+volatile bool gyrobias_rest;
+
+static struct gyrobias_bin bins[GYROBIAS_BINS];
+static struct gyrobias_window window;
+static volatile bool reset_requested;
+
+/* model as of the last time it was staged */
+static float staged_offset[3], staged_tco[3];
+static s64 staged_time;
+
+static float *const model_offset[3] = {&mpu_gyroffset_x, &mpu_gyroffset_y, &mpu_gyroffset_z};
+static float *const model_tco[3] = {&mpu_gyrtco_x, &mpu_gyrtco_y, &mpu_gyrtco_z};
+
+static void gyrobias_eval(float temp) {
+    int i;
+
+    for (i = 0; i < 3; i++)
+        gyrobias_current.v[i] = *model_offset[i] + *model_tco[i] * (temp - mpu_gyrref_t);
+}
+
+void gyrobias_init(float temp) {
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        staged_offset[i] = *model_offset[i];
+        staged_tco[i] = *model_tco[i];
+    }
+
+    gyrobias_eval(temp);
+}
+
+void gyrobias_reset() {
+    // applied by the sensor path, which owns the bins
+    reset_requested = true;
+}
+
+/* weighted line fit across the populated bins, keeps the old slope if they are too close together */
+static void gyrobias_fit() {
+    float w, wsum = 0, tmean = 0, bmean[3] = {0}, stt = 0, stb[3] = {0}, dt;
+    float tmin = INFINITY, tmax = -INFINITY;
+    int i, j;
+
+    for (i = 0; i < GYROBIAS_BINS; i++) {
+        if (!bins[i].windows)
+            continue;
+
+        // well-populated bins count more, but not so much that one bin drowns the others
+        w = bins[i].windows < 32 ? bins[i].windows : 32;
+        wsum += w;
+        tmean += w * bins[i].temp;
+        for (j = 0; j < 3; j++)
+            bmean[j] += w * bins[i].bias.v[j];
+
+        tmin = fminf(tmin, bins[i].temp);
+        tmax = fmaxf(tmax, bins[i].temp);
+    }
+
+    if (wsum == 0)
+        return;
+
+    tmean /= wsum;
+    for (j = 0; j < 3; j++)
+        bmean[j] /= wsum;
+
+    if (tmax - tmin >= GYROBIAS_MIN_SPREAD) {
+        for (i = 0; i < GYROBIAS_BINS; i++) {
+            if (!bins[i].windows)
+                continue;
+
+            w = bins[i].windows < 32 ? bins[i].windows : 32;
+            dt = bins[i].temp - tmean;
+            stt += w * dt * dt;
+            for (j = 0; j < 3; j++)
+                stb[j] += w * dt * (bins[i].bias.v[j] - bmean[j]);
+        }
+
+        for (j = 0; j < 3; j++)
+            *model_tco[j] = stb[j] / stt;
+    }
+
+    // line through the weighted mean
+    for (j = 0; j < 3; j++)
+        *model_offset[j] = bmean[j] - *model_tco[j] * (tmean - mpu_gyrref_t);
+}
+
+/* saves the model once it moved enough, flash writes are rate limited as the quad can sit at rest for hours */
+static void gyrobias_stage() {
+    s64 now = esp_timer_get_time();
+    bool changed = false;
+    int i;
+
+    if (now - staged_time < GYROBIAS_STAGE_RATE * 1000ll)
+        return;
+
+    for (i = 0; i < 3; i++) {
+        // tco error is weighed over a 10C swing
+        if (fabsf(*model_offset[i] - staged_offset[i]) > GYROBIAS_STAGE_DELTA ||
+            fabsf(*model_tco[i] - staged_tco[i]) * 10.f > GYROBIAS_STAGE_DELTA)
+            changed = true;
+    }
+
+    if (!changed)
+        return;
+
+    for (i = 0; i < 3; i++) {
+        staged_offset[i] = *model_offset[i];
+        staged_tco[i] = *model_tco[i];
+    }
+    staged_time = now;
+
+    reg_stage(reg_lookup_hash(REG_HASH_MPU_GYROFFSET_X));
+    reg_stage(reg_lookup_hash(REG_HASH_MPU_GYROFFSET_Y));
+    reg_stage(reg_lookup_hash(REG_HASH_MPU_GYROFFSET_Z));
+    reg_stage(reg_lookup_hash(REG_HASH_MPU_GYRTCO_X));
+    reg_stage(reg_lookup_hash(REG_HASH_MPU_GYRTCO_Y));
+    reg_stage(reg_lookup_hash(REG_HASH_MPU_GYRTCO_Z));
+}
+
+static bool gyrobias_window_end() {
+    struct gyrobias_bin *bin;
+    float n = window.samples, var, temp;
+    vec3f_t mean;
+    int i, b;
+
+    temp = window.temp / n;
+    gyrobias_rest = !hq_armed &&
+                    window.acc_min >= (G_ACCL - GYROBIAS_REST_ACC) * (G_ACCL - GYROBIAS_REST_ACC) &&
+                    window.acc_max <= (G_ACCL + GYROBIAS_REST_ACC) * (G_ACCL + GYROBIAS_REST_ACC);
+
+    for (i = 0; i < 3; i++) {
+        mean.v[i] = window.sum.v[i] / n;
+        var = window.sum_sq.v[i] / n - mean.v[i] * mean.v[i];
+
+        if (var > GYROBIAS_REST_VAR)
+            gyrobias_rest = false;
+    }
+
+    if (reset_requested) {
+        memset(bins, 0, sizeof(bins));
+        reset_requested = false;
+    }
+
+    if (gyrobias_rest) {
+        for (i = 0; i < 3; i++)
+            gyrobias_rest_acc.v[i] = window.acc.v[i] / n;
+
+        b = (int) floorf((temp - GYROBIAS_BIN_MIN) / GYROBIAS_BIN_WIDTH);
+        b = b < 0 ? 0 : b >= GYROBIAS_BINS ? GYROBIAS_BINS - 1 : b;
+        bin = &bins[b];
+
+        if (!bin->windows) {
+            bin->bias = mean;
+            bin->temp = temp;
+        } else {
+            for (i = 0; i < 3; i++)
+                bin->bias.v[i] += (mean.v[i] - bin->bias.v[i]) * GYROBIAS_BIN_GAIN;
+            bin->temp += (temp - bin->temp) * GYROBIAS_BIN_GAIN;
+        }
+
+        if (bin->windows < UINT16_MAX)
+            bin->windows++;
+
+        gyrobias_fit();
+        gyrobias_stage();
+    }
+
+    // temperature drifts while flying too
+    gyrobias_eval(temp);
+    memset(&window, 0, sizeof(window));
+
+    return gyrobias_rest;
+}
+
+bool gyrobias_sample(const vec3f_t *gyr, const vec3f_t *acc, float temp) {
+    float acc_sq;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        window.sum.v[i] += gyr->v[i];
+        window.sum_sq.v[i] += gyr->v[i] * gyr->v[i];
+        window.acc.v[i] += acc->v[i];
+    }
+
+    // squared, saves a sqrtf per sample
+    acc_sq = acc->x * acc->x + acc->y * acc->y + acc->z * acc->z;
+    if (!window.samples || acc_sq < window.acc_min)
+        window.acc_min = acc_sq;
+    if (!window.samples || acc_sq > window.acc_max)
+        window.acc_max = acc_sq;
+
+    window.temp += temp;
+
+    if (++window.samples < GYROBIAS_WINDOW)
+        return false;
+
+    return gyrobias_window_end();
+}
@@ -0,0 +1,87 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HACKQUAD_GYROBIAS_H
+#define HACKQUAD_GYROBIAS_H
+
+#include <stdbool.h>
+
+#include "hackquad/lint_defs.h"
+#include "flightmath.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Background gyro bias estimation. Every GYROBIAS_WINDOW samples the gyro
+ * variance and the accel magnitude are checked, if the quad sat still (and
+ * disarmed) the window's mean gyro rate is its bias at the window's temperature.
+ *
+ * Rest windows are averaged into temperature bins, a line fit across the bins
+ * gives the bias model persisted in the registry (declared in mpu.h):
+ *
+ *   bias(T) = mpu_gyroffset + mpu_gyrtco * (T - mpu_gyrref_t)
+ */
+
+#define GYROBIAS_WINDOW      256    /* samples per rest check, ~0.25s at 1kHz */
+#define GYROBIAS_REST_VAR    0.04f  /* max gyro variance (dps^2) on any axis within a rest window */
+#define GYROBIAS_REST_ACC    0.4f   /* max deviation of |acc| from 1g (m/s^2) within a rest window */
+#define GYROBIAS_BIN_MIN     -10.f  /* C, lower edge of the first temperature bin */
+#define GYROBIAS_BIN_WIDTH   5.f    /* C */
+#define GYROBIAS_BINS        16
+#define GYROBIAS_BIN_GAIN    0.1f   /* weight of a new rest window in its bin's average */
+#define GYROBIAS_MIN_SPREAD  4.f    /* C, bins must span this much before the slope is refit */
+#define GYROBIAS_STAGE_DELTA 0.02f  /* dps, model change worth saving to flash */
+#define GYROBIAS_STAGE_RATE  60000  /* ms, min time between saving the model */
+
+/* bias at the current temperature, subtract from raw gyro rates */
+extern vec3f_t gyrobias_current;
+
+/* whether the last window was at rest */
+extern volatile bool gyrobias_rest;
+
+/* mean accel (m/s^2) of the last rest window */
+extern vec3f_t gyrobias_rest_acc;
+
+/**
+ * Recomputes gyrobias_current from the registry model.
+ */
+void gyrobias_init(float temp);
+
+/**
+ * Feeds one sample (uncorrected gyro rates) into the estimator. Called from the
+ * sensor path, does a few adds per sample and the rest once per window.
+ *
+ * @param gyr  - dps, without bias correction
+ * @param acc  - m/s^2
+ * @param temp - C
+ * @return true if the window ended at rest (gyrobias_current may have changed)
+ */
+bool gyrobias_sample(const vec3f_t *gyr, const vec3f_t *acc, float temp);
+
+/**
+ * Forgets the learned bins, the next rest window starts a new model.
+ */
+void gyrobias_reset();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HACKQUAD_GYROBIAS_H */
@@ -29,40 +29,75 @@
 #include "hackquad/wifi.h"
 #include "hackquad/mpu.h"
 #include "hackquad/hackquad_msg.h"
+#include "hackquad/transport.h"
+#include "hackquad/ctrllink.h"
 #include "hackquad/udpserver.h"
+#include "hackquad/espnow.h"
 #include "hackquad/pid.h"
+#include "hackquad/setpoint.h"
+#include "hackquad/thrust.h"
 #include "hackquad/httpserver.h"
 #include "hackquad/blinkcodes.h"
-#include "pthread.h"
+#include "hackquad/bootprof.h"
+#include "hackquad/sysmem.h"
+#include "hackquad/syscpu.h"
+#include "hackquad/trace.h"
 
 #define POWER_SEL_IO        33
 #define HACKQUAD_MDNS_EN    1   /* whether or not to init mdns */
 #define HACKQUAD_TEST_LOG   0   /* whether or not to spawn logging task */
 
-#define FLAG_PANIC_MODE     (1 << 31)
 #define FC_PANIC_MODE_ACT   50  /* max degrees of rotation before fc enters panic-mode */
 
 #define STATUS_UPDATE_RATE  100  /* delay in ms between sending status updates */
 #define FC_UPDATE_TIMEOUT   50   /* delay in ms between recv-ing updates before fc times-out */
-#define NO_CTRL_TIMEOUT     3000 /* delay in ms to enter panic mode after not recving ctrl update */
+#define NO_CTRL_TIMEOUT     3000 /* delay in ms before the throttle is ramped down after not recving ctrl update */
+#define NO_CTRL_STALE       100  /* delay in ms before the quad levels out after not recving ctrl update */
 
-/* copied strait from arduino cause im lazy */
-#define constrain(amt, low, high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+/* CTRL_TRANSPORT */
+#define HQ_TRANSPORT_UDP    0
+#define HQ_TRANSPORT_ESPNOW 1
 
-struct control_data {
-    float throttle, x, y, z;
-    int flag_clear_panicmode;
-};
+/* FC_OUTER_DIV, estimator + angle loop run every n mpu samples, rate loop every sample */
+#define FC_OUTER_DIV_DEFAULT 1
+
+#define REG_COMMIT_RATE     500  /* delay in ms between checks for staged registry changes */
+#define REG_COMMIT_DISARMED 1000 /* time in ms the quad must be disarmed before staged changes are committed */
+
+/* stacks in bytes, see /sys/mem for how much of them is used */
+SYSMEM_TASK(fc, 4096);
+SYSMEM_TASK(link, 3072);
+SYSMEM_TASK(status, 3072); /* samples run time stats too */
+SYSMEM_TASK(commit, 3072);
+#if HACKQUAD_TEST_LOG
+SYSMEM_TASK(log, 2048);
+#endif
 
 TaskHandle_t task_hackquad_main;
+volatile int hq_armed;
 float hq_avg_fcloop;
 
-static struct control_data control;
 static struct udp_context udp_ctx;
+static struct espnow_context espnow_ctx;
+static u8 ctrl_transport = HQ_TRANSPORT_UDP;
+static u8 fc_outer_div = FC_OUTER_DIV_DEFAULT;
+static struct setpoint_conf ctrl_conf = {
+        .mode = SETPOINT_INTERPOLATE,
+        .slew_angle = 360.f,
+        .slew_yaw = 2000.f,
+        .stale = NO_CTRL_STALE,
+        .timeout = NO_CTRL_TIMEOUT
+};
+struct setpoint_shaper ctrl_setpoint = {.conf = &ctrl_conf};
+/* MOTOR_THRUST_*, thrust ~ duty^2 until measured, linearization off so existing pid tunes still fly */
+static struct thrust_curve motor_curve = {
+        .linearize = 0,
+        .thrust = {0.015625f, 0.0625f, 0.140625f, 0.25f, 0.390625f, 0.5625f, 0.765625f, 1.f}
+};
+static struct thrust_lut motor_lut;
 static struct pid_kon pid_angle_consts;
 static struct pid_kon pid_rate_consts;
 static struct pid_kon pid_yaw_rate_consts;
-static pthread_mutex_t ctrl_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static struct pid_ctx pid_angle[2] = {
         {.kons = &pid_angle_consts},
@@ -81,16 +116,27 @@ static void hackquad_main(void *args) {
     (void) args;
 
     u32 msg;
-    u64 curr_time, last_mpu_update = 0, last_fc_update = 0;
-    float dt;
+    u64 curr_time, last_mpu_update = 0, last_fc_update = 0, last_outer_update = 0, loop_start;
+    float dt, outer_dt;
     struct control_data ctrl;
+    struct setpoint sp;
     float output[3];
-    float x_set_point_adj;
-    float y_set_point_adj;
+    float x_set_point_adj = 0;
+    float y_set_point_adj = 0;
+    u8 outer_count = 0;
+    int outer_due = 0;
     int fc_panicmode = 0;
+    int stage;
+
+    // set before the mpu can notify it, this task preempts app_main() before it could store the handle
+    task_hackquad_main = xTaskGetCurrentTaskHandle();
 
     memset(&ctrl, 0, sizeof(ctrl));
+    setpoint_init(&ctrl_setpoint, &ctrl_conf);
+    thrust_lut_build(&motor_lut, &motor_curve);
 
+    // ends when the flight loop is ready to run
+    stage = boot_begin("i2c/mpu");
     ESP_ERROR_CHECK(iic_init(0, I2C_BUS0_SDA, I2C_BUS0_SCL, I2C_BUS0_FRQ));
     mpu_init();
 
@@ -100,23 +146,37 @@ static void hackquad_main(void *args) {
 
     // started, change blink-rate
     blc_setrate(BLCR_NORMAL);
+    boot_end(stage);
 
     for (;;) {
         // on mpu or user-input data change, we re-do the flight calculations / update the motors
         if (xTaskNotifyWait(0, 0xFFFFFFFF, &msg, FC_UPDATE_TIMEOUT / portTICK_PERIOD_MS)) {
+            loop_start = esp_timer_get_time();
+            trace_begin(TRACE_FC_LOOP, (u8) (msg & (HQMSG_MPU_UPDATE | HQMSG_CTRL_UPDATE)));
 
             // if new mpu data rdy, read data
             if (msg & HQMSG_MPU_UPDATE) {
                 curr_time = esp_timer_get_time();
+                trace_begin(TRACE_MPU_READ, 0);
                 mpu_read((float) (curr_time - last_mpu_update) * 1e-6f);
+                trace_end(TRACE_MPU_READ, 0);
                 last_mpu_update = curr_time;
+
+                if (++outer_count >= fc_outer_div) {
+                    outer_count = 0;
+                    outer_due = 1;
+                }
             }
 
             // new control data rdy, read data
             if (msg & HQMSG_CTRL_UPDATE) {
-                pthread_mutex_lock(&ctrl_mutex);
-                memcpy(&ctrl, &control, sizeof(ctrl));
-                pthread_mutex_unlock(&ctrl_mutex);
+                ctrllink_get_control(&ctrl);
+
+                sp.throttle = ctrl.throttle * MOTOR_MAX_THROTTLE;
+                sp.x = ctrl.x;
+                sp.y = ctrl.y;
+                sp.z = ctrl.z;
+                setpoint_push(&ctrl_setpoint, &sp, ctrl.sent, ctrl.recv);
             }
 
             // use updated data to redo the flight calculations
@@ -128,10 +188,13 @@ static void hackquad_main(void *args) {
             // keep track of avg flight controller refresh rate
             hq_avg_fcloop = hq_avg_fcloop * 0.995f + dt * 0.005f;
 
+            // smooths the 20ms steps between control packets, levels out/lands once they stop
+            setpoint_update(&ctrl_setpoint, curr_time, &sp);
+
             /*
              * --=== FLIGHT CONTROLLER ===--
              */
-            if (ctrl.throttle > 0) {
+            if (sp.throttle > 0) {
                 // trigger panic mode if angle becomes too skewed
                 if (fabsf(mpu_latest.angle.x) > FC_PANIC_MODE_ACT ||
                     fabsf(mpu_latest.angle.y) > FC_PANIC_MODE_ACT) {
@@ -155,66 +218,73 @@ static void hackquad_main(void *args) {
                 //float asx = ctrl.x * cosf(yaw_rad) + ctrl.y * sinf(yaw_rad);
                 //float asy = -ctrl.x * sinf(yaw_rad) + ctrl.y * cosf(yaw_rad);
 
-                x_set_point_adj = pid_update(&pid_angle[0], ctrl.x, mpu_latest.angle.x, dt);
+                // inner loop on the newest gyro rates, set points are the angle loop's last output
                 output[0] = pid_update(&pid_rate[0], -x_set_point_adj, mpu_latest.rate.x, dt);
-
-                y_set_point_adj = pid_update(&pid_angle[1], ctrl.y, mpu_latest.angle.y, dt);
                 output[1] = pid_update(&pid_rate[1], -y_set_point_adj, mpu_latest.rate.y, dt);
 
                 // yaw always rate/gyro controlled
-                output[2] = pid_update(&pid_rate[2], ctrl.z, mpu_latest.rate.z, dt);
+                output[2] = pid_update(&pid_rate[2], sp.z, mpu_latest.rate.z, dt);
 
                 // TODO extend pid chain with linear acceleration control
                 // TODO add multiplier for battery percentage adjustment
                 // combine pid motor matrix
-                motor_throttle(M0, constrain(ctrl.throttle - output[0] - output[1] - output[2], 0, 1023));
-                motor_throttle(M1, constrain(ctrl.throttle - output[0] + output[1] + output[2], 0, 1023));
-                motor_throttle(M2, constrain(ctrl.throttle + output[0] + output[1] - output[2], 0, 1023));
-                motor_throttle(M3, constrain(ctrl.throttle + output[0] - output[1] + output[2], 0, 1023));
+                hq_armed = 1;
+                // mixed in thrust, mapped to duty per motor
+                motor_throttle(M0, thrust_duty(&motor_lut, sp.throttle - output[0] - output[1] - output[2]));
+                motor_throttle(M1, thrust_duty(&motor_lut, sp.throttle - output[0] + output[1] + output[2]));
+                motor_throttle(M2, thrust_duty(&motor_lut, sp.throttle + output[0] + output[1] - output[2]));
+                motor_throttle(M3, thrust_duty(&motor_lut, sp.throttle + output[0] - output[1] + output[2]));
             } else {
                 panic_mode:
+                hq_armed = 0;
                 for (int i = 0; i < 4; i++)
                     motor_throttle(i, 0);
+
+                x_set_point_adj = 0;
+                y_set_point_adj = 0;
+
+                // curve changes through the registry only take effect while disarmed
+                thrust_lut_refresh(&motor_lut, &motor_curve);
+            }
+
+            /*
+             * --=== ATTITUDE / ANGLE LOOP ===--
+             * every fc_outer_div samples, after the motors are out so it never delays them.
+             * its output is used by the rate loop from the next sample on.
+             */
+            if (outer_due) {
+                outer_due = 0;
+                trace_begin(TRACE_ATTITUDE, 0);
+                mpu_update_attitude();
+
+                curr_time = esp_timer_get_time();
+                outer_dt = (float) (curr_time - last_outer_update) * 1e-6f;
+                last_outer_update = curr_time;
+
+                if (hq_armed) {
+                    x_set_point_adj = pid_update(&pid_angle[0], sp.x, mpu_latest.angle.x, outer_dt);
+                    y_set_point_adj = pid_update(&pid_angle[1], sp.y, mpu_latest.angle.y, outer_dt);
+                }
+                trace_end(TRACE_ATTITUDE, 0);
             }
-        } else
+
+            // 0 when we got here from the timeout below
+            if (loop_start) {
+                mpu_timing_loop((u32) (esp_timer_get_time() - loop_start));
+                trace_end(TRACE_FC_LOOP, (u8) (msg & (HQMSG_MPU_UPDATE | HQMSG_CTRL_UPDATE)));
+            }
+        } else {
+            loop_start = 0;
             goto panic_mode; // timed-out (prob MPU issue), ensure motors remain off
+        }
     }
 }
 
-void udp_recv_handler(int id, u8 *data, size_t len) {
-    switch (id) {
-        default:
-            ESP_LOGE(TAG, "packet of unknown id recv-ed, id = %i", id);
-            break;
-
-        /* UPDATE_CONTROL */
-        case 69:
-            if (len < 16)
-                return;
-
-            // pseudo-mutex created here by xTaskNotify() as we can be fairly confident that once notified, the flight
-            // controller loop will process this WAY before our next control data update
-            // could modify the data and cause problems
-            pthread_mutex_lock(&ctrl_mutex);
-            control.throttle = ((float *) data)[0] * MOTOR_MAX_THROTTLE;
-            control.x        = ((float *) data)[1];
-            control.y        = ((float *) data)[2];
-            control.z        = ((float *) data)[3];
-
-            // TODO create u8 flags var which stores clear panic mode and en stabilization info
-            //      or keep as is and maintain stabilization for some period after zero throttle
-            //      maybe use accel values and maintain stabilization until down-accel is zero
-
-            // use sign bit to indicate that we wish to reset panic-mode detection
-            control.flag_clear_panicmode = *((u32 *) &control.throttle) & FLAG_PANIC_MODE;
-            *((u32 *) &control.throttle) &= ~FLAG_PANIC_MODE;
-            pthread_mutex_unlock(&ctrl_mutex);
-
-            // notify new data
-            xTaskNotify(task_hackquad_main, HQMSG_CTRL_UPDATE, eSetBits);
-            portYIELD();
-            break;
-    }
+static void link_notify() {
+    // pseudo-mutex created here by xTaskNotify() as we can be fairly confident that once notified, the flight
+    // controller loop will process this WAY before our next control data update
+    xTaskNotify(task_hackquad_main, HQMSG_CTRL_UPDATE, eSetBits);
+    portYIELD();
 }
 
 /**
@@ -223,14 +293,19 @@ void udp_recv_handler(int id, u8 *data, size_t len) {
  *
  * It would save on a lot of unnecessary mov's.
  */
-static void udp_server_task(void *arg) {
+static void link_task(void *arg) {
     (void) arg;
 
-    udp_ctx.recv_handler = udp_recv_handler;
-    udp_create(&udp_ctx, IPADDR_ANY, UDPSERVER_PORT);
+    // esp-now falls back to udp if it can't be started
+    if (ctrl_transport == HQ_TRANSPORT_ESPNOW && !espnow_create(&espnow_ctx)) {
+        ctrllink_init(&espnow_ctx.transport, link_notify);
+    } else {
+        udp_create(&udp_ctx, IPADDR_ANY, UDPSERVER_PORT);
+        ctrllink_init(&udp_ctx.transport, link_notify);
+    }
 
     for (;;)
-        udp_yield(&udp_ctx);
+        ctrllink_yield();
 }
 
 #if HACKQUAD_TEST_LOG
@@ -275,17 +350,22 @@ static void hq_mdns_init() {
 static void status_update_task(void *arg) {
     (void) arg;
 
-    struct __attribute__((packed)) {
-        u8 id;
-        float battery;
-        s8 rssi;
-        float fc_loop_time;
-        float x, y, z;
-    } status_update;
+    struct status_update status_update;
+    const struct syscpu_report *cpu;
+    int cpu_count = 0;
 
-    status_update.id = 20;
+    syscpu_init();
 
     for (;;) {
+        // cpu use goes out every SYSCPU_SAMPLE_MS, along with a status update
+        if (++cpu_count >= SYSCPU_SAMPLE_MS / STATUS_UPDATE_RATE) {
+            cpu_count = 0;
+            if ((cpu = syscpu_sample()))
+                ctrllink_send_cpu(cpu);
+        }
+        // ends a capture started at /sys/trace once it ran its time
+        trace_poll();
+
         status_update.battery = battery_read();
         status_update.rssi = wifi_get_rssi();
         status_update.fc_loop_time = hq_avg_fcloop;
@@ -293,62 +373,82 @@ static void status_update_task(void *arg) {
         status_update.y = mpu_latest.angle.y;
         status_update.z = mpu_latest.angle.z;
 
-        udp_sendp(&udp_ctx, (u8 * ) & status_update, sizeof(status_update));
+        ctrllink_send_status(&status_update);
         vTaskDelay(STATUS_UPDATE_RATE / portTICK_PERIOD_MS);
     }
 }
 
+/**
+ * Flash writes stall the cache of both cores, so staged registry changes are only
+ * committed once the quad has been sitting disarmed for a bit.
+ */
+static void reg_commit_task(void *arg) {
+    (void) arg;
+
+    TickType_t disarmed_since = xTaskGetTickCount();
+
+    for (;;) {
+        vTaskDelay(REG_COMMIT_RATE / portTICK_PERIOD_MS);
+
+        if (hq_armed) {
+            disarmed_since = xTaskGetTickCount();
+            continue;
+        }
+
+        if ((xTaskGetTickCount() - disarmed_since) * portTICK_PERIOD_MS >= REG_COMMIT_DISARMED && reg_dirty_count())
+            reg_commit();
+    }
+}
+
 void app_main() {
+    int stage;
+
+    stage = boot_begin("motor/led");
     motor_init();
     blc_init();
+    boot_end(stage);
 
     // enable high-power mode (also turns on camera circuitry)
     //gpio_reset_pin(POWER_SEL_IO);
     //gpio_set_level(POWER_SEL_IO, 1);
 
+    stage = boot_begin("registry");
     reg_init();
+    boot_end(stage);
+
+    // i2c/mpu bring-up only needs the registry, it runs on the flight task while wifi connects
+    sysmem_task_start(fc, hackquad_main, "hackquad_main", NULL, configMAX_PRIORITIES - 1);
+
+    stage = boot_begin("battery");
     battery_init();
+    boot_end(stage);
+
+    stage = boot_begin("wifi");
     wifi_init();
+    boot_end(stage);
 #if HACKQUAD_MDNS_EN
+    stage = boot_begin("mdns");
     hq_mdns_init();
+    boot_end(stage);
 #endif
+    stage = boot_begin("http");
     http_init();
+    boot_end(stage);
 
-    xTaskCreate(hackquad_main, "hackquad_main", 4096, NULL, configMAX_PRIORITIES - 1, &task_hackquad_main);
-    xTaskCreate(udp_server_task, "udp_server", 2048, NULL, configMAX_PRIORITIES - 2, NULL);
-    xTaskCreate(status_update_task, "status_task", 2048, NULL, configMAX_PRIORITIES - 3, NULL);
+    sysmem_task_start(link, link_task, "link", NULL, configMAX_PRIORITIES - 2);
+    sysmem_task_start(status, status_update_task, "status_task", NULL, configMAX_PRIORITIES - 3);
+    sysmem_task_start(commit, reg_commit_task, "reg_commit", NULL, 1);
+    sysmem_add(SYSMEM_LINK, sizeof(udp_ctx) + sizeof(espnow_ctx));
+    trace_init();
 #if HACKQUAD_TEST_LOG
-    xTaskCreate(test_log_task, "log_task", 2048, NULL, 0, NULL);
+    sysmem_task_start(log, test_log_task, "log_task", NULL, 0);
 #endif
+
+    // timeline gets logged once the flight task is done with the mpu too
+    boot_finish();
 }
 
-DEFINE_REGISTRY({
-    {"WIFI_AP_SSID",       REG_STR, &wifi_ap_ssid, 0, {0}},
-    {"WIFI_AP_PASS",       REG_STR, &wifi_ap_pass, 0, {0}},
-    {"WIFI_AP_AUTHMODE",   REG_8B,  &wifi_ap_authmode, 0, {0}},
-    {"WIFI_AP_MAX_CONN",   REG_8B,  &wifi_ap_max_connection, 0, {0}},
-    {"WIFI_AP_CHANNEL",    REG_8B,  &wifi_ap_channel, 0, {0}},
-    {"WIFI_ST_SSID",       REG_STR, &wifi_st_ssid, 0, {0}},
-    {"WIFI_ST_PASS",       REG_STR, &wifi_st_pass, 0, {0}},
-    {"WIFI_ST_AUTHMODE",   REG_8B,  &wifi_st_authmode, 0, {0}},
-    {"WIFI_ST_MAX_RETRYS", REG_8B,  &wifi_st_max_retrys, 0, {0}},
-    {"WIFI_MODE",          REG_8B,  &wifi_mode, 0, {0}},
-
-    {"MPU_HAS_CALIBRATION", REG_8B,  &mpu_has_calibration, 0, {0}},
-    {"MPU_GYROFFSET_X",     REG_FLT, &mpu_gyroffset_x, 0, {0}},
-    {"MPU_GYROFFSET_Y",     REG_FLT, &mpu_gyroffset_y, 0, {0}},
-    {"MPU_GYROFFSET_Z",     REG_FLT, &mpu_gyroffset_z, 0, {0}},
-    {"MPU_ACCOFFSET_X",     REG_FLT, &mpu_accoffset_x, 0, {0}},
-    {"MPU_ACCOFFSET_Y",     REG_FLT, &mpu_accoffset_y, 0, {0}},
-    {"MPU_ACCOFFSET_Z",     REG_FLT, &mpu_accoffset_z, 0, {0}},
-
-    {"PID_ANGLE_KP",      REG_FLT, &pid_angle_consts.kp, 0, {0}},
-    {"PID_ANGLE_KI",      REG_FLT, &pid_angle_consts.ki, 0, {0}},
-    {"PID_ANGLE_KD",      REG_FLT, &pid_angle_consts.kd, 0, {0}},
-    {"PID_ANGLE_EPSILON", REG_FLT, &pid_angle_consts.epsilon, 0, {0}},
-    {"PID_RATE_KP",       REG_FLT, &pid_rate_consts.kp, 0, {0}},
-    {"PID_RATE_KI",       REG_FLT, &pid_rate_consts.ki, 0, {0}},
-    {"PID_RATE_KD",       REG_FLT, &pid_rate_consts.kd, 0, {0}},
-    {"PID_RATE_EPSILON",  REG_FLT, &pid_rate_consts.epsilon, 0, {0}},
-    {"PID_YAWRATE_KP",    REG_FLT, &pid_yaw_rate_consts.kp, 0, {0}},
-});
+struct reg_entry registry[] = {
+#include "hackquad/registry.def"
+};
+DEFINE_REGISTRY_LEN();
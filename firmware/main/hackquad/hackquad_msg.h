@@ -20,6 +20,7 @@
 #define HACKQUAD_MSG_H
 
 #include "freertos/task.h"
+#include "hackquad/setpoint.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -31,6 +32,12 @@ extern "C" {
 
 extern TaskHandle_t task_hackquad_main;
 
+/* non-zero while the flight controller is driving the motors */
+extern volatile int hq_armed;
+
+/* owned by the flight task, read by /ctrl/stats */
+extern struct setpoint_shaper ctrl_setpoint;
+
 #ifdef __cplusplus
 }
 #endif
@@ -17,12 +17,21 @@
  */
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "hackquad/httpserver.h"
 #include "hackquad/lint_defs.h"
 #include "hackquad/registry.h"
 #include "hackquad/mpu.h"
-#include "hackquad/blinkcodes.h"
+#include "hackquad/hackquad_msg.h"
+#include "hackquad/ctrllink.h"
+#include "hackquad/jsonstream.h"
+#include "hackquad/arena.h"
+#include "hackquad/sysmem.h"
+#include "hackquad/syscpu.h"
+#include "hackquad/trace.h"
 #include "esp_log.h"
 #include "assert.h"
 #include "esp_http_server.h"
@@ -31,11 +40,50 @@
 /*
  * Only reason this isn't just a TCP socket is I originally planned on making the UI as a webapp
  * running on the HackQuad.
+ *
+ * Every request gets the server's arena, request bodies, cJSON nodes (through its
+ * hooks) and responses are allocated from it and all dropped at once after the
+ * handler returns. esp_http_server runs all handlers on its one task, so one
+ * arena is enough. The high water mark of each endpoint is kept for /http/mem.
  */
 
-static char *heap;
+struct http_endpoint {
+    const char *uri;
+    httpd_method_t method;
+    int (*handler)(httpd_req_t *req, struct arena *mem);
+
+    /* since boot */
+    u32 requests;
+    u32 failed;     /* requests that ran out of arena */
+    size_t peak;    /* most arena used by one request */
+};
+
+static u8 arena_buf[HTTPSERVER_ARENA_SIZE];
+static struct arena arena;
+static struct arena *cjson_arena; /* arena of the request being handled, cJSON mallocs outside of one go to the heap */
 static httpd_handle_t server;
 
+static void *cjson_malloc(size_t size) {
+    return cjson_arena ? arena_alloc(cjson_arena, size) : malloc(size);
+}
+
+static void cjson_free(void *ptr) {
+    if (!arena_owns(&arena, ptr))
+        free(ptr);
+}
+
+static int http_oom(httpd_req_t *req) {
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "out of request memory");
+    return -1;
+}
+
+/* httpd_err_code_t has no 409 */
+static int http_conflict(httpd_req_t *req, const char *msg) {
+    httpd_resp_set_status(req, "409 Conflict");
+    httpd_resp_sendstr(req, msg);
+    return -1;
+}
+
 static void reg_addvalue_tojson(struct reg_entry *ent, cJSON *json) {
     double num_val;
 
@@ -68,38 +116,46 @@ static void reg_addvalue_tojson(struct reg_entry *ent, cJSON *json) {
     cJSON_AddNumberToObject(json, "value", num_val);
 }
 
-static void http_recv(httpd_req_t *req) {
-    size_t read, offset;
+/* whole body, terminated, from the request's arena. NULL once an error response was sent */
+static char *http_recv(httpd_req_t *req, struct arena *mem) {
+    char *body;
+    size_t offset;
+    int read;
 
-    if (req->content_len > HTTPSERVER_HEAP_SIZE) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "content length too long");
-        return;
+    body = req->content_len < mem->size ? arena_alloc(mem, req->content_len + 1) : NULL;
+    if (!body) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "content length too long");
+        return NULL;
     }
 
-    offset = 0;
-    do {
-        read = httpd_req_recv(req, heap + offset, req->content_len);
+    for (offset = 0; offset < req->content_len; offset += read) {
+        read = httpd_req_recv(req, body + offset, req->content_len - offset);
+
+        if (read == HTTPD_SOCK_ERR_TIMEOUT) {
+            httpd_resp_send_err(req, HTTPD_408_REQ_TIMEOUT, "timed out reading request");
+            return NULL;
+        }
 
         if (read <= 0) {
-            // 500 invalid read
             httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "failed to read data from request");
-            return;
+            return NULL;
         }
+    }
 
-        offset += read;
-    } while (offset < req->content_len);
-
-    heap[req->content_len] = '\0';
+    body[offset] = '\0';
+    return body;
 }
 
 /* curl --header "Content-Type: application/json" --request GET --data {\"key\":\"WIFI_ST_SSID\"} http://hackquad.local/reg/get */
-static int handler_reg_get(httpd_req_t *req) {
+static int handler_reg_get(httpd_req_t *req, struct arena *mem) {
     cJSON *root, *out, *key;
     struct reg_entry *reg;
+    char *body, *resp;
     int ret;
 
-    http_recv(req);
-    root = cJSON_Parse(heap);
+    if (!(body = http_recv(req, mem)))
+        return -1;
+    root = cJSON_Parse(body);
 
     key = cJSON_GetObjectItemCaseSensitive(root, "key");
     if (!cJSON_IsString(key)) {
@@ -118,26 +174,33 @@ static int handler_reg_get(httpd_req_t *req) {
     out = cJSON_CreateObject();
     cJSON_AddNumberToObject(out, "type", reg->type);
     reg_addvalue_tojson(reg, out);
-
-    cJSON_PrintPreallocated(out, heap, HTTPSERVER_HEAP_SIZE, false);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, (char *) heap);
+    cJSON_AddBoolToObject(out, "dirty", reg->state != REG_CLEAN);
+
+    resp = cJSON_PrintUnformatted(out);
+    if (resp) {
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, resp);
+        ret = 0;
+    } else {
+        ret = http_oom(req);
+    }
 
     cJSON_Delete(out);
-    ret = 0;
     error:
     cJSON_Delete(root);
     return ret;
 }
 
 /* curl --header "Content-Type: application/json" --request POST --data {\"key\":\"PID_ANGLE_KP\",\"value\":2.06969} http://hackquad.local/reg/set */
-static int handler_reg_set(httpd_req_t *req) {
+static int handler_reg_set(httpd_req_t *req, struct arena *mem) {
     cJSON *reqjson, *value, *key;
     struct reg_entry *reg;
+    char *body;
     int ret;
 
-    http_recv(req);
-    reqjson = cJSON_Parse(heap);
+    if (!(body = http_recv(req, mem)))
+        return -1;
+    reqjson = cJSON_Parse(body);
 
     key = cJSON_GetObjectItemCaseSensitive(reqjson, "key");
     value = cJSON_GetObjectItemCaseSensitive(reqjson, "value");
@@ -168,14 +231,25 @@ static int handler_reg_set(httpd_req_t *req) {
             *((u32 *) reg->location) = value->valueint;
             break;
         case REG_STR:
-            strcpy(reg->location, value->valuestring);
+            if (cJSON_IsString(value) && strlen(value->valuestring) > REG_VALUE_MAX) {
+                httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "value too long");
+                ret = -1;
+                goto error;
+            }
+
+            if (cJSON_IsString(value))
+                strlcpy(reg->location, value->valuestring, reg->size);
             break;
         case REG_FLT:
             *((float *) reg->location) = (float) value->valuedouble;
     }
 
-    // ensure changes saved
-    reg_write(key->valuestring);
+    // applied right away, saved to flash once disarmed (or on /reg/commit)
+    if (reg_stage(reg)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "value too long to store");
+        ret = -1;
+        goto error;
+    }
 
     httpd_resp_sendstr(req, "ok");
     ret = 0;
@@ -184,99 +258,327 @@ static int handler_reg_set(httpd_req_t *req) {
     return ret;
 }
 
-static int handler_reg_list(httpd_req_t *req) {
-    cJSON *out, *ent;
+static void reg_addvalue_tostream(struct reg_entry *ent, struct json_stream *js) {
+    switch (ent->type) {
+        case REG_8B:
+            js_printf(js, "%u", *((u8 *) ent->location));
+            break;
+        case REG_16B:
+            js_printf(js, "%u", *((u16 *) ent->location));
+            break;
+        case REG_32B:
+            js_printf(js, "%u", (unsigned) *((u32 *) ent->location));
+            break;
+        case REG_64B:
+            js_printf(js, "%llu", (unsigned long long) *((u64 *) ent->location));
+            break;
+        case REG_STR:
+            js_string(js, ent->location, ent->size);
+            break;
+        case REG_FLT:
+            js_float(js, *((float *) ent->location));
+            break;
+        default:
+            js_puts(js, "null");
+            break;
+    }
+}
+
+/* streamed straight from registry[] so it works no matter how large the registry gets */
+static int handler_reg_list(httpd_req_t *req, struct arena *mem) {
+    struct json_stream *js;
     size_t i;
 
-    out = cJSON_CreateArray();
-    for (i = 0; i < registry_len; i++) {
-        ent = cJSON_CreateObject();
-        cJSON_AddItemToArray(out, ent);
+    if (!(js = arena_alloc(mem, sizeof(*js))))
+        return http_oom(req);
+
+    js_begin(js, req);
+    js_puts(js, "[");
 
-        cJSON_AddStringToObject(ent, "key", registry[i].key);
-        cJSON_AddNumberToObject(ent, "type", registry[i].type);
-        //cJSON_AddStringToObject(ent, "type", reg_type_tostr(registry[i].type));
-        reg_addvalue_tojson(&registry[i], ent);
+    for (i = 0; i < registry_len; i++) {
+        js_puts(js, i ? ",{\"key\":" : "{\"key\":");
+        js_string(js, registry[i].key, SIZE_MAX);
+        js_printf(js, ",\"type\":%d,\"value\":", registry[i].type);
+        reg_addvalue_tostream(&registry[i], js);
+        js_puts(js, registry[i].state != REG_CLEAN ? ",\"dirty\":true}" : ",\"dirty\":false}");
     }
 
-    cJSON_PrintPreallocated(out, heap, HTTPSERVER_HEAP_SIZE, false);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, (char *) heap);
+    js_puts(js, "]");
+    return js_end(js);
+}
 
-    cJSON_Delete(out);
+/* curl --request POST http://hackquad.local/reg/commit */
+static int handler_reg_commit(httpd_req_t *req, struct arena *mem) {
+    (void) mem;
+
+    if (reg_commit()) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "failed to commit registry");
+        return -1;
+    }
+
+    httpd_resp_sendstr(req, "ok");
     return 0;
 }
 
-static void _mpu_calibrate_task(void *arg) {
-    (void) arg;
+/* curl --request POST http://hackquad.local/mpu/calibrate */
+static int handler_mpu_calibrate(httpd_req_t *req, struct arena *mem) {
+    (void) mem;
 
-    blc_setrate(BLCR_VERY_FAST);
+    // finishes (and stages itself) once the quad sits still, led blinks very fast until then
     mpu_calibrate();
-    blc_setrate(BLCR_NORMAL);
-
-    // ensure calibration is saved
-    if (mpu_has_calibration) {
-        reg_write("MPU_HAS_CALIBRATION");
-        reg_write("MPU_GYROFFSET_X");
-        reg_write("MPU_GYROFFSET_Y");
-        reg_write("MPU_GYROFFSET_Z");
-        reg_write("MPU_ACCOFFSET_X");
-        reg_write("MPU_ACCOFFSET_Y");
-        reg_write("MPU_ACCOFFSET_Z");
-
-        ESP_LOGI(TAG, "saved mpu calibration to registry");
+    httpd_resp_sendstr(req, "ok");
+    return 0;
+}
+
+/* curl http://hackquad.local/mpu/timing, maxes are since the last request */
+static int handler_mpu_timing(httpd_req_t *req, struct arena *mem) {
+    struct json_stream *js;
+
+    if (!(js = arena_alloc(mem, sizeof(*js))))
+        return http_oom(req);
+
+    js_begin(js, req);
+    js_printf(js, "{\"rate_mode\":%u,\"period\":%u,\"samples\":%u,\"missed\":%u,", mpu_rate_mode,
+              (unsigned) mpu_timing.period, (unsigned) mpu_timing.samples, (unsigned) mpu_timing.missed);
+    js_printf(js, "\"read\":{\"avg\":%.1f,\"max\":%u},", mpu_timing.read, (unsigned) mpu_timing.read_max);
+    js_printf(js, "\"est\":{\"avg\":%.1f,\"max\":%u},", mpu_timing.est, (unsigned) mpu_timing.est_max);
+    js_printf(js, "\"loop\":{\"avg\":%.1f,\"max\":%u}}", mpu_timing.loop, (unsigned) mpu_timing.loop_max);
+    mpu_timing_reset();
+
+    return js_end(js);
+}
+
+/* curl http://hackquad.local/ctrl/stats, age_max is since the last request, link counters since boot */
+static int handler_ctrl_stats(httpd_req_t *req, struct arena *mem) {
+    struct setpoint_stats *st = &ctrl_setpoint.stats;
+    struct ctrllink_stats link;
+    struct json_stream *js;
+
+    ctrllink_get_stats(&link);
+
+    if (!(js = arena_alloc(mem, sizeof(*js))))
+        return http_oom(req);
+
+    js_begin(js, req);
+    js_printf(js, "{\"shaping\":%u,\"packets\":%u,\"lost\":%u,\"late\":%u,", ctrl_setpoint.conf->mode,
+              (unsigned) st->packets, (unsigned) st->lost, (unsigned) st->late);
+    js_printf(js, "\"stale\":%u,\"failsafe\":%u,", (unsigned) st->stale, (unsigned) st->failsafe);
+    js_printf(js, "\"interval\":%.1f,\"jitter\":%.1f,\"age_max\":%u,", st->interval, st->jitter,
+              (unsigned) st->age_max);
+    js_printf(js, "\"link\":{\"control\":%u,\"dropped\":%u,\"rejected\":%u}}", (unsigned) link.control,
+              (unsigned) link.dropped, (unsigned) link.rejected);
+    setpoint_stats_reset(&ctrl_setpoint);
+
+    return js_end(js);
+}
+
+/* curl http://hackquad.local/sys/mem, free_min is the least stack/heap ever left */
+static int handler_sys_mem(httpd_req_t *req, struct arena *mem) {
+    struct sysmem_heap heaps[SYSMEM_HEAPS];
+    struct sysmem_task *tasks;
+    struct json_stream *js;
+    size_t i, n;
+
+    js = arena_alloc(mem, sizeof(*js));
+    tasks = arena_alloc(mem, sizeof(*tasks) * SYSMEM_REPORT_MAX);
+    if (!js || !tasks)
+        return http_oom(req);
+
+    n = sysmem_tasks(tasks, SYSMEM_REPORT_MAX);
+    sysmem_heaps(heaps);
+
+    js_begin(js, req);
+    js_puts(js, "{\"tasks\":[");
+    for (i = 0; i < n; i++) {
+        js_puts(js, i ? ",{\"name\":" : "{\"name\":");
+        js_string(js, tasks[i].name, SIZE_MAX);
+        js_printf(js, ",\"stack\":%u,\"free_min\":%u}", (unsigned) tasks[i].stack, (unsigned) tasks[i].free_min);
+    }
+
+    js_puts(js, "],\"heap\":{");
+    for (i = 0; i < SYSMEM_HEAPS; i++)
+        js_printf(js, "%s\"%s\":{\"free\":%u,\"free_min\":%u,\"largest\":%u}", i ? "," : "", heaps[i].name,
+                  (unsigned) heaps[i].free, (unsigned) heaps[i].free_min, (unsigned) heaps[i].largest);
+
+    js_puts(js, "},\"static\":{");
+    for (i = 0; i < SYSMEM_OWNERS; i++)
+        js_printf(js, "%s\"%s\":%u", i ? "," : "", sysmem_owner_names[i], (unsigned) sysmem_owned(i));
+
+    js_puts(js, "}}");
+    return js_end(js);
+}
+
+/* curl http://hackquad.local/sys/cpu, % of one core over the last window ms */
+static int handler_sys_cpu(httpd_req_t *req, struct arena *mem) {
+    struct syscpu_report *cpu;
+    struct json_stream *js;
+    size_t i;
+
+    js = arena_alloc(mem, sizeof(*js));
+    cpu = arena_alloc(mem, sizeof(*cpu));
+    if (!js || !cpu)
+        return http_oom(req);
+
+    syscpu_get(cpu);
+
+    js_begin(js, req);
+    js_printf(js, "{\"window\":%u,\"cores\":[", (unsigned) cpu->window);
+    for (i = 0; i < cpu->cores; i++)
+        js_printf(js, i ? ",%.1f" : "%.1f", cpu->core_load[i]);
+
+    js_puts(js, "],\"tasks\":[");
+    for (i = 0; i < cpu->tasks_len; i++) {
+        js_puts(js, i ? ",{\"name\":" : "{\"name\":");
+        js_string(js, cpu->tasks[i].name, sizeof(cpu->tasks[i].name));
+        js_printf(js, ",\"core\":%d,\"load\":%.1f}", cpu->tasks[i].core, cpu->tasks[i].load);
     }
 
-    vTaskDelete(NULL);
+    js_puts(js, "]}");
+    return js_end(js);
 }
 
-/* curl --request POST http://hackquad.local/mpu/calibrate */
-static int handler_mpu_calibrate(httpd_req_t *req) {
+/* curl --request POST http://hackquad.local/sys/trace, starts a capture of TRACE_CAPTURE_MS */
+static int handler_sys_trace_start(httpd_req_t *req, struct arena *mem) {
+    (void) mem;
+
+    if (trace_start(TRACE_CAPTURE_MS))
+        return http_conflict(req, "capture running");
+
     httpd_resp_sendstr(req, "ok");
-    xTaskCreate(_mpu_calibrate_task, "mpu_calibrate", 2048, NULL, 0, NULL);
     return 0;
 }
 
-static int handler_index(httpd_req_t *req) {
+/*
+ * curl -o hq.trace http://hackquad.local/sys/trace, the last finished capture.
+ * tools/trace2json.py hq.trace hq.json for ui.perfetto.dev
+ */
+static int handler_sys_trace(httpd_req_t *req, struct arena *mem) {
+    struct trace_header *header;
+    int core, ret;
+
+    if (!(header = arena_alloc(mem, sizeof(*header))))
+        return http_oom(req);
+
+    if ((ret = trace_get(header)) == ESP_ERR_NOT_FOUND) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "no capture, POST to start one");
+        return -1;
+    } else if (ret) {
+        return http_conflict(req, "capture running");
+    }
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    if (httpd_resp_send_chunk(req, (const char *) header, sizeof(*header)) ||
+        httpd_resp_send_chunk(req, (const char *) trace_point_names, sizeof(trace_point_names)))
+        return ESP_FAIL;
+
+    // straight from the buffers, nothing but a late writer of the capture touches them until the next one
+    for (core = 0; core < header->cores; core++) {
+        if (header->core[core].count && httpd_resp_send_chunk(req, (const char *) trace_events(core),
+                                                              header->core[core].count * sizeof(struct trace_event)))
+            return ESP_FAIL;
+    }
+
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static int handler_index(httpd_req_t *req, struct arena *mem) {
+    (void) mem;
+
     httpd_resp_sendstr(req, "HackQuad running");
     return 0;
 }
 
-static inline int http_add(const char *uri, httpd_method_t method, esp_err_t (*handler)(httpd_req_t *r)) {
-    httpd_uri_t entry;
+/* curl http://hackquad.local/http/mem, arena use per endpoint since boot */
+static int handler_http_mem(httpd_req_t *req, struct arena *mem);
+
+static struct http_endpoint endpoints[] = {
+        {.uri = "/reg/get",       .method = HTTP_GET,  .handler = handler_reg_get},
+        {.uri = "/reg/set",       .method = HTTP_POST, .handler = handler_reg_set},
+        {.uri = "/reg/list",      .method = HTTP_GET,  .handler = handler_reg_list},
+        {.uri = "/reg/commit",    .method = HTTP_POST, .handler = handler_reg_commit},
+        {.uri = "/mpu/calibrate", .method = HTTP_POST, .handler = handler_mpu_calibrate},
+        {.uri = "/mpu/timing",    .method = HTTP_GET,  .handler = handler_mpu_timing},
+        {.uri = "/ctrl/stats",    .method = HTTP_GET,  .handler = handler_ctrl_stats},
+        {.uri = "/http/mem",      .method = HTTP_GET,  .handler = handler_http_mem},
+        {.uri = "/sys/mem",       .method = HTTP_GET,  .handler = handler_sys_mem},
+        {.uri = "/sys/cpu",       .method = HTTP_GET,  .handler = handler_sys_cpu},
+        {.uri = "/sys/trace",     .method = HTTP_POST, .handler = handler_sys_trace_start},
+        {.uri = "/sys/trace",     .method = HTTP_GET,  .handler = handler_sys_trace},
+        {.uri = "/",              .method = HTTP_GET,  .handler = handler_index},
+};
+
+#define HTTP_ENDPOINTS (sizeof(endpoints) / sizeof(endpoints[0]))
+
+static int handler_http_mem(httpd_req_t *req, struct arena *mem) {
+    struct json_stream *js;
+    size_t i;
 
-    entry.uri = uri;
-    entry.method = method;
-    entry.handler = handler;
-    entry.user_ctx = NULL;
+    if (!(js = arena_alloc(mem, sizeof(*js))))
+        return http_oom(req);
 
-    return httpd_register_uri_handler(server, &entry);
+    js_begin(js, req);
+    js_printf(js, "{\"arena\":%u,\"endpoints\":[", (unsigned) mem->size);
+
+    for (i = 0; i < HTTP_ENDPOINTS; i++) {
+        js_puts(js, i ? ",{\"uri\":" : "{\"uri\":");
+        js_string(js, endpoints[i].uri, SIZE_MAX);
+        js_printf(js, ",\"requests\":%u,\"peak\":%u,\"failed\":%u}", (unsigned) endpoints[i].requests,
+                  (unsigned) endpoints[i].peak, (unsigned) endpoints[i].failed);
+    }
+
+    // this request's own use only counts once it's done
+    js_puts(js, "]}");
+    return js_end(js);
+}
+
+static esp_err_t http_dispatch(httpd_req_t *req) {
+    struct http_endpoint *ep = req->user_ctx;
+    int ret;
+
+    assert(cjson_arena == NULL);
+    cjson_arena = &arena;
+    trace_begin(TRACE_HTTP, ep - endpoints);
+    ret = ep->handler(req, &arena);
+    trace_end(TRACE_HTTP, ep - endpoints);
+    cjson_arena = NULL;
+
+    ep->requests++;
+    if (arena.used > ep->peak)
+        ep->peak = arena.used;
+    if (arena.failed)
+        ep->failed++;
+
+    // everything the request allocated, at once
+    arena_reset(&arena);
+    return ret;
 }
 
 int http_init() {
     esp_err_t ret;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    cJSON_Hooks hooks = {.malloc_fn = cjson_malloc, .free_fn = cjson_free};
+    httpd_uri_t entry;
+    size_t i;
 
-    assert(heap == NULL);
+    assert(arena.base == NULL);
     //config.uri_match_fn = httpd_uri_match_wildcard;
+    config.max_uri_handlers = HTTP_ENDPOINTS;
 
-    // allocate mem for http recvs
-    heap = malloc(HTTPSERVER_HEAP_SIZE);
-    if (!heap) {
-        ESP_LOGE(TAG, "out of memory");
-        return ESP_FAIL;
-    }
+    arena_init(&arena, arena_buf, sizeof(arena_buf));
+    sysmem_add(SYSMEM_HTTP, sizeof(arena_buf));
+    cJSON_InitHooks(&hooks);
 
     if ((ret = httpd_start(&server, &config))) {
         return ret;
     }
 
-    // init handlers
-    http_add("/reg/get", HTTP_GET, handler_reg_get);
-    http_add("/reg/set", HTTP_POST, handler_reg_set);
-    http_add("/reg/list", HTTP_GET, handler_reg_list);
-    http_add("/mpu/calibrate", HTTP_POST, handler_mpu_calibrate);
-    http_add("/", HTTP_GET, handler_index);
+    for (i = 0; i < HTTP_ENDPOINTS; i++) {
+        entry.uri = endpoints[i].uri;
+        entry.method = endpoints[i].method;
+        entry.handler = http_dispatch;
+        entry.user_ctx = &endpoints[i];
+        httpd_register_uri_handler(server, &entry);
+    }
 
     return ESP_OK;
 }
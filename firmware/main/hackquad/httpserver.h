@@ -23,7 +23,7 @@
 extern "C" {
 #endif
 
-#define HTTPSERVER_HEAP_SIZE 4096
+#define HTTPSERVER_ARENA_SIZE 4096 /* per request: body, cJSON nodes, response */
 
 int http_init();
 
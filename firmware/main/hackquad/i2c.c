@@ -17,10 +17,19 @@
  */
 
 #include "driver/i2c.h"
+#include "esp_idf_version.h"
 #include <string.h>
 
 #include "hackquad/i2c.h"
 
+/* register address write + repeated start read, ~300 bytes of link buffer */
+#define IIC_READ_TRANSACTIONS 2
+
+/* static cmd links came with IDF v4.4, older ones malloc/free the link every read */
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 4, 0)
+#define IIC_STATIC_LINK
+#endif
+
 int iic_init(int port, int sda_pin, int scl_pin, u32 freq) {
     i2c_config_t conf;
 
@@ -40,6 +49,10 @@ int iic_init(int port, int sda_pin, int scl_pin, u32 freq) {
 }
 
 int iic_readl(int port, u8 address, u8 reg, u8 *buffer, size_t len) {
+#ifdef IIC_STATIC_LINK
+    // on the stack instead of malloc/free per read, this runs for every mpu sample
+    u8 link[I2C_LINK_RECOMMENDED_SIZE(IIC_READ_TRANSACTIONS)];
+#endif
     i2c_cmd_handle_t ctx;
     int ret;
 
@@ -48,7 +61,11 @@ int iic_readl(int port, u8 address, u8 reg, u8 *buffer, size_t len) {
      * | S | slave_address + W:0 | ACK | reg_address | ACK |
      * -----------------------------------------------------
      */
+#ifdef IIC_STATIC_LINK
+    ctx = i2c_cmd_link_create_static(link, sizeof(link));
+#else
     ctx = i2c_cmd_link_create();
+#endif
     i2c_master_start(ctx);
     i2c_master_write_byte(ctx, (address << 1) | I2C_MASTER_WRITE, 1);
     i2c_master_write_byte(ctx, reg, 1);
@@ -65,7 +82,11 @@ int iic_readl(int port, u8 address, u8 reg, u8 *buffer, size_t len) {
 
     // send i2c cmd queue
     ret = i2c_master_cmd_begin(port, ctx, I2C_MAX_WAIT);
+#ifdef IIC_STATIC_LINK
+    i2c_cmd_link_delete_static(ctx);
+#else
     i2c_cmd_link_delete(ctx);
+#endif
 
     return ret;
 }
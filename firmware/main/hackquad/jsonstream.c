@@ -0,0 +1,151 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "hackquad/jsonstream.h"
+
+static void js_flush(struct json_stream *js) {
+    if (js->len == 0 || js->err)
+        return;
+
+    js->err = httpd_resp_send_chunk(js->req, js->buf, js->len);
+    js->len = 0;
+}
+
+void js_begin(struct json_stream *js, httpd_req_t *req) {
+    js->req = req;
+    js->err = ESP_OK;
+    js->len = 0;
+
+    httpd_resp_set_type(req, "application/json");
+}
+
+void js_write(struct json_stream *js, const char *data, size_t len) {
+    size_t n;
+
+    while (len > 0 && !js->err) {
+        n = sizeof(js->buf) - js->len;
+        if (n > len)
+            n = len;
+
+        memcpy(js->buf + js->len, data, n);
+        js->len += n;
+        data += n;
+        len -= n;
+
+        if (js->len == sizeof(js->buf))
+            js_flush(js);
+    }
+}
+
+void js_puts(struct json_stream *js, const char *str) {
+    js_write(js, str, strlen(str));
+}
+
+void js_printf(struct json_stream *js, const char *fmt, ...) {
+    char tmp[48];
+    va_list args;
+    int n;
+
+    va_start(args, fmt);
+    n = vsnprintf(tmp, sizeof(tmp), fmt, args);
+    va_end(args);
+
+    if (n <= 0)
+        return;
+
+    if ((size_t) n < sizeof(tmp)) {
+        js_write(js, tmp, n);
+        return;
+    }
+
+    // too long for tmp, format straight into an emptied chunk buffer instead
+    js_flush(js);
+    if (js->err)
+        return;
+
+    va_start(args, fmt);
+    n = vsnprintf(js->buf, sizeof(js->buf), fmt, args);
+    va_end(args);
+
+    js->len = (size_t) n < sizeof(js->buf) ? (size_t) n : sizeof(js->buf) - 1;
+}
+
+void js_string(struct json_stream *js, const char *str, size_t maxlen) {
+    const char *start = str;
+    const char *end = str + strnlen(str, maxlen);
+    char esc[7];
+
+    js_write(js, "\"", 1);
+
+    // copy runs of plain chars in one go, only break for chars that need escaping
+    for (; str < end; str++) {
+        unsigned char c = (unsigned char) *str;
+
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        js_write(js, start, str - start);
+        start = str + 1;
+
+        switch (c) {
+            case '"':
+                js_write(js, "\\\"", 2);
+                break;
+            case '\\':
+                js_write(js, "\\\\", 2);
+                break;
+            case '\n':
+                js_write(js, "\\n", 2);
+                break;
+            case '\r':
+                js_write(js, "\\r", 2);
+                break;
+            case '\t':
+                js_write(js, "\\t", 2);
+                break;
+            default:
+                snprintf(esc, sizeof(esc), "\\u%04x", c);
+                js_write(js, esc, 6);
+                break;
+        }
+    }
+
+    js_write(js, start, str - start);
+    js_write(js, "\"", 1);
+}
+
+void js_float(struct json_stream *js, float value) {
+    if (isfinite(value))
+        js_printf(js, "%.9g", (double) value);
+    else
+        js_puts(js, "null");
+}
+
+esp_err_t js_end(struct json_stream *js) {
+    js_flush(js);
+
+    if (!js->err)
+        js->err = httpd_resp_send_chunk(js->req, NULL, 0);
+
+    return js->err;
+}
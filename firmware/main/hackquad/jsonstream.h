@@ -0,0 +1,73 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HACKQUAD_JSONSTREAM_H
+#define HACKQUAD_JSONSTREAM_H
+
+#include "hackquad/lint_defs.h"
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JSONSTREAM_CHUNK_SIZE 256
+
+/*
+ * Writes json straight into a chunked http response through a small fixed
+ * buffer. Memory use is constant no matter how large the document is.
+ *
+ * Structure (commas, nesting) is left to the caller.
+ */
+struct json_stream {
+    httpd_req_t *req;
+    esp_err_t err;
+    size_t len;
+    char buf[JSONSTREAM_CHUNK_SIZE];
+};
+
+void js_begin(struct json_stream *js, httpd_req_t *req);
+
+void js_write(struct json_stream *js, const char *data, size_t len);
+
+void js_puts(struct json_stream *js, const char *str);
+
+void js_printf(struct json_stream *js, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * Writes a quoted and escaped json string, reading at most maxlen chars.
+ */
+void js_string(struct json_stream *js, const char *str, size_t maxlen);
+
+/**
+ * Writes a float, non-finite values become null.
+ */
+void js_float(struct json_stream *js, float value);
+
+/**
+ * Flushes remaining data and terminates the chunked response.
+ *
+ * @return ESP_OK or the first error hit while sending
+ */
+esp_err_t js_end(struct json_stream *js);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HACKQUAD_JSONSTREAM_H */
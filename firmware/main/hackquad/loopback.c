@@ -0,0 +1,114 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "hackquad/loopback.h"
+
+static void queue_init(struct loopback_queue *queue) {
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+    queue->head = 0;
+    queue->count = 0;
+    queue->closed = false;
+    queue->dropped = 0;
+}
+
+static void queue_close(struct loopback_queue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static ssize_t loopback_recv(struct hq_transport *transport, u8 *buf, size_t len) {
+    struct loopback_queue *queue = ((struct loopback_end *) transport)->rx;
+
+    pthread_mutex_lock(&queue->lock);
+    while (!queue->count && !queue->closed)
+        pthread_cond_wait(&queue->cond, &queue->lock);
+
+    if (!queue->count) {
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
+    }
+
+    if (queue->lens[queue->head] < len)
+        len = queue->lens[queue->head];
+
+    memcpy(buf, queue->frames[queue->head], len);
+    queue->head = (queue->head + 1) % LOOPBACK_QUEUE_LEN;
+    queue->count--;
+    pthread_mutex_unlock(&queue->lock);
+
+    return len;
+}
+
+static ssize_t loopback_send(struct hq_transport *transport, const u8 *data, size_t len) {
+    struct loopback_queue *queue = ((struct loopback_end *) transport)->tx;
+    size_t tail;
+
+    if (len > HQLINK_BUFFER_SIZE)
+        return -1;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == LOOPBACK_QUEUE_LEN) {
+        queue->dropped++;
+    } else {
+        tail = (queue->head + queue->count) % LOOPBACK_QUEUE_LEN;
+        memcpy(queue->frames[tail], data, len);
+        queue->lens[tail] = len;
+        queue->count++;
+        pthread_cond_signal(&queue->cond);
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return len;
+}
+
+static const struct hq_transport_ops loopback_transport_ops = {
+        .name = "loopback",
+        .mtu  = HQLINK_BUFFER_SIZE,
+        .recv = loopback_recv,
+        .send = loopback_send
+};
+
+void loopback_create(struct loopback_pair *pair) {
+    queue_init(&pair->ab);
+    queue_init(&pair->ba);
+
+    pair->a.transport.ops = &loopback_transport_ops;
+    pair->a.tx = &pair->ab;
+    pair->a.rx = &pair->ba;
+
+    pair->b.transport.ops = &loopback_transport_ops;
+    pair->b.tx = &pair->ba;
+    pair->b.rx = &pair->ab;
+}
+
+void loopback_close(struct loopback_pair *pair) {
+    queue_close(&pair->ab);
+    queue_close(&pair->ba);
+}
+
+void loopback_destroy(struct loopback_pair *pair) {
+    pthread_mutex_destroy(&pair->ab.lock);
+    pthread_cond_destroy(&pair->ab.cond);
+    pthread_mutex_destroy(&pair->ba.lock);
+    pthread_cond_destroy(&pair->ba.cond);
+}
@@ -0,0 +1,84 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HACKQUAD_LOOPBACK_H
+#define HACKQUAD_LOOPBACK_H
+
+#include <stdbool.h>
+
+#include "hackquad/lint_defs.h"
+#include "hackquad/transport.h"
+#include "pthread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOOPBACK_QUEUE_LEN 8
+
+/*
+ * In-memory transport of the control link, see transport.h. Two connected ends,
+ * whatever one end sends the other receives. Only needs pthreads, used to test
+ * the framing (and measure its overhead) on the host.
+ */
+struct loopback_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    u8 frames[LOOPBACK_QUEUE_LEN][HQLINK_BUFFER_SIZE];
+    size_t lens[LOOPBACK_QUEUE_LEN];
+    size_t head, count;
+    bool closed;
+
+    /* frames dropped because the queue was full, like a datagram would be */
+    u32 dropped;
+};
+
+struct loopback_end {
+    struct hq_transport transport;
+
+    /* PRIVATE */
+    struct loopback_queue *rx, *tx;
+};
+
+struct loopback_pair {
+    struct loopback_end a, b;
+
+    /* PRIVATE */
+    struct loopback_queue ab, ba;
+};
+
+/**
+ * Connects pair->a and pair->b.
+ */
+void loopback_create(struct loopback_pair *pair);
+
+/**
+ * Wakes up and fails every pending/future recv on both ends.
+ */
+void loopback_close(struct loopback_pair *pair);
+
+/**
+ * Frees the pair, nothing may be using it anymore.
+ */
+void loopback_destroy(struct loopback_pair *pair);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HACKQUAD_LOOPBACK_H */
@@ -22,16 +22,18 @@
 
 #include "hackquad/mpu.h"
 #include "hackquad/i2c.h"
+#include "hackquad/gyrobias.h"
+#include "hackquad/estimator.h"
+#include "hackquad/registry.h"
+#include "hackquad/blinkcodes.h"
+#include "hackquad/trace.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/event_groups.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "hackquad/hackquad_msg.h"
 
-/* 0=madgwick / 1=adaptive_comp_filter */
-#define ANGLE_MODE 0
-
 /* r/w macros for i2c */
 #define iicw(reg, data)      iic_write(&mpu, reg, data)
 #define iicr(reg, buff, len) iic_read(&mpu, reg, buff, len)
@@ -52,7 +54,21 @@
 #define G_ACCL 9.80665f
 #define ACC_TO_MSS ((1.0f / ACC_LSB) * G_ACCL)
 
-#define MADGWICK_GYRO_ERR 5.f
+/* max gravity off the z axis (m/s^2) in a calibration window, ~10 deg of tilt */
+#define MPU_CAL_LEVEL 1.7f
+
+/*
+ * rough bus time of a register read: address+reg write, repeated start+address,
+ * len bytes, 9 bits each, plus the driver's command queue/isr overhead
+ */
+#define MPU_I2C_OVERHEAD 60 /* us */
+#define MPU_READ_TIME(len) ((((3 + (len)) * 9 + 3) * 1000000 / I2C_BUS0_FRQ) + MPU_I2C_OVERHEAD)
+
+#define MPU_TIMING_AVG 0.99f
+
+/* p30, temp in C = TEMP_OUT / 340 + 36.53 */
+#define TEMP_LSB    340.0f
+#define TEMP_OFFSET 36.53f
 
 /* REGISTRY */
 u8 mpu_has_calibration = 0;
@@ -62,6 +78,11 @@ float mpu_gyroffset_z  = 0.0f;
 float mpu_accoffset_x  = 0.0f;
 float mpu_accoffset_y  = 0.0f;
 float mpu_accoffset_z  = 0.0f;
+u8 mpu_ahrs_adaptive   = 1;
+u8 mpu_estimator       = ESTIMATOR_MADGWICK;
+u8 mpu_rate_mode       = MPU_RATE_NORMAL;
+
+struct mpu_timing mpu_timing;
 
 struct mpu_data mpu_latest;
 
@@ -70,86 +91,177 @@ static iic_device_t mpu = {
     .port    = MPU_BUS
 };
 
+/* set by mpu_calibrate(), the next rest window sets the accel offsets */
+static volatile bool calibrating;
+
+/* mpu_rate_mode as of boot, the sensor is only configured once */
+static u8 rate_mode;
+static u8 acc_countdown;
+static vec3f_t acc;  /* m/s^2, without offsets, kept between decimated reads */
+
+/* gyro integrated since the last mpu_update_attitude() */
+static vec3f_t gyr_sum;
+static float gyr_dt;
+
+/* gravity (-z at rest) within MPU_CAL_LEVEL of the sensor's z axis, the offsets would take in the tilt otherwise */
+static bool _mpu_level(const vec3f_t *rest_acc) {
+    return rest_acc->z < 0.f && rest_acc->x * rest_acc->x + rest_acc->y * rest_acc->y < MPU_CAL_LEVEL * MPU_CAL_LEVEL;
+}
+
+static void _mpu_finish_calibration() {
+    mpu_accoffset_x = gyrobias_rest_acc.x;
+    mpu_accoffset_y = gyrobias_rest_acc.y;
+    mpu_accoffset_z = gyrobias_rest_acc.z + G_ACCL; // should be 1g
+
+    mpu_has_calibration = true;
+    calibrating = false;
+
+    // flight task, registry lookups by hash are O(1)
+    reg_stage(reg_lookup_hash(REG_HASH_MPU_HAS_CALIBRATION));
+    reg_stage(reg_lookup_hash(REG_HASH_MPU_GYROFFSET_X));
+    reg_stage(reg_lookup_hash(REG_HASH_MPU_GYROFFSET_Y));
+    reg_stage(reg_lookup_hash(REG_HASH_MPU_GYROFFSET_Z));
+    reg_stage(reg_lookup_hash(REG_HASH_MPU_ACCOFFSET_X));
+    reg_stage(reg_lookup_hash(REG_HASH_MPU_ACCOFFSET_Y));
+    reg_stage(reg_lookup_hash(REG_HASH_MPU_ACCOFFSET_Z));
+
+    blc_setrate(BLCR_NORMAL);
+}
+
 static inline void _mpu_read_raw() {
     u8  buff[14];
     s16 raw_acc16[3];
+    s16 raw_temp16;
     s16 raw_gyr16[3];
+    vec3f_t gyr;
+
+    // low lag: gyro only (6 bytes instead of 14) but every MPU_ACC_DECIMATION'th sample
+    if (rate_mode == MPU_RATE_LOWLAG && acc_countdown) {
+        acc_countdown--;
+        iicr(0x43 /* GYRO_OUT */, buff + 8, 6);
+    } else {
+        acc_countdown = MPU_ACC_DECIMATION - 1;
+        iicr(0x3B /* ACCEL_OUT */, buff, sizeof(buff)); // p29
 
-    iicr(0x3B /* ACCEL_OUT */, buff, sizeof(buff)); // p29
+        raw_acc16[0] = (buff[0] << 8) | buff[1];
+        raw_acc16[1] = (buff[2] << 8) | buff[3];
+        raw_acc16[2] = (buff[4] << 8) | buff[5];
 
-    raw_acc16[0] = (buff[0] << 8) | buff[1];
-    raw_acc16[1] = (buff[2] << 8) | buff[3];
-    raw_acc16[2] = (buff[4] << 8) | buff[5];
+        raw_temp16 = (buff[6] << 8) | buff[7];
+
+        acc.x = (float) raw_acc16[0] * ACC_TO_MSS;
+        acc.y = (float) raw_acc16[1] * ACC_TO_MSS;
+        acc.z = (float) raw_acc16[2] * ACC_TO_MSS;
+
+        mpu_latest.temp = (float) raw_temp16 / TEMP_LSB + TEMP_OFFSET;
+    }
 
     raw_gyr16[0] = (buff[8]  << 8) | buff[9];
     raw_gyr16[1] = (buff[10] << 8) | buff[11];
     raw_gyr16[2] = (buff[12] << 8) | buff[13];
 
-    // dont need to divide raw_acc by LSB if only using values for angle calculations
-    // this is because these calculations are interested in the distribution
-    // of gravitational acceleration amongst the axes (e.g. they are unitless)
-    mpu_latest.raw_acc.x = (float) raw_acc16[0] * ACC_TO_MSS;
-    mpu_latest.raw_acc.y = (float) raw_acc16[1] * ACC_TO_MSS;
-    mpu_latest.raw_acc.z = (float) raw_acc16[2] * ACC_TO_MSS;
+    gyr.x = (float) raw_gyr16[0] / GYR_LSB;
+    gyr.y = (float) raw_gyr16[1] / GYR_LSB;
+    gyr.z = (float) raw_gyr16[2] / GYR_LSB;
+
+    // gyrobias_sample gets the uncorrected rates; the estimator gets them with gyrobias_current subtracted,
+    // which only changes once per window
+    if (gyrobias_sample(&gyr, &acc, mpu_latest.temp) && calibrating && _mpu_level(&gyrobias_rest_acc))
+        _mpu_finish_calibration();
+
+    mpu_latest.raw_gyr.x = gyr.x - gyrobias_current.x;
+    mpu_latest.raw_gyr.y = gyr.y - gyrobias_current.y;
+    mpu_latest.raw_gyr.z = gyr.z - gyrobias_current.z;
 
-    mpu_latest.raw_gyr.x = (float) raw_gyr16[0] / GYR_LSB;
-    mpu_latest.raw_gyr.y = (float) raw_gyr16[1] / GYR_LSB;
-    mpu_latest.raw_gyr.z = (float) raw_gyr16[2] / GYR_LSB;
+    mpu_latest.raw_acc = acc;
+    if (mpu_has_calibration) {
+        mpu_latest.raw_acc.x -= mpu_accoffset_x;
+        mpu_latest.raw_acc.y -= mpu_accoffset_y;
+        mpu_latest.raw_acc.z -= mpu_accoffset_z;
+    }
+}
+
+static inline void _mpu_timing_add(float *avg, u32 *max, u32 us) {
+    *avg = *avg * MPU_TIMING_AVG + (float) us * (1.f - MPU_TIMING_AVG);
+    if (us > *max)
+        *max = us;
 }
 
-#if ANGLE_MODE == 0
 void mpu_read(float dt) {
+    u64 start;
+    u32 interval;
+
+    start = esp_timer_get_time();
     _mpu_read_raw();
+    _mpu_timing_add(&mpu_timing.read, &mpu_timing.read_max, (u32) (esp_timer_get_time() - start));
 
-    // update quaternion from rotation during elapsed time
-    // TODO converges very slowly after crash, inc beta during rest to inc conv
-    madgwick_update(&mpu_latest.ahrs, dt, mpu_latest.raw_acc.x, mpu_latest.raw_acc.y, mpu_latest.raw_acc.z,
-                    mpu_latest.raw_gyr.x * DEG_TO_RAD, mpu_latest.raw_gyr.y * DEG_TO_RAD, mpu_latest.raw_gyr.z * DEG_TO_RAD);
+    // anything past 1.5 periods means data ready fired while we were busy, the
+    // first sample's dt is since boot
+    interval = (u32) (dt * 1e6f);
+    if (!mpu_timing.samples++)
+        dt = (float) mpu_timing.period * 1e-6f;
+    else if (interval > mpu_timing.period + mpu_timing.period / 2)
+        mpu_timing.missed += (interval + mpu_timing.period / 2) / mpu_timing.period - 1;
 
     // take 70% of current accepted gyr and add it to 30% of new-raw gyr
     mpu_latest.rate.x = mpu_latest.rate.x * MPU_GYR_COMPFILTER0 + mpu_latest.raw_gyr.x * MPU_GYR_COMPFILTER1;
     mpu_latest.rate.y = mpu_latest.rate.y * MPU_GYR_COMPFILTER0 + mpu_latest.raw_gyr.y * MPU_GYR_COMPFILTER1;
     mpu_latest.rate.z = mpu_latest.rate.z * MPU_GYR_COMPFILTER0 + mpu_latest.raw_gyr.z * MPU_GYR_COMPFILTER1;
 
-    // rpy angle
-    vec3f_t gravity;
-    quaternion_get_gravity(&mpu_latest.ahrs.q, &gravity);
-    quaternion_euler(&mpu_latest.ahrs.q, &gravity, &mpu_latest.angle);
+    // rotation since the last attitude update, the estimator gets the mean rate
+    gyr_sum.x += mpu_latest.raw_gyr.x * dt;
+    gyr_sum.y += mpu_latest.raw_gyr.y * dt;
+    gyr_sum.z += mpu_latest.raw_gyr.z * dt;
+    gyr_dt += dt;
 }
-#elif ANGLE_MODE == 1
-void mpu_read(float dt) {
-    _mpu_read_raw();
 
-    float comp_gyr, comp_acc = 0.006f, acc_err;
-    const float comp_gain = 4.f;
+void mpu_update_attitude() {
+    struct estimator_input in;
+    u64 start;
 
-    // error from g-vector
-    acc_err = (sqrtf(mpu_latest.raw_acc.x*mpu_latest.raw_acc.x + mpu_latest.raw_acc.y*mpu_latest.raw_acc.y + mpu_latest.raw_acc.z*mpu_latest.raw_acc.z) / G_ACCL) - 1.f;
-    acc_err = sqrtf(acc_err*acc_err);
-    comp_acc *= 1.f / expf(acc_err*comp_gain);
-    comp_gyr = 1.f - comp_acc;
+    if (gyr_dt <= 0.f)
+        return;
 
-    mpu_latest.angle.x = (mpu_latest.angle.x + mpu_latest.raw_gyr.x * dt) * comp_gyr +
-                         ((atan2f(mpu_latest.raw_acc.y, mpu_latest.raw_acc.z) * RAD_TO_DEG) * comp_acc);
-    mpu_latest.angle.y = (mpu_latest.angle.y + mpu_latest.raw_gyr.y * dt) * comp_gyr +
-                         ((atanf(-mpu_latest.raw_acc.x / sqrtf(mpu_latest.raw_acc.y * mpu_latest.raw_acc.y + mpu_latest.raw_acc.z * mpu_latest.raw_acc.z)) * RAD_TO_DEG) * comp_acc);
+    start = esp_timer_get_time();
 
-    // filter gyro rates
-    mpu_latest.rate.x = mpu_latest.rate.x * MPU_GYR_COMPFILTER0 + mpu_latest.raw_gyr.x * MPU_GYR_COMPFILTER1;
-    mpu_latest.rate.y = mpu_latest.rate.y * MPU_GYR_COMPFILTER0 + mpu_latest.raw_gyr.y * MPU_GYR_COMPFILTER1;
-    mpu_latest.rate.z = mpu_latest.rate.z * MPU_GYR_COMPFILTER0 + mpu_latest.raw_gyr.z * MPU_GYR_COMPFILTER1;
+    // first sample or MPU_ESTIMATOR changed, (re)start from the current accel
+    if (!mpu_latest.est.ops || mpu_estimator != mpu_latest.est.type) {
+        if (estimator_select(&mpu_latest.est, mpu_estimator, &mpu_latest.raw_acc)) {
+            ESP_LOGW(TAG, "unknown estimator %d", mpu_estimator);
+            mpu_estimator = mpu_latest.est.ops ? mpu_latest.est.type : ESTIMATOR_MADGWICK;
+            estimator_select(&mpu_latest.est, mpu_estimator, &mpu_latest.raw_acc);
+        }
+    }
+
+    in.dt = gyr_dt;
+    in.acc = mpu_latest.raw_acc;
+    in.gyr.x = gyr_sum.x / gyr_dt;
+    in.gyr.y = gyr_sum.y / gyr_dt;
+    in.gyr.z = gyr_sum.z / gyr_dt;
+    in.rest = gyrobias_rest;
+    mpu_latest.est.adaptive = mpu_ahrs_adaptive;
+    estimator_update(&mpu_latest.est, &in);
+
+    memset(&gyr_sum, 0, sizeof(gyr_sum));
+    gyr_dt = 0.f;
+
+    // rpy angle
+    estimator_angle(&mpu_latest.est, &mpu_latest.angle);
+
+    _mpu_timing_add(&mpu_timing.est, &mpu_timing.est_max, (u32) (esp_timer_get_time() - start));
 }
-#endif
 
 static void IRAM_ATTR _mpu_isr_handler(void *arg) {
     (void) arg;
 
     BaseType_t higher_priority_taskwoken /*= pdFALSE*/;
 
+    trace_begin(TRACE_MPU_ISR, 0);
     //prvClearInterrupt(); // auto-clr
 
     // notify task of mpu update
     xTaskNotifyFromISR(task_hackquad_main, HQMSG_MPU_UPDATE, eSetBits, &higher_priority_taskwoken);
+    trace_end(TRACE_MPU_ISR, 0);
 
     // request ctx switch from kernel to notified task. for speeeeddd
     // assuming higher_priority_taskwoken always true, because it should be
@@ -162,7 +274,16 @@ int mpu_init() {
 
     ESP_LOGI(TAG, "initializing mpu...");
 
-    madgwick_init(&mpu_latest.ahrs, MADGWICK_GYRO_ERR);
+    // estimator is started by the first mpu_update_attitude(), it needs an accel reading
+    mpu_latest.est.ops = NULL;
+    gyrobias_init(mpu_gyrref_t);
+
+    rate_mode = mpu_rate_mode;
+    acc_countdown = 0;
+    memset(&gyr_sum, 0, sizeof(gyr_sum));
+    gyr_dt = 0.f;
+    memset(&mpu_timing, 0, sizeof(mpu_timing));
+    mpu_timing.period = 1000;
 
     iicw(0x6B /* PWR_MGMT_1 */, 1 << 7 /* RESET */);
     vTaskDelay(120 / portTICK_PERIOD_MS);
@@ -171,7 +292,21 @@ int mpu_init() {
     vTaskDelay(15 / portTICK_PERIOD_MS);
     iicw(0x1B /* GYRO_CONFIG */, (GYR_RANGE_SEL << 3) /* 1 = FS_SEL 500dps */);
     iicw(0x1C /* ACCEL_CONFIG */, (ACC_RANGE_SEL << 3) /* 2 = AFS_SEL 8g | 1 = AFS_SEL 4g */);
-    iicw(0x1A /* CONFIG */, 3 /* DLPF_44_42 */);
+    if (rate_mode == MPU_RATE_LOWLAG) {
+        iicw(0x1A /* CONFIG */, 0 /* DLPF_260_256, gyro at 8kHz */);
+        iicw(0x19 /* SMPLRT_DIV */, MPU_LOWLAG_SMPLRT);
+        mpu_timing.period = (1 + MPU_LOWLAG_SMPLRT) * 1000 / 8;
+
+        // the decimated full read has to fit in a sample period with room to spare for the flight loop
+        ESP_LOGI(TAG, "low lag mode: %uus period, ~%uus gyro reads, ~%uus full reads every %d",
+                 (unsigned) mpu_timing.period, (unsigned) MPU_READ_TIME(6), (unsigned) MPU_READ_TIME(14),
+                 MPU_ACC_DECIMATION);
+        if (MPU_READ_TIME(14) > mpu_timing.period / 2)
+            ESP_LOGW(TAG, "full reads take over half the sample period, expect missed samples");
+    } else {
+        iicw(0x1A /* CONFIG */, 3 /* DLPF_44_42, gyro at 1kHz */);
+        iicw(0x19 /* SMPLRT_DIV */, 0);
+    }
 
     iicw(0x37 /* INT_PIN_CFG */, 1 << 4 /* clear INT_STATUS by any read */);
     iicw(0x38 /* INT_ENABLE */, 1 /* DATA_RDY_EN */);
@@ -196,65 +331,25 @@ int mpu_init() {
         return whoami;
 }
 
-static void IRAM_ATTR _mpu_calibrate_isr_handler(EventGroupHandle_t event) {
-    BaseType_t higher_priority_taskwoken /*= pdFALSE*/;
+void mpu_timing_loop(u32 us) {
+    _mpu_timing_add(&mpu_timing.loop, &mpu_timing.loop_max, us);
+}
 
-    xEventGroupSetBitsFromISR(event, 1, &higher_priority_taskwoken);
-    portYIELD_FROM_ISR();
+void mpu_timing_reset() {
+    mpu_timing.read_max = 0;
+    mpu_timing.est_max = 0;
+    mpu_timing.loop_max = 0;
 }
 
-// TODO skew correction calibration routine, i made this one for leveling relative to a surface (which isn't needed w/ the current angle methods)
 void mpu_calibrate() {
-    EventGroupHandle_t mpu_event;
-    EventBits_t flags;
-    unsigned int i;
-
-    // remove old isr while calibrating to prevent mpu updates to main loop
-    if (gpio_isr_handler_remove(MPU_INT))
-        return;
-
-    mpu_event = xEventGroupCreate();
-    if (!mpu_event)
-        goto cleanup;
-
-    // add temp mpu isr
-    if (gpio_isr_handler_add(MPU_INT, (gpio_isr_t) _mpu_calibrate_isr_handler, mpu_event))
-        goto cleanup;
-
-    // for each update of mpu, read data and calculate offsets
-    for (i = 0; i < MPU_CALIBRATION_ITERATIONS; i++) {
-        flags = xEventGroupWaitBits(mpu_event, 1, true, true, 100);
-
-        if (flags & 1) {
-            // mpu updated, read data
-            _mpu_read_raw();
+    // start over, the model of the old calibration may be way off (e.g. new sensor)
+    gyrobias_reset();
+    calibrating = true;
+    blc_setrate(BLCR_VERY_FAST);
 
-            mpu_gyroffset_x += mpu_latest.raw_gyr.x;
-            mpu_gyroffset_y += mpu_latest.raw_gyr.y;
-            mpu_gyroffset_z += mpu_latest.raw_gyr.z;
-
-            mpu_accoffset_x += mpu_latest.raw_acc.x;
-            mpu_accoffset_y += mpu_latest.raw_acc.y;
-            mpu_accoffset_z += mpu_latest.raw_acc.z;
-        } else
-            goto cleanup; // timeout
-    }
-
-    // calculate final offset
-    mpu_gyroffset_x /= (float) MPU_CALIBRATION_ITERATIONS;
-    mpu_gyroffset_y /= (float) MPU_CALIBRATION_ITERATIONS;
-    mpu_gyroffset_z /= (float) MPU_CALIBRATION_ITERATIONS;
-
-    mpu_accoffset_x /= (float) MPU_CALIBRATION_ITERATIONS;
-    mpu_accoffset_y /= (float) MPU_CALIBRATION_ITERATIONS;
-    mpu_accoffset_z = (mpu_accoffset_z / (float) MPU_CALIBRATION_ITERATIONS) + G_ACCL; // should be 1g
-
-    mpu_has_calibration = true;
-    ESP_LOGI(TAG, "mpu calibrated! gyr0 = %.2f, gyr1 = %.2f, gyr2 = %.2f, acc0 = %.2f, acc1 = %.2f, acc2 = %.2f", mpu_gyroffset_x,
-             mpu_gyroffset_y, mpu_gyroffset_z, mpu_accoffset_x, mpu_accoffset_y, mpu_accoffset_z);
+    ESP_LOGI(TAG, "mpu calibration requested, keep the quad level and still");
+}
 
-    cleanup:
-    vEventGroupDelete(mpu_event);
-    gpio_isr_handler_remove(MPU_INT);
-    ESP_ERROR_CHECK(gpio_isr_handler_add(MPU_INT, _mpu_isr_handler, NULL));
+bool mpu_calibrating() {
+    return calibrating;
 }
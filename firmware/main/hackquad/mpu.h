@@ -19,10 +19,13 @@
 #ifndef HACKQUAD_MPU_H
 #define HACKQUAD_MPU_H
 
+#include <stdbool.h>
+
 #include "hackquad/i2c.h"
 #include "hackquad/lint_defs.h"
 #include "esp_attr.h"
 #include "flightmath.h"
+#include "hackquad/estimator.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -32,31 +35,93 @@ extern "C" {
 #define MPU_ADDR 0x68
 #define MPU_INT  38
 
-#define MPU_CALIBRATION_ITERATIONS 4269
 /*
-#define MPU_CAL_ERROR_BASE  0x1000
-#define MPU_CAL_ERROR_
-*/
+ * MPU_RATE_MODE, applied on boot. The output rate is 1kHz either way, what
+ * changes is the DLPF lag before the rate PID sees anything. Low lag trades
+ * accel/gyro noise for ~4ms less of it.
+ *
+ *   NORMAL - 1kHz, 44Hz DLPF (~4.9ms lag), accel+temp+gyro every sample
+ *   LOWLAG - 1kHz out of the 8kHz gyro, 256Hz DLPF (~1ms lag), gyro-only reads
+ *            with accel+temp every MPU_ACC_DECIMATION samples
+ */
+#define MPU_RATE_NORMAL    0
+#define MPU_RATE_LOWLAG    1
+#define MPU_LOWLAG_SMPLRT  7  /* 8kHz / (1 + 7) = 1kHz, same as normal, 3 (2kHz) doesn't fit the 400kHz bus with accel reads */
+#define MPU_ACC_DECIMATION 4
+
+/*
+ * Flight loop timing, averages are ewma, maxes since the last mpu_timing_reset().
+ * A sample is missed when the flight task wasn't done with the previous one
+ * before the next came in (notifications don't queue up).
+ */
+struct mpu_timing {
+    u32 period;             /* us, expected sample period */
+    u32 samples;
+    u32 missed;
+    float read, est, loop;  /* us avg of the i2c read / estimator run / whole flight loop */
+    u32 read_max, est_max, loop_max;
+};
 
 struct mpu_data {
-    madgwick_ahrs_t ahrs;
+    struct estimator est;     /* MPU_ESTIMATOR */
     vec3f_t angle, rate;
-    vec3f_t raw_acc, raw_gyr;
+    vec3f_t raw_acc, raw_gyr; /* offset/bias corrected */
+    float temp;               /* C */
 };
 
 extern u8 mpu_has_calibration;
 extern float mpu_gyroffset_x;
 extern float mpu_gyroffset_y;
 extern float mpu_gyroffset_z;
+extern float mpu_gyrtco_x;  /* dps/C, bias model of gyrobias.c */
+extern float mpu_gyrtco_y;
+extern float mpu_gyrtco_z;
+extern float mpu_gyrref_t;  /* C */
 extern float mpu_accoffset_x;
 extern float mpu_accoffset_y;
 extern float mpu_accoffset_z;
+extern u8 mpu_ahrs_adaptive;
+extern u8 mpu_estimator;  /* enum estimator_type */
+extern u8 mpu_rate_mode;
+
+extern struct mpu_timing mpu_timing;
 
 extern struct mpu_data mpu_latest;
 
 int mpu_init();
+
+/**
+ * Reads a sample, updates the filtered rates. Cheap enough for every sample,
+ * the attitude is only updated by mpu_update_attitude().
+ *
+ * @param dt - s since the last sample
+ */
 void mpu_read(float dt);
-void mpu_calibrate(); // DONT USE
+
+/**
+ * Runs the estimator over the samples read since its last run (mean gyro rate,
+ * latest accel) and updates the angles.
+ */
+void mpu_update_attitude();
+
+/**
+ * Adds one flight loop iteration (from wake-up to motor output) to mpu_timing.
+ */
+void mpu_timing_loop(u32 us);
+void mpu_timing_reset();
+
+/**
+ * Requests a calibration, returns right away. The accel offsets are taken (and
+ * the gyro bias model restarted) from the next window the quad sits level
+ * (gravity within MPU_CAL_LEVEL of z) and still, see gyrobias.h. Gyro bias keeps
+ * being estimated in the background either way.
+ */
+void mpu_calibrate();
+
+/**
+ * @return whether a requested calibration is still waiting for the quad to rest
+ */
+bool mpu_calibrating();
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,229 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "hackquad/regbatch.h"
+#include "hackquad/registry.h"
+#include "esp_log.h"
+
+#define REGBATCH_ACK_HEADER 5
+
+/* reads a numeric wire value, returns bytes consumed or 0 if it didn't fit */
+static size_t read_number(reg_type_t type, const u8 *data, size_t len, s64 *ival, float *fval) {
+    size_t size = reg_type_size(type);
+    u8 v8;
+    u16 v16;
+    s32 v32;
+
+    if (size == 0 || size > len)
+        return 0;
+
+    switch (type) {
+        default:
+            return 0;
+        case REG_8B:
+            v8 = data[0];
+            *ival = v8;
+            break;
+        case REG_16B:
+            memcpy(&v16, data, sizeof(v16));
+            *ival = v16;
+            break;
+        case REG_32B:
+            memcpy(&v32, data, sizeof(v32));
+            *ival = v32;
+            break;
+        case REG_64B:
+            memcpy(ival, data, sizeof(*ival));
+            break;
+        case REG_FLT:
+            memcpy(fval, data, sizeof(*fval));
+            *ival = (s64) *fval;
+            return size;
+    }
+
+    *fval = (float) *ival;
+    return size;
+}
+
+static int apply_number(struct reg_entry *ent, s64 ival, float fval) {
+    switch (ent->type) {
+        default:
+            return REGBATCH_BAD_TYPE;
+        case REG_8B:
+            *((u8 *) ent->location) = (u8) ival;
+            break;
+        case REG_16B:
+            *((u16 *) ent->location) = (u16) ival;
+            break;
+        case REG_32B:
+            *((u32 *) ent->location) = (u32) ival;
+            break;
+        case REG_64B:
+            *((u64 *) ent->location) = (u64) ival;
+            break;
+        case REG_FLT:
+            *((float *) ent->location) = fval;
+            break;
+    }
+
+    return REGBATCH_OK;
+}
+
+/* appends type+value of ent to out, returns bytes written or 0 if it didn't fit */
+static size_t write_value(struct reg_entry *ent, u8 *out, size_t len) {
+    size_t size;
+
+    if (ent->type == REG_STR)
+        size = strnlen(ent->location, ent->size - 1) + 1;
+    else
+        size = reg_type_size(ent->type);
+
+    if (size == 0 || size + 1 > len)
+        return 0;
+
+    out[0] = ent->type;
+    memcpy(out + 1, ent->location, size);
+
+    // location isn't guaranteed terminated if it was filled to the brim
+    if (ent->type == REG_STR)
+        out[size] = '\0';
+
+    return size + 1;
+}
+
+size_t regbatch_process(const u8 *data, size_t len, u8 *out, size_t out_len) {
+    const u8 *end = data + len;
+    struct reg_entry *ent;
+    size_t wr, used;
+    u8 seq, flags, count, op, type, status;
+    u8 ok = 0, err = 0, ack_flags = 0;
+    u32 hash;
+    s64 ival;
+    float fval;
+
+    if (len < 3 || out_len < REGBATCH_ACK_HEADER)
+        return 0;
+
+    seq = data[0];
+    flags = data[1];
+    count = data[2];
+    data += 3;
+
+    wr = REGBATCH_ACK_HEADER;
+    while (count--) {
+        if (end - data < 5) {
+            ack_flags |= REGBATCH_ACK_MALFORMED;
+            break;
+        }
+
+        // every result needs at least its hash + status
+        if (out_len - wr < 5) {
+            ack_flags |= REGBATCH_ACK_TRUNCATED;
+            break;
+        }
+
+        op = data[0];
+        memcpy(&hash, data + 1, sizeof(hash));
+        data += 5;
+
+        memcpy(out + wr, &hash, sizeof(hash));
+        ent = reg_lookup_hash(hash);
+        status = REGBATCH_OK;
+        used = 0;
+
+        if (op == REGBATCH_OP_SET) {
+            if (end - data < 1) {
+                ack_flags |= REGBATCH_ACK_MALFORMED;
+                break;
+            }
+
+            type = *data++;
+            if (type == REG_STR) {
+                used = strnlen((const char *) data, end - data);
+                if (used == (size_t) (end - data)) {
+                    ack_flags |= REGBATCH_ACK_MALFORMED;
+                    break;
+                }
+
+                if (!ent) {
+                    status = REGBATCH_UNKNOWN_KEY;
+                } else if (ent->type != REG_STR) {
+                    status = REGBATCH_BAD_TYPE;
+                } else if (used >= ent->size || used > REG_VALUE_MAX) {
+                    status = REGBATCH_BAD_VALUE;
+                } else {
+                    memcpy(ent->location, data, used + 1);
+                }
+
+                data += used + 1;
+            } else {
+                used = read_number(type, data, end - data, &ival, &fval);
+                if (!used) {
+                    ack_flags |= REGBATCH_ACK_MALFORMED;
+                    break;
+                }
+
+                data += used;
+                status = ent ? apply_number(ent, ival, fval) : REGBATCH_UNKNOWN_KEY;
+            }
+
+            // applied to ram right away, saved to flash later
+            if (status == REGBATCH_OK && reg_stage(ent))
+                status = REGBATCH_BAD_VALUE;
+
+            out[wr + 4] = status;
+            wr += 5;
+        } else if (op == REGBATCH_OP_GET) {
+            if (!ent) {
+                out[wr + 4] = REGBATCH_UNKNOWN_KEY;
+                wr += 5;
+                status = REGBATCH_UNKNOWN_KEY;
+            } else {
+                used = write_value(ent, out + wr + 5, out_len - wr - 5);
+                if (!used) {
+                    ack_flags |= REGBATCH_ACK_TRUNCATED;
+                    break;
+                }
+
+                out[wr + 4] = REGBATCH_OK;
+                wr += 5 + used;
+            }
+        } else {
+            ack_flags |= REGBATCH_ACK_MALFORMED;
+            break;
+        }
+
+        if (status == REGBATCH_OK)
+            ok++;
+        else
+            err++;
+    }
+
+    // explicit commit request, flushes everything staged so far (not just this batch)
+    if ((flags & REGBATCH_FLAG_PERSIST) && reg_commit())
+        ack_flags |= REGBATCH_ACK_PERSIST_FAIL;
+
+    out[0] = REGBATCH_ACK_ID;
+    out[1] = seq;
+    out[2] = ack_flags;
+    out[3] = ok;
+    out[4] = err;
+    return wr;
+}
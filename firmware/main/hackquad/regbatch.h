@@ -0,0 +1,85 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HACKQUAD_REGBATCH_H
+#define HACKQUAD_REGBATCH_H
+
+#include "hackquad/lint_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary registry channel, lets the controller get/set many registry entries
+ * in a single datagram instead of one http request per key.
+ *
+ * request (REGBATCH_PACKET_ID), all values little-endian:
+ *   | seq u8 | flags u8 | count u8 | op[count] |
+ *   op  = | GET u8 | key_hash u32 |
+ *       | SET u8 | key_hash u32 | type u8 | value |
+ *
+ * ack (REGBATCH_ACK_ID), one per request:
+ *   | id u8 | seq u8 | flags u8 | ok u8 | err u8 | result[ok+err] |
+ *   result = | key_hash u32 | status u8 | (GET && OK): type u8 | value |
+ *
+ * value is 1/2/4/8 bytes for REG_8B/16B/32B(FLT)/64B and null-terminated for
+ * REG_STR. Numeric values are converted to the entry's type on SET.
+ *
+ * SETs are applied to ram and staged, REGBATCH_FLAG_PERSIST requests an
+ * immediate reg_commit() of everything staged.
+ */
+
+#define REGBATCH_PACKET_ID 70
+#define REGBATCH_ACK_ID    21
+#define REGBATCH_ACK_SIZE  512
+
+/* ops */
+#define REGBATCH_OP_GET 0
+#define REGBATCH_OP_SET 1
+
+/* request flags */
+#define REGBATCH_FLAG_PERSIST (1) /* commit to flash now */
+
+/* ack flags */
+#define REGBATCH_ACK_TRUNCATED    (1)      /* ran out of ack space, remaining ops skipped */
+#define REGBATCH_ACK_MALFORMED    (1 << 1) /* request ended mid-op */
+#define REGBATCH_ACK_PERSIST_FAIL (1 << 2)
+
+/* result status */
+#define REGBATCH_OK          0
+#define REGBATCH_UNKNOWN_KEY 1
+#define REGBATCH_BAD_TYPE    2
+#define REGBATCH_BAD_VALUE   3
+
+/**
+ * Applies a registry batch request and builds its acknowledgement.
+ *
+ * @param data    - request payload (after the udp header)
+ * @param len
+ * @param out     - ack buffer, REGBATCH_ACK_SIZE is plenty
+ * @param out_len
+ * @return length of the ack written to out
+ */
+size_t regbatch_process(const u8 *data, size_t len, u8 *out, size_t out_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HACKQUAD_REGBATCH_H */
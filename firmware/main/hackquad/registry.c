@@ -17,20 +17,56 @@
  */
 
 #include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
 
 #include "registry.h"
+#include "sysmem.h"
+#include "trace.h"
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 #define NVS_NAMESPACE "hq_registry"
 
+/*
+ * The whole registry is stored as a single nvs blob so boot is one read (and at
+ * most one write) instead of an nvs_open + read per entry.
+ *
+ * | magic u32 | version u16 | count u16 | len u32 | crc u32 | record[count] |
+ * record = | key_hash u32 | type u8 | len u8 | value[len] |
+ *
+ * crc is crc32 of the len bytes of records. Strings are stored without their
+ * terminator. Records of unknown keys or mismatched types are skipped, entries
+ * missing from the blob keep their defaults and get written on the next store.
+ */
+#define REG_BLOB_KEY     "registry"
+#define REG_BLOB_MAGIC   0x47455248 /* "HREG" */
+#define REG_BLOB_VERSION 1
+#define REG_BLOB_RECORD  6
+#define REG_BLOB_TRIES   3
+
+struct reg_blob_header {
+    u32 magic;
+    u16 version;
+    u16 count;
+    u32 len;
+    u32 crc;
+};
+
+static StaticSemaphore_t commit_mutex_buf;
+static SemaphoreHandle_t commit_mutex;
+
 /* method taken from Java src */
 int reg_calc_hashcode(const char *str) {
     int hash = 0;
     size_t len = strlen(str);
 
-    for (int i = 0; i < len; i++)
+    for (size_t i = 0; i < len; i++)
         hash = 31 * hash + str[i];
 
     return hash;
@@ -53,32 +89,265 @@ void reg_hashcode_tostr(u32 hash, char *buffer) {
     buffer[8] = 0;
 }
 
+/* slot -> registry index + 1, see tools/gen_registry_index.py */
+static const u8 reg_index[1 << REG_INDEX_BITS] = REG_INDEX_TABLE;
+
+struct reg_entry *reg_lookup_hash(u32 hash) {
+    u8 i = reg_index[(u32) (hash * REG_INDEX_SEED) >> (32 - REG_INDEX_BITS)];
+
+    // every slot is either empty or owned by one key, unknown keys can still land on an owned one
+    if (i && registry[i - 1].key_hash == hash)
+        return &registry[i - 1];
+
+    return NULL;
+}
+
 struct reg_entry *reg_lookup(const char *key) {
-    u32 curr_hash;
-    struct reg_entry *entry = NULL;
-    int i;
+    struct reg_entry *entry = reg_lookup_hash(reg_calc_hashcode(key));
 
-    // lookup reg_entry
-    curr_hash = reg_calc_hashcode(key);
-    for (i = 0; i < registry_len; i++) {
-        if (registry[i].key_hash == curr_hash) {
-            entry = &registry[i];
+    // a different key can share the hash of a real one
+    if (entry && strcmp(entry->key, key))
+        return NULL;
+
+    return entry;
+}
+
+size_t reg_type_size(reg_type_t type) {
+    switch (type) {
+        case REG_8B:
+            return 1;
+        case REG_16B:
+            return 2;
+        case REG_32B:
+        case REG_FLT:
+            return 4;
+        case REG_64B:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+/* size of the stored value of entry, strings without terminator */
+static size_t _reg_value_len(struct reg_entry *entry) {
+    if (entry->type == REG_STR)
+        return strnlen(entry->location, entry->size - 1);
+
+    return reg_type_size(entry->type);
+}
+
+/* copies a stored record into entry, false if it doesn't fit the entry anymore */
+static bool _reg_apply_record(struct reg_entry *entry, u8 type, const u8 *value, size_t len) {
+    if (type != entry->type)
+        return false;
+
+    if (entry->type == REG_STR) {
+        if (len >= entry->size)
+            return false;
+
+        memcpy(entry->location, value, len);
+        ((char *) entry->location)[len] = '\0';
+        return true;
+    }
+
+    if (len != reg_type_size(entry->type))
+        return false;
+
+    memcpy(entry->location, value, len);
+    return true;
+}
+
+/*
+ * Reads the registry blob flash->ram. Loads only `only` if not NULL.
+ *
+ * @return number of entries loaded or -1 if there is no valid blob
+ */
+static int _reg_load_blob(nvs_handle_t handle, struct reg_entry *only) {
+    struct reg_blob_header header;
+    struct reg_entry *entry;
+    size_t size = 0, len;
+    u8 *blob, *rec, *end;
+    int loaded = 0;
+    u32 hash;
+
+    if (nvs_get_blob(handle, REG_BLOB_KEY, NULL, &size) || size < sizeof(header))
+        return -1;
+
+    blob = malloc(size);
+    if (!blob) {
+        ESP_LOGE(TAG, "no memory to load registry blob of %d bytes", (int) size);
+        return -1;
+    }
+
+    if (nvs_get_blob(handle, REG_BLOB_KEY, blob, &size))
+        goto invalid;
+
+    memcpy(&header, blob, sizeof(header));
+    if (header.magic != REG_BLOB_MAGIC || header.version != REG_BLOB_VERSION) {
+        ESP_LOGW(TAG, "registry blob has unknown format %08x v%d", header.magic, header.version);
+        goto invalid;
+    }
+
+    if (header.len != size - sizeof(header) ||
+        esp_rom_crc32_le(0, blob + sizeof(header), header.len) != header.crc) {
+        ESP_LOGE(TAG, "registry blob is corrupt");
+        goto invalid;
+    }
+
+    rec = blob + sizeof(header);
+    end = rec + header.len;
+    while (end - rec >= REG_BLOB_RECORD) {
+        memcpy(&hash, rec, sizeof(hash));
+        len = rec[5];
+        if ((size_t) (end - rec - REG_BLOB_RECORD) < len)
             break;
+
+        entry = reg_lookup_hash(hash);
+        if (entry && (!only || entry == only) && _reg_apply_record(entry, rec[4], rec + REG_BLOB_RECORD, len))
+            loaded++;
+
+        rec += REG_BLOB_RECORD + len;
+    }
+
+    free(blob);
+    return loaded;
+
+invalid:
+    free(blob);
+    return -1;
+}
+
+/*
+ * Serializes the records of the whole registry into blob.
+ *
+ * @return end of the records or NULL if they didn't fit size (a string grew since sizing it)
+ */
+static u8 *_reg_fill_blob(u8 *blob, size_t size) {
+    u8 *rec = blob + sizeof(struct reg_blob_header);
+    size_t i, len;
+
+    for (i = 0; i < registry_len; i++) {
+        len = _reg_value_len(&registry[i]);
+        if (len > REG_VALUE_MAX) {
+            ESP_LOGE(TAG, "%s is too long to store (%d bytes)", registry[i].key, (int) len);
+            return NULL;
         }
+
+        if (rec + REG_BLOB_RECORD + len > blob + size)
+            return NULL;
+
+        memcpy(rec, &registry[i].key_hash, sizeof(u32));
+        rec[4] = registry[i].type;
+        rec[5] = len;
+        memcpy(rec + REG_BLOB_RECORD, registry[i].location, len);
+        rec += REG_BLOB_RECORD + len;
     }
 
-    return entry;
+    return rec;
 }
 
-void reg_init() {
-    int failed_writes, succ_writes, i;
+/* serializes the whole registry ram->flash, caller commits */
+static esp_err_t _reg_store_blob(nvs_handle_t handle) {
+    struct reg_blob_header header;
+    size_t i, size;
+    esp_err_t ret;
+    u8 *blob, *rec = NULL;
+    int tries;
+
+    // strings can change while the blob is filled, size it again if one outgrew it
+    for (tries = 0; !rec && tries < REG_BLOB_TRIES; tries++) {
+        size = sizeof(header);
+        for (i = 0; i < registry_len; i++)
+            size += REG_BLOB_RECORD + _reg_value_len(&registry[i]);
+
+        blob = malloc(size);
+        if (!blob) {
+            ESP_LOGE(TAG, "no memory to store registry blob of %d bytes", (int) size);
+            return ESP_ERR_NO_MEM;
+        }
+
+        rec = _reg_fill_blob(blob, size);
+        if (!rec)
+            free(blob);
+    }
+
+    // nothing written, staged entries stay dirty for the next commit
+    if (!rec)
+        return ESP_ERR_INVALID_SIZE;
+
+    header.magic = REG_BLOB_MAGIC;
+    header.version = REG_BLOB_VERSION;
+    header.count = registry_len;
+    header.len = rec - blob - sizeof(header);
+    header.crc = esp_rom_crc32_le(0, blob + sizeof(header), header.len);
+    memcpy(blob, &header, sizeof(header));
+
+    ret = nvs_set_blob(handle, REG_BLOB_KEY, blob, rec - blob);
+    free(blob);
+    return ret;
+}
+
+/* reads one entry stored in the old one-nvs-key-per-entry layout */
+static esp_err_t _reg_read_legacy(nvs_handle_t handle, struct reg_entry *entry) {
+    size_t size;
+
+    switch (entry->type) {
+        default:
+            return ESP_FAIL;
+        case REG_8B:
+            return nvs_get_u8(handle, entry->key_hash_str, entry->location);
+        case REG_16B:
+            return nvs_get_u16(handle, entry->key_hash_str, entry->location);
+        case REG_32B:
+        case REG_FLT:
+            return nvs_get_u32(handle, entry->key_hash_str, entry->location);
+        case REG_64B:
+            return nvs_get_u64(handle, entry->key_hash_str, entry->location);
+        case REG_STR:
+            size = entry->size;
+            return nvs_get_str(handle, entry->key_hash_str, entry->location, &size);
+    }
+}
+
+/*
+ * Moves values of the per-key layout into the blob. Old keys are only erased
+ * once the blob holding their values has been written.
+ *
+ * @return number of entries migrated
+ */
+static int _reg_migrate(nvs_handle_t handle) {
+    int migrated = 0;
+    size_t i;
 
-    // calculate hash/hash_str at runtime
     for (i = 0; i < registry_len; i++) {
-        registry[i].key_hash = reg_calc_hashcode(registry[i].key);
-        reg_hashcode_tostr(registry[i].key_hash, registry[i].key_hash_str);
+        if (!_reg_read_legacy(handle, &registry[i]))
+            migrated++;
+    }
+
+    if (!migrated)
+        return 0;
+
+    if (_reg_store_blob(handle) || nvs_commit(handle)) {
+        ESP_LOGE(TAG, "failed to write migrated registry blob, keeping old layout");
+        return -1;
     }
 
+    for (i = 0; i < registry_len; i++)
+        nvs_erase_key(handle, registry[i].key_hash_str);
+
+    nvs_commit(handle);
+    return migrated;
+}
+
+void reg_init() {
+    int64_t start = esp_timer_get_time();
+    nvs_handle_t handle;
+    int loaded, migrated = 0;
+    esp_err_t ret = ESP_OK;
+
+    commit_mutex = xSemaphoreCreateMutexStatic(&commit_mutex_buf);
+    sysmem_add(SYSMEM_REGISTRY, sizeof(struct reg_entry) * registry_len + sizeof(commit_mutex_buf));
+
     // try to start nvs_flash
     if (nvs_flash_init()) {
         ESP_LOGE(TAG, "invalid nvs flash partition, creating / initializing registry");
@@ -86,30 +355,40 @@ void reg_init() {
         ESP_ERROR_CHECK(nvs_flash_init());
     }
 
-    failed_writes = 0;
-    succ_writes = 0;
-    for (i = 0; i < registry_len; i++) {
-        // attempt to read value from flash->ram
-        if (reg_read(registry[i].key)) {
-
-            // reg_value didnt exist in flash, write default
-            if (reg_write(registry[i].key))
-                failed_writes++;
-            else
-                succ_writes++;
-        }
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle)) {
+        ESP_LOGE(TAG, "failed to acquire nvs read/write handle, using registry defaults");
+        return;
+    }
+
+    loaded = _reg_load_blob(handle, NULL);
+    if (loaded < 0) {
+        // no blob yet, either a fresh flash or one written by the per-key layout
+        loaded = 0;
+        migrated = _reg_migrate(handle);
+        if (migrated > 0)
+            loaded = registry_len;
     }
 
-    ESP_LOGI(TAG, "registry initialized with %d entries | %d failed writes | %d successful writes", registry_len,
-             failed_writes, succ_writes);
+    // new entries (or a fresh flash) get their defaults written
+    if ((size_t) loaded != registry_len) {
+        ret = _reg_store_blob(handle);
+        if (!ret)
+            ret = nvs_commit(handle);
+    }
+
+    nvs_close(handle);
+
+    // time-to-ready of the registry, compare against the per-key layout on a migrating boot
+    ESP_LOGI(TAG, "registry initialized with %d entries | %d loaded | %d migrated | %s | %lld us",
+             (int) registry_len, loaded, migrated > 0 ? migrated : 0,
+             (size_t) loaded == registry_len ? "unchanged" : ret ? "store failed" : "stored",
+             (long long) (esp_timer_get_time() - start));
 }
 
-// TODO expand read/write functions to use reg_entry/key_hash/etc
 int reg_read(const char *key) {
     nvs_handle_t handle;
     struct reg_entry *entry;
-    size_t dummy;
-    esp_err_t ret;
+    int loaded;
 
     entry = reg_lookup(key);
     if (!entry) {
@@ -117,45 +396,22 @@ int reg_read(const char *key) {
         return ESP_FAIL;
     }
 
-    ret = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
-    if (!ret) {
-
-        switch (entry->type) {
-            default:
-                return ESP_FAIL;
-            case REG_8B:
-                ret = nvs_get_u8(handle, entry->key_hash_str, entry->location);
-                break;
-            case REG_16B:
-                ret = nvs_get_u16(handle, entry->key_hash_str, entry->location);
-                break;
-            case REG_32B:
-            case REG_FLT:
-                ret = nvs_get_u32(handle, entry->key_hash_str, entry->location);
-                break;
-            case REG_64B:
-                ret = nvs_get_u64(handle, entry->key_hash_str, entry->location);
-                break;
-            case REG_STR:
-                // i know the size will always be ok here because its setter verified
-                // thus we need to trick the api into not throwing a ESP_ERR_NVS_INVALID_LENGTH
-                dummy = 0xFFFFFFFF;
-                ret = nvs_get_str(handle, entry->key_hash_str, entry->location, &dummy);
-                break;
-        }
-
-        nvs_close(handle);
-        return ret;
-    } else {
-        ESP_LOGE(TAG, "failed to acquire nvs read handle, code = %i", ret);
-        return ret;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle)) {
+        ESP_LOGE(TAG, "failed to acquire nvs read handle");
+        return ESP_FAIL;
     }
+
+    loaded = _reg_load_blob(handle, entry);
+    nvs_close(handle);
+
+    if (loaded > 0)
+        entry->state = REG_CLEAN;
+
+    return loaded > 0 ? ESP_OK : ESP_FAIL;
 }
 
 int reg_write(const char *key) {
-    nvs_handle_t handle;
     struct reg_entry *entry;
-    esp_err_t ret;
 
     entry = reg_lookup(key);
     if (!entry) {
@@ -163,35 +419,78 @@ int reg_write(const char *key) {
         return ESP_FAIL;
     }
 
-    if (!nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle)) {
-
-        switch (entry->type) {
-            default:
-                return ESP_FAIL;
-            case REG_8B:
-                ret = nvs_set_u8(handle, entry->key_hash_str, *(u8 *) entry->location);
-                break;
-            case REG_16B:
-                ret = nvs_set_u16(handle, entry->key_hash_str, *(u16 *) entry->location);
-                break;
-            case REG_32B:
-            case REG_FLT:
-                ret = nvs_set_u32(handle, entry->key_hash_str, *(u32 *) entry->location);
-                break;
-            case REG_64B:
-                ret = nvs_set_u64(handle, entry->key_hash_str, *(u64 *) entry->location);
-                break;
-            case REG_STR:
-                /* only store small strings, will likely never need size data */
-                ret = nvs_set_str(handle, entry->key_hash_str, entry->location);
-                break;
-        }
+    if (reg_stage(entry))
+        return ESP_FAIL;
+
+    return reg_commit() ? ESP_FAIL : ESP_OK;
+}
 
-        nvs_commit(handle);
-        nvs_close(handle);
-        return ret;
-    } else {
+int reg_stage(struct reg_entry *entry) {
+    // the blob stores value lengths in a u8
+    if (_reg_value_len(entry) > REG_VALUE_MAX) {
+        ESP_LOGE(TAG, "%s is too long to store, not staged", entry->key);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    __atomic_store_n(&entry->state, REG_DIRTY, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
+
+/* state from -> to if it still is from, atomic against reg_stage() on another task */
+static bool reg_state_swap(struct reg_entry *entry, u8 from, u8 to) {
+    return __atomic_compare_exchange_n(&entry->state, &from, to, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+size_t reg_dirty_count() {
+    size_t i, count = 0;
+
+    for (i = 0; i < registry_len; i++) {
+        if (registry[i].state != REG_CLEAN)
+            count++;
+    }
+
+    return count;
+}
+
+int reg_commit() {
+    nvs_handle_t handle;
+    int written = 0;
+    esp_err_t ret;
+    u8 done;
+    size_t i;
+
+    if (!reg_dirty_count())
+        return 0;
+
+    xSemaphoreTake(commit_mutex, portMAX_DELAY);
+
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle)) {
         ESP_LOGE(TAG, "failed to acquire nvs read/write handle");
-        return ESP_FAIL;
+        xSemaphoreGive(commit_mutex);
+        return reg_dirty_count();
+    }
+
+    // marked before writing, if it gets staged again mid-write it goes back to dirty
+    for (i = 0; i < registry_len; i++) {
+        if (reg_state_swap(&registry[i], REG_DIRTY, REG_COMMITTING))
+            written++;
     }
+
+    // the blob always holds the whole registry, one write covers every staged entry
+    trace_begin(TRACE_REG_COMMIT, 0);
+    ret = _reg_store_blob(handle);
+    if (!ret)
+        ret = nvs_commit(handle);
+    trace_end(TRACE_REG_COMMIT, 0);
+    nvs_close(handle);
+
+    // reg_stage() doesn't lock, an entry it re-staged since is DIRTY again and the swap leaves it so
+    done = ret ? REG_DIRTY : REG_CLEAN;
+    for (i = 0; i < registry_len; i++)
+        reg_state_swap(&registry[i], REG_COMMITTING, done);
+
+    xSemaphoreGive(commit_mutex);
+
+    ESP_LOGI(TAG, "registry commit | %d written | %s", written, ret ? "failed" : "ok");
+    return ret ? written : 0;
 }
@@ -20,6 +20,7 @@
 #define HACKQUAD_REGISTRY_H
 
 #include "lint_defs.h"
+#include "registry_index.h" /* generated from registry.def by tools/gen_registry_index.py */
 
 #ifdef __cplusplus
 extern "C" {
@@ -34,26 +35,44 @@ typedef enum {
     REG_FLT
 } reg_type_t;
 
+/* commit state of an entry, changes are applied to ram right away and saved to flash later by reg_commit() */
+typedef enum {
+    REG_CLEAN = 0,  /* ram matches flash */
+    REG_DIRTY,      /* changed in ram, not yet committed */
+    REG_COMMITTING  /* being written by reg_commit(), falls back to REG_DIRTY on failure */
+} reg_state_t;
+
 struct reg_entry {
     /* must be init-ed in registry[] */
     char *key;
     reg_type_t type;
     void *location;
+    size_t size; /* sizeof(*location), bounds REG_STR writes */
 
-    /* private */
+    /* private, precomputed at build time by REG_ENTRY() */
     u32 key_hash;
 
     /* hex str, used as key for nvs system, not ideal but I dont want to write my own system */
     char key_hash_str[9];
+
+    volatile u8 state; /* reg_state_t */
 };
 
 extern struct reg_entry registry[];
 extern size_t registry_len;
 
-/* MUST USE IN IMPL */
-#define DEFINE_REGISTRY(...)                                          \
-    struct reg_entry registry[] = __VA_ARGS__;                        \
-    size_t registry_len = sizeof(registry) / sizeof(struct reg_entry)
+/*
+ * Entry of registry.def, hash/hash_str come from the generated index so they cost
+ * nothing at boot and a key missing from the index fails to compile.
+ */
+#define REG_ENTRY(key, type, var) \
+    { #key, type, &(var), sizeof(var), REG_HASH_##key, REG_HASHSTR_##key, REG_CLEAN },
+
+/* MUST USE IN IMPL, right after registry[] = { #include "hackquad/registry.def" } */
+#define DEFINE_REGISTRY_LEN()                                                              \
+    size_t registry_len = sizeof(registry) / sizeof(struct reg_entry);                     \
+    _Static_assert(sizeof(registry) / sizeof(struct reg_entry) == REG_INDEX_COUNT,         \
+                   "registry[] out of sync with registry_index.h, rebuild from registry.def")
 
 
 int reg_calc_hashcode(const char *str);
@@ -78,12 +97,51 @@ int reg_request(const char *key, void *buffer);
 int reg_read(const char *key);
 
 /**
- * Writes registry value from memory->flash.
+ * Writes registry value from memory->flash. Stages the entry and commits,
+ * see reg_commit().
  */
 int reg_write(const char *key);
 
+/* longest value that can be stored, strings without terminator */
+#define REG_VALUE_MAX 255
+
+/**
+ * @return size of a value of type, 0 for REG_STR
+ */
+size_t reg_type_size(reg_type_t type);
+
 struct reg_entry *reg_lookup(const char *key);
 
+/**
+ * Marks an entry as changed in memory. It will be saved by the next
+ * reg_commit().
+ *
+ * @return ESP_ERR_INVALID_SIZE (and not staged) if the value is longer than REG_VALUE_MAX
+ */
+int reg_stage(struct reg_entry *entry);
+
+/**
+ * Writes all staged entries memory->flash. The registry is stored as a single
+ * blob, so this is one nvs write regardless of how many entries are staged.
+ * Flash writes stall the cache of both cores, so avoid calling this while
+ * flying.
+ *
+ * @return number of entries that failed to commit
+ */
+int reg_commit();
+
+/**
+ * @return number of entries changed but not yet committed
+ */
+size_t reg_dirty_count();
+
+/**
+ * O(1) lookup through the build-time perfect hash index.
+ *
+ * @return entry with key_hash == hash or NULL
+ */
+struct reg_entry *reg_lookup_hash(u32 hash);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,185 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "hackquad/setpoint.h"
+
+#define SETPOINT_EWMA 0.95f
+
+enum {
+    SETPOINT_OK,
+    SETPOINT_STALE,
+    SETPOINT_FAILSAFE
+};
+
+void setpoint_init(struct setpoint_shaper *s, const struct setpoint_conf *conf) {
+    memset(s, 0, sizeof(*s));
+    s->conf = conf;
+    s->stats.interval = SETPOINT_INTERVAL;
+}
+
+void setpoint_push(struct setpoint_shaper *s, const struct setpoint *sp, u32 sent, u64 recv) {
+    float interval = s->stats.interval, delay;
+    u64 t, expected;
+    u32 dsent;
+
+    dsent = sent - s->latest_sent; // wraps fine
+
+    // the controller's send time mapped to local time, or just the arrival without one
+    if (sent && s->count && s->latest_sent && (u64) dsent * 1000 > recv - s->recv + SETPOINT_RESYNC) {
+        // went backwards (wrapped huge) or ahead by far more than the time between the packets
+        // here, the controller restarted. not loss, start mapping its clock over from this one
+        s->stats.resync++;
+        s->gap = false;
+        t = recv;
+    } else if (sent && s->count && s->latest_sent) {
+
+        // a gap on its own is loss, gap after gap is the controller sending slower than it used to
+        if (dsent > interval * 1.5e-3f && !s->gap)
+            s->stats.lost += (u32) (dsent * 1e3f / interval + 0.5f) - 1;
+        else
+            s->stats.interval = interval * SETPOINT_EWMA + dsent * 1e3f * (1.f - SETPOINT_EWMA);
+        s->gap = dsent > interval * 1.5e-3f;
+
+        // fastest arrival seen so far is the link's best, slowly let go of it to follow clock drift
+        expected = s->latest_t + (u64) dsent * 1000 + SETPOINT_OFFSET_LEAK;
+        t = recv < expected ? recv : expected;
+
+        delay = (float) (recv - t);
+        s->stats.jitter = s->stats.jitter * SETPOINT_EWMA + delay * (1.f - SETPOINT_EWMA);
+        if (delay > interval / 2.f)
+            s->stats.late++;
+    } else {
+        if (s->count && recv - s->recv > 0)
+            s->stats.interval = interval * SETPOINT_EWMA + (float) (recv - s->recv) * (1.f - SETPOINT_EWMA);
+
+        t = recv;
+    }
+
+    s->prev = s->latest;
+    s->prev_t = s->latest_t;
+    s->latest = *sp;
+    s->latest_t = t;
+    s->latest_sent = sent;
+    s->recv = recv;
+    s->stats.packets++;
+
+    if (s->count < 2)
+        s->count++;
+
+    // out of the first packet there's nothing to shape from
+    if (s->count == 1) {
+        s->prev = *sp;
+        s->prev_t = t;
+        s->out = *sp;
+    }
+
+    s->state = SETPOINT_OK;
+}
+
+static inline float lerp(float a, float b, float f) {
+    return a + (b - a) * f;
+}
+
+static inline float slew(float from, float to, float max) {
+    if (max <= 0.f)
+        return to;
+
+    if (to > from + max)
+        return from + max;
+    if (to < from - max)
+        return from - max;
+    return to;
+}
+
+void setpoint_update(struct setpoint_shaper *s, u64 now, struct setpoint *out) {
+    const struct setpoint_conf *conf = s->conf;
+    struct setpoint target;
+    float f, span, dt;
+    u64 age;
+
+    dt = s->last_update ? (float) (now - s->last_update) * 1e-6f : 0.f;
+    s->last_update = now;
+
+    if (!s->count) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+
+    // the link task can stamp a packet after the caller took now
+    age = now > s->recv ? now - s->recv : 0;
+    if (age > s->stats.age_max)
+        s->stats.age_max = age > UINT32_MAX ? UINT32_MAX : (u32) age;
+
+    target = s->latest;
+    span = (float) (s->latest_t - s->prev_t);
+
+    // only shape between packets that came in about one interval apart
+    if (conf->mode != SETPOINT_STEP && span > 0.f && span < s->stats.interval * 4.f) {
+        f = fminf(fmaxf((float) (s64) (now - s->latest_t) / span, 0.f), 1.f);
+
+        if (conf->mode == SETPOINT_INTERPOLATE) {
+            target.x = lerp(s->prev.x, s->latest.x, f);
+            target.y = lerp(s->prev.y, s->latest.y, f);
+            target.z = lerp(s->prev.z, s->latest.z, f);
+            target.throttle = lerp(s->prev.throttle, s->latest.throttle, f);
+        } else {
+            target.x = lerp(s->latest.x, 2.f * s->latest.x - s->prev.x, f);
+            target.y = lerp(s->latest.y, 2.f * s->latest.y - s->prev.y, f);
+            target.z = lerp(s->latest.z, 2.f * s->latest.z - s->prev.z, f);
+            target.throttle = fmaxf(lerp(s->latest.throttle, 2.f * s->latest.throttle - s->prev.throttle, f), 0.f);
+        }
+
+        // cutting the throttle has to be immediate
+        if (s->latest.throttle <= 0.f)
+            target.throttle = 0.f;
+    }
+
+    // degrade as packets stop coming in: level out, then bring it down
+    if (age > (u64) conf->timeout * 1000) {
+        if (s->state != SETPOINT_FAILSAFE)
+            s->stats.failsafe++;
+        s->state = SETPOINT_FAILSAFE;
+
+        f = (float) (age - (u64) conf->timeout * 1000) / SETPOINT_FAILSAFE_RAMP;
+        target.throttle = s->latest.throttle * fmaxf(1.f - f, 0.f);
+    } else if (age > (u64) conf->stale * 1000) {
+        if (s->state == SETPOINT_OK)
+            s->stats.stale++;
+        s->state = SETPOINT_STALE;
+    }
+
+    if (s->state != SETPOINT_OK) {
+        target.x = 0.f;
+        target.y = 0.f;
+        target.z = 0.f;
+    }
+
+    s->out.x = slew(s->out.x, target.x, conf->slew_angle * dt);
+    s->out.y = slew(s->out.y, target.y, conf->slew_angle * dt);
+    s->out.z = slew(s->out.z, target.z, conf->slew_yaw * dt);
+    s->out.throttle = target.throttle;
+
+    *out = s->out;
+}
+
+void setpoint_stats_reset(struct setpoint_shaper *s) {
+    s->stats.age_max = 0;
+}
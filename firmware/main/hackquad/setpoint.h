@@ -0,0 +1,119 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HACKQUAD_SETPOINT_H
+#define HACKQUAD_SETPOINT_H
+
+#include <stdbool.h>
+
+#include "hackquad/lint_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Shapes the controller's setpoints for the flight loop. Control packets come
+ * in every ~20ms while the loop runs at 1kHz, stepping the angle loop's input
+ * each time. Between packets the setpoint is interpolated/predicted from the
+ * last two (timed by the controller's send timestamp when it has one), then
+ * slew limited.
+ *
+ * Without packets for conf->stale the quad levels out and holds its throttle,
+ * after conf->timeout the throttle is ramped down over SETPOINT_FAILSAFE_RAMP.
+ */
+
+/* CTRL_SHAPING */
+#define SETPOINT_STEP        0 /* packets as they come, as before */
+#define SETPOINT_INTERPOLATE 1 /* between the last two packets, one packet interval behind */
+#define SETPOINT_PREDICT     2 /* extrapolates the last two packets (up to one interval), no delay */
+
+#define SETPOINT_INTERVAL      20000    /* us, assumed packet interval until one is measured */
+#define SETPOINT_OFFSET_LEAK   50       /* us per packet, lets the clock offset follow drift */
+#define SETPOINT_RESYNC        1000000  /* us, controller clock jump past the arrival gap taken as a restart */
+#define SETPOINT_FAILSAFE_RAMP 2000000  /* us, throttle ramp down after the timeout */
+
+struct setpoint {
+    float throttle, x, y, z;
+};
+
+struct setpoint_conf {
+    u8 mode;
+    float slew_angle;  /* deg/s for x/y, 0 = off */
+    float slew_yaw;    /* deg/s^2 for z, 0 = off */
+    u32 stale;         /* ms without packets before leveling out */
+    u32 timeout;       /* ms without packets before the throttle is ramped down */
+};
+
+struct setpoint_stats {
+    u32 packets;
+    u32 lost;        /* gaps in the controller's timestamps */
+    u32 resync;      /* controller timestamps that jumped back or far ahead (restarts) */
+    u32 late;        /* arrived over half an interval later than the link's best */
+    u32 stale;       /* times the quad was leveled out for lack of packets */
+    u32 failsafe;    /* times the throttle was ramped down for lack of packets */
+    float interval;  /* us, ewma between packets */
+    float jitter;    /* us, ewma of the arrival delay over the link's best */
+    u32 age_max;     /* us, longest time without a packet since setpoint_stats_reset() */
+};
+
+struct setpoint_shaper {
+    /* SET BY CALLER */
+    const struct setpoint_conf *conf;
+
+    /* PRIVATE */
+    struct setpoint prev, latest, out;
+    u64 prev_t, latest_t;  /* us, when the packets were sent, in local time */
+    u64 recv;              /* us, local arrival of the latest packet */
+    u64 last_update;
+    u32 latest_sent;       /* ms, controller clock */
+    u8 count;              /* packets held, up to 2 */
+    bool gap;              /* the latest packet came over 1.5 intervals after the one before */
+    u8 state;
+
+    struct setpoint_stats stats;
+};
+
+void setpoint_init(struct setpoint_shaper *s, const struct setpoint_conf *conf);
+
+/**
+ * Adds a control packet.
+ *
+ * @param s
+ * @param sp
+ * @param sent - ms controller timestamp, 0 if the controller doesn't send one
+ * @param recv - us local arrival time
+ */
+void setpoint_push(struct setpoint_shaper *s, const struct setpoint *sp, u32 sent, u64 recv);
+
+/**
+ * Shaped setpoint at local time now, call once per flight loop.
+ *
+ * @param s
+ * @param now - us
+ * @param out
+ */
+void setpoint_update(struct setpoint_shaper *s, u64 now, struct setpoint *out);
+
+void setpoint_stats_reset(struct setpoint_shaper *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HACKQUAD_SETPOINT_H */
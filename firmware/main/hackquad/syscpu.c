@@ -0,0 +1,139 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hackquad/syscpu.h"
+#include "hackquad/sysmem.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "pthread.h"
+
+struct snapshot {
+    u32 time;   /* us of the run time clock */
+    size_t len;
+    struct {
+        TaskHandle_t handle;
+        u32 counter;
+    } tasks[SYSCPU_TASKS_MAX];
+};
+
+/* only touched by the sampling task */
+static TaskStatus_t status[SYSCPU_TASKS_MAX];
+static struct snapshot snaps[SYSCPU_WINDOW + 1];
+static size_t snaps_len, snaps_next;
+static struct syscpu_report next;
+static bool overflowed;
+
+static struct syscpu_report report;
+static pthread_mutex_t report_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static u32 counter_before(const struct snapshot *old, TaskHandle_t handle) {
+    size_t i;
+
+    for (i = 0; i < old->len; i++) {
+        if (old->tasks[i].handle == handle)
+            return old->tasks[i].counter;
+    }
+
+    // started within the window, all of its time is in it
+    return 0;
+}
+
+static int by_load(const void *a, const void *b) {
+    float la = ((const struct syscpu_task *) a)->load, lb = ((const struct syscpu_task *) b)->load;
+
+    return (la < lb) - (la > lb);
+}
+
+void syscpu_init() {
+    sysmem_add(SYSMEM_CPU, sizeof(status) + sizeof(snaps) + sizeof(next) + sizeof(report));
+    syscpu_sample();
+}
+
+const struct syscpu_report *syscpu_sample() {
+    struct snapshot *now, *old;
+    struct syscpu_task *task;
+    BaseType_t affinity;
+    UBaseType_t n;
+    u32 total, elapsed;
+    size_t i, c;
+
+    n = uxTaskGetSystemState(status, SYSCPU_TASKS_MAX, &total);
+    if (!n) {
+        if (!overflowed)
+            ESP_LOGW(TAG, "more than %d tasks, raise SYSCPU_TASKS_MAX", SYSCPU_TASKS_MAX);
+        overflowed = true;
+        return NULL;
+    }
+
+    now = &snaps[snaps_next];
+    now->time = total;
+    now->len = n;
+    for (i = 0; i < n; i++) {
+        now->tasks[i].handle = status[i].xHandle;
+        now->tasks[i].counter = status[i].ulRunTimeCounter;
+    }
+
+    // the oldest sample, SYSCPU_WINDOW intervals back once the ring is full
+    old = snaps_len ? &snaps[snaps_len <= SYSCPU_WINDOW ? 0 : (snaps_next + 1) % (SYSCPU_WINDOW + 1)] : NULL;
+    snaps_next = (snaps_next + 1) % (SYSCPU_WINDOW + 1);
+    if (snaps_len <= SYSCPU_WINDOW)
+        snaps_len++;
+
+    // counters are 32 bit us, the differences survive them wrapping
+    if (!old || !(elapsed = now->time - old->time))
+        return NULL;
+
+    next.window = elapsed / 1000;
+    next.cores = 0;
+    next.tasks_len = n;
+    for (i = 0; i < n; i++) {
+        task = &next.tasks[i];
+        strncpy(task->name, status[i].pcTaskName, sizeof(task->name) - 1);
+        task->name[sizeof(task->name) - 1] = '\0';
+        affinity = xTaskGetAffinity(status[i].xHandle);
+        task->core = affinity == tskNO_AFFINITY ? -1 : (s8) affinity;
+        task->load = (float) (now->tasks[i].counter - counter_before(old, now->tasks[i].handle)) * 100.f /
+                     (float) elapsed;
+
+        for (c = 0; c < portNUM_PROCESSORS && c < SYSCPU_CORES; c++) {
+            if (status[i].xHandle == xTaskGetIdleTaskHandleForCPU(c)) {
+                next.core_load[c] = 100.f - task->load;
+                next.cores++;
+            }
+        }
+    }
+
+    qsort(next.tasks, next.tasks_len, sizeof(next.tasks[0]), by_load);
+
+    pthread_mutex_lock(&report_mutex);
+    report = next;
+    pthread_mutex_unlock(&report_mutex);
+
+    return &next;
+}
+
+void syscpu_get(struct syscpu_report *out) {
+    pthread_mutex_lock(&report_mutex);
+    *out = report;
+    pthread_mutex_unlock(&report_mutex);
+}
@@ -0,0 +1,78 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HACKQUAD_SYSCPU_H
+#define HACKQUAD_SYSCPU_H
+
+#include <stddef.h>
+
+#include "hackquad/lint_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Per-task cpu use from FreeRTOS' run time stats (esp_timer clock, see
+ * sdkconfig), over a sliding window of the last SYSCPU_WINDOW samples.
+ * Loads are in % of one core, a core's load is what its idle task didn't get.
+ * Served at /sys/cpu and sent to the controller (CTRLLINK_CPU_ID).
+ */
+
+#define SYSCPU_TASKS_MAX 24     /* sampled tasks, esp-idf with wifi + ours is ~20 */
+#define SYSCPU_WINDOW    5      /* samples */
+#define SYSCPU_SAMPLE_MS 1000
+#define SYSCPU_CORES     2
+#define SYSCPU_NAME_LEN  16     /* CONFIG_FREERTOS_MAX_TASK_NAME_LEN */
+
+struct syscpu_task {
+    char name[SYSCPU_NAME_LEN];
+    s8 core;        /* pinned to, -1 when it runs on either */
+    float load;     /* % of one core */
+};
+
+struct syscpu_report {
+    u32 window;                         /* ms the loads are over, 0 until there are two samples */
+    u8 cores;                           /* cores with a known load */
+    float core_load[SYSCPU_CORES];      /* % */
+    size_t tasks_len;
+    struct syscpu_task tasks[SYSCPU_TASKS_MAX];  /* busiest first */
+};
+
+/**
+ * Takes the first sample.
+ */
+void syscpu_init();
+
+/**
+ * Takes a sample and updates the report, call every SYSCPU_SAMPLE_MS from one task.
+ *
+ * @return the new report, valid until the next sample. NULL without one
+ */
+const struct syscpu_report *syscpu_sample();
+
+/**
+ * Copies out the report of the last sample.
+ */
+void syscpu_get(struct syscpu_report *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HACKQUAD_SYSCPU_H */
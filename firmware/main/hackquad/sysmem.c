@@ -0,0 +1,109 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "hackquad/sysmem.h"
+#include "esp_heap_caps.h"
+
+const char *const sysmem_owner_names[SYSMEM_OWNERS] = {
+        [SYSMEM_TASKS] = "tasks",
+        [SYSMEM_LINK] = "link",
+        [SYSMEM_ESPNOW] = "espnow",
+        [SYSMEM_HTTP] = "http",
+        [SYSMEM_REGISTRY] = "registry",
+        [SYSMEM_CPU] = "cpu",
+        [SYSMEM_TRACE] = "trace"
+};
+
+/*
+ * esp-idf's own tasks, stacks come from sdkconfig and the heap. Both idle tasks
+ * are called IDLE, they're looked up by core instead.
+ */
+static const char *const idf_tasks[] = {"httpd", "tiT", "wifi", "sys_evt", "esp_timer", "ipc0", "ipc1"};
+static const char *const idle_tasks[] = {"IDLE0", "IDLE1"};
+
+_Static_assert(sizeof(idf_tasks) / sizeof(idf_tasks[0]) + sizeof(idle_tasks) / sizeof(idle_tasks[0]) == SYSMEM_IDF_TASKS,
+               "SYSMEM_IDF_TASKS out of sync");
+
+static struct {
+    TaskHandle_t handle;
+    u32 stack;
+} tasks[SYSMEM_TASKS_MAX];
+static size_t tasks_len;
+
+static size_t owned[SYSMEM_OWNERS];
+
+TaskHandle_t sysmem_task_add(TaskHandle_t task, size_t stack, size_t tcb) {
+    // only called during boot, before anything reads the table
+    if (task && tasks_len < SYSMEM_TASKS_MAX) {
+        tasks[tasks_len].handle = task;
+        tasks[tasks_len].stack = stack;
+        tasks_len++;
+    }
+
+    sysmem_add(SYSMEM_TASKS, stack + tcb);
+    return task;
+}
+
+void sysmem_add(enum sysmem_owner owner, size_t bytes) {
+    owned[owner] += bytes;
+}
+
+size_t sysmem_owned(enum sysmem_owner owner) {
+    return owned[owner];
+}
+
+static size_t idf_task(struct sysmem_task *out, const char *name, TaskHandle_t handle) {
+    if (!handle)
+        return 0;
+
+    out->name = name;
+    out->stack = 0;
+    out->free_min = uxTaskGetStackHighWaterMark(handle) * sizeof(StackType_t);
+    return 1;
+}
+
+size_t sysmem_tasks(struct sysmem_task *out, size_t max) {
+    size_t i, n = 0;
+
+    for (i = 0; i < tasks_len && n < max; i++, n++) {
+        out[n].name = pcTaskGetName(tasks[i].handle);
+        out[n].stack = tasks[i].stack;
+        out[n].free_min = uxTaskGetStackHighWaterMark(tasks[i].handle) * sizeof(StackType_t);
+    }
+
+    for (i = 0; i < sizeof(idf_tasks) / sizeof(idf_tasks[0]) && n < max; i++)
+        n += idf_task(&out[n], idf_tasks[i], xTaskGetHandle(idf_tasks[i]));
+
+    for (i = 0; i < portNUM_PROCESSORS && n < max; i++)
+        n += idf_task(&out[n], idle_tasks[i], xTaskGetIdleTaskHandleForCPU(i));
+
+    return n;
+}
+
+static void heap_info(struct sysmem_heap *out, const char *name, u32 caps) {
+    out->name = name;
+    out->free = heap_caps_get_free_size(caps);
+    out->free_min = heap_caps_get_minimum_free_size(caps);
+    out->largest = heap_caps_get_largest_free_block(caps);
+}
+
+void sysmem_heaps(struct sysmem_heap out[SYSMEM_HEAPS]) {
+    heap_info(&out[0], "internal", MALLOC_CAP_INTERNAL);
+    heap_info(&out[1], "dma", MALLOC_CAP_DMA);
+    heap_info(&out[2], "iram", MALLOC_CAP_EXEC);
+}
@@ -0,0 +1,104 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HACKQUAD_SYSMEM_H
+#define HACKQUAD_SYSMEM_H
+
+#include <stddef.h>
+
+#include "hackquad/lint_defs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Long-lived tasks and buffers come from static memory, sized at build time so
+ * whatever heap is left is known up front. Every subsystem adds what it holds
+ * here, /sys/mem reports it next to the tasks' stack high water marks and the
+ * heap per capability.
+ */
+
+enum sysmem_owner {
+    SYSMEM_TASKS = 0,   /* stacks + tcbs of the tasks started through sysmem_task_start() */
+    SYSMEM_LINK,        /* control link transports and buffers */
+    SYSMEM_ESPNOW,      /* frame queue between the wifi task and the link task */
+    SYSMEM_HTTP,        /* request arena */
+    SYSMEM_REGISTRY,    /* registry table */
+    SYSMEM_CPU,         /* run time stats samples */
+    SYSMEM_TRACE,       /* event tracer buffers */
+    SYSMEM_OWNERS
+};
+
+extern const char *const sysmem_owner_names[SYSMEM_OWNERS];
+
+#define SYSMEM_TASKS_MAX  8
+#define SYSMEM_IDF_TASKS  9
+#define SYSMEM_REPORT_MAX (SYSMEM_TASKS_MAX + SYSMEM_IDF_TASKS)
+
+struct sysmem_task {
+    const char *name;
+    u32 stack;      /* bytes, 0 for esp-idf's own tasks */
+    u32 free_min;   /* least stack that was ever left, bytes */
+};
+
+/* MALLOC_CAP_INTERNAL, MALLOC_CAP_DMA, MALLOC_CAP_EXEC */
+#define SYSMEM_HEAPS 3
+
+struct sysmem_heap {
+    const char *name;
+    u32 free, free_min, largest;
+};
+
+/* static storage of one task, stack in bytes (a StackType_t is one byte on the esp32) */
+#define SYSMEM_TASK(var, stack_size)                                   \
+    static StackType_t var##_stack[(stack_size) / sizeof(StackType_t)]; \
+    static StaticTask_t var##_tcb
+
+/* starts a task defined by SYSMEM_TASK(var, ...), evaluates to its handle */
+#define sysmem_task_start(var, fn, name, arg, prio)                                                            \
+    sysmem_task_add(xTaskCreateStatic(fn, name, sizeof(var##_stack) / sizeof(StackType_t), arg, prio,          \
+                                      var##_stack, &var##_tcb), sizeof(var##_stack), sizeof(var##_tcb))
+
+/**
+ * Tracks a task for /sys/mem, accounts stack + tcb to SYSMEM_TASKS.
+ *
+ * @return task
+ */
+TaskHandle_t sysmem_task_add(TaskHandle_t task, size_t stack, size_t tcb);
+
+void sysmem_add(enum sysmem_owner owner, size_t bytes);
+
+size_t sysmem_owned(enum sysmem_owner owner);
+
+/**
+ * Tracked tasks, then the esp-idf tasks that are running.
+ *
+ * @return tasks written to out
+ */
+size_t sysmem_tasks(struct sysmem_task *out, size_t max);
+
+void sysmem_heaps(struct sysmem_heap out[SYSMEM_HEAPS]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HACKQUAD_SYSMEM_H */
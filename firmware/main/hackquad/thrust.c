@@ -0,0 +1,62 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "hackquad/thrust.h"
+
+void thrust_lut_build(struct thrust_lut *lut, const struct thrust_curve *curve) {
+    float t[THRUST_CURVE_POINTS + 1], target;
+    int i, k;
+
+    memcpy(&lut->built, curve, sizeof(*curve));
+
+    // monotone, normalized to the thrust at full duty
+    t[0] = 0;
+    for (i = 0; i < THRUST_CURVE_POINTS; i++)
+        t[i + 1] = curve->thrust[i] > t[i] ? curve->thrust[i] : t[i];
+
+    if (!curve->linearize || !(t[THRUST_CURVE_POINTS] > 0)) {
+        for (i = 0; i < THRUST_LUT_SIZE; i++)
+            lut->duty[i] = THRUST_MAX * (float) i / (THRUST_LUT_SIZE - 1);
+        return;
+    }
+
+    for (i = 1; i <= THRUST_CURVE_POINTS; i++)
+        t[i] /= t[THRUST_CURVE_POINTS];
+
+    // walk the curve's segments along with the table, first segment reaching the target wins
+    lut->duty[0] = 0;
+    k = 0;
+    for (i = 1; i < THRUST_LUT_SIZE; i++) {
+        target = (float) i / (THRUST_LUT_SIZE - 1);
+        while (k < THRUST_CURVE_POINTS - 1 && t[k + 1] < target)
+            k++;
+
+        lut->duty[i] = THRUST_MAX / THRUST_CURVE_POINTS *
+                       ((float) k + (target - t[k]) / (t[k + 1] - t[k]));
+    }
+}
+
+int thrust_lut_refresh(struct thrust_lut *lut, const struct thrust_curve *curve) {
+    if (!memcmp(&lut->built, curve, sizeof(*curve)))
+        return 0;
+
+    thrust_lut_build(lut, curve);
+    return 1;
+}
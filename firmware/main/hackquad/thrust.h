@@ -0,0 +1,91 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HACKQUAD_THRUST_H
+#define HACKQUAD_THRUST_H
+
+#include "hackquad/lint_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Maps the mixer's outputs from thrust to motor duty. Thrust grows roughly with
+ * the square of the duty cycle, so without it the loop gain (thrust per unit of
+ * pid output) is several times higher at high throttle than near idle.
+ *
+ * The motors' thrust curve lives in the registry as the thrust at 1/8, 2/8 .. 8/8
+ * duty (any unit, only the shape matters). It is inverted into a table of duty
+ * at evenly spaced thrust, looked up with linear interpolation per motor write.
+ * Mixer outputs keep the duty's range (0..THRUST_MAX), full thrust is still full duty.
+ */
+
+#define THRUST_CURVE_POINTS 8   /* MOTOR_THRUST_1..8 */
+#define THRUST_LUT_BITS     6
+#define THRUST_LUT_SIZE     ((1 << THRUST_LUT_BITS) + 1)
+#define THRUST_MAX          1023.f  /* 10-bit duty */
+
+struct thrust_curve {
+    u8 linearize;                       /* MOTOR_LINEARIZE, 0 = thrust is passed through as duty */
+    float thrust[THRUST_CURVE_POINTS];  /* thrust at (i + 1) / 8 duty, zero at zero duty */
+};
+
+struct thrust_lut {
+    struct thrust_curve built;          /* curve the table was built from */
+    float duty[THRUST_LUT_SIZE];        /* duty at i / (THRUST_LUT_SIZE - 1) of full thrust */
+};
+
+/**
+ * Builds the table from curve. Points are made monotone (a point below the one
+ * before it is raised to it), a curve without any thrust gives a straight table.
+ */
+void thrust_lut_build(struct thrust_lut *lut, const struct thrust_curve *curve);
+
+/**
+ * Rebuilds the table if curve changed since it was built.
+ *
+ * @return 1 if it was rebuilt
+ */
+int thrust_lut_refresh(struct thrust_lut *lut, const struct thrust_curve *curve);
+
+/**
+ * @param thrust 0..THRUST_MAX, clamped
+ * @return duty 0..THRUST_MAX
+ */
+static inline u32 thrust_duty(const struct thrust_lut *lut, float thrust) {
+    float x, f;
+    int i;
+
+    if (!(thrust > 0))
+        return 0;
+    if (thrust >= THRUST_MAX)
+        return (u32) THRUST_MAX;
+
+    x = thrust * ((THRUST_LUT_SIZE - 1) / THRUST_MAX);
+    i = (int) x;
+    f = x - (float) i;
+
+    return (u32) (lut->duty[i] + (lut->duty[i + 1] - lut->duty[i]) * f + 0.5f);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HACKQUAD_THRUST_H */
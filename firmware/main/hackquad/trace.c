@@ -0,0 +1,243 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "hal/cpu_hal.h"
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_ipc.h"
+#include "esp_timer.h"
+#include "hackquad/trace.h"
+#include "hackquad/sysmem.h"
+
+enum trace_state {
+    TRACE_IDLE = 0,     /* nothing captured yet */
+    TRACE_RUNNING,
+    TRACE_DONE
+};
+
+struct trace_buffer {
+    u32 head;   /* next free slot, counts on past the end while full */
+    struct trace_event events[TRACE_EVENTS];
+};
+
+struct trace_clock {
+    u32 cycles;
+    s64 us;
+};
+
+const char trace_point_names[TRACE_POINTS][TRACE_NAME_LEN] = {
+        [TRACE_MPU_ISR] = "mpu_isr",
+        [TRACE_FC_LOOP] = "fc_loop",
+        [TRACE_MPU_READ] = "mpu_read",
+        [TRACE_ATTITUDE] = "attitude",
+        [TRACE_LINK_RECV] = "link_recv",
+        [TRACE_LINK_SEND] = "link_send",
+        [TRACE_HTTP] = "http",
+        [TRACE_REG_COMMIT] = "reg_commit",
+        [TRACE_WIFI_EVENT] = "wifi_event"
+};
+
+volatile int trace_active;
+
+static struct trace_buffer buffers[TRACE_CORES];
+
+/*
+ * trace_start() only moves IDLE/DONE -> RUNNING and trace_poll() only RUNNING ->
+ * DONE, so the two don't need a lock. Everything below is written before the
+ * state changes and read after.
+ */
+static int state;
+static s64 deadline;
+static struct trace_clock start_clocks[TRACE_CORES];
+static struct trace_core_info finished[TRACE_CORES];
+static u32 task_count;
+
+/* the running task's number (configUSE_TRACE_FACILITY), given out on its first event */
+static u8 IRAM_ATTR trace_task() {
+    TaskHandle_t task;
+    UBaseType_t number;
+
+    // isrs nest on their core, they don't need telling apart
+    if (xPortInIsrContext())
+        return 0;
+
+    task = xTaskGetCurrentTaskHandle();
+    number = uxTaskGetTaskNumber(task);
+    if (!number) {
+        // only ever set by the task itself
+        number = __atomic_fetch_add(&task_count, 1, __ATOMIC_RELAXED) % 255 + 1;
+        vTaskSetTaskNumber(task, number);
+    }
+
+    return (u8) number;
+}
+
+void IRAM_ATTR _trace_add(u8 point, u8 type, u8 arg) {
+    u8 core = xPortGetCoreID();
+    struct trace_buffer *buf = &buffers[core];
+    struct trace_event *ev;
+    u32 i;
+
+    // isrs on this core may claim slots in between. an unpinned task moved to the other core
+    // right here shares this buffer with it for one event, the atomic add still keeps it whole
+    i = __atomic_fetch_add(&buf->head, 1, __ATOMIC_RELAXED);
+    if (i >= TRACE_EVENTS)
+        return;
+
+    ev = &buf->events[i];
+    ev->cycles = cpu_hal_get_cycle_count();
+    ev->point = point;
+    ev->task = trace_task();
+    ev->arg = arg;
+
+    // completes the slot, a writer preempted before here is skipped by the reader
+    __atomic_store_n(&ev->flags, type | core << 4, __ATOMIC_RELEASE);
+}
+
+/* runs on the core whose cycle counter is read */
+static void trace_read_clock(void *arg) {
+    struct trace_clock *clock = arg;
+
+    clock->cycles = cpu_hal_get_cycle_count();
+    clock->us = esp_timer_get_time();
+}
+
+static void trace_read_clocks(struct trace_clock clocks[TRACE_CORES]) {
+    int core;
+
+    for (core = 0; core < portNUM_PROCESSORS; core++)
+        esp_ipc_call_blocking(core, trace_read_clock, &clocks[core]);
+}
+
+static u32 trace_claimed(int core) {
+    u32 head = __atomic_load_n(&buffers[core].head, __ATOMIC_RELAXED);
+
+    return head < TRACE_EVENTS ? head : TRACE_EVENTS;
+}
+
+static int trace_full() {
+    int core;
+
+    for (core = 0; core < portNUM_PROCESSORS; core++) {
+        if (trace_claimed(core) < TRACE_EVENTS)
+            return 0;
+    }
+
+    return 1;
+}
+
+void trace_init() {
+    u32 i;
+    int core;
+
+    for (core = 0; core < TRACE_CORES; core++) {
+        for (i = 0; i < TRACE_EVENTS; i++)
+            buffers[core].events[i].flags = TRACE_INCOMPLETE;
+    }
+
+    sysmem_add(SYSMEM_TRACE, sizeof(buffers));
+}
+
+int trace_start(u32 ms) {
+    u32 i, n;
+    int core;
+
+    if (__atomic_load_n(&state, __ATOMIC_ACQUIRE) == TRACE_RUNNING)
+        return ESP_ERR_INVALID_STATE;
+
+    if (ms > TRACE_CAPTURE_MS)
+        ms = TRACE_CAPTURE_MS;
+
+    // slots of the last capture read as written otherwise
+    for (core = 0; core < TRACE_CORES; core++) {
+        n = trace_claimed(core);
+        for (i = 0; i < n; i++)
+            buffers[core].events[i].flags = TRACE_INCOMPLETE;
+
+        __atomic_store_n(&buffers[core].head, 0, __ATOMIC_RELAXED);
+    }
+
+    trace_read_clocks(start_clocks);
+    deadline = esp_timer_get_time() + (s64) ms * 1000;
+
+    __atomic_store_n(&state, TRACE_RUNNING, __ATOMIC_RELEASE);
+    __atomic_store_n(&trace_active, 1, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
+
+void trace_poll() {
+    struct trace_clock end[TRACE_CORES];
+    struct trace_core_info *info;
+    u32 head;
+    int core;
+
+    if (__atomic_load_n(&state, __ATOMIC_ACQUIRE) != TRACE_RUNNING)
+        return;
+
+    if (esp_timer_get_time() < deadline && !trace_full())
+        return;
+
+    __atomic_store_n(&trace_active, 0, __ATOMIC_RELEASE);
+    trace_read_clocks(end);
+
+    for (core = 0; core < TRACE_CORES; core++) {
+        info = &finished[core];
+        memset(info, 0, sizeof(*info));
+        if (core >= portNUM_PROCESSORS)
+            continue;
+
+        info->start_cycles = start_clocks[core].cycles;
+        info->start_us = start_clocks[core].us;
+        info->end_cycles = end[core].cycles;
+        info->end_us = end[core].us;
+
+        head = __atomic_load_n(&buffers[core].head, __ATOMIC_RELAXED);
+        info->count = trace_claimed(core);
+        info->dropped = head - info->count;
+    }
+
+    __atomic_store_n(&state, TRACE_DONE, __ATOMIC_RELEASE);
+}
+
+int trace_get(struct trace_header *out) {
+    switch (__atomic_load_n(&state, __ATOMIC_ACQUIRE)) {
+        case TRACE_RUNNING:
+            return ESP_ERR_INVALID_STATE;
+        case TRACE_IDLE:
+            return ESP_ERR_NOT_FOUND;
+        default:
+            break;
+    }
+
+    memset(out, 0, sizeof(*out));
+    memcpy(out->magic, "HQTR", sizeof(out->magic));
+    out->version = TRACE_VERSION;
+    out->cores = portNUM_PROCESSORS;
+    out->points = TRACE_POINTS;
+    out->name_len = TRACE_NAME_LEN;
+    memcpy(out->core, finished, sizeof(out->core));
+    return ESP_OK;
+}
+
+const struct trace_event *trace_events(int core) {
+    return buffers[core].events;
+}
@@ -0,0 +1,159 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HACKQUAD_TRACE_H
+#define HACKQUAD_TRACE_H
+
+#include <stddef.h>
+
+#include "hackquad/lint_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Event tracer, shows how the isr, flight loop, link, http and wifi interleave.
+ * Events are fixed 8 byte records stamped with the cycle counter of the core they
+ * happened on, each core appends to a buffer of its own with one atomic add (no
+ * locks, so isrs can trace). Tracing is off (one load + branch per point) until
+ * trace_start() arms a capture, trace_poll() ends it once the buffers fill or its
+ * time is up. POST /sys/trace arms one, GET /sys/trace downloads the last finished
+ * one and tools/trace2json.py turns that into chrome trace json.
+ *
+ * capture, little-endian:
+ *   | "HQTR" | version u8 | cores u8 | points u8 | name_len u8 |
+ *   TRACE_CORES * (start_cycles u32 | start_us s64 | end_cycles u32 | end_us s64 | count u32 | dropped u32) |
+ *   points * name char[name_len] |
+ *   core 0's count events | core 1's count events | ...
+ *   event: | cycles u32 | point u8 | flags u8 | task u8 | arg u8 |
+ *   flags: type (bits 0-3) | core (bits 4-7), TRACE_INCOMPLETE while being written
+ * start/end pair each core's cycle counter with esp_timer, the counters of the two
+ * cores aren't in sync. Events of one core aren't necessarily in order, an isr can
+ * stamp its event between another's slot and stamp. task is a number given to each
+ * task on its first event (1-255, wraps), 0 in isrs.
+ */
+
+#define TRACE_VERSION      2
+#define TRACE_CORES        2
+#define TRACE_EVENTS       2048    /* per core, 16KiB each */
+#define TRACE_NAME_LEN     16
+#define TRACE_CAPTURE_MS   500     /* longest capture, cycle counters wrap after ~17s */
+
+enum trace_point {
+    TRACE_MPU_ISR = 0,      /* mpu data ready interrupt */
+    TRACE_FC_LOOP,          /* one flight loop pass, arg = HQMSG bits it woke up for */
+    TRACE_MPU_READ,         /* i2c read of a sample and rate filtering */
+    TRACE_ATTITUDE,         /* estimator update + angle loop, every FC_OUTER_DIV samples */
+    TRACE_LINK_RECV,        /* handling of one control link packet, arg = packet id */
+    TRACE_LINK_SEND,        /* arg = packet id */
+    TRACE_HTTP,             /* one request, arg = endpoint index */
+    TRACE_REG_COMMIT,       /* registry written to flash */
+    TRACE_WIFI_EVENT,       /* arg = wifi_event_t */
+    TRACE_POINTS
+};
+
+enum trace_type {
+    TRACE_BEGIN = 0,
+    TRACE_END,
+    TRACE_INSTANT
+};
+
+#define TRACE_INCOMPLETE 0xFF   /* flags of a slot claimed but not written (yet) */
+
+struct __attribute__((packed)) trace_event {
+    u32 cycles;
+    u8 point;
+    u8 flags;   /* type | core << 4, written last */
+    u8 task;
+    u8 arg;
+};
+
+struct __attribute__((packed)) trace_core_info {
+    u32 start_cycles;
+    s64 start_us;
+    u32 end_cycles;
+    s64 end_us;
+    u32 count;      /* slots claimed, TRACE_INCOMPLETE ones included */
+    u32 dropped;    /* events past a full buffer */
+};
+
+struct __attribute__((packed)) trace_header {
+    char magic[4];
+    u8 version;
+    u8 cores;
+    u8 points;
+    u8 name_len;
+    struct trace_core_info core[TRACE_CORES];
+};
+
+extern const char trace_point_names[TRACE_POINTS][TRACE_NAME_LEN];
+extern volatile int trace_active;
+
+void _trace_add(u8 point, u8 type, u8 arg);
+
+static inline void trace_begin(enum trace_point point, u8 arg) {
+    if (trace_active)
+        _trace_add(point, TRACE_BEGIN, arg);
+}
+
+static inline void trace_end(enum trace_point point, u8 arg) {
+    if (trace_active)
+        _trace_add(point, TRACE_END, arg);
+}
+
+static inline void trace_instant(enum trace_point point, u8 arg) {
+    if (trace_active)
+        _trace_add(point, TRACE_INSTANT, arg);
+}
+
+/**
+ * Accounts the buffers to SYSMEM_TRACE.
+ */
+void trace_init();
+
+/**
+ * Arms a capture of up to ms (at most TRACE_CAPTURE_MS), dropping the last one.
+ * Call from one task at a time, the same as trace_get().
+ *
+ * @return ESP_ERR_INVALID_STATE if one is running already
+ */
+int trace_start(u32 ms);
+
+/**
+ * Ends a running capture once its time is up or the buffers are full, call
+ * every ~100ms from one task.
+ */
+void trace_poll();
+
+/**
+ * @param out filled in with the header of the last finished capture
+ * @return ESP_ERR_INVALID_STATE while one runs, ESP_ERR_NOT_FOUND if there is none
+ */
+int trace_get(struct trace_header *out);
+
+/**
+ * @return the last finished capture's events of core, out->core[core].count of them
+ */
+const struct trace_event *trace_events(int core);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HACKQUAD_TRACE_H */
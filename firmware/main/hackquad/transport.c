@@ -0,0 +1,87 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "hackquad/transport.h"
+#include "esp_log.h"
+#include "esp_err.h"
+
+int hq_link_yield(struct hq_link *link) {
+    const struct hq_frame_header *head;
+    ssize_t read;
+
+    read = link->transport->ops->recv(link->transport, link->recv_buffer, sizeof(link->recv_buffer));
+    if (read < 0) {
+        ESP_LOGE(TAG, "%s recv failed", link->transport->ops->name);
+        return ESP_FAIL;
+    }
+
+    // no fragmentation supported, must arrive as entire/confined packet. Datagrams larger than the
+    // buffer are cut short by the transport, handling what's left would act on half a registry batch
+    if (read < (ssize_t) sizeof(struct hq_frame_header) || read > HQLINK_BUFFER_SIZE) {
+        link->dropped++;
+        return ESP_FAIL;
+    }
+
+    head = (struct hq_frame_header *) link->recv_buffer;
+
+    // ensure data order, discard old packets
+    if (head->nonce == 0) {
+        // prime nonce, takes priority
+        link->latest_recv_nonce = 0;
+    } else if (head->nonce <= link->latest_recv_nonce &&
+               link->latest_recv_nonce - head->nonce <= HQLINK_NONCE_WINDOW) {
+        // older or repeated (duplicated by the network), the controller never reuses one before 0 re-primes
+        link->dropped++;
+        return ESP_FAIL;
+    } else
+        // newer, or so far back it's a controller that restarted and lost its nonce 0 (or wrapped)
+        link->latest_recv_nonce = head->nonce;
+
+    // answered right here so the rtt doesn't include the handler
+    if (head->id == HQLINK_PING_ID) {
+        link->recv_buffer[sizeof(struct hq_frame_header) - 1] = HQLINK_PONG_ID;
+        hq_link_send(link, link->recv_buffer + sizeof(struct hq_frame_header) - 1,
+                     read - sizeof(struct hq_frame_header) + 1);
+        return ESP_OK;
+    }
+
+    // call recv handler
+    link->recv_handler(head->id, link->recv_buffer + sizeof(struct hq_frame_header),
+                       read - sizeof(struct hq_frame_header));
+    return ESP_OK;
+}
+
+ssize_t hq_link_send(struct hq_link *link, const u8 *data, size_t len) {
+    struct hq_transport *transport = link->transport;
+
+    if (!transport)
+        return 0;
+
+    return transport->ops->send(transport, data, len);
+}
+
+size_t hq_link_mtu(struct hq_link *link) {
+    struct hq_transport *transport = link->transport;
+
+    if (!transport || transport->ops->mtu > HQLINK_BUFFER_SIZE)
+        return HQLINK_BUFFER_SIZE;
+
+    return transport->ops->mtu;
+}
@@ -0,0 +1,127 @@
+/*
+ * HackQuad - an open-source firmware+hardware quadcopter
+ * Copyright (C) 2020, Andrew Howard, <divisionind.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HACKQUAD_TRANSPORT_H
+#define HACKQUAD_TRANSPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "hackquad/lint_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Control/telemetry link, split into framing (this file, transport.c) and the
+ * transport moving the frames (udp, esp-now or loopback).
+ *
+ * inbound frame:  | id u8 | nonce u24 | payload |
+ * outbound frame: | id u8 | payload |
+ *
+ * Nonces order inbound frames, anything up to HQLINK_NONCE_WINDOW older than
+ * (or repeating) the latest one is dropped.
+ * A nonce of 0 re-primes the order (controller restarted). So does one further
+ * back than the window, a restarted controller whose first frame got lost would
+ * be locked out until it caught up with the old nonces otherwise.
+ */
+
+#define HQLINK_BUFFER_SIZE  512 /* fits a full registry batch */
+#define HQLINK_NONCE_WINDOW 64  /* frames the network may reorder/repeat, further back is a new session */
+
+/* echoed back as HQLINK_PONG_ID with the same payload, for measuring link rtt */
+#define HQLINK_PING_ID 71
+#define HQLINK_PONG_ID 23
+
+struct hq_transport;
+
+struct hq_transport_ops {
+    const char *name;
+
+    /* largest frame the transport can move */
+    size_t mtu;
+
+    /**
+     * Blocks until a frame arrives.
+     *
+     * @return length of the frame written to buf or < 0 on error
+     */
+    ssize_t (*recv)(struct hq_transport *transport, u8 *buf, size_t len);
+
+    /**
+     * Sends a frame to the peer the last frame was received from.
+     *
+     * @return amount of data sent, 0 if there is no peer yet
+     */
+    ssize_t (*send)(struct hq_transport *transport, const u8 *data, size_t len);
+};
+
+struct hq_transport {
+    const struct hq_transport_ops *ops;
+};
+
+struct __attribute__((packed)) hq_frame_header {
+    u8 id;
+    u32 nonce:24;
+};
+
+typedef void (*hq_frame_handler_t)(int id, u8 *data, size_t len);
+
+struct hq_link {
+    /* SET BY CALLER */
+    struct hq_transport *transport;
+    hq_frame_handler_t recv_handler;
+
+    /* PRIVATE */
+    u8 recv_buffer[HQLINK_BUFFER_SIZE + 1]; /* one spare byte tells oversized datagrams from full ones */
+
+    /* highest nonce recv-ed */
+    u32 latest_recv_nonce:24;
+
+    /* frames dropped for being too short / too long / out of order / repeated */
+    u32 dropped;
+};
+
+/**
+ * Receives a frame from the transport, checks its order and calls the handler.
+ * Blocking.
+ *
+ * @param link
+ * @return ESP_OK/FAIL
+ */
+int hq_link_yield(struct hq_link *link);
+
+/**
+ * Sends an outbound frame (id already in data[0]) over the transport.
+ *
+ * @return amount of data sent, 0 if the link has no transport/peer yet
+ */
+ssize_t hq_link_send(struct hq_link *link, const u8 *data, size_t len);
+
+/**
+ * @return largest frame that can be sent over the link
+ */
+size_t hq_link_mtu(struct hq_link *link);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HACKQUAD_TRANSPORT_H */
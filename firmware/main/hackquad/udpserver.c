@@ -19,12 +19,11 @@
 #include <string.h>
 
 #include "hackquad/udpserver.h"
-#include "hackquad/hackquad_msg.h"
 #include "esp_log.h"
-#include "freertos/task.h"
+#include "esp_err.h"
 
 #if UDPSERVER_LOG_RECVB
-static void print_data(u8 *data, size_t len) {
+static void print_data(const u8 *data, size_t len) {
     printf("received (%i) = ", len);
 
     for (size_t i = 0; i < len; i++) {
@@ -35,37 +34,34 @@ static void print_data(u8 *data, size_t len) {
 }
 #endif
 
-int udp_yield(struct udp_context *ctx) {
-    const struct udp_packet_header *head;
-    ssize_t read = recvfrom(ctx->sock, ctx->recv_buffer, UDPSERVER_RECV_BUFFER_SIZE, 0, &ctx->from,
-                            &ctx->fromlen);
+static ssize_t udp_recv(struct hq_transport *transport, u8 *buf, size_t len) {
+    struct udp_context *ctx = (struct udp_context *) transport;
+    ssize_t read;
 
-    if (read < (ssize_t) sizeof(struct udp_packet_header)) {
+    read = recvfrom(ctx->sock, buf, len, 0, &ctx->from, &ctx->fromlen);
+    if (read < 0) {
         ESP_LOGE(TAG, "error in recvfrom(), errno = %i", errno);
-        return ESP_FAIL;
+        return -1;
     }
 
 #if UDPSERVER_LOG_RECVB
-    print_data(ctx->recv_buffer, read);
+    print_data(buf, read);
 #endif
 
-    // no fragmentation supported, must arrive as entire/confined packet
-    head = (struct udp_packet_header *) ctx->recv_buffer;
-
-    // ensure data order, discard old packets
-    if (head->nonce == 0) {
-        // prime nonce, takes priority
-        ctx->latest_recv_nonce = 0;
-    } else if (head->nonce < ctx->latest_recv_nonce) {
-        return ESP_FAIL;
-    }
+    return read;
+}
 
-    // call recv handler
-    ctx->recv_handler(head->id, ctx->recv_buffer + sizeof(struct udp_packet_header),
-                      read - sizeof(struct udp_packet_header));
-    return ESP_OK;
+static ssize_t udp_send(struct hq_transport *transport, const u8 *data, size_t len) {
+    return udp_sendp((struct udp_context *) transport, data, len);
 }
 
+static const struct hq_transport_ops udp_transport_ops = {
+        .name = "udp",
+        .mtu  = HQLINK_BUFFER_SIZE,
+        .recv = udp_recv,
+        .send = udp_send
+};
+
 int udp_create(struct udp_context *ctx, u32 ipaddr /* IPADDR_ANY */, u16 port) {
     // init udp server
     struct sockaddr_in addr;
@@ -86,13 +82,14 @@ int udp_create(struct udp_context *ctx, u32 ipaddr /* IPADDR_ANY */, u16 port) {
         return ESP_FAIL;
     }
 
+    ctx->transport.ops = &udp_transport_ops;
     ctx->fromlen = sizeof(ctx->from);
 
     ESP_LOGI(TAG, "created udp socket on ::%i", port);
     return ESP_OK;
 }
 
-ssize_t udp_sendp(struct udp_context *ctx, u8 *data, size_t len) {
+ssize_t udp_sendp(struct udp_context *ctx, const u8 *data, size_t len) {
     if (*ctx->from.sa_data)
         return sendto(ctx->sock, data, len, 0, &ctx->from, ctx->fromlen);
     else
@@ -23,59 +23,36 @@
 #include <stddef.h>
 
 #include "hackquad/lint_defs.h"
+#include "hackquad/transport.h"
 #include "lwip/sockets.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#define UDPSERVER_RECV_BUFFER_SIZE 128
 #define UDPSERVER_PORT             25565
 #define UDPSERVER_LOG_RECVB        0
 
-typedef void (*udp_recv_handler_t)(int id, u8 *data, size_t len);
-
+/* udp transport of the control link, see transport.h */
 struct udp_context {
-    /* SET BY CALLER */
-    udp_recv_handler_t recv_handler;
+    struct hq_transport transport;
 
     /* PRIVATE */
     int sock;
     struct sockaddr from;
     socklen_t fromlen;
-    u8 recv_buffer[UDPSERVER_RECV_BUFFER_SIZE];
-
-    /* current sending nonce */
-    u32 send_nonce:24;
-
-    /* highest nonce recv-ed */
-    u32 latest_recv_nonce:24;
-};
-
-struct __attribute__((packed)) udp_packet_header {
-    u8 id;
-    u32 nonce:24;
 };
 
 /**
  * Creates a UDP server.
  *
- * @param ctx    - udp server instance handlers and persistent data
+ * @param ctx    - udp server instance, ctx->transport is ready to use on success
  * @param ipaddr - address to bind to (e.g. IPADDR_ANY/0.0.0.0)
  * @param port
  * @return ESP_OK/FAIL
  */
 int udp_create(struct udp_context *ctx, u32 ipaddr /* IPADDR_ANY */, u16 port);
 
-/**
- * Receives packets from the udp socket. Blocking until a full packet is recieved and processed
- * by calling its handler.
- *
- * @param ctx
- * @return ESP_OK/FAIL
- */
-int udp_yield(struct udp_context *ctx);
-
 /**
  * Sends data to the last person data was received from.
  *
@@ -84,7 +61,7 @@ int udp_yield(struct udp_context *ctx);
  * @param len  - amount of data from buffer to send
  * @return amount of data sent
  */
-ssize_t udp_sendp(struct udp_context *ctx, u8 *data, size_t len);
+ssize_t udp_sendp(struct udp_context *ctx, const u8 *data, size_t len);
 
 #ifdef __cplusplus
 }
@@ -19,6 +19,9 @@
 #include <string.h>
 
 #include "hackquad/wifi.h"
+#include "hackquad/registry.h"
+#include "hackquad/trace.h"
+#include "hackquad/bootprof.h"
 #include "esp_wifi_types.h"
 #include "esp_timer.h"
 #include "esp_log.h"
@@ -28,9 +31,12 @@
 #define WIFI_FAIL_FLAG    (1 << 1)
 #define WIFI_SUCCESS_FLAG 1
 
+#define WIFI_FASTCONN_RETRYS 1 /* retrys of the cached ap before falling back to a full scan */
+
 struct hq_wifi_event_args {
     EventGroupHandle_t wifi_event_group;
     int retry_num;
+    int max_retrys;
 };
 
 
@@ -47,6 +53,15 @@ char wifi_ap_pass[64] = "division";
 char wifi_st_ssid[32] = "HackQuad";
 char wifi_st_pass[64] = "division";
 
+/*
+ * last ap sta mode connected with, used to skip the scan on the next boot. The
+ * ip always comes from dhcp, lwip asks for the last lease again first
+ * (CONFIG_LWIP_DHCP_RESTORE_LAST_IP) and the server confirms or refuses it.
+ */
+u8 wifi_st_fastconn       = 1;
+u64 wifi_st_bssid         = 0; /* 6 bytes, 0 = none cached */
+u8 wifi_st_channel        = 0;
+
 static void sta_wifi_event_handler(struct hq_wifi_event_args *arg, esp_event_base_t event_base, s32 event_id, void *event_data) {
     ip_event_got_ip_t *event;
 
@@ -54,7 +69,7 @@ static void sta_wifi_event_handler(struct hq_wifi_event_args *arg, esp_event_bas
         esp_wifi_connect();
     } else
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (arg->retry_num < wifi_st_max_retrys) {
+        if (arg->retry_num < arg->max_retrys) {
             esp_wifi_connect();
             arg->retry_num++;
         } else {
@@ -72,6 +87,42 @@ static void sta_wifi_event_handler(struct hq_wifi_event_args *arg, esp_event_bas
     }
 }
 
+/* directed connect to the cached ap, dhcp as usual */
+static void sta_config_cached(wifi_config_t *conf) {
+    conf->sta.bssid_set = 1;
+    memcpy(conf->sta.bssid, &wifi_st_bssid, sizeof(conf->sta.bssid));
+    conf->sta.channel = wifi_st_channel;
+    conf->sta.scan_method = WIFI_FAST_SCAN;
+}
+
+/* any ap with our ssid on any channel */
+static void sta_config_scan(wifi_config_t *conf) {
+    conf->sta.bssid_set = 0;
+    conf->sta.channel = 0;
+    conf->sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+}
+
+/* remembers the ap we ended up with, only touches the registry if something changed */
+static void sta_update_cache() {
+    wifi_ap_record_t aprec;
+    u64 bssid = 0;
+
+    if (esp_wifi_sta_get_ap_info(&aprec))
+        return;
+
+    memcpy(&bssid, aprec.bssid, sizeof(aprec.bssid));
+
+    if (bssid == wifi_st_bssid && aprec.primary == wifi_st_channel)
+        return;
+
+    wifi_st_bssid = bssid;
+    wifi_st_channel = aprec.primary;
+
+    // saved by the registry commit task, the quad is disarmed during boot
+    reg_stage(reg_lookup("WIFI_ST_BSSID"));
+    reg_stage(reg_lookup("WIFI_ST_CHANNEL"));
+}
+
 static int init_wifi_sta() {
     struct hq_wifi_event_args wifi_event_arg;
     wifi_config_t conf;
@@ -79,9 +130,15 @@ static int init_wifi_sta() {
     esp_event_handler_instance_t any_event_handler;
     esp_event_handler_instance_t got_ip_handler;
     wifi_init_config_t init_cfg = WIFI_INIT_CONFIG_DEFAULT();
+    s64 start;
+    int cached;
+
+    start = esp_timer_get_time();
+    cached = wifi_st_fastconn && wifi_st_bssid && wifi_st_channel;
 
     wifi_event_arg.wifi_event_group = xEventGroupCreate();
     wifi_event_arg.retry_num = 0;
+    wifi_event_arg.max_retrys = cached ? WIFI_FASTCONN_RETRYS : wifi_st_max_retrys;
 
     esp_netif_create_default_wifi_sta();
     ESP_ERROR_CHECK(esp_wifi_init(&init_cfg));
@@ -102,11 +159,16 @@ static int init_wifi_sta() {
     strcpy((char *) conf.sta.password, wifi_st_pass);
     conf.sta.threshold.authmode = wifi_st_authmode;
 
+    if (cached)
+        sta_config_cached(&conf);
+    else
+        sta_config_scan(&conf);
+
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));  // be sure to call this to prevent that stupid flash caching crap
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &conf));
     ESP_ERROR_CHECK(esp_wifi_start());
-    ESP_LOGI(TAG, "wifi sta mode started");
+    ESP_LOGI(TAG, "wifi sta mode started%s", cached ? ", trying cached ap" : "");
 
     ESP_ERROR_CHECK(esp_wifi_set_max_tx_power(78));  // 20dBm
     ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_NONE));  // lowest latency
@@ -115,12 +177,37 @@ static int init_wifi_sta() {
     status = xEventGroupWaitBits(wifi_event_arg.wifi_event_group, WIFI_FAIL_FLAG | WIFI_SUCCESS_FLAG,
                                  pdFALSE, pdFALSE, portMAX_DELAY);
 
+    // couldn't associate with the cached bssid/channel in WIFI_FASTCONN_RETRYS tries (ap moved
+    // channel or gone), do it the slow way
+    if (cached && !(status & WIFI_SUCCESS_FLAG)) {
+        ESP_LOGW(TAG, "cached ap failed after %lld ms, falling back to full scan",
+                 (long long) (esp_timer_get_time() - start) / 1000);
+
+        xEventGroupClearBits(wifi_event_arg.wifi_event_group, WIFI_FAIL_FLAG | WIFI_SUCCESS_FLAG);
+        wifi_event_arg.retry_num = 0;
+        wifi_event_arg.max_retrys = wifi_st_max_retrys;
+
+        sta_config_scan(&conf);
+        ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &conf));
+        esp_wifi_connect();
+
+        status = xEventGroupWaitBits(wifi_event_arg.wifi_event_group, WIFI_FAIL_FLAG | WIFI_SUCCESS_FLAG,
+                                     pdFALSE, pdFALSE, portMAX_DELAY);
+        cached = 0;
+    }
+
     ESP_ERROR_CHECK(esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, any_event_handler));
     ESP_ERROR_CHECK(esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, got_ip_handler));
     vEventGroupDelete(wifi_event_arg.wifi_event_group);
 
     if (status & WIFI_SUCCESS_FLAG) {
-        ESP_LOGI(TAG, "connected to wifi ssid = \"%s\"", wifi_st_ssid);
+        // which way it went shows on the boot timeline, next to the wifi stage's time
+        boot_mark(cached ? "wifi: cached ap" : "wifi: full scan");
+        ESP_LOGI(TAG, "connected to wifi ssid = \"%s\" in %lld ms (%s)", wifi_st_ssid,
+                 (long long) (esp_timer_get_time() - start) / 1000, cached ? "cached ap" : "full scan");
+
+        if (wifi_st_fastconn)
+            sta_update_cache();
         return 0;
     } else {
         ESP_LOGE(TAG, "FAILED to connect to wifi ssid = \"%s\"", wifi_st_ssid);
@@ -142,6 +229,15 @@ static void ap_wifi_event_handler(void *arg, esp_event_base_t event_base, s32 ev
     }
 }
 
+/* marks the event's delivery on the default event loop's task, not when the wifi task raised it */
+static void trace_wifi_event_handler(void *arg, esp_event_base_t event_base, s32 event_id, void *event_data) {
+    (void) arg;
+    (void) event_base;
+    (void) event_data;
+
+    trace_instant(TRACE_WIFI_EVENT, event_id);
+}
+
 static void init_wifi_ap() {
     wifi_config_t conf;
     wifi_init_config_t init_cfg = WIFI_INIT_CONFIG_DEFAULT();
@@ -180,6 +276,13 @@ void wifi_init() {
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
+    // stays registered in any mode, the sta/ap handlers only log
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
+                                                        ESP_EVENT_ANY_ID,
+                                                        &trace_wifi_event_handler,
+                                                        NULL,
+                                                        NULL));
+
     if (wifi_mode == WIFI_MODE_AP) {
         goto start_ap;
     }
@@ -38,6 +38,10 @@ extern char wifi_ap_pass[64];
 extern char wifi_st_ssid[32];
 extern char wifi_st_pass[64];
 
+extern u8 wifi_st_fastconn;       // connect to the cached ap below without scanning
+extern u64 wifi_st_bssid;
+extern u8 wifi_st_channel;
+
 void wifi_init();
 s8 wifi_get_rssi();
 
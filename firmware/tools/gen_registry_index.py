@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+#
+# HackQuad - an open-source firmware+hardware quadcopter
+# Copyright (C) 2020, Andrew Howard, <divisionind.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#
+"""
+Generates registry_index.h from registry.def at build time.
+
+For every REG_ENTRY(key, ...) it precomputes the key's hash (same as
+reg_calc_hashcode / java's String.hashCode) and its nvs key string, then searches
+for a multiplier that maps every hash to its own slot of a small power-of-2
+table so reg_lookup_hash() is a single multiply+shift.
+
+Fails (and with it the build) if two keys hash to the same value, as they would
+alias each other in ram and in nvs.
+
+usage: gen_registry_index.py <registry.def> <registry_index.h>
+"""
+
+import re
+import sys
+
+ENTRY = re.compile(r'^\s*REG_ENTRY\(\s*([A-Za-z_]\w*)\s*,')
+MAX_EXTRA_BITS = 4
+MAX_SEEDS = 1 << 16
+
+
+def java_hash(key):
+    h = 0
+    for c in key.encode('ascii'):
+        h = (31 * h + c) & 0xFFFFFFFF
+    return h
+
+
+def strip_comments(text):
+    text = re.sub(r'/\*.*?\*/', '', text, flags=re.S)
+    return re.sub(r'//[^\n]*', '', text)
+
+
+def parse(path):
+    with open(path) as f:
+        text = strip_comments(f.read())
+
+    keys = []
+    for line in text.splitlines():
+        m = ENTRY.match(line)
+        if m:
+            keys.append(m.group(1))
+        elif line.strip():
+            fail('%s: unrecognised line "%s"' % (path, line.strip()))
+
+    return keys
+
+
+def fail(msg):
+    sys.stderr.write('gen_registry_index: error: %s\n' % msg)
+    sys.exit(1)
+
+
+def slot(h, seed, bits):
+    return ((h * seed) & 0xFFFFFFFF) >> (32 - bits)
+
+
+def find_index(hashes):
+    min_bits = max(1, (len(hashes) - 1).bit_length())
+
+    for bits in range(min_bits, min_bits + MAX_EXTRA_BITS + 1):
+        seed = 0x9E3779B1  # golden ratio, then walk odd multipliers
+        for _ in range(MAX_SEEDS):
+            slots = set(slot(h, seed, bits) for h in hashes)
+            if len(slots) == len(hashes):
+                return bits, seed
+            seed = (seed + 0x3C6EF372) & 0xFFFFFFFF | 1
+
+    fail('no collision-free index found for %d keys' % len(hashes))
+
+
+def main():
+    if len(sys.argv) != 3:
+        fail('usage: gen_registry_index.py <registry.def> <registry_index.h>')
+
+    keys = parse(sys.argv[1])
+    if not keys:
+        fail('%s: no registry entries' % sys.argv[1])
+    if len(keys) > 255:
+        fail('index uses u8 slots, at most 255 entries are supported')
+
+    seen = {}
+    for key in keys:
+        h = java_hash(key)
+        if key in seen.values():
+            fail('duplicate registry key %s' % key)
+        if h in seen:
+            fail('registry hash collision: %s and %s both hash to 0x%08x' % (seen[h], key, h))
+        seen[h] = key
+
+    hashes = [java_hash(k) for k in keys]
+    bits, seed = find_index(hashes)
+
+    table = [0] * (1 << bits)
+    for i, h in enumerate(hashes):
+        table[slot(h, seed, bits)] = i + 1
+
+    out = []
+    out.append('/* generated by tools/gen_registry_index.py from registry.def, do not edit */')
+    out.append('')
+    out.append('#ifndef HACKQUAD_REGISTRY_INDEX_H')
+    out.append('#define HACKQUAD_REGISTRY_INDEX_H')
+    out.append('')
+    out.append('#define REG_INDEX_COUNT %d' % len(keys))
+    out.append('#define REG_INDEX_BITS  %d' % bits)
+    out.append('#define REG_INDEX_SEED  0x%08xu' % seed)
+    out.append('')
+    width = max(len(k) for k in keys)
+    for key, h in zip(keys, hashes):
+        out.append('#define REG_HASH_%s 0x%08xu' % (key.ljust(width), h))
+        out.append('#define REG_HASHSTR_%s "%08x"' % (key.ljust(width), h))
+    out.append('')
+    out.append('/* slot -> registry index + 1, 0 = empty */')
+    out.append('#define REG_INDEX_TABLE { \\')
+    for i in range(0, len(table), 16):
+        out.append('    %s, \\' % ', '.join('%3d' % v for v in table[i:i + 16]))
+    out.append('}')
+    out.append('')
+    out.append('#endif /* HACKQUAD_REGISTRY_INDEX_H */')
+    out.append('')
+
+    text = '\n'.join(out)
+
+    # only touch the header if it changed, avoids rebuilding everything that includes it
+    try:
+        with open(sys.argv[2]) as f:
+            if f.read() == text:
+                return
+    except IOError:
+        pass
+
+    with open(sys.argv[2], 'w') as f:
+        f.write(text)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+#
+# HackQuad - an open-source firmware+hardware quadcopter
+# Copyright (C) 2020, Andrew Howard, <divisionind.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#
+"""
+Converts a /sys/trace capture (see main/hackquad/trace.h) to chrome trace event
+json, open it in ui.perfetto.dev or chrome://tracing.
+
+Every core is a process with a track per trace point. Begin/end pairs of the
+same task (or, in isrs, the same core) become complete events on the core they
+began on (unpinned tasks can end on the other one), each core's cycle counter
+is mapped to us with the esp_timer readings taken at the start and end of the
+capture. Slots the capture ended before their writer finished are skipped.
+
+usage: trace2json.py <capture> [<out.json>]
+"""
+
+import json
+import struct
+import sys
+
+MAGIC = b'HQTR'
+VERSION = 2
+TRACE_CORES = 2
+
+HEADER = struct.Struct('<4sBBBB')
+CORE_INFO = struct.Struct('<IqIqII')
+EVENT = struct.Struct('<IBBBB')
+
+BEGIN, END, INSTANT = 0, 1, 2
+INCOMPLETE = 0xFF
+
+
+def fail(msg):
+    sys.stderr.write('trace2json: error: %s\n' % msg)
+    sys.exit(1)
+
+
+def parse(data):
+    if len(data) < HEADER.size + TRACE_CORES * CORE_INFO.size:
+        fail('capture too short for its header')
+
+    magic, version, cores, points, name_len = HEADER.unpack_from(data)
+    if magic != MAGIC:
+        fail('not a trace capture')
+    if version != VERSION:
+        fail('capture version %d, this converter reads %d' % (version, VERSION))
+
+    off = HEADER.size
+    infos = []
+    for core in range(TRACE_CORES):
+        infos.append(CORE_INFO.unpack_from(data, off))
+        off += CORE_INFO.size
+    infos = infos[:cores]
+
+    names = []
+    for i in range(points):
+        names.append(data[off:off + name_len].split(b'\0', 1)[0].decode('ascii'))
+        off += name_len
+
+    events = []
+    incomplete = 0
+    for core, info in enumerate(infos):
+        count = info[4]
+        if off + count * EVENT.size > len(data):
+            fail('capture truncated in core %d\'s events' % core)
+        for i in range(count):
+            cycles, point, flags, task, arg = EVENT.unpack_from(data, off)
+            off += EVENT.size
+            if flags == INCOMPLETE:
+                incomplete += 1
+                continue
+            events.append((cycles, point, flags & 0xF, flags >> 4, task, arg))
+
+    if incomplete:
+        sys.stderr.write('trace2json: %d events still being written when the capture ended\n' % incomplete)
+
+    return infos, names, events
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        fail('usage: trace2json.py <capture> [<out.json>]')
+
+    with open(sys.argv[1], 'rb') as f:
+        infos, names, events = parse(f.read())
+
+    origin = min(info[1] for info in infos)
+
+    # cycles -> us since the earliest start, per core
+    clocks = []
+    for start_cycles, start_us, end_cycles, end_us, count, dropped in infos:
+        rate = ((end_cycles - start_cycles) & 0xFFFFFFFF) / max(end_us - start_us, 1)
+        clocks.append((start_cycles, start_us - origin, rate))
+        if dropped:
+            sys.stderr.write('trace2json: core %d dropped %d events, its buffer filled\n' % (len(clocks) - 1, dropped))
+
+    def us(cycles, core):
+        start_cycles, start, rate = clocks[core]
+        return start + ((cycles - start_cycles) & 0xFFFFFFFF) / rate
+
+    out = []
+    for core in range(len(infos)):
+        out.append({'ph': 'M', 'name': 'process_name', 'pid': core, 'args': {'name': 'core %d' % core}})
+        for point, name in enumerate(names):
+            out.append({'ph': 'M', 'name': 'thread_name', 'pid': core, 'tid': point, 'args': {'name': name}})
+
+    timeline = sorted(((us(cycles, core), point, kind, core, task, arg)
+                       for cycles, point, kind, core, task, arg in events))
+
+    open_spans = {}
+    unmatched = 0
+    for ts, point, kind, core, task, arg in timeline:
+        name = names[point] if point < len(names) else 'point %d' % point
+        # tasks can move between cores, isrs (task 0) can't
+        key = (point, task) if task else (point, 0, core)
+
+        if kind == BEGIN:
+            open_spans.setdefault(key, []).append((ts, core, arg))
+        elif kind == END:
+            if not open_spans.get(key):
+                # began before the capture did
+                unmatched += 1
+                continue
+            start, start_core, start_arg = open_spans[key].pop()
+            out.append({'ph': 'X', 'name': name, 'pid': start_core, 'tid': point, 'ts': round(start, 3),
+                        'dur': round(ts - start, 3), 'args': {'arg': start_arg, 'task': task}})
+        elif kind == INSTANT:
+            out.append({'ph': 'i', 's': 't', 'name': name, 'pid': core, 'tid': point, 'ts': round(ts, 3),
+                        'args': {'arg': arg, 'task': task}})
+
+    unmatched += sum(len(spans) for spans in open_spans.values())
+    if unmatched:
+        sys.stderr.write('trace2json: %d begin/end events cut off by the capture\'s start or end\n' % unmatched)
+
+    text = json.dumps({'traceEvents': out, 'displayTimeUnit': 'ns'})
+    if len(sys.argv) == 3:
+        with open(sys.argv[2], 'w') as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+
+
+if __name__ == '__main__':
+    main()